@@ -14,13 +14,23 @@
 #include <StringList.h>
 
 #include "App.h"
+#include "AudioEngine.h"
+#include "EngineHost.h"
 #include "MainWindow.h"
+#include "Pad.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "App"
 
 const char* kApplicationSignature = "application/x-vnd.humdinger-Samedi";
 
+static bigtime_t sLaunchTime = 0;
+static const int32 kMeasuredPads = 128;
+
 
 App::App()
 	:
@@ -28,11 +38,18 @@ App::App()
 {
 	fMainWindow = new MainWindow();
 	fMainWindow->Show();
+
+	// to let go of the Samedis playing through this one when they're gone
+	be_roster->StartWatching(this, B_REQUEST_QUIT);
 }
 
 
 App::~App()
 {
+	be_roster->StopWatching(this);
+	while (!fEngineHosts.empty())
+		_DetachGuest(fEngineHosts.begin()->first);
+
 	delete fMainWindow;
 }
 
@@ -54,8 +71,37 @@ void
 App::ArgvReceived(int32 argc, char** argv)
 {
 	BMessenger messenger(fMainWindow);
-	BMessage message(B_REFS_RECEIVED);
 
+	// "--startup-times [ensemble]" prints how long it took till the window
+	// was drawn and the ensemble loaded, then quits
+	if (strcmp(argv[1], "--startup-times") == 0) {
+		BMessage message(STARTUP_TIMES);
+		message.AddInt64("launched", sLaunchTime);
+		entry_ref ref;
+		if (argc > 2 && get_ref_for_path(argv[2], &ref) == B_OK)
+			message.AddRef("refs", &ref);
+		messenger.SendMessage(&message);
+		return;
+	}
+
+	// "--render-threads" prints how many voices each number of render
+	// threads mixes, then quits
+	if (strcmp(argv[1], "--render-threads") == 0) {
+		_ReportRenderThreads();
+		PostMessage(B_QUIT_REQUESTED);
+		return;
+	}
+
+	// "--pad-drawing [count]" prints what drawing that many pads costs,
+	// compared to the controls they were made of before, then quits
+	if (strcmp(argv[1], "--pad-drawing") == 0) {
+		int32 count = argc > 2 ? atoi(argv[2]) : kMeasuredPads;
+		_ReportPadDrawing(count > 0 ? count : kMeasuredPads);
+		PostMessage(B_QUIT_REQUESTED);
+		return;
+	}
+
+	BMessage message(B_REFS_RECEIVED);
 	BEntry entry(argv[1], true); // traverse links
 	entry_ref ref;
 	entry.GetRef(&ref);
@@ -79,6 +125,18 @@ App::MessageReceived(BMessage* msg)
 			_ShowLatencyAlert();
 			break;
 		}
+		case ENGINE_ATTACH:
+		{
+			_AttachGuest(msg);
+			break;
+		}
+		case B_SOME_APP_QUIT:
+		{
+			team_id team;
+			if (msg->FindInt32("be:team", &team) == B_OK)
+				_DetachGuest(team);
+			break;
+		}
 		default:
 		{
 			BApplication::MessageReceived(msg);
@@ -98,6 +156,56 @@ App::RefsReceived(BMessage* message)
 // #pragma mark -
 
 
+void
+App::_AttachGuest(BMessage* msg)
+{
+	BMessenger target;
+	BMessage reply(B_REPLY);
+	status_t status = msg->FindMessenger("target", &target);
+
+	// only a Samedi that plays itself can host, not one that plays through
+	// another one or doesn't know yet
+	AudioEngine* engine = fMainWindow->Engine();
+	if (status == B_OK && (!engine->IsPlaying() || (int32)fEngineHosts.size() >= kMaxGuests))
+		status = B_NOT_ALLOWED;
+
+	EngineHost* host = NULL;
+	if (status == B_OK) {
+		// the guest's team is its id, what it sends is checked against it
+		host = new EngineHost(engine, fMainWindow->Cache(), target, target.Team());
+		status = host->Attach();
+	}
+	if (status == B_OK) {
+		host->Run();
+		_DetachGuest(target.Team());
+		fEngineHosts[target.Team()] = BMessenger(host);
+		reply.AddMessenger("engine", BMessenger(host));
+		reply.AddInt32("midi port", host->MidiPort());
+		reply.AddInt32("guest", target.Team());
+	} else {
+		if (host != NULL && host->Lock())
+			host->Quit();
+		reply.AddInt32("error", status);
+	}
+	msg->SendReply(&reply);
+}
+
+
+void
+App::_DetachGuest(team_id team)
+{
+	std::map<team_id, BMessenger>::iterator found = fEngineHosts.find(team);
+	if (found == fEngineHosts.end())
+		return;
+
+	// waits, so the guest is out of the audio thread before anything goes
+	BMessage message(ENGINE_DETACH);
+	BMessage reply;
+	found->second.SendMessage(&message, &reply);
+	fEngineHosts.erase(found);
+}
+
+
 void
 App::_ShowLatencyAlert()
 {
@@ -141,9 +249,70 @@ App::_ShowLatencyAlert()
 }
 
 
+void
+App::_ReportRenderThreads()
+{
+	// a bar for each number of threads, scaled to the fastest of them all
+	static const int32 kVoiceCounts[3] = { 16, 32, 64 };
+	static const int32 kBarWidth = 50;
+	float rates[3][kMaxRenderThreads];
+	float fastest = 0.0f;
+	for (int32 i = 0; i < 3; i++) {
+		for (int32 threads = 1; threads <= kMaxRenderThreads; threads++) {
+			float rate = AudioEngine::MeasureRenderThreads(threads, kVoiceCounts[i]);
+			rates[i][threads - 1] = rate;
+			if (rate > fastest)
+				fastest = rate;
+		}
+	}
+
+	system_info info;
+	printf("Voices mixed per millisecond, %" B_PRId32 " CPUs\n",
+		get_system_info(&info) == B_OK ? (int32)info.cpu_count : 1);
+	for (int32 i = 0; i < 3; i++) {
+		printf("\n%" B_PRId32 " voices\n", kVoiceCounts[i]);
+		for (int32 threads = 1; threads <= kMaxRenderThreads; threads++) {
+			float rate = rates[i][threads - 1];
+			int32 bar = fastest > 0.0f ? (int32)(rate * kBarWidth / fastest + 0.5f) : 0;
+			printf("  %" B_PRId32 " thread%s %-*s %8.1f  %.2fx\n", threads,
+				threads == 1 ? " " : "s", (int)kBarWidth, BString().Append('#', bar).String(),
+				rate, rates[i][0] > 0.0f ? rate / rates[i][0] : 0.0f);
+		}
+	}
+}
+
+
+void
+App::_ReportPadDrawing(int32 count)
+{
+	PadDrawCost pads;
+	PadDrawCost controls;
+	status_t status = Pad::MeasureDrawing(count, pads, controls);
+	if (status != B_OK) {
+		printf("The pads could not be drawn: %s\n", strerror(status));
+		return;
+	}
+
+	// memory per pad, and the time to draw them all in the fastest pass
+	printf("%" B_PRId32 " pads drawn into a bitmap\n", count);
+	const char* kNames[2] = { "Drawn cells", "Controls, as before" };
+	PadDrawCost* costs[2] = { &pads, &controls };
+	for (int32 i = 0; i < 2; i++) {
+		printf("  %-20s %3" B_PRId32 " views, %7.1f KiB per pad, %8.2f ms to draw all\n",
+			kNames[i], costs[i]->views, costs[i]->memory / 1024.0,
+			costs[i]->drawTime / 1000.0);
+	}
+	if (controls.drawTime > 0) {
+		printf("  The drawn cells take %.2fx as long as the controls\n",
+			(float)pads.drawTime / controls.drawTime);
+	}
+}
+
+
 int
 main()
 {
+	sLaunchTime = system_time();
 	App* app = new App();
 	app->Run();
 	delete app;
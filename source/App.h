@@ -12,6 +12,9 @@
 #include "MainWindow.h"
 
 #include <Application.h>
+#include <Messenger.h>
+
+#include <map>
 
 
 class App : public BApplication {
@@ -26,8 +29,13 @@ public:
 
 private:
 	void			_ShowLatencyAlert();
+	void			_ReportRenderThreads();
+	void			_ReportPadDrawing(int32 count);
+	void			_AttachGuest(BMessage* msg);
+	void			_DetachGuest(team_id team);
 
 	MainWindow*		fMainWindow;
+	std::map<team_id, BMessenger>	fEngineHosts;
 };
 
 #endif /* APP_H */
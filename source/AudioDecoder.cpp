@@ -0,0 +1,847 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioDecoder.h"
+#include "BitReader.h"
+#include "FileIdentity.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const int64_t kBlockFrames = 1024;		// converted at a time
+static const int32_t kMaxChannels = 8;
+static const int32_t kMaxFlacBlockFrames = 65535;
+static const int32_t kMaxLpcOrder = 32;
+static const int64_t kInitialFlacFrames = 1 << 22;	// reserved, if not known
+static const float kIntScale = 1.0f / 2147483648.0f;
+
+
+static inline uint32_t
+get16le(const uint8_t* p)
+{
+	return p[0] | (uint32_t)p[1] << 8;
+}
+
+
+static inline uint32_t
+get32le(const uint8_t* p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static inline uint32_t
+get16be(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 8 | p[1];
+}
+
+
+static inline uint32_t
+get24be(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+
+static inline uint32_t
+get32be(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static double
+extended_to_double(const uint8_t* p)
+{
+	// the 80 bit float AIFF stores the frame rate in
+	int32_t exponent = (p[0] & 0x7f) << 8 | p[1];
+	uint64_t mantissa = (uint64_t)get32be(p + 2) << 32 | get32be(p + 6);
+	if (mantissa == 0 || exponent == 0x7fff)
+		return 0.0;
+
+	double value = ldexp((double)mantissa, exponent - 16383 - 63);
+	return (p[0] & 0x80) != 0 ? -value : value;
+}
+
+
+// #pragma mark - conversion kernels
+
+
+static void
+unpack_ints(const uint8_t* source, int64_t count, int32_t bytes, bool bigEndian,
+	bool isUnsigned, int32_t* target)
+{
+	// left aligned to 32 bits, so all of them convert with the same scale;
+	// one loop per layout, each simple enough to be vectorized
+	uint32_t* out = (uint32_t*)target;
+	switch (bytes) {
+		case 1:
+		{
+			uint8_t flip = isUnsigned ? 0x80 : 0;
+			for (int64_t i = 0; i < count; i++)
+				out[i] = (uint32_t)(uint8_t)(source[i] ^ flip) << 24;
+			break;
+		}
+		case 2:
+			if (bigEndian) {
+				for (int64_t i = 0; i < count; i++)
+					out[i] = (uint32_t)source[i * 2] << 24 | (uint32_t)source[i * 2 + 1] << 16;
+			} else {
+				for (int64_t i = 0; i < count; i++)
+					out[i] = (uint32_t)source[i * 2 + 1] << 24 | (uint32_t)source[i * 2] << 16;
+			}
+			break;
+		case 3:
+			if (bigEndian) {
+				for (int64_t i = 0; i < count; i++) {
+					out[i] = (uint32_t)source[i * 3] << 24 | (uint32_t)source[i * 3 + 1] << 16
+						| (uint32_t)source[i * 3 + 2] << 8;
+				}
+			} else {
+				for (int64_t i = 0; i < count; i++) {
+					out[i] = (uint32_t)source[i * 3 + 2] << 24 | (uint32_t)source[i * 3 + 1] << 16
+						| (uint32_t)source[i * 3] << 8;
+				}
+			}
+			break;
+		case 4:
+			if (bigEndian) {
+				for (int64_t i = 0; i < count; i++)
+					out[i] = get32be(source + i * 4);
+			} else {
+				for (int64_t i = 0; i < count; i++)
+					out[i] = get32le(source + i * 4);
+			}
+			break;
+	}
+}
+
+
+static void
+unpack_floats(const uint8_t* source, int64_t count, int32_t bytes, bool bigEndian,
+	float* target)
+{
+	for (int64_t i = 0; i < count; i++) {
+		if (bytes == 4) {
+			uint32_t bits = bigEndian ? get32be(source + i * 4) : get32le(source + i * 4);
+			memcpy(&target[i], &bits, sizeof(float));
+		} else {
+			const uint8_t* p = source + i * 8;
+			uint64_t bits = bigEndian ? (uint64_t)get32be(p) << 32 | get32be(p + 4)
+				: (uint64_t)get32le(p + 4) << 32 | get32le(p);
+			double value;
+			memcpy(&value, &bits, sizeof(double));
+			target[i] = (float)value;
+		}
+	}
+}
+
+
+static void
+ints_to_floats(const int32_t* source, int64_t count, float scale, float* target)
+{
+	for (int64_t i = 0; i < count; i++)
+		target[i] = source[i] * scale;
+}
+
+
+static void
+to_stereo(const float* source, int64_t frameCount, int32_t channels, float* target)
+{
+	// the first two channels, mono is played on both
+	if (channels == 2)
+		memcpy(target, source, frameCount * 2 * sizeof(float));
+	else if (channels == 1) {
+		for (int64_t i = 0; i < frameCount; i++)
+			target[i * 2] = target[i * 2 + 1] = source[i];
+	} else {
+		for (int64_t i = 0; i < frameCount; i++) {
+			target[i * 2] = source[i * channels];
+			target[i * 2 + 1] = source[i * channels + 1];
+		}
+	}
+}
+
+
+static void
+interleave(const float* left, const float* right, int64_t frameCount, float* target)
+{
+	for (int64_t i = 0; i < frameCount; i++) {
+		target[i * 2] = left[i];
+		target[i * 2 + 1] = right[i];
+	}
+}
+
+
+// #pragma mark - FLAC bitstream
+
+
+struct CrcTables {
+	CrcTables()
+	{
+		for (int32_t i = 0; i < 256; i++) {
+			uint8_t crc8 = i;
+			uint16_t crc16 = i << 8;
+			for (int32_t bit = 0; bit < 8; bit++) {
+				crc8 = (crc8 & 0x80) != 0 ? (crc8 << 1) ^ 0x07 : crc8 << 1;
+				crc16 = (crc16 & 0x8000) != 0 ? (crc16 << 1) ^ 0x8005 : crc16 << 1;
+			}
+			table8[i] = crc8;
+			table16[i] = crc16;
+		}
+	}
+
+	uint8_t		table8[256];
+	uint16_t	table16[256];
+};
+
+
+static const CrcTables&
+crc_tables()
+{
+	static CrcTables tables;
+	return tables;
+}
+
+
+static uint8_t
+crc8(const uint8_t* data, size_t size)
+{
+	const CrcTables& tables = crc_tables();
+	uint8_t crc = 0;
+	for (size_t i = 0; i < size; i++)
+		crc = tables.table8[crc ^ data[i]];
+	return crc;
+}
+
+
+static uint16_t
+crc16(const uint8_t* data, size_t size)
+{
+	const CrcTables& tables = crc_tables();
+	uint16_t crc = 0;
+	for (size_t i = 0; i < size; i++)
+		crc = (crc << 8) ^ tables.table16[(crc >> 8) ^ data[i]];
+	return crc;
+}
+
+
+static bool
+decode_residual(BitReader& reader, int32_t* samples, int32_t blockSize, int32_t order)
+{
+	uint32_t method = reader.Read(2);
+	if (method > 1)
+		return false;
+
+	int32_t parameterBits = method == 0 ? 4 : 5;
+	uint32_t escape = method == 0 ? 15 : 31;
+	int32_t partitionOrder = reader.Read(4);
+	int32_t partitionSize = blockSize >> partitionOrder;
+	if ((partitionSize << partitionOrder) != blockSize || partitionSize < order)
+		return false;
+
+	int32_t* target = samples + order;
+	for (int32_t partition = 0; partition < 1 << partitionOrder; partition++) {
+		int32_t count = partition == 0 ? partitionSize - order : partitionSize;
+		uint32_t parameter = reader.Read(parameterBits);
+		if (parameter == escape) {
+			int32_t bits = reader.Read(5);
+			for (int32_t i = 0; i < count; i++)
+				*target++ = reader.ReadSigned(bits);
+		} else {
+			for (int32_t i = 0; i < count; i++) {
+				uint32_t value = reader.ReadUnary() << parameter | reader.Read(parameter);
+				*target++ = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+			}
+		}
+		if (reader.Overrun())
+			return false;
+	}
+	return true;
+}
+
+
+static bool
+decode_subframe(BitReader& reader, int32_t* samples, int32_t blockSize, int32_t bits)
+{
+	if (reader.Read(1) != 0)
+		return false;
+
+	uint32_t type = reader.Read(6);
+	int32_t wasted = 0;
+	if (reader.Read(1) != 0) {
+		wasted = reader.ReadUnary() + 1;
+		if (wasted >= bits)
+			return false;
+		bits -= wasted;
+	}
+
+	if (type == 0) {
+		int32_t value = reader.ReadSigned(bits);
+		for (int32_t i = 0; i < blockSize; i++)
+			samples[i] = value;
+	} else if (type == 1) {
+		for (int32_t i = 0; i < blockSize; i++)
+			samples[i] = reader.ReadSigned(bits);
+	} else if (type >= 8 && type <= 12) {
+		int32_t order = type - 8;
+		if (order > blockSize)
+			return false;
+		for (int32_t i = 0; i < order; i++)
+			samples[i] = reader.ReadSigned(bits);
+		if (!decode_residual(reader, samples, blockSize, order))
+			return false;
+
+		// 64 bit, so no garbage can overflow
+		for (int32_t i = order; i < blockSize; i++) {
+			int64_t prediction = 0;
+			switch (order) {
+				case 1:
+					prediction = samples[i - 1];
+					break;
+				case 2:
+					prediction = 2 * (int64_t)samples[i - 1] - samples[i - 2];
+					break;
+				case 3:
+					prediction = 3 * ((int64_t)samples[i - 1] - samples[i - 2])
+						+ samples[i - 3];
+					break;
+				case 4:
+					prediction = 4 * ((int64_t)samples[i - 1] + samples[i - 3])
+						- 6 * (int64_t)samples[i - 2] - samples[i - 4];
+					break;
+			}
+			samples[i] = (int32_t)(samples[i] + prediction);
+		}
+	} else if (type >= 32) {
+		int32_t order = (type & 31) + 1;
+		if (order > blockSize)
+			return false;
+		for (int32_t i = 0; i < order; i++)
+			samples[i] = reader.ReadSigned(bits);
+
+		int32_t precision = reader.Read(4) + 1;
+		int32_t shift = reader.ReadSigned(5);
+		if (precision == 16 || shift < 0)
+			return false;
+		int32_t coefficients[kMaxLpcOrder];
+		for (int32_t i = 0; i < order; i++)
+			coefficients[i] = reader.ReadSigned(precision);
+		if (!decode_residual(reader, samples, blockSize, order))
+			return false;
+
+		for (int32_t i = order; i < blockSize; i++) {
+			int64_t sum = 0;
+			for (int32_t j = 0; j < order; j++)
+				sum += (int64_t)coefficients[j] * samples[i - j - 1];
+			samples[i] = (int32_t)(samples[i] + (sum >> shift));
+		}
+	} else
+		return false;
+
+	if (wasted > 0) {
+		for (int32_t i = 0; i < blockSize; i++)
+			samples[i] = (int32_t)((uint32_t)samples[i] << wasted);
+	}
+	return !reader.Overrun();
+}
+
+
+// #pragma mark - AudioDecoder
+
+
+AudioDecoder::AudioDecoder()
+	:
+	fFrames(NULL),
+	fFrameCount(0),
+	fCapacity(0),
+	fFrameRate(0.0)
+{
+}
+
+
+AudioDecoder::~AudioDecoder()
+{
+	free(fFrames);
+}
+
+
+AudioDecoder::Result
+AudioDecoder::Decode(const uint8_t* data, size_t size)
+{
+	_MakeEmpty();
+
+	Result result = kUnknownFormat;
+	if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0)
+		result = _DecodeWav(data, size);
+	else if (size >= 12 && memcmp(data, "FORM", 4) == 0
+		&& (memcmp(data + 8, "AIFF", 4) == 0 || memcmp(data + 8, "AIFC", 4) == 0))
+		result = _DecodeAiff(data, size);
+	else if (size >= 4 && (memcmp(data, "fLaC", 4) == 0 || memcmp(data, "ID3", 3) == 0))
+		result = _DecodeFlac(data, size);
+
+	if (result == kOK && (fFrameCount == 0 || !(fFrameRate > 0.0)))
+		result = kBadData;
+	if (result != kOK)
+		_MakeEmpty();
+	return result;
+}
+
+
+float*
+AudioDecoder::DetachFrames()
+{
+	float* frames = fFrames;
+	fFrames = NULL;
+	fCapacity = 0;
+	return frames;
+}
+
+
+/*static*/ uint64_t
+AudioDecoder::Fingerprint(const uint8_t* data, size_t size)
+{
+	bool isWav = size >= 12 && memcmp(data, "RIFF", 4) == 0
+		&& memcmp(data + 8, "WAVE", 4) == 0;
+	bool isAiff = size >= 12 && memcmp(data, "FORM", 4) == 0
+		&& (memcmp(data + 8, "AIFF", 4) == 0 || memcmp(data + 8, "AIFC", 4) == 0);
+	if (isWav || isAiff) {
+		// the sample data chunk, whatever its format
+		const char* name = isWav ? "data" : "SSND";
+		size_t offset = 12;
+		while (offset + 8 <= size) {
+			const uint8_t* chunk = data + offset;
+			size_t chunkSize = isWav ? get32le(chunk + 4) : get32be(chunk + 4);
+			size_t available = size - offset - 8;
+			if (chunkSize > available)
+				chunkSize = available;
+			if (memcmp(chunk, name, 4) == 0)
+				return chunkSize > 0 ? hash_content(chunk + 8, chunkSize) : 0;
+			offset += 8 + chunkSize + (chunkSize & 1);
+		}
+		return 0;
+	}
+
+	// the MD5 of the decoded samples a FLAC encoder puts in the stream info,
+	// or the frames if it didn't
+	size_t offset = 0;
+	if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+		offset = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14
+			| (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+		if ((data[5] & 0x10) != 0)
+			offset += 10;
+	}
+	if (offset + 4 > size || memcmp(data + offset, "fLaC", 4) != 0)
+		return 0;
+	offset += 4;
+
+	static const uint8_t kNoSignature[16] = {};
+	const uint8_t* signature = NULL;
+	bool last = false;
+	while (!last) {
+		if (offset + 4 > size)
+			return 0;
+		last = (data[offset] & 0x80) != 0;
+		int32_t type = data[offset] & 0x7f;
+		size_t length = get24be(data + offset + 1);
+		offset += 4;
+		if (length > size - offset)
+			return 0;
+		if (type == 0 && length >= 34 && memcmp(data + offset + 18, kNoSignature, 16) != 0)
+			signature = data + offset + 18;
+		offset += length;
+	}
+	if (signature != NULL)
+		return hash_content(signature, 16);
+	return offset < size ? hash_content(data + offset, size - offset) : 0;
+}
+
+
+// #pragma mark -
+
+
+AudioDecoder::Result
+AudioDecoder::_DecodeWav(const uint8_t* data, size_t size)
+{
+	PcmFormat format;
+	bool haveFormat = false;
+
+	size_t offset = 12;
+	while (offset + 8 <= size) {
+		const uint8_t* chunk = data + offset;
+		const uint8_t* body = chunk + 8;
+		size_t chunkSize = get32le(chunk + 4);
+		size_t available = size - offset - 8;
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunkSize < 16 || chunkSize > available)
+				return kBadData;
+
+			// WAVE_FORMAT_EXTENSIBLE has the actual one in its GUID
+			uint32_t tag = get16le(body);
+			if (tag == 0xfffe && chunkSize >= 40)
+				tag = get16le(body + 24);
+			if (tag != 1 && tag != 3)
+				return kUnknownFormat;
+
+			format.channels = get16le(body + 2);
+			fFrameRate = get32le(body + 4);
+			uint32_t blockAlign = get16le(body + 12);
+			if (format.channels == 0 || blockAlign % format.channels != 0)
+				return kBadData;
+
+			format.bytes = blockAlign / format.channels;
+			format.isFloat = tag == 3;
+			format.bigEndian = false;
+			format.isUnsigned = format.bytes == 1;
+			if (format.channels > kMaxChannels
+				|| (format.isFloat && format.bytes != 4 && format.bytes != 8)
+				|| (!format.isFloat && (format.bytes < 1 || format.bytes > 4)))
+				return kUnknownFormat;
+			haveFormat = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!haveFormat)
+				return kBadData;
+			// written while recording, the size may never have been set
+			if (chunkSize == 0 || chunkSize > available)
+				chunkSize = available;
+			return _DecodePcm(body, chunkSize, format);
+		}
+
+		if (chunkSize > available)
+			break;
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+	return kBadData;
+}
+
+
+AudioDecoder::Result
+AudioDecoder::_DecodeAiff(const uint8_t* data, size_t size)
+{
+	bool isAifc = memcmp(data + 8, "AIFC", 4) == 0;
+	PcmFormat format;
+	bool haveFormat = false;
+	uint32_t frameCount = 0;
+	const uint8_t* sound = NULL;
+	size_t soundSize = 0;
+
+	size_t offset = 12;
+	while (offset + 8 <= size) {
+		const uint8_t* chunk = data + offset;
+		const uint8_t* body = chunk + 8;
+		size_t chunkSize = get32be(chunk + 4);
+		size_t available = size - offset - 8;
+		if (chunkSize > available)
+			chunkSize = available;
+
+		if (memcmp(chunk, "COMM", 4) == 0) {
+			if (chunkSize < (isAifc ? 22u : 18u))
+				return kBadData;
+
+			format.channels = get16be(body);
+			frameCount = get32be(body + 2);
+			int32_t bits = get16be(body + 6);
+			fFrameRate = extended_to_double(body + 8);
+			format.bytes = (bits + 7) / 8;
+			format.isFloat = false;
+			format.bigEndian = true;
+			format.isUnsigned = false;
+
+			if (isAifc) {
+				const uint8_t* compression = body + 18;
+				if (memcmp(compression, "sowt", 4) == 0)
+					format.bigEndian = false;
+				else if (memcmp(compression, "fl32", 4) == 0
+					|| memcmp(compression, "FL32", 4) == 0) {
+					format.isFloat = true;
+					format.bytes = 4;
+				} else if (memcmp(compression, "fl64", 4) == 0
+					|| memcmp(compression, "FL64", 4) == 0) {
+					format.isFloat = true;
+					format.bytes = 8;
+				} else if (memcmp(compression, "NONE", 4) != 0
+					&& memcmp(compression, "twos", 4) != 0)
+					return kUnknownFormat;
+			}
+			if (format.channels == 0)
+				return kBadData;
+			if (format.channels > kMaxChannels || format.bytes < 1
+				|| (!format.isFloat && format.bytes > 4))
+				return kUnknownFormat;
+			haveFormat = true;
+		} else if (memcmp(chunk, "SSND", 4) == 0) {
+			if (chunkSize < 8)
+				return kBadData;
+			size_t dataOffset = get32be(body);
+			if (dataOffset > chunkSize - 8)
+				return kBadData;
+			sound = body + 8 + dataOffset;
+			soundSize = chunkSize - 8 - dataOffset;
+		}
+
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+
+	// the sound data may come before the format
+	if (!haveFormat || sound == NULL)
+		return kBadData;
+
+	size_t frameSize = format.channels * format.bytes;
+	if ((uint64_t)frameCount * frameSize < soundSize)
+		soundSize = (size_t)frameCount * frameSize;
+	return _DecodePcm(sound, soundSize, format);
+}
+
+
+AudioDecoder::Result
+AudioDecoder::_DecodePcm(const uint8_t* data, size_t size, const PcmFormat& format)
+{
+	size_t frameSize = format.channels * format.bytes;
+	int64_t frameCount = size / frameSize;
+	if (frameCount == 0)
+		return kBadData;
+	if (!_Reserve(frameCount))
+		return kNoMemory;
+
+	fInts.resize(kBlockFrames * format.channels);
+	fFloats.resize(kBlockFrames * format.channels);
+
+	// in blocks, so the unpacked samples stay in the cache until converted
+	for (int64_t done = 0; done < frameCount; done += kBlockFrames) {
+		int64_t count = frameCount - done < kBlockFrames ? frameCount - done : kBlockFrames;
+		const uint8_t* source = data + done * frameSize;
+		int64_t samples = count * format.channels;
+		if (format.isFloat)
+			unpack_floats(source, samples, format.bytes, format.bigEndian, &fFloats[0]);
+		else {
+			unpack_ints(source, samples, format.bytes, format.bigEndian, format.isUnsigned,
+				&fInts[0]);
+			ints_to_floats(&fInts[0], samples, kIntScale, &fFloats[0]);
+		}
+		to_stereo(&fFloats[0], count, format.channels, fFrames + (fFrameCount + done) * 2);
+	}
+	fFrameCount += frameCount;
+	return kOK;
+}
+
+
+AudioDecoder::Result
+AudioDecoder::_DecodeFlac(const uint8_t* data, size_t size)
+{
+	size_t offset = 0;
+	if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+		// a tag some programs put in front, its size is "syncsafe"
+		offset = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14
+			| (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+		if ((data[5] & 0x10) != 0)
+			offset += 10;
+	}
+	if (offset + 4 > size || memcmp(data + offset, "fLaC", 4) != 0)
+		return kUnknownFormat;
+	offset += 4;
+
+	FlacInfo info;
+	bool haveInfo = false;
+	bool last = false;
+	while (!last) {
+		if (offset + 4 > size)
+			return kBadData;
+		last = (data[offset] & 0x80) != 0;
+		int32_t type = data[offset] & 0x7f;
+		size_t length = get24be(data + offset + 1);
+		offset += 4;
+		if (length > size - offset)
+			return kBadData;
+
+		if (type == 0) {
+			// STREAMINFO
+			if (length < 34)
+				return kBadData;
+			const uint8_t* p = data + offset;
+			fFrameRate = (uint32_t)p[10] << 12 | (uint32_t)p[11] << 4 | p[12] >> 4;
+			info.channels = ((p[12] >> 1) & 7) + 1;
+			info.bits = ((p[12] & 1) << 4 | p[13] >> 4) + 1;
+			info.totalFrames = (uint64_t)(p[13] & 0x0f) << 32 | get32be(p + 14);
+			haveInfo = true;
+		}
+		offset += length;
+	}
+	if (!haveInfo)
+		return kBadData;
+	if (info.bits < 4 || info.bits > 24)
+		return kUnknownFormat;
+
+	int64_t reserved = info.totalFrames > 0 && info.totalFrames < (uint64_t)kInitialFlacFrames
+		? (int64_t)info.totalFrames : kInitialFlacFrames;
+	if (!_Reserve(reserved))
+		return kNoMemory;
+
+	fInts.resize(kMaxFlacBlockFrames * info.channels);
+	fFloats.resize(kMaxFlacBlockFrames * 2);
+
+	// a frame that doesn't decode is skipped, up to the next sync code
+	while (offset + 2 <= size) {
+		if (data[offset] != 0xff || (data[offset + 1] & 0xfe) != 0xf8) {
+			offset++;
+			continue;
+		}
+
+		size_t used;
+		Result result = _DecodeFlacFrame(data + offset, size - offset, info, used);
+		if (result == kNoMemory)
+			return result;
+		offset += result == kOK ? used : 1;
+
+		if (info.totalFrames > 0 && (uint64_t)fFrameCount >= info.totalFrames) {
+			fFrameCount = info.totalFrames;
+			break;
+		}
+	}
+	return fFrameCount > 0 ? kOK : kBadData;
+}
+
+
+AudioDecoder::Result
+AudioDecoder::_DecodeFlacFrame(const uint8_t* data, size_t size, const FlacInfo& info,
+	size_t& used)
+{
+	static const int32_t kSampleBits[8] = { 0, 8, 12, -1, 16, 20, 24, 32 };
+
+	BitReader reader(data, size);
+	if (reader.Read(14) != 0x3ffe || reader.Read(1) != 0)
+		return kBadData;
+	reader.Read(1);		// fixed or variable blocks, they're taken as they come
+
+	uint32_t blockCode = reader.Read(4);
+	uint32_t rateCode = reader.Read(4);
+	uint32_t channelCode = reader.Read(4);
+	uint32_t bitsCode = reader.Read(3);
+	if (reader.Read(1) != 0 || blockCode == 0 || rateCode == 15 || channelCode > 10)
+		return kBadData;
+
+	// the frame or sample number, UTF-8 style
+	uint32_t first = reader.Read(8);
+	int32_t following = 0;
+	while (following < 7 && (first & (0x80 >> following)) != 0)
+		following++;
+	if (following == 1 || first == 0xff)
+		return kBadData;
+	for (int32_t i = 1; i < following; i++) {
+		if ((reader.Read(8) & 0xc0) != 0x80)
+			return kBadData;
+	}
+
+	int32_t blockSize;
+	if (blockCode == 1)
+		blockSize = 192;
+	else if (blockCode <= 5)
+		blockSize = 576 << (blockCode - 2);
+	else if (blockCode == 6)
+		blockSize = reader.Read(8) + 1;
+	else if (blockCode == 7)
+		blockSize = reader.Read(16) + 1;
+	else
+		blockSize = 256 << (blockCode - 8);
+
+	if (rateCode == 12)
+		reader.Read(8);
+	else if (rateCode == 13 || rateCode == 14)
+		reader.Read(16);
+
+	size_t headerSize = reader.BytePosition();
+	if (reader.Overrun() || reader.Read(8) != crc8(data, headerSize) || reader.Overrun())
+		return kBadData;
+
+	int32_t channels = channelCode < 8 ? channelCode + 1 : 2;
+	int32_t bits = bitsCode == 0 ? info.bits : kSampleBits[bitsCode];
+	if (channels != info.channels || bits != info.bits || blockSize > kMaxFlacBlockFrames)
+		return kBadData;
+
+	// the side channel has one bit more
+	int32_t* samples = &fInts[0];
+	for (int32_t channel = 0; channel < channels; channel++) {
+		bool side = (channelCode == 8 && channel == 1) || (channelCode == 9 && channel == 0)
+			|| (channelCode == 10 && channel == 1);
+		if (!decode_subframe(reader, samples + channel * blockSize, blockSize,
+				bits + (side ? 1 : 0)))
+			return kBadData;
+	}
+
+	reader.AlignToByte();
+	size_t frameSize = reader.BytePosition();
+	if (reader.Overrun() || reader.Read(16) != crc16(data, frameSize) || reader.Overrun())
+		return kBadData;
+	used = frameSize + 2;
+
+	// unsigned, so no garbage can overflow
+	int32_t* left = samples;
+	int32_t* right = channels > 1 ? samples + blockSize : samples;
+	switch (channelCode) {
+		case 8:		// left, side
+			for (int32_t i = 0; i < blockSize; i++)
+				right[i] = (int32_t)((uint32_t)left[i] - (uint32_t)right[i]);
+			break;
+		case 9:		// side, right
+			for (int32_t i = 0; i < blockSize; i++)
+				left[i] = (int32_t)((uint32_t)left[i] + (uint32_t)right[i]);
+			break;
+		case 10:	// mid, side
+			for (int32_t i = 0; i < blockSize; i++) {
+				uint32_t mid = (uint32_t)left[i] << 1 | (right[i] & 1);
+				uint32_t side = right[i];
+				left[i] = (int32_t)(mid + side) >> 1;
+				right[i] = (int32_t)(mid - side) >> 1;
+			}
+			break;
+	}
+
+	if (!_Reserve(fFrameCount + blockSize))
+		return kNoMemory;
+
+	float scale = 1.0f / (1 << (bits - 1));
+	float* leftFloats = &fFloats[0];
+	float* rightFloats = leftFloats + blockSize;
+	ints_to_floats(left, blockSize, scale, leftFloats);
+	ints_to_floats(right, blockSize, scale, rightFloats);
+	interleave(leftFloats, rightFloats, blockSize, fFrames + fFrameCount * 2);
+	fFrameCount += blockSize;
+	return kOK;
+}
+
+
+bool
+AudioDecoder::_Reserve(int64_t frameCount)
+{
+	if (frameCount <= fCapacity)
+		return true;
+
+	int64_t capacity = fCapacity * 2 > frameCount ? fCapacity * 2 : frameCount;
+	float* frames = (float*)realloc(fFrames, capacity * 2 * sizeof(float));
+	if (frames == NULL)
+		return false;
+
+	fFrames = frames;
+	fCapacity = capacity;
+	return true;
+}
+
+
+void
+AudioDecoder::_MakeEmpty()
+{
+	free(fFrames);
+	fFrames = NULL;
+	fFrameCount = 0;
+	fCapacity = 0;
+	fFrameRate = 0.0;
+}
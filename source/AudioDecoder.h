@@ -0,0 +1,86 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef AUDIO_DECODER_H
+#define AUDIO_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+// Decodes WAV, AIFF and FLAC files straight from memory into interleaved
+// stereo float, mono played on both channels. The samples are unpacked and
+// converted a block at a time, in plain loops the compiler turns into vector
+// instructions. Any other format, or an encoding not handled here, is left
+// to the media kit.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+class AudioDecoder {
+public:
+	enum Result {
+		kOK,
+		kUnknownFormat,
+		kBadData,
+		kNoMemory
+	};
+
+					AudioDecoder();
+					~AudioDecoder();
+
+	Result			Decode(const uint8_t* data, size_t size);
+
+	// malloc()ed, the caller takes them over
+	float*			DetachFrames();
+	int64_t			FrameCount() const { return fFrameCount; }
+	double			FrameRate() const { return fFrameRate; }
+
+	// A hash of just the audio of a WAV, AIFF or FLAC file, without decoding
+	// it: tags and other chunks around it may change, it stays the same.
+	// 0 for any other file.
+	static uint64_t	Fingerprint(const uint8_t* data, size_t size);
+
+private:
+	struct PcmFormat {
+		int32_t		channels;
+		int32_t		bytes;		// per sample, the bits left aligned
+		bool		isFloat;
+		bool		bigEndian;
+		bool		isUnsigned;
+	};
+
+	struct FlacInfo {
+		int32_t		channels;
+		int32_t		bits;
+		uint64_t	totalFrames;	// 0 if unknown
+	};
+
+	Result			_DecodeWav(const uint8_t* data, size_t size);
+	Result			_DecodeAiff(const uint8_t* data, size_t size);
+	Result			_DecodePcm(const uint8_t* data, size_t size,
+						const PcmFormat& format);
+	Result			_DecodeFlac(const uint8_t* data, size_t size);
+	Result			_DecodeFlacFrame(const uint8_t* data, size_t size,
+						const FlacInfo& info, size_t& used);
+
+	bool			_Reserve(int64_t frameCount);
+	void			_MakeEmpty();
+
+	float*			fFrames;
+	int64_t			fFrameCount;
+	int64_t			fCapacity;
+	double			fFrameRate;
+
+	std::vector<int32_t>	fInts;
+	std::vector<float>		fFloats;
+};
+
+
+#endif // AUDIO_DECODER_H
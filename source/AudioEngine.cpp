@@ -0,0 +1,2738 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioEngine.h"
+#include "GuestMidi.h"
+#include "Recorder.h"
+#include "Sample.h"
+#include "SampleCache.h"
+
+#include <Catalog.h>
+#include <MidiDefs.h>
+#include <SoundPlayer.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "AudioEngine"
+
+static const int32 kCommandQueueSize = 256;
+static const int32 kMidiQueueSize = 1024;
+static const int32 kReleaseQueueSize = 1024;
+static const int32 kKitQueueSize = 16;
+static const int32 kKitSwapQueueSize = 16;
+static const bigtime_t kJanitorInterval = 50000;
+static const float kPitchBendRange = 2.0f;	// semitones
+static const int32 kPatternQueueSize = 16;
+static const int32 kClocksPerStep = 6;		// MIDI clock has 24 per quarter note
+static const double kNoStep = 1e18;
+static const float kMinTempo = 20.0f;
+static const uint8 kRecordedPadChannel = 9;	// channel 10, General MIDI drums
+static const float kMeterIntegration = 0.3f;	// seconds, as RMS meters do
+static const float kSilentEnvelope = 0.001f;	// -60 dB, where a decay ends
+static const float kDenormal = 1e-15f;
+static const bigtime_t kAttachTimeout = 1000000;
+static const bigtime_t kRemoteTimeout = 100000;
+static const int32 kWorkerSpins = 2000;		// about 10 to 50 µs of pauses
+static const int32 kMeasuredBuffers = 2000;
+
+
+static inline void
+cpu_pause()
+{
+	// lets the other hyperthread of the core run while spinning
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+
+static inline void
+mix(float* target, const float* source, int32 count, float gain)
+{
+	for (int32 i = 0; i < count; i++)
+		target[i] += source[i] * gain;
+}
+
+
+static inline void
+mix_metered(float* target, const float* source, int32 count, float gain,
+	float& peak, float& squares)
+{
+	// the same sum, measuring what's added on the way
+	float high = peak;
+	float sum = 0.0f;
+	for (int32 i = 0; i < count; i++) {
+		float value = source[i] * gain;
+		target[i] += value;
+		float magnitude = fabsf(value);
+		high = magnitude > high ? magnitude : high;
+		sum += value * value;
+	}
+	peak = high;
+	squares += sum;
+}
+
+
+AudioEngine::Kit::Kit()
+	:
+	locked(false),
+	resident(false)
+{
+	memset(pads, 0, sizeof(pads));
+	for (int32 i = 0; i < kPadCount; i++) {
+		pads[i].note = kDefaultNote + i;
+		pads[i].gain = 1.0f;
+		pads[i].filterType = kFilterOff;
+		pads[i].cutoff = kDefaultCutoff;
+		pads[i].resonance = kDefaultResonance;
+		ComputeFilter(pads[i]);
+	}
+}
+
+
+bool
+AudioEngine::PadSettings::IsProcessed() const
+{
+	return filterType != kFilterOff || attack > 0.0f || decay > 0.0f || release > 0.0f;
+}
+
+
+AudioEngine::Pattern::Pattern()
+	:
+	tempo(120.0f),
+	swing(0.5f),
+	syncToClock(false)
+{
+	memset(steps, 0, sizeof(steps));
+}
+
+
+// #pragma mark -
+
+
+AudioEngine::AudioEngine(BMessenger target)
+	:
+	fKit(new Kit),
+	fBusesRendered(1),
+	fOutputBuses(1),
+	fVoiceAge(0),
+	fPitchRate(1.0f),
+	fPattern(NULL),
+	fStep(0),
+	fStepFrame(kNoStep),
+	fClockTicks(-1),
+	fLastClockTime(0),
+	fClockFramesPerStep(0.0),
+	fBufferTime(0),
+	fBufferFrames(0),
+	fRenderedFrames(0),
+	fStepLog(NULL),
+	fCommands(kCommandQueueSize),
+	fMidiEvents(kMidiQueueSize),
+	fReleased(kReleaseQueueSize),
+	fReleasedKits(kKitQueueSize),
+	fReleasedPatterns(kPatternQueueSize),
+	fKitSwaps(kKitSwapQueueSize),
+	fReleasedGuests(kMaxGuests * 2),
+	fRemotePort(-1),
+	fGuestId(-1),
+	fRemoteMode(false),
+	fRemoteLost(false),
+	fMemoryLocker(kDefaultMemoryLockLimit),
+	fSampleLocker(&fMemoryLocker),
+	fWorkingMemoryLocked(false),
+	fRecorder(NULL),
+	fRecorderLocked(false),
+	fMeteringBuffer(false),
+	fMetering(false),
+	fPlainCount(0),
+	fProcessedCount(0),
+	fRenderThreads(0),
+	fWorkerCount(0),
+	fWorkSem(-1),
+	fWorkDoneSem(-1),
+	fWaitingForWorkers(false),
+	fNextVoice(0),
+	fVoicesDone(0),
+	fGeneration(0),
+	fTrackingPlayheads(false),
+	fPlayer(NULL),
+	fTarget(target),
+	fJanitorThread(-1),
+	fJanitorSem(-1),
+	fQuitting(false),
+	fMidiEventCount(0),
+	fMidiEventTime(0),
+	fSequencerRunning(false),
+	fWantsMidiClock(false),
+	fPriorityStatus(B_NO_INIT),
+	fPriorityRequested(false),
+	fPriorityReported(false)
+{
+	memset(fResidentKits, 0, sizeof(fResidentKits));
+	memset(fVoices, 0, sizeof(fVoices));
+	memset(fBuses, 0, sizeof(fBuses));
+	for (int32 i = 0; i < 128; i++)
+		fControllers[i] = -1;
+	memset(fPadPeaks, 0, sizeof(fPadPeaks));
+	memset(fPadSquares, 0, sizeof(fPadSquares));
+	memset(fMeanSquares, 0, sizeof(fMeanSquares));
+	for (int32 i = 0; i <= kPadCount; i++) {
+		fMeters[i].peak = 0.0f;
+		fMeters[i].meanSquare = 0.0f;
+	}
+	for (int32 i = 0; i < 2; i++) {
+		fRenderTime[i] = 0;
+		fRenderCount[i] = 0;
+	}
+	for (int32 i = 0; i < kPadCount; i++)
+		fPlayheads[i] = -1.0f;
+	for (int32 i = 0; i < 2; i++) {
+		fVoiceTime[i] = 0;
+		fVoiceCount[i] = 0;
+	}
+	fUnpackTime = 0;
+	memset(&fLanes, 0, sizeof(fLanes));
+	memset(fSlices, 0, sizeof(fSlices));
+	for (int32 i = 0; i < kMaxGuests; i++)
+		fGuests[i] = NULL;
+	for (int32 i = 0; i < kMaxRenderThreads; i++) {
+		fThreadTime[i] = 0;
+		fThreadVoices[i] = 0;
+	}
+}
+
+
+AudioEngine::~AudioEngine()
+{
+	Stop();
+	if (fRemoteMode) {
+		BMessage message(ENGINE_DETACH);
+		fRemote.SendMessage(&message, (BHandler*)NULL, kRemoteTimeout);
+	}
+
+	// the audio thread is gone, so everything can be released right here
+	_DiscardCommands();
+	for (int32 i = 0; i < kMaxGuests; i++)
+		delete fGuests[i].load();
+	AudioEngine* guest;
+	while (fReleasedGuests.Pop(guest))
+		delete guest;
+
+	for (int32 i = 0; i < kMaxVoices; i++)
+		_FreeVoice(fVoices[i]);
+	for (int32 i = 0; i < kMaxResidentKits; i++) {
+		if (fResidentKits[i] != NULL && fResidentKits[i] != fKit)
+			_DeleteKit(fResidentKits[i]);
+	}
+
+	_CollectGarbage();
+	_DeleteKit(fKit);
+	delete fPattern;
+
+	if (fWorkingMemoryLocked) {
+		fMemoryLocker.Unlock(this, sizeof(*this));
+		fMemoryLocker.Unlock(fCommands.Buffer(), fCommands.BufferSize());
+		fMemoryLocker.Unlock(fMidiEvents.Buffer(), fMidiEvents.BufferSize());
+		fMemoryLocker.Unlock(fReleased.Buffer(), fReleased.BufferSize());
+		fMemoryLocker.Unlock(fReleasedKits.Buffer(), fReleasedKits.BufferSize());
+		fMemoryLocker.Unlock(fReleasedPatterns.Buffer(), fReleasedPatterns.BufferSize());
+		fMemoryLocker.Unlock(fKitSwaps.Buffer(), fKitSwaps.BufferSize());
+		fMemoryLocker.Unlock(fReleasedGuests.Buffer(), fReleasedGuests.BufferSize());
+	}
+	if (fRecorderLocked)
+		fMemoryLocker.Unlock(fRecorder->Buffer(), fRecorder->BufferSize());
+}
+
+
+status_t
+AudioEngine::Start()
+{
+	if (fPlayer != NULL || fRemoteMode)
+		return B_OK;
+
+	if (!fCommands.IsValid() || !fMidiEvents.IsValid() || !fReleased.IsValid() || !fReleasedKits.IsValid()
+		|| !fReleasedPatterns.IsValid() || !fKitSwaps.IsValid() || !fReleasedGuests.IsValid())
+		return B_NO_MEMORY;
+
+	_LockWorkingMemory();
+	if (!fKit->locked && fMemoryLocker.Lock(fKit, sizeof(Kit)) == B_OK)
+		fKit->locked = true;
+
+	fQuitting = false;
+	fJanitorSem = create_sem(0, "samedi janitor");
+	fJanitorThread = spawn_thread(_JanitorThread, "samedi janitor", B_LOW_PRIORITY, this);
+	if (fJanitorThread >= 0)
+		resume_thread(fJanitorThread);
+	_StartWorkers();
+
+	media_raw_audio_format format = media_raw_audio_format::wildcard;
+	format.frame_rate = kEngineFrameRate;
+	format.channel_count = kEngineChannels * fOutputBuses;
+	format.format = media_raw_audio_format::B_AUDIO_FLOAT;
+	format.byte_order = B_MEDIA_HOST_ENDIAN;
+	format.buffer_size = kBufferFrames * format.channel_count * sizeof(float);
+
+	fPlayer = new BSoundPlayer(&format, "Samedi", _PlayBuffer, NULL, this);
+	status_t status = fPlayer->InitCheck();
+	if (status != B_OK) {
+		BString text(B_TRANSLATE("⚠ Could not connect to the media server: %error%"));
+		text.ReplaceFirst("%error%", strerror(status));
+		_PostStatus(text, true);
+		delete fPlayer;
+		fPlayer = NULL;
+		return status;
+	}
+
+	fPlayer->SetHasData(true);
+	return fPlayer->Start();
+}
+
+
+void
+AudioEngine::Stop()
+{
+	if (fPlayer != NULL) {
+		fPlayer->Stop();
+		delete fPlayer;
+		fPlayer = NULL;
+	}
+
+	if (fJanitorThread >= 0) {
+		fQuitting = true;
+		release_sem(fJanitorSem);
+		status_t result;
+		wait_for_thread(fJanitorThread, &result);
+		fJanitorThread = -1;
+	}
+	if (fJanitorSem >= 0) {
+		delete_sem(fJanitorSem);
+		fJanitorSem = -1;
+	}
+	_StopWorkers();
+}
+
+
+/*static*/ status_t
+AudioEngine::RequestHost(const BMessenger& host, const BMessenger& target,
+	BMessage& reply)
+{
+	BMessage request(ENGINE_ATTACH);
+	request.AddMessenger("target", target);
+	status_t status = host.SendMessage(&request, &reply, kAttachTimeout, kAttachTimeout);
+	if (status != B_OK)
+		return status;
+	if (!reply.HasMessenger("engine"))
+		return reply.GetInt32("error", B_ERROR);
+	return B_OK;
+}
+
+
+status_t
+AudioEngine::AttachToHost(const BMessage& reply)
+{
+	if (fPlayer != NULL || fRemoteMode)
+		return B_NOT_ALLOWED;
+
+	BMessenger remote;
+	port_id port = reply.GetInt32("midi port", -1);
+	if (reply.FindMessenger("engine", &remote) != B_OK || port < 0)
+		return B_BAD_VALUE;
+
+	// nothing played what was set so far, the window sends it again
+	_DiscardCommands();
+	fRemote = remote;
+	fRemotePort = port;
+	fGuestId = reply.GetInt32("guest", -1);
+	fRemoteLost = false;
+	fRemoteMode = true;
+
+	if (fMetering)
+		_PushCommand(kSetMetering, 0, true);
+	if (fTrackingPlayheads)
+		_PushCommand(kTrackPlayheads, 0, true);
+	return B_OK;
+}
+
+
+status_t
+AudioEngine::PlayLocally()
+{
+	if (!fRemoteMode)
+		return B_OK;
+
+	// the window sends everything again, what the host got is lost with it
+	fRemoteMode = false;
+	fRemote = BMessenger();
+	fRemotePort = -1;
+	return Start();
+}
+
+
+status_t
+AudioEngine::AddGuest(AudioEngine* guest)
+{
+	// the host's audio thread renders it, so it has to stay in memory, too
+	guest->_LockWorkingMemory();
+	// its samples come from the host's cache and stay there after it's gone,
+	// they count towards the host's limit
+	guest->fSampleLocker = fSampleLocker;
+
+	Command command = { kAddGuest, 0, 0, 0.0f, NULL, NULL, 0, NULL, guest };
+	return fCommands.Push(command) ? B_OK : B_NO_MEMORY;
+}
+
+
+status_t
+AudioEngine::RemoveGuest(AudioEngine* guest)
+{
+	Command command = { kRemoveGuest, 0, 0, 0.0f, NULL, NULL, 0, NULL, guest };
+	return fCommands.Push(command) ? B_OK : B_NO_MEMORY;
+}
+
+
+void
+AudioEngine::ApplyRemote(const BMessage* message, SampleCache* cache)
+{
+	int32 what = message->GetInt32("command", -1);
+	int32 pad = message->GetInt32("pad", 0);
+	int32 value = message->GetInt32("value", 0);
+	float gain = message->GetFloat("gain", 0.0f);
+	bigtime_t time = message->GetInt64("time", 0);
+
+	switch (what) {
+		case kSwapKit:
+		case kSetResidentKit:
+		{
+			// the samples from the cache are let go once the engine holds them
+			Sample* samples[kPadCount] = {};
+			Kit* kit = NULL;
+			BMessage archive;
+			if (message->FindMessage("kit", &archive) == B_OK)
+				kit = _UnarchiveKit(archive, cache, samples);
+			if (what == kSetResidentKit)
+				SetResidentKit(value, kit);
+			else if (kit != NULL)
+				SwapKit(kit, time);
+			for (int32 i = 0; i < kPadCount; i++) {
+				if (samples[i] != NULL)
+					samples[i]->ReleaseReference();
+			}
+			return;
+		}
+		case kSelectProgram:
+			SelectProgram(value, time);
+			return;
+		case kSetPattern:
+		{
+			BMessage archive;
+			if (message->FindMessage("pattern", &archive) == B_OK)
+				SetPattern(_UnarchivePattern(archive));
+			return;
+		}
+		case kSetMetering:
+			SetMetering(value != 0);
+			return;
+		case kTrackPlayheads:
+			SetTrackingPlayheads(value != 0);
+			return;
+		case kAddGuest:
+		case kRemoveGuest:
+			return;
+	}
+	if (what < kSetSample || what > kStopSequencer)
+		return;
+
+	Sample* sample = NULL;
+	const char* path;
+	if (message->FindString("path", &path) == B_OK) {
+		sample = cache->Get(path);
+		_PostPinStatus(PinSample(sample));
+	}
+	if (!_PushCommand(what, pad, value, gain, sample) && sample != NULL)
+		sample->ReleaseReference();
+}
+
+
+status_t
+AudioEngine::SetOutputBuses(int32 count)
+{
+	if (count < 1 || count > kBusCount)
+		return B_BAD_VALUE;
+	if (count == fOutputBuses)
+		return B_OK;
+
+	// The format of a media node is fixed, so it's replaced by one with more
+	// or fewer channels. Stopping it waits for its last buffer, the voices
+	// go on where they were.
+	fOutputBuses = count;
+	if (fPlayer == NULL)
+		return B_OK;
+
+	Stop();
+	return Start();
+}
+
+
+status_t
+AudioEngine::SetRenderThreads(int32 count)
+{
+	if (count < 0 || count > kMaxRenderThreads)
+		return B_BAD_VALUE;
+	if (count == fRenderThreads)
+		return B_OK;
+
+	// the workers are only started and stopped with the audio thread
+	fRenderThreads = count;
+	if (fPlayer == NULL)
+		return B_OK;
+
+	Stop();
+	return Start();
+}
+
+
+// #pragma mark - window thread
+
+
+void
+AudioEngine::SetSample(int32 pad, Sample* sample)
+{
+	if (sample != NULL) {
+		if (!fRemoteMode)
+			_PostPinStatus(PinSample(sample));
+		sample->AcquireReference();
+	}
+
+	if (!_PushCommand(kSetSample, pad, 0, 0.0f, sample) && sample != NULL)
+		sample->ReleaseReference();
+}
+
+
+void
+AudioEngine::ReplaceSample(int32 pad, Sample* sample)
+{
+	if (sample != NULL) {
+		if (!fRemoteMode)
+			_PostPinStatus(PinSample(sample));
+		sample->AcquireReference();
+	}
+
+	if (!_PushCommand(kReplaceSample, pad, 0, 0.0f, sample) && sample != NULL)
+		sample->ReleaseReference();
+}
+
+
+void
+AudioEngine::SetMuted(int32 pad, bool muted)
+{
+	_PushCommand(kSetMuted, pad, muted);
+}
+
+
+void
+AudioEngine::SetLooping(int32 pad, bool looping)
+{
+	_PushCommand(kSetLooping, pad, looping);
+}
+
+
+void
+AudioEngine::SetGain(int32 pad, float gain)
+{
+	_PushCommand(kSetGain, pad, 0, gain);
+}
+
+
+void
+AudioEngine::SetChokeGroup(int32 pad, int32 group)
+{
+	_PushCommand(kSetChokeGroup, pad, group);
+}
+
+
+void
+AudioEngine::SetNote(int32 pad, int32 note)
+{
+	_PushCommand(kSetNote, pad, note);
+}
+
+
+void
+AudioEngine::SetGate(int32 pad, bool gate)
+{
+	_PushCommand(kSetGate, pad, gate);
+}
+
+
+void
+AudioEngine::SetGainController(int32 pad, int32 controller)
+{
+	_PushCommand(kSetGainController, pad, controller);
+}
+
+
+void
+AudioEngine::SetFilter(int32 pad, int32 type, float cutoff, float resonance)
+{
+	_PushCommand(kSetFilterType, pad, type);
+	_PushCommand(kSetCutoff, pad, 0, cutoff);
+	_PushCommand(kSetResonance, pad, 0, resonance);
+}
+
+
+void
+AudioEngine::SetBus(int32 pad, int32 bus)
+{
+	_PushCommand(kSetBus, pad, bus);
+}
+
+
+void
+AudioEngine::SetTrim(int32 pad, int64 start, int64 end)
+{
+	// the voices check them against their sample, so they may come in any
+	// order
+	_PushCommand(kSetTrimStart, pad, (int32)start);
+	_PushCommand(kSetTrimEnd, pad, (int32)end);
+}
+
+
+void
+AudioEngine::SetEnvelope(int32 pad, float attack, float decay, float release)
+{
+	_PushCommand(kSetAttack, pad, 0, attack);
+	_PushCommand(kSetDecay, pad, 0, decay);
+	_PushCommand(kSetRelease, pad, 0, release);
+}
+
+
+void
+AudioEngine::Trigger(int32 pad)
+{
+	_PushCommand(kTrigger, pad);
+}
+
+
+void
+AudioEngine::StopPad(int32 pad)
+{
+	_PushCommand(kStop, pad);
+}
+
+
+void
+AudioEngine::SwapKit(Kit* kit, bigtime_t requested)
+{
+	if (fRemoteMode) {
+		BMessage message(ENGINE_COMMAND);
+		message.AddInt32("command", kSwapKit);
+		message.AddInt64("time", requested);
+		BMessage archive;
+		_ArchiveKit(*kit, archive);
+		message.AddMessage("kit", &archive);
+		_SendToHost(message);
+
+		// no audio thread uses the kit while the host plays, it only keeps
+		// the notes the pads are recorded as
+		for (int32 i = 0; i < kPadCount; i++)
+			fKit->pads[i].note = kit->pads[i].note;
+		delete kit;
+		return;
+	}
+
+	Command command = { kSwapKit, 0, 0, 0.0f, NULL, _PrepareKit(kit), requested, NULL,
+		NULL };
+	if (!fCommands.Push(command))
+		_DeleteKit(kit);
+}
+
+
+void
+AudioEngine::SetResidentKit(int32 program, Kit* kit)
+{
+	if (program < 0 || program >= kMaxResidentKits) {
+		delete kit;
+		return;
+	}
+
+	if (fRemoteMode) {
+		BMessage message(ENGINE_COMMAND);
+		message.AddInt32("command", kSetResidentKit);
+		message.AddInt32("value", program);
+		if (kit != NULL) {
+			BMessage archive;
+			_ArchiveKit(*kit, archive);
+			message.AddMessage("kit", &archive);
+		}
+		_SendToHost(message);
+		delete kit;
+		return;
+	}
+
+	if (kit != NULL)
+		_PrepareKit(kit);
+
+	Command command = { kSetResidentKit, 0, program, 0.0f, NULL, kit, 0, NULL, NULL };
+	if (!fCommands.Push(command) && kit != NULL)
+		_DeleteKit(kit);
+}
+
+
+void
+AudioEngine::ClearResidentKits()
+{
+	_PushCommand(kClearResidentKits, 0);
+}
+
+
+void
+AudioEngine::SelectProgram(int32 program, bigtime_t requested)
+{
+	if (fRemoteMode) {
+		BMessage message(ENGINE_COMMAND);
+		message.AddInt32("command", kSelectProgram);
+		message.AddInt32("value", program);
+		message.AddInt64("time", requested);
+		_SendToHost(message);
+		return;
+	}
+
+	Command command = { kSelectProgram, 0, program, 0.0f, NULL, NULL, requested, NULL,
+		NULL };
+	fCommands.Push(command);
+}
+
+
+bool
+AudioEngine::HandleMidi(uint8 status, uint8 data1, uint8 data2, bigtime_t time)
+{
+	// Only what this Samedi's own sources and channels let through goes to
+	// the host, so it's recorded here, too. Once the host is gone, the
+	// events wait for this engine to start.
+	if (fRemoteMode && !fRemoteLost) {
+		if (fRecorder != NULL && status >= B_NOTE_OFF && status < B_SYS_EX_START)
+			fRecorder->Record(status, data1, data2, time);
+		return _SendMidiToHost(status, data1, data2, time);
+	}
+
+	MidiEvent event = { time, status, data1, data2 };
+	return fMidiEvents.Push(event);
+}
+
+
+bool
+AudioEngine::HitPad(int32 pad, bool down, bigtime_t time, uint8 velocity)
+{
+	if (pad < 0 || pad >= kPadCount)
+		return false;
+
+	if (fRemoteMode && !fRemoteLost) {
+		_RecordPadHit(pad, down, velocity, time);
+		return _SendMidiToHost(down ? kPadDown : kPadUp, pad, velocity, time);
+	}
+
+	MidiEvent event = { time, (uint8)(down ? kPadDown : kPadUp), (uint8)pad, velocity };
+	return fMidiEvents.Push(event);
+}
+
+
+void
+AudioEngine::GetMidiStats(uint64& events, bigtime_t& time) const
+{
+	events = fMidiEventCount.load(std::memory_order_relaxed);
+	time = fMidiEventTime.load(std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::SetPattern(Pattern* pattern)
+{
+	fWantsMidiClock = pattern != NULL && pattern->syncToClock;
+
+	if (fRemoteMode) {
+		BMessage message(ENGINE_COMMAND);
+		message.AddInt32("command", kSetPattern);
+		if (pattern != NULL) {
+			BMessage archive;
+			_ArchivePattern(*pattern, archive);
+			message.AddMessage("pattern", &archive);
+		}
+		_SendToHost(message);
+		delete pattern;
+		return;
+	}
+
+	Command command = { kSetPattern, 0, 0, 0.0f, NULL, NULL, 0, pattern, NULL };
+	if (!fCommands.Push(command))
+		delete pattern;
+}
+
+
+void
+AudioEngine::StartSequencer()
+{
+	_PushCommand(kStartSequencer, 0);
+}
+
+
+void
+AudioEngine::StopSequencer()
+{
+	_PushCommand(kStopSequencer, 0);
+}
+
+
+/*static*/ void
+AudioEngine::ComputeFilter(PadSettings& pad)
+{
+	// RBJ's audio EQ cookbook, normalized so a0 is 1
+	Biquad& filter = pad.filter;
+	if (pad.filterType == kFilterOff) {
+		filter.b0 = 1.0f;
+		filter.b1 = filter.b2 = filter.a1 = filter.a2 = 0.0f;
+		return;
+	}
+
+	float nyquist = kEngineFrameRate / 2;
+	float cutoff = pad.cutoff < 20.0f ? 20.0f
+		: pad.cutoff > nyquist * 0.95f ? nyquist * 0.95f : pad.cutoff;
+	float resonance = pad.resonance < 0.5f ? 0.5f
+		: pad.resonance > 20.0f ? 20.0f : pad.resonance;
+
+	double w0 = 2.0 * M_PI * cutoff / kEngineFrameRate;
+	double cosine = cos(w0);
+	double alpha = sin(w0) / (2.0 * resonance);
+	double a0 = 1.0 + alpha;
+	double b0, b1, b2;
+	switch (pad.filterType) {
+		case kFilterHighPass:
+			b0 = (1.0 + cosine) / 2.0;
+			b1 = -(1.0 + cosine);
+			b2 = b0;
+			break;
+		case kFilterBandPass:
+			b0 = alpha;
+			b1 = 0.0;
+			b2 = -alpha;
+			break;
+		case kFilterLowPass:
+		default:
+			b0 = (1.0 - cosine) / 2.0;
+			b1 = 1.0 - cosine;
+			b2 = b0;
+			break;
+	}
+	filter.b0 = b0 / a0;
+	filter.b1 = b1 / a0;
+	filter.b2 = b2 / a0;
+	filter.a1 = -2.0 * cosine / a0;
+	filter.a2 = (1.0 - alpha) / a0;
+}
+
+
+/*static*/ double
+AudioEngine::StepLength(const Pattern& pattern, int32 step)
+{
+	// in frames, swing lengthens the first step of each pair and shortens
+	// the second
+	float tempo = pattern.tempo > kMinTempo ? pattern.tempo : kMinTempo;
+	double length = kEngineFrameRate * 60.0 / tempo / 4.0;
+	return length * 2.0 * (step % 2 == 0 ? pattern.swing : 1.0 - pattern.swing);
+}
+
+
+void
+AudioEngine::SetMetering(bool metering)
+{
+	// the host meters a guest, and sends it what it measured
+	fMetering = metering;
+	if (fRemoteMode)
+		_PushCommand(kSetMetering, 0, metering);
+}
+
+
+void
+AudioEngine::GetLevels(int32 pad, float& peak, float& rms)
+{
+	Meter& meter = fMeters[pad == kMasterMeter || pad < 0 || pad >= kPadCount
+		? kPadCount : pad];
+	peak = meter.peak.exchange(0.0f, std::memory_order_relaxed);
+	rms = sqrtf(meter.meanSquare.load(std::memory_order_relaxed));
+}
+
+
+void
+AudioEngine::GetVoiceTimes(bigtime_t& plain, bigtime_t& processed) const
+{
+	bigtime_t times[2];
+	for (int32 i = 0; i < 2; i++) {
+		uint64 count = fVoiceCount[i].load(std::memory_order_relaxed);
+		times[i] = count > 0
+			? fVoiceTime[i].load(std::memory_order_relaxed) * 1000 / (bigtime_t)count : 0;
+	}
+	plain = times[0];
+	processed = times[1];
+}
+
+
+float
+AudioEngine::VoicesPerMillisecond(int32 threads) const
+{
+	if (threads < 1 || threads > kMaxRenderThreads)
+		return 0.0f;
+
+	bigtime_t time = fThreadTime[threads - 1].load(std::memory_order_relaxed);
+	uint64 voices = fThreadVoices[threads - 1].load(std::memory_order_relaxed);
+	return time > 0 ? voices * 1000.0f / time : 0.0f;
+}
+
+
+/*static*/ float
+AudioEngine::MeasureRenderThreads(int32 threads, int32 voiceCount)
+{
+	// long enough that no voice ends while it's measured
+	int64 frameCount = (int64)(kMeasuredBuffers + 1) * kBufferFrames;
+	float* data = (float*)malloc(frameCount * kEngineChannels * sizeof(float));
+	float* bus = new(std::nothrow) float[kMeasuredBuffers * kBufferFrames * kEngineChannels];
+	if (data == NULL || bus == NULL) {
+		free(data);
+		delete[] bus;
+		return 0.0f;
+	}
+	for (int64 i = 0; i < frameCount * kEngineChannels; i++)
+		data[i] = (rand() % 2001 - 1000) / 1000.0f;
+
+	FileIdentity identity;
+	memset(&identity, 0, sizeof(identity));
+	Sample* sample = new Sample("noise", NULL, data, frameCount, identity);
+
+	AudioEngine engine((BMessenger()));
+	for (int32 pad = 0; pad < kPadCount; pad++) {
+		sample->AcquireReference();
+		engine.fKit->pads[pad].sample = sample;
+	}
+	sample->ReleaseReference();
+	for (int32 i = 0; i < voiceCount && i < kMaxVoices; i++)
+		engine._StartVoice(i % kPadCount);
+
+	engine.fRenderThreads = threads;
+	engine.fQuitting = false;
+	engine._StartWorkers();
+
+	bigtime_t start = system_time();
+	engine.RenderOffline(&bus, 1, kMeasuredBuffers * kBufferFrames);
+	bigtime_t time = system_time() - start;
+
+	engine._StopWorkers();
+	delete[] bus;
+	return time > 0 ? (float)engine.fPlainCount * kMeasuredBuffers * 1000.0f / time : 0.0f;
+}
+
+
+void
+AudioEngine::GetRenderTimes(bigtime_t& plain, bigtime_t& metered) const
+{
+	// average per buffer
+	bigtime_t times[2];
+	for (int32 i = 0; i < 2; i++) {
+		uint32 count = fRenderCount[i].load(std::memory_order_relaxed);
+		times[i] = count > 0 ? fRenderTime[i].load(std::memory_order_relaxed) / count : 0;
+	}
+	plain = times[0];
+	metered = times[1];
+}
+
+
+bigtime_t
+AudioEngine::UnpackTime() const
+{
+	uint32 count = fRenderCount[0].load(std::memory_order_relaxed)
+		+ fRenderCount[1].load(std::memory_order_relaxed);
+	return count > 0 ? fUnpackTime.load(std::memory_order_relaxed) / count : 0;
+}
+
+
+void
+AudioEngine::SetTrackingPlayheads(bool tracking)
+{
+	fTrackingPlayheads = tracking;
+	if (fRemoteMode)
+		_PushCommand(kTrackPlayheads, 0, tracking);
+}
+
+
+float
+AudioEngine::PlayheadOf(int32 pad) const
+{
+	if (pad < 0 || pad >= kPadCount)
+		return -1.0f;
+
+	return fPlayheads[pad].load(std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::ArchiveLevels(BMessage& message)
+{
+	// the mix last, as the meters are kept
+	if (IsMetering()) {
+		for (int32 i = 0; i <= kPadCount; i++) {
+			float peak;
+			float rms;
+			GetLevels(i < kPadCount ? i : kMasterMeter, peak, rms);
+			message.AddFloat("peak", peak);
+			message.AddFloat("rms", rms);
+		}
+	}
+	if (IsTrackingPlayheads()) {
+		for (int32 i = 0; i < kPadCount; i++)
+			message.AddFloat("playhead", PlayheadOf(i));
+	}
+}
+
+
+void
+AudioEngine::ApplyRemoteLevels(const BMessage* message)
+{
+	// the peak is kept until it's read, like the audio thread does it
+	float peak;
+	float rms;
+	for (int32 i = 0; i <= kPadCount && message->FindFloat("peak", i, &peak) == B_OK
+			&& message->FindFloat("rms", i, &rms) == B_OK; i++) {
+		if (peak > fMeters[i].peak.load(std::memory_order_relaxed))
+			fMeters[i].peak.store(peak, std::memory_order_relaxed);
+		fMeters[i].meanSquare.store(rms * rms, std::memory_order_relaxed);
+	}
+
+	float playhead;
+	for (int32 i = 0; i < kPadCount
+			&& message->FindFloat("playhead", i, &playhead) == B_OK; i++)
+		fPlayheads[i].store(playhead, std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::SetRecorder(Recorder* recorder)
+{
+	if (fPlayer != NULL || fRecorder != NULL)
+		return;
+
+	fRecorder = recorder;
+	if (fRecorder != NULL)
+		fRecorderLocked = fMemoryLocker.Lock(fRecorder->Buffer(), fRecorder->BufferSize()) == B_OK;
+}
+
+
+status_t
+AudioEngine::PinSample(Sample* sample)
+{
+	return sample->Pin(fSampleLocker);
+}
+
+
+void
+AudioEngine::SetMemoryLockLimit(size_t limit)
+{
+	fMemoryLocker.SetLimit(limit);
+}
+
+
+// #pragma mark - audio thread
+
+
+void
+AudioEngine::Render(float* buffer, int32 frameCount, int32 busCount)
+{
+	// the buses interleaved, as the media node has them
+	int32 channels = busCount * kEngineChannels;
+	while (frameCount > 0) {
+		int32 count = frameCount < kBufferFrames ? frameCount : kBufferFrames;
+		_RenderBuses(count, busCount);
+		for (int32 bus = 0; bus < busCount; bus++) {
+			const float* source = fBuses[bus];
+			float* target = buffer + bus * kEngineChannels;
+			for (int32 frame = 0; frame < count; frame++) {
+				target[frame * channels] = source[frame * kEngineChannels];
+				target[frame * channels + 1] = source[frame * kEngineChannels + 1];
+			}
+		}
+		buffer += count * channels;
+		frameCount -= count;
+	}
+}
+
+
+void
+AudioEngine::RenderOffline(float* const* buses, int32 busCount, int32 frameCount,
+	std::vector<int64>* stepFrames)
+{
+	// there's no janitor, but no audio thread either to wait for
+	fStepLog = stepFrames;
+	for (int32 done = 0; done < frameCount; done += kBufferFrames) {
+		int32 count = frameCount - done < kBufferFrames ? frameCount - done : kBufferFrames;
+		_RenderBuses(count, busCount);
+		for (int32 bus = 0; bus < busCount; bus++) {
+			memcpy(buses[bus] + done * kEngineChannels, fBuses[bus],
+				count * kEngineChannels * sizeof(float));
+		}
+	}
+	fStepLog = NULL;
+	_CollectGarbage();
+}
+
+
+void
+AudioEngine::_RenderBuses(int32 frameCount, int32 busCount)
+{
+	fBusesRendered = busCount;
+	for (int32 bus = 0; bus < busCount; bus++)
+		memset(fBuses[bus], 0, frameCount * kEngineChannels * sizeof(float));
+	fBufferTime = system_time();
+	fBufferFrames = frameCount;
+
+	_ProcessCommands();
+	_ProcessMidiEvents();
+	_RunSequencer(frameCount);
+
+	fMeteringBuffer = fMetering.load(std::memory_order_relaxed);
+	if (fMeteringBuffer) {
+		memset(fPadPeaks, 0, sizeof(fPadPeaks));
+		memset(fPadSquares, 0, sizeof(fPadSquares));
+	}
+
+	// voices with a filter or envelope are processed together
+	fPlainCount = 0;
+	fProcessedCount = 0;
+	for (int32 i = 0; i < kMaxVoices; i++) {
+		Voice& voice = fVoices[i];
+		if (voice.sample == NULL)
+			continue;
+		if (fKit->pads[voice.pad].IsProcessed() || voice.stage != kEnvelopeHold)
+			fProcessed[fProcessedCount++] = i;
+		else
+			fPlain[fPlainCount++] = i;
+	}
+
+	if (fPlainCount >= kParallelVoices && fWorkerCount > 0)
+		_RenderParallel(frameCount);
+	else {
+		_RenderPlainVoices(frameCount);
+		_RenderProcessedVoices(frameCount);
+	}
+	fRenderedFrames += frameCount;
+
+	// the Samedis playing through this one, mixed in bus by bus
+	for (int32 i = 0; i < kMaxGuests; i++) {
+		AudioEngine* guest = fGuests[i].load(std::memory_order_acquire);
+		if (guest == NULL)
+			continue;
+		guest->_RenderBuses(frameCount, busCount);
+		for (int32 bus = 0; bus < busCount; bus++) {
+			float* target = fBuses[bus];
+			const float* source = guest->fBuses[bus];
+			for (int32 j = 0; j < frameCount * kEngineChannels; j++)
+				target[j] += source[j];
+		}
+	}
+
+	if (fMeteringBuffer)
+		_PublishLevels(frameCount, busCount);
+	if (fTrackingPlayheads.load(std::memory_order_relaxed))
+		_PublishPlayheads();
+
+	// to compare, so the cost of the meters is known
+	fRenderTime[fMeteringBuffer].fetch_add(system_time() - fBufferTime,
+		std::memory_order_relaxed);
+	fRenderCount[fMeteringBuffer].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/*static*/ void
+AudioEngine::_PlayBuffer(void* cookie, void* buffer, size_t size,
+	const media_raw_audio_format& format)
+{
+	AudioEngine* engine = (AudioEngine*)cookie;
+
+	if (!engine->fPriorityRequested)
+		engine->_RaiseAudioThreadPriority();
+
+	// the node has as many buses as it has channel pairs
+	int32 busCount = format.channel_count / kEngineChannels;
+	if (format.format != media_raw_audio_format::B_AUDIO_FLOAT
+		|| format.channel_count % kEngineChannels != 0
+		|| busCount < 1 || busCount > kBusCount) {
+		memset(buffer, 0, size);
+		return;
+	}
+
+	engine->Render((float*)buffer, size / (format.channel_count * sizeof(float)), busCount);
+}
+
+
+void
+AudioEngine::_ProcessCommands()
+{
+	// Setting a pad to what it already is does nothing, so the pads can
+	// repeat the state of a freshly swapped kit without cutting the voices
+	// that ring out from the old one.
+	Command command;
+	while (fCommands.Pop(command)) {
+		switch (command.what) {
+			case kSwapKit:
+				_SwapKit(command.kit, -1, command.time);
+				continue;
+			case kSetResidentKit:
+				_SetResidentKit(command.value, command.kit);
+				continue;
+			case kClearResidentKits:
+				for (int32 i = 0; i < kMaxResidentKits; i++)
+					_SetResidentKit(i, NULL);
+				continue;
+			case kSelectProgram:
+			{
+				Kit* kit = NULL;
+				if (command.value >= 0 && command.value < kMaxResidentKits)
+					kit = fResidentKits[command.value];
+				_SwapKit(kit, command.value, command.time);
+				continue;
+			}
+			case kSetPattern:
+				_ReleaseLater(fPattern);
+				fPattern = command.pattern;
+				continue;
+			case kStartSequencer:
+				// a synced sequencer starts with the next clock
+				fSequencerRunning = true;
+				fStep = 0;
+				fClockTicks = -1;
+				fStepFrame = fPattern != NULL && fPattern->syncToClock ? kNoStep : 0.0;
+				continue;
+			case kStopSequencer:
+				fSequencerRunning = false;
+				continue;
+			case kAddGuest:
+			{
+				bool added = false;
+				for (int32 i = 0; i < kMaxGuests && !added; i++) {
+					if (fGuests[i].load(std::memory_order_relaxed) == NULL) {
+						fGuests[i].store(command.guest, std::memory_order_release);
+						added = true;
+					}
+				}
+				if (!added && fReleasedGuests.Push(command.guest) && fJanitorSem >= 0)
+					release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+				continue;
+			}
+			case kRemoveGuest:
+				// the janitor deletes it, it may be collecting its garbage
+				// right now
+				for (int32 i = 0; i < kMaxGuests; i++) {
+					if (fGuests[i].load(std::memory_order_relaxed) == command.guest)
+						fGuests[i].store(NULL, std::memory_order_release);
+				}
+				if (fReleasedGuests.Push(command.guest) && fJanitorSem >= 0)
+					release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+				continue;
+		}
+
+		if (command.pad < 0 || command.pad >= kPadCount) {
+			_ReleaseLater(command.sample);
+			continue;
+		}
+
+		PadSettings& pad = fKit->pads[command.pad];
+		switch (command.what) {
+			case kSetSample:
+				if (command.sample == pad.sample) {
+					_ReleaseLater(command.sample);
+					break;
+				}
+				_StopVoices(command.pad);
+				_ReleaseLater(pad.sample);
+				pad.sample = command.sample;
+				break;
+			case kReplaceSample:
+				// the voices hold the old one until they are done with it,
+				// the next ones start on the new one
+				if (command.sample == pad.sample) {
+					_ReleaseLater(command.sample);
+					break;
+				}
+				_ReleaseLater(pad.sample);
+				pad.sample = command.sample;
+				break;
+			case kSetMuted:
+				if ((command.value != 0) == pad.muted)
+					break;
+				pad.muted = command.value != 0;
+				if (pad.muted)
+					_StopVoices(command.pad);
+				break;
+			case kSetLooping:
+				if ((command.value != 0) == pad.looping)
+					break;
+				pad.looping = command.value != 0;
+				for (int32 i = 0; i < kMaxVoices; i++) {
+					if (fVoices[i].sample != NULL && fVoices[i].pad == command.pad)
+						fVoices[i].looping = pad.looping;
+				}
+				break;
+			case kSetGain:
+				if (command.gain == pad.gain)
+					break;
+				pad.gain = command.gain;
+				for (int32 i = 0; i < kMaxVoices; i++) {
+					if (fVoices[i].sample != NULL && fVoices[i].pad == command.pad)
+						fVoices[i].gain = pad.gain;
+				}
+				break;
+			case kSetChokeGroup:
+				pad.chokeGroup = command.value;
+				break;
+			case kSetNote:
+				pad.note = command.value;
+				break;
+			case kSetGate:
+				pad.gate = command.value != 0;
+				break;
+			case kSetFilterType:
+				if (command.value == pad.filterType)
+					break;
+				pad.filterType = command.value;
+				ComputeFilter(pad);
+				break;
+			case kSetCutoff:
+				if (command.gain == pad.cutoff)
+					break;
+				pad.cutoff = command.gain;
+				ComputeFilter(pad);
+				break;
+			case kSetResonance:
+				if (command.gain == pad.resonance)
+					break;
+				pad.resonance = command.gain;
+				ComputeFilter(pad);
+				break;
+			case kSetAttack:
+				pad.attack = command.gain;
+				break;
+			case kSetDecay:
+				pad.decay = command.gain;
+				break;
+			case kSetRelease:
+				pad.release = command.gain;
+				break;
+			case kSetBus:
+				if (command.value == pad.bus || command.value < 0
+					|| command.value >= kBusCount)
+					break;
+				pad.bus = command.value;
+				for (int32 i = 0; i < kMaxVoices; i++) {
+					if (fVoices[i].sample != NULL && fVoices[i].pad == command.pad)
+						fVoices[i].bus = pad.bus;
+				}
+				break;
+			case kSetTrimStart:
+				pad.trimStart = command.value;
+				break;
+			case kSetTrimEnd:
+				pad.trimEnd = command.value;
+				break;
+			case kSetGainController:
+				if (command.value == pad.gainController)
+					break;
+				pad.gainController = command.value;
+				for (int32 i = 0; i < kMaxVoices; i++) {
+					if (fVoices[i].sample != NULL && fVoices[i].pad == command.pad)
+						fVoices[i].controller = pad.gainController;
+				}
+				break;
+			case kTrigger:
+				_StartVoice(command.pad);
+				break;
+			case kStop:
+				_StopVoices(command.pad);
+				break;
+		}
+	}
+}
+
+
+void
+AudioEngine::_ProcessMidiEvents()
+{
+	MidiEvent event;
+	if (!fMidiEvents.Pop(event))
+		return;
+
+	// the time per event is shown in the MIDI in menu
+	bigtime_t start = system_time();
+	uint32 total = 0;
+	bool more = true;
+	while (more) {
+		// Events of one source arrive in order, so this insertion sort
+		// mostly just merges the sources.
+		int32 count = 0;
+		do {
+			int32 i = count++;
+			while (i > 0 && fMidiBatch[i - 1].time > event.time) {
+				fMidiBatch[i] = fMidiBatch[i - 1];
+				i--;
+			}
+			fMidiBatch[i] = event;
+			more = fMidiEvents.Pop(event);
+		} while (more && count < kMidiBatchSize);
+
+		for (int32 i = 0; i < count; i++)
+			_HandleMidiEvent(fMidiBatch[i]);
+		total += count;
+	}
+
+	fMidiEventCount.fetch_add(total, std::memory_order_relaxed);
+	fMidiEventTime.fetch_add(system_time() - start, std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::_HandleMidiEvent(const MidiEvent& event)
+{
+	// a guest's events come from another process
+	if ((event.status == kPadDown || event.status == kPadUp)
+		&& event.data1 >= kPadCount)
+		return;
+
+	switch (event.status) {
+		case kPadDown:
+			_StartVoice(event.data1, 0, event.data2 / 127.0f);
+			_RecordPadHit(event.data1, true, event.data2, event.time);
+			return;
+		case kPadUp:
+			_RecordPadHit(event.data1, false, 0, event.time);
+			if (fKit->pads[event.data1].gate)
+				_StopVoices(event.data1);
+			return;
+		case B_TIMING_CLOCK:
+		case B_START:
+		case B_CONTINUE:
+		case B_STOP:
+			_HandleMidiClock(event);
+			return;
+	}
+
+	if (fRecorder != NULL && event.status >= B_NOTE_OFF && event.status < B_SYS_EX_START)
+		fRecorder->Record(event.status, event.data1, event.data2, event.time);
+
+	switch (event.status & 0xf0) {
+		case B_NOTE_ON:
+			if (event.data2 > 0) {
+				for (int32 i = 0; i < kPadCount; i++) {
+					if (fKit->pads[i].note == event.data1)
+						_StartVoice(i, 0, event.data2 / 127.0f);
+				}
+				break;
+			}
+			// a note on without velocity is a note off
+			// fall through
+		case B_NOTE_OFF:
+			for (int32 i = 0; i < kPadCount; i++) {
+				if (fKit->pads[i].note == event.data1 && fKit->pads[i].gate)
+					_StopVoices(i);
+			}
+			break;
+		case B_KEY_PRESSURE:
+			_DampVoices(event.data1, event.data2);
+			break;
+		case B_CONTROL_CHANGE:
+			fControllers[event.data1 & 0x7f] = event.data2;
+			break;
+		case B_PITCH_BEND:
+		{
+			float bend = ((event.data2 << 7 | event.data1) - 8192) / 8192.0f;
+			fPitchRate = powf(2.0f, bend * kPitchBendRange / 12.0f);
+			break;
+		}
+	}
+}
+
+
+void
+AudioEngine::_RecordPadHit(int32 pad, bool down, uint8 velocity, bigtime_t time)
+{
+	// as the note the pad listens to, on the drum channel
+	int32 note = fKit->pads[pad].note;
+	if (fRecorder == NULL || note < 0 || note > 127)
+		return;
+
+	uint8 status = (down ? B_NOTE_ON : B_NOTE_OFF) | kRecordedPadChannel;
+	fRecorder->Record(status, note, down ? velocity : 0, time);
+}
+
+
+void
+AudioEngine::_HandleMidiClock(const MidiEvent& event)
+{
+	bool synced = fPattern != NULL && fPattern->syncToClock;
+
+	switch (event.status) {
+		case B_START:
+			fStep = 0;
+			fClockTicks = -1;
+			fStepFrame = kNoStep;
+			// fall through
+		case B_CONTINUE:
+			if (synced)
+				fSequencerRunning = true;
+			return;
+		case B_STOP:
+			if (synced)
+				fSequencerRunning = false;
+			return;
+	}
+
+	// the tempo, averaged over a few clocks against their jitter
+	if (fLastClockTime > 0 && event.time > fLastClockTime) {
+		double frames = (event.time - fLastClockTime) * kEngineFrameRate / 1000000.0
+			* kClocksPerStep;
+		fClockFramesPerStep = fClockFramesPerStep > 0.0
+			? fClockFramesPerStep * 0.9 + frames * 0.1 : frames;
+	}
+	fLastClockTime = event.time;
+
+	if (!synced || !fSequencerRunning || ++fClockTicks % kClocksPerStep != 0)
+		return;
+
+	double frame = _FrameOf(event.time);
+	if (fStep % 2 == 1)
+		frame += (fPattern->swing - 0.5) * 2.0 * fClockFramesPerStep;
+	fStepFrame = frame;
+}
+
+
+double
+AudioEngine::_FrameOf(bigtime_t time) const
+{
+	// Timed events are played one buffer late, so they keep their exact
+	// distance from each other.
+	double frame = (time - fBufferTime) * kEngineFrameRate / 1000000.0 + fBufferFrames;
+	return frame > 0.0 ? frame : 0.0;
+}
+
+
+void
+AudioEngine::_RunSequencer(int32 frameCount)
+{
+	if (!fSequencerRunning || fPattern == NULL)
+		return;
+
+	while (fStepFrame < frameCount) {
+		_PlayStep(fStep, (int32)fStepFrame);
+
+		// synced, the clock decides when the next step is due
+		if (fPattern->syncToClock)
+			fStepFrame = kNoStep;
+		else
+			fStepFrame += StepLength(*fPattern, fStep);
+		fStep = (fStep + 1) % kStepCount;
+	}
+	fStepFrame -= frameCount;
+}
+
+
+void
+AudioEngine::_PlayStep(int32 step, int32 offset)
+{
+	if (fStepLog != NULL)
+		fStepLog->push_back(fRenderedFrames + offset);
+
+	for (int32 pad = 0; pad < kPadCount; pad++) {
+		uint8 velocity = fPattern->steps[pad][step];
+		if (velocity > 0)
+			_StartVoice(pad, offset, velocity / 127.0f);
+	}
+}
+
+
+void
+AudioEngine::_SwapKit(Kit* kit, int32 program, bigtime_t requested)
+{
+	KitSwap swap = { program, kit != NULL, requested, system_time() };
+	if (kit != NULL && kit != fKit) {
+		if (!fKit->resident)
+			_ReleaseLater(fKit);
+		fKit = kit;
+	}
+
+	// a program that isn't resident is reported, too, the window can then
+	// load it from disk
+	if (fKitSwaps.Push(swap) && fJanitorSem >= 0)
+		release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+}
+
+
+void
+AudioEngine::_SetResidentKit(int32 program, Kit* kit)
+{
+	Kit*& slot = fResidentKits[program];
+	if (slot != NULL) {
+		slot->resident = false;
+		// the active kit is released when it's swapped out
+		if (slot != fKit)
+			_ReleaseLater(slot);
+	}
+
+	slot = kit;
+	if (slot != NULL)
+		slot->resident = true;
+}
+
+
+void
+AudioEngine::_StartVoice(int32 pad, int32 offset, float velocity)
+{
+	PadSettings& state = fKit->pads[pad];
+	if (state.sample == NULL || state.muted)
+		return;
+
+	// a looping pad restarts its loop instead of stacking another one on top
+	if (state.looping)
+		_StopVoices(pad);
+
+	// silence the other pads of the choke group, e.g. an open hi-hat
+	if (state.chokeGroup != 0) {
+		for (int32 i = 0; i < kPadCount; i++) {
+			if (i != pad && fKit->pads[i].chokeGroup == state.chokeGroup)
+				_StopVoices(i);
+		}
+	}
+
+	// use a free voice, or steal the oldest one
+	Voice* voice = NULL;
+	for (int32 i = 0; i < kMaxVoices; i++) {
+		if (fVoices[i].sample == NULL) {
+			voice = &fVoices[i];
+			break;
+		}
+		if (voice == NULL || fVoiceAge - fVoices[i].age > fVoiceAge - voice->age)
+			voice = &fVoices[i];
+	}
+	_FreeVoice(*voice);
+
+	// a loop keeps its length, the silence around a hit is skipped
+	int64 start = 0;
+	int64 end = state.sample->FrameCount();
+	if (state.trimEnd > state.trimStart && state.trimEnd <= end) {
+		start = state.trimStart;
+		end = state.trimEnd;
+	}
+
+	state.sample->AcquireReference();
+	voice->sample = state.sample;
+	voice->position = state.looping ? 0 : start;
+	voice->end = end;
+	voice->fraction = 0.0f;
+	voice->block = -1;
+	voice->pad = pad;
+	voice->bus = state.bus;
+	voice->looping = state.looping;
+	voice->delay = offset;
+	voice->gain = state.gain;
+	voice->velocity = velocity;
+	voice->damping = 1.0f;
+	voice->controller = state.gainController;
+	voice->level = _VoiceLevel(*voice);
+	voice->age = fVoiceAge++;
+
+	memset(voice->z1, 0, sizeof(voice->z1));
+	memset(voice->z2, 0, sizeof(voice->z2));
+	voice->envelope = state.attack > 0.0f ? 0.0f : 1.0f;
+	_SetEnvelopeStage(*voice, state.attack > 0.0f ? kEnvelopeAttack
+		: state.decay > 0.0f ? kEnvelopeDecay : kEnvelopeHold);
+}
+
+
+void
+AudioEngine::_StopVoices(int32 pad)
+{
+	// with a release, the voices fade out instead
+	bool release = fKit->pads[pad].release > 0.0f;
+	for (int32 i = 0; i < kMaxVoices; i++) {
+		Voice& voice = fVoices[i];
+		if (voice.sample == NULL || voice.pad != pad)
+			continue;
+		if (!release)
+			_FreeVoice(voice);
+		else if (voice.stage != kEnvelopeRelease)
+			_SetEnvelopeStage(voice, kEnvelopeRelease);
+	}
+}
+
+
+void
+AudioEngine::_SetEnvelopeStage(Voice& voice, int32 stage)
+{
+	// attacks rise in a line, decays and releases fall exponentially, to
+	// -60 dB in their time
+	const PadSettings& pad = fKit->pads[voice.pad];
+	voice.stage = stage;
+	voice.envelopeMultiply = 1.0f;
+	voice.envelopeAdd = 0.0f;
+	switch (stage) {
+		case kEnvelopeAttack:
+			voice.envelopeAdd = 1.0f / (pad.attack * kEngineFrameRate);
+			break;
+		case kEnvelopeDecay:
+			voice.envelopeMultiply = expf(logf(kSilentEnvelope) / (pad.decay * kEngineFrameRate));
+			break;
+		case kEnvelopeRelease:
+			if (pad.release > 0.0f) {
+				voice.envelopeMultiply
+					= expf(logf(kSilentEnvelope) / (pad.release * kEngineFrameRate));
+			} else
+				voice.envelopeMultiply = 0.0f;
+			break;
+	}
+}
+
+
+void
+AudioEngine::_DampVoices(int32 note, int32 pressure)
+{
+	// pressing a struck pad, e.g. to choke a cymbal by hand
+	for (int32 i = 0; i < kPadCount; i++) {
+		if (fKit->pads[i].note != note)
+			continue;
+
+		if (pressure >= 127) {
+			_StopVoices(i);
+			continue;
+		}
+		for (int32 j = 0; j < kMaxVoices; j++) {
+			if (fVoices[j].sample != NULL && fVoices[j].pad == i)
+				fVoices[j].damping = 1.0f - pressure / 127.0f;
+		}
+	}
+}
+
+
+void
+AudioEngine::_FreeVoice(Voice& voice)
+{
+	_ReleaseLater(voice.sample);
+	voice.sample = NULL;
+}
+
+
+float
+AudioEngine::_VoiceLevel(const Voice& voice) const
+{
+	float level = voice.gain * voice.velocity * voice.damping;
+	if (voice.controller == 0)
+		return level;
+
+	// a controller that hasn't been moved yet leaves the pad at full gain
+	int32 value = fControllers[voice.controller & kGainControllerMask];
+	if (value < 0)
+		return level;
+
+	float amount = value / 127.0f;
+	if ((voice.controller & kGainControllerInverted) != 0)
+		amount = 1.0f - amount;
+	return level * amount;
+}
+
+
+void
+AudioEngine::_RenderVoice(Voice& voice, float* buffer, int32 frameCount,
+	float* peak, float* squares)
+{
+	// a voice of the sequencer may start within the buffer
+	if (voice.delay > 0) {
+		if (voice.delay >= frameCount) {
+			voice.delay -= frameCount;
+			return;
+		}
+		buffer += voice.delay * kEngineChannels;
+		frameCount -= voice.delay;
+		voice.delay = 0;
+	}
+
+	// the fraction of a bend that's over is dropped, that's inaudible
+	if (fPitchRate == 1.0f)
+		voice.fraction = 0.0f;
+
+	// a changed level is faded in over the buffer, so it doesn't click
+	float level = _VoiceLevel(voice);
+	if (fPitchRate != 1.0f || voice.fraction != 0.0f || level != voice.level) {
+		_RenderBentVoice(voice, buffer, frameCount, peak, squares);
+		return;
+	}
+
+	int64 sampleFrames = voice.looping ? voice.sample->FrameCount() : voice.end;
+	float gain = level;
+
+	// past the trimmed frames, when it stopped looping
+	if (voice.position >= sampleFrames) {
+		_FreeVoice(voice);
+		return;
+	}
+
+	int32 done = 0;
+	while (done < frameCount) {
+		int64 count;
+		const float* source = _VoiceFrames(voice, voice.position, count);
+		if (count > sampleFrames - voice.position)
+			count = sampleFrames - voice.position;
+		if (count > frameCount - done)
+			count = frameCount - done;
+
+		float* target = buffer + done * kEngineChannels;
+		if (peak != NULL)
+			mix_metered(target, source, count * kEngineChannels, gain, *peak, *squares);
+		else
+			mix(target, source, count * kEngineChannels, gain);
+
+		done += count;
+		voice.position += count;
+
+		if (voice.position >= sampleFrames) {
+			if (!voice.looping) {
+				_FreeVoice(voice);
+				return;
+			}
+			voice.position = 0;
+		}
+	}
+}
+
+
+void
+AudioEngine::_RenderBentVoice(Voice& voice, float* buffer, int32 frameCount,
+	float* peak, float* squares)
+{
+	const float* data = voice.sample->Data();
+	int64 sampleFrames = voice.looping ? voice.sample->FrameCount() : voice.end;
+	float rate = fPitchRate;
+	float level = voice.level;
+	float targetLevel = _VoiceLevel(voice);
+	float step = (targetLevel - level) / frameCount;
+	voice.level = targetLevel;
+
+	for (int32 i = 0; i < frameCount; i++) {
+		// the frame after a packed block's is unpacked with it
+		int64 available;
+		const float* a = _VoiceFrames(voice, voice.position, available);
+		const float* b = a + kEngineChannels;
+		if (voice.position + 1 >= sampleFrames)
+			b = voice.looping ? data : a;
+
+		float* target = buffer + i * kEngineChannels;
+		level += step;
+		for (int32 channel = 0; channel < kEngineChannels; channel++) {
+			float value = (a[channel] + (b[channel] - a[channel]) * voice.fraction) * level;
+			target[channel] += value;
+			if (peak != NULL) {
+				float magnitude = fabsf(value);
+				if (magnitude > *peak)
+					*peak = magnitude;
+				*squares += value * value;
+			}
+		}
+
+		voice.fraction += rate;
+		int64 advance = (int64)voice.fraction;
+		voice.fraction -= advance;
+		voice.position += advance;
+
+		if (voice.position >= sampleFrames) {
+			if (!voice.looping) {
+				_FreeVoice(voice);
+				return;
+			}
+			voice.position %= sampleFrames;
+		}
+	}
+}
+
+
+inline const float*
+AudioEngine::_VoiceFrames(Voice& voice, int64 position, int64& available)
+{
+	const Sample* sample = voice.sample;
+	int64 headFrames = sample->HeadFrames();
+	if (position < headFrames) {
+		available = headFrames - position;
+		return sample->Data() + position * kEngineChannels;
+	}
+
+	// past the head of a packed sample, from the voice's unpacked block
+	float* unpacked = fUnpacked[&voice - fVoices];
+	int64 block = (position - headFrames) / kPackedBlockFrames;
+	int64 start = headFrames + block * kPackedBlockFrames;
+	if (voice.block != block) {
+		bigtime_t time = system_time();
+		sample->UnpackBlock(block, unpacked);
+		voice.block = block;
+		fUnpackTime.fetch_add(system_time() - time, std::memory_order_relaxed);
+	}
+
+	int64 end = start + kPackedBlockFrames;
+	available = (end < sample->FrameCount() ? end : sample->FrameCount()) - position;
+	return unpacked + (position - start) * kEngineChannels;
+}
+
+
+float*
+AudioEngine::_BusOf(const Voice& voice, BusBuffer* buses)
+{
+	return voice.bus < fBusesRendered ? buses[voice.bus] : buses[0];
+}
+
+
+void
+AudioEngine::_RenderPlainVoices(int32 frameCount)
+{
+	if (fPlainCount == 0)
+		return;
+
+	bigtime_t start = system_time();
+	for (int32 i = 0; i < fPlainCount; i++) {
+		Voice& voice = fVoices[fPlain[i]];
+		_RenderVoice(voice, _BusOf(voice, fBuses), frameCount,
+			fMeteringBuffer ? &fPadPeaks[voice.pad] : NULL,
+			fMeteringBuffer ? &fPadSquares[voice.pad] : NULL);
+	}
+
+	// for the cost per voice of each path, and of one thread
+	bigtime_t time = system_time() - start;
+	fVoiceTime[0].fetch_add(time, std::memory_order_relaxed);
+	fVoiceCount[0].fetch_add(fPlainCount, std::memory_order_relaxed);
+	fThreadTime[0].fetch_add(time, std::memory_order_relaxed);
+	fThreadVoices[0].fetch_add(fPlainCount, std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::_RenderParallel(int32 frameCount)
+{
+	// The workers are woken first, they take a moment to get going. The
+	// buffer's generation tells them their sums from before are stale.
+	bigtime_t start = system_time();
+	fGeneration++;
+	fVoicesDone.store(0, std::memory_order_relaxed);
+	fNextVoice.store((uint64)fGeneration << 32 | (uint64)fPlainCount << 16,
+		std::memory_order_release);
+	release_sem_etc(fWorkSem, fWorkerCount, B_DO_NOT_RESCHEDULE);
+
+	bigtime_t processed = system_time();
+	_RenderProcessedVoices(frameCount);
+	processed = system_time() - processed;
+
+	uint32 generation;
+	int32 index;
+	while (_ClaimVoice(generation, index)) {
+		Voice& voice = fVoices[index];
+		_RenderVoice(voice, _BusOf(voice, fBuses), frameCount,
+			fMeteringBuffer ? &fPadPeaks[voice.pad] : NULL,
+			fMeteringBuffer ? &fPadSquares[voice.pad] : NULL);
+		fVoicesDone.fetch_add(1, std::memory_order_release);
+	}
+
+	// none are left to take, the workers are finishing their last one
+	_WaitForWorkers();
+
+	int32 threads = 1;
+	for (int32 i = 0; i < fWorkerCount; i++) {
+		Slice& slice = fSlices[i];
+		if (slice.generation != fGeneration)
+			continue;
+
+		threads++;
+		for (int32 bus = 0; bus < fBusesRendered; bus++)
+			mix(fBuses[bus], slice.buses[bus], frameCount * kEngineChannels, 1.0f);
+		if (fMeteringBuffer) {
+			for (int32 pad = 0; pad < kPadCount; pad++) {
+				if (slice.padPeaks[pad] > fPadPeaks[pad])
+					fPadPeaks[pad] = slice.padPeaks[pad];
+				fPadSquares[pad] += slice.padSquares[pad];
+			}
+		}
+	}
+
+	// the filtered voices were rendered in the meantime, not by the others
+	bigtime_t time = system_time() - start - processed;
+	fThreadTime[threads - 1].fetch_add(time > 0 ? time : 0, std::memory_order_relaxed);
+	fThreadVoices[threads - 1].fetch_add(fPlainCount, std::memory_order_relaxed);
+}
+
+
+bool
+AudioEngine::_ClaimVoice(uint32& generation, int32& index)
+{
+	// any thread; a thread that's still at an earlier buffer fails to
+	// swap, as the generation doesn't match anymore
+	uint64 next = fNextVoice.load(std::memory_order_acquire);
+	while (true) {
+		int32 voice = next & 0xffff;
+		int32 count = (next >> 16) & 0xffff;
+		if (voice >= count)
+			return false;
+		if (fNextVoice.compare_exchange_weak(next, next + 1, std::memory_order_acq_rel,
+				std::memory_order_acquire)) {
+			generation = next >> 32;
+			index = fPlain[voice];
+			return true;
+		}
+	}
+}
+
+
+void
+AudioEngine::_RenderProcessedVoices(int32 frameCount)
+{
+	if (fProcessedCount == 0)
+		return;
+
+	bigtime_t start = system_time();
+
+	// gather the voices into lanes, filled up with silent ones to whole
+	// vectors, so the lanes can be processed without any remainder
+	int32 laneCount = (fProcessedCount + kLaneWidth - 1) / kLaneWidth * kLaneWidth;
+	for (int32 lane = 0; lane < laneCount; lane++) {
+		if (lane >= fProcessedCount) {
+			fLanes.b0[lane] = fLanes.b1[lane] = fLanes.b2[lane] = 0.0f;
+			fLanes.a1[lane] = fLanes.a2[lane] = 0.0f;
+			fLanes.envelope[lane] = fLanes.multiply[lane] = fLanes.add[lane] = 0.0f;
+			for (int32 channel = 0; channel < kEngineChannels; channel++)
+				fLanes.z1[channel][lane] = fLanes.z2[channel][lane] = 0.0f;
+			continue;
+		}
+
+		const Voice& voice = fVoices[fProcessed[lane]];
+		const Biquad& filter = fKit->pads[voice.pad].filter;
+		fLanes.b0[lane] = filter.b0;
+		fLanes.b1[lane] = filter.b1;
+		fLanes.b2[lane] = filter.b2;
+		fLanes.a1[lane] = filter.a1;
+		fLanes.a2[lane] = filter.a2;
+		fLanes.envelope[lane] = voice.envelope;
+		fLanes.multiply[lane] = voice.envelopeMultiply;
+		fLanes.add[lane] = voice.envelopeAdd;
+		for (int32 channel = 0; channel < kEngineChannels; channel++) {
+			fLanes.z1[channel][lane] = voice.z1[channel];
+			fLanes.z2[channel][lane] = voice.z2[channel];
+		}
+	}
+
+	// the voices are measured after their filter, not while read
+	bool metering = fMeteringBuffer;
+
+	for (int32 offset = 0; offset < frameCount; offset += kProcessFrames) {
+		int32 count = frameCount - offset < kProcessFrames ? frameCount - offset : kProcessFrames;
+
+		// each voice's frames, turned into its lane; the lanes filling up the
+		// last vector have no gain, whatever their input
+		for (int32 lane = 0; lane < fProcessedCount; lane++) {
+			Voice& voice = fVoices[fProcessed[lane]];
+			memset(fVoiceBuffer, 0, sizeof(fVoiceBuffer));
+			if (voice.sample != NULL)
+				_RenderVoice(voice, fVoiceBuffer, count);
+			for (int32 frame = 0; frame < count; frame++) {
+				for (int32 channel = 0; channel < kEngineChannels; channel++) {
+					fLanes.input[channel][frame][lane]
+						= fVoiceBuffer[frame * kEngineChannels + channel];
+				}
+			}
+		}
+
+		process_lanes(fLanes, count, laneCount);
+
+		for (int32 lane = 0; lane < fProcessedCount; lane++) {
+			const Voice& voice = fVoices[fProcessed[lane]];
+			int32 pad = voice.pad;
+			float* target = _BusOf(voice, fBuses) + offset * kEngineChannels;
+			float peak = fPadPeaks[pad];
+			float squares = 0.0f;
+			for (int32 frame = 0; frame < count; frame++) {
+				for (int32 channel = 0; channel < kEngineChannels; channel++) {
+					float value = fLanes.input[channel][frame][lane];
+					target[frame * kEngineChannels + channel] += value;
+					if (metering) {
+						float magnitude = fabsf(value);
+						peak = magnitude > peak ? magnitude : peak;
+						squares += value * value;
+					}
+				}
+			}
+			if (metering) {
+				fPadPeaks[pad] = peak;
+				fPadSquares[pad] += squares;
+			}
+		}
+
+		// move on the envelopes that are through their stage
+		for (int32 lane = 0; lane < fProcessedCount; lane++) {
+			Voice& voice = fVoices[fProcessed[lane]];
+			voice.envelope = fLanes.envelope[lane];
+			if (voice.sample == NULL)
+				continue;
+
+			if (voice.stage == kEnvelopeAttack && voice.envelope >= 1.0f) {
+				_SetEnvelopeStage(voice, fKit->pads[voice.pad].decay > 0.0f
+					? kEnvelopeDecay : kEnvelopeHold);
+			} else if ((voice.stage == kEnvelopeDecay || voice.stage == kEnvelopeRelease)
+				&& voice.envelope < kSilentEnvelope)
+				_FreeVoice(voice);
+			fLanes.multiply[lane] = voice.envelopeMultiply;
+			fLanes.add[lane] = voice.envelopeAdd;
+		}
+	}
+
+	for (int32 lane = 0; lane < fProcessedCount; lane++) {
+		Voice& voice = fVoices[fProcessed[lane]];
+		for (int32 channel = 0; channel < kEngineChannels; channel++) {
+			float z1 = fLanes.z1[channel][lane];
+			float z2 = fLanes.z2[channel][lane];
+			voice.z1[channel] = fabsf(z1) < kDenormal ? 0.0f : z1;
+			voice.z2[channel] = fabsf(z2) < kDenormal ? 0.0f : z2;
+		}
+	}
+
+	fVoiceTime[1].fetch_add(system_time() - start, std::memory_order_relaxed);
+	fVoiceCount[1].fetch_add(fProcessedCount, std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::_PublishLevels(int32 frameCount, int32 busCount)
+{
+	// the master meter shows the loudest of the outputs, so it clips when
+	// any of them does
+	float masterPeak = 0.0f;
+	float masterSquares = 0.0f;
+	for (int32 bus = 0; bus < busCount; bus++) {
+		const float* buffer = fBuses[bus];
+		float squares = 0.0f;
+		for (int32 i = 0; i < frameCount * kEngineChannels; i++) {
+			float magnitude = fabsf(buffer[i]);
+			masterPeak = magnitude > masterPeak ? magnitude : masterPeak;
+			squares += buffer[i] * buffer[i];
+		}
+		masterSquares = squares > masterSquares ? squares : masterSquares;
+	}
+
+	// The RMS follows over a while, like a real meter; the peak is kept
+	// until the meter is read. The voices of one pad add up their energy.
+	float samples = frameCount * kEngineChannels;
+	float follow = 1.0f - expf(-frameCount / (kEngineFrameRate * kMeterIntegration));
+	for (int32 i = 0; i <= kPadCount; i++) {
+		float peak = i < kPadCount ? fPadPeaks[i] : masterPeak;
+		float squares = i < kPadCount ? fPadSquares[i] : masterSquares;
+
+		fMeanSquares[i] += (squares / samples - fMeanSquares[i]) * follow;
+		fMeters[i].meanSquare.store(fMeanSquares[i], std::memory_order_relaxed);
+		if (peak > fMeters[i].peak.load(std::memory_order_relaxed))
+			fMeters[i].peak.store(peak, std::memory_order_relaxed);
+	}
+}
+
+
+void
+AudioEngine::_PublishPlayheads()
+{
+	float playheads[kPadCount];
+	uint32 ages[kPadCount];
+	for (int32 i = 0; i < kPadCount; i++)
+		playheads[i] = -1.0f;
+
+	for (int32 i = 0; i < kMaxVoices; i++) {
+		const Voice& voice = fVoices[i];
+		if (voice.sample == NULL || voice.delay > 0)
+			continue;
+
+		// the newest voice, it's the one just heard
+		if (playheads[voice.pad] < 0.0f || voice.age > ages[voice.pad]) {
+			playheads[voice.pad] = (float)voice.position / voice.sample->FrameCount();
+			ages[voice.pad] = voice.age;
+		}
+	}
+
+	for (int32 i = 0; i < kPadCount; i++)
+		fPlayheads[i].store(playheads[i], std::memory_order_relaxed);
+}
+
+
+void
+AudioEngine::_ReleaseLater(Sample* sample)
+{
+	if (sample == NULL)
+		return;
+
+	// If the queue is ever full, the reference is leaked rather than
+	// risking to free the sample on the audio thread.
+	if (fReleased.Push(sample) && fJanitorSem >= 0)
+		release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+}
+
+
+void
+AudioEngine::_ReleaseLater(Kit* kit)
+{
+	if (kit == NULL)
+		return;
+
+	if (fReleasedKits.Push(kit) && fJanitorSem >= 0)
+		release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+}
+
+
+void
+AudioEngine::_ReleaseLater(Pattern* pattern)
+{
+	if (pattern == NULL)
+		return;
+
+	if (fReleasedPatterns.Push(pattern) && fJanitorSem >= 0)
+		release_sem_etc(fJanitorSem, 1, B_DO_NOT_RESCHEDULE);
+}
+
+
+void
+AudioEngine::_RaiseAudioThreadPriority()
+{
+	fPriorityRequested = true;
+	status_t status = set_thread_priority(find_thread(NULL), B_REAL_TIME_PRIORITY);
+	fPriorityStatus = status < B_OK ? status : B_OK;
+}
+
+
+// #pragma mark - render workers
+
+
+void
+AudioEngine::_StartWorkers()
+{
+	// one thread per CPU at most, the audio thread is one of them
+	int32 threads = fRenderThreads;
+	if (threads <= 0) {
+		system_info info;
+		threads = get_system_info(&info) == B_OK ? info.cpu_count : 1;
+	}
+	if (threads > kMaxRenderThreads)
+		threads = kMaxRenderThreads;
+
+	fWorkerCount = 0;
+	if (threads < 2)
+		return;
+	fWorkSem = create_sem(0, "samedi render work");
+	fWorkDoneSem = create_sem(0, "samedi render work done");
+	if (fWorkSem < 0 || fWorkDoneSem < 0)
+		return;
+
+	for (int32 i = 0; i < threads - 1; i++) {
+		Worker& worker = fWorkers[fWorkerCount];
+		worker.engine = this;
+		worker.index = fWorkerCount;
+		worker.thread = spawn_thread(_WorkerThread, "samedi render worker",
+			B_REAL_TIME_PRIORITY, &worker);
+		if (worker.thread < 0)
+			break;
+		resume_thread(worker.thread);
+		fWorkerCount++;
+	}
+}
+
+
+void
+AudioEngine::_WaitForWorkers()
+{
+	// Usually that's a few microseconds, too short to sleep on a semaphore.
+	// But a worker can be preempted, e.g. by another real-time thread on its
+	// CPU, so after a while the audio thread gives up its CPU to it.
+	for (int32 i = 0; i < kWorkerSpins; i++) {
+		if (fVoicesDone.load(std::memory_order_acquire) >= fPlainCount)
+			return;
+		cpu_pause();
+	}
+
+	while (true) {
+		fWaitingForWorkers.store(true, std::memory_order_seq_cst);
+		if (fVoicesDone.load(std::memory_order_seq_cst) >= fPlainCount) {
+			// unless a worker saw the flag already and releases the semaphore
+			if (!fWaitingForWorkers.exchange(false, std::memory_order_seq_cst))
+				acquire_sem(fWorkDoneSem);
+			return;
+		}
+		if (acquire_sem(fWorkDoneSem) != B_OK)
+			return;
+	}
+}
+
+
+void
+AudioEngine::_StopWorkers()
+{
+	// after the audio thread, so no buffer waits for them anymore
+	fQuitting = true;
+	if (fWorkSem >= 0)
+		release_sem_etc(fWorkSem, fWorkerCount, 0);
+	for (int32 i = 0; i < fWorkerCount; i++) {
+		status_t result;
+		wait_for_thread(fWorkers[i].thread, &result);
+	}
+	fWorkerCount = 0;
+
+	if (fWorkSem >= 0) {
+		delete_sem(fWorkSem);
+		fWorkSem = -1;
+	}
+	if (fWorkDoneSem >= 0) {
+		delete_sem(fWorkDoneSem);
+		fWorkDoneSem = -1;
+	}
+}
+
+
+/*static*/ status_t
+AudioEngine::_WorkerThread(void* data)
+{
+	Worker* worker = (Worker*)data;
+	worker->engine->_Work(worker->index);
+	return B_OK;
+}
+
+
+void
+AudioEngine::_Work(int32 index)
+{
+	Slice& slice = fSlices[index];
+	while (acquire_sem(fWorkSem) == B_OK && !fQuitting) {
+		uint32 generation;
+		int32 voiceIndex;
+		while (_ClaimVoice(generation, voiceIndex)) {
+			// the sums start over with the first voice of a buffer
+			int32 frameCount = fBufferFrames;
+			if (slice.generation != generation) {
+				for (int32 bus = 0; bus < fBusesRendered; bus++)
+					memset(slice.buses[bus], 0, frameCount * kEngineChannels * sizeof(float));
+				memset(slice.padPeaks, 0, sizeof(slice.padPeaks));
+				memset(slice.padSquares, 0, sizeof(slice.padSquares));
+				slice.generation = generation;
+			}
+
+			Voice& voice = fVoices[voiceIndex];
+			_RenderVoice(voice, _BusOf(voice, slice.buses), frameCount,
+				fMeteringBuffer ? &slice.padPeaks[voice.pad] : NULL,
+				fMeteringBuffer ? &slice.padSquares[voice.pad] : NULL);
+			fVoicesDone.fetch_add(1, std::memory_order_seq_cst);
+
+			// only one worker wakes the audio thread
+			if (fWaitingForWorkers.load(std::memory_order_seq_cst)
+				&& fWaitingForWorkers.exchange(false, std::memory_order_seq_cst))
+				release_sem_etc(fWorkDoneSem, 1, B_DO_NOT_RESCHEDULE);
+		}
+	}
+}
+
+
+// #pragma mark - janitor thread
+
+
+/*static*/ status_t
+AudioEngine::_JanitorThread(void* data)
+{
+	((AudioEngine*)data)->_Janitor();
+	return B_OK;
+}
+
+
+void
+AudioEngine::_Janitor()
+{
+	while (!fQuitting) {
+		acquire_sem_etc(fJanitorSem, 1, B_RELATIVE_TIMEOUT, kJanitorInterval);
+		_CollectGarbage();
+		_ReportStatus();
+		_ServeGuests();
+	}
+}
+
+
+void
+AudioEngine::_CollectGarbage()
+{
+	Sample* sample;
+	while (fReleased.Pop(sample))
+		sample->ReleaseReference();
+
+	Kit* kit;
+	while (fReleasedKits.Pop(kit))
+		_DeleteKit(kit);
+
+	Pattern* pattern;
+	while (fReleasedPatterns.Pop(pattern))
+		delete pattern;
+}
+
+
+void
+AudioEngine::_DiscardCommands()
+{
+	// only while there's no audio thread to take them
+	Command command;
+	while (fCommands.Pop(command)) {
+		if (command.sample != NULL)
+			command.sample->ReleaseReference();
+		if (command.kit != NULL)
+			_DeleteKit(command.kit);
+		delete command.pattern;
+		// one that's removed is still among the guests
+		if (command.what == kAddGuest)
+			delete command.guest;
+	}
+
+	MidiEvent event;
+	while (fMidiEvents.Pop(event))
+		;
+}
+
+
+void
+AudioEngine::_DeleteKit(Kit* kit)
+{
+	for (int32 i = 0; i < kPadCount; i++) {
+		if (kit->pads[i].sample != NULL)
+			kit->pads[i].sample->ReleaseReference();
+	}
+	if (kit->locked)
+		fMemoryLocker.Unlock(kit, sizeof(Kit));
+
+	delete kit;
+}
+
+
+AudioEngine::Kit*
+AudioEngine::_PrepareKit(Kit* kit)
+{
+	status_t pinStatus = B_OK;
+	for (int32 i = 0; i < kPadCount; i++) {
+		ComputeFilter(kit->pads[i]);
+
+		Sample* sample = kit->pads[i].sample;
+		if (sample == NULL)
+			continue;
+
+		status_t status = PinSample(sample);
+		if (status != B_OK)
+			pinStatus = status;
+		sample->AcquireReference();
+	}
+	if (pinStatus != B_OK)
+		_PostPinStatus(pinStatus);
+
+	if (!kit->locked && fMemoryLocker.Lock(kit, sizeof(Kit)) == B_OK)
+		kit->locked = true;
+
+	return kit;
+}
+
+
+// #pragma mark -
+
+
+bool
+AudioEngine::_PushCommand(uint32 what, int32 pad, int32 value, float gain,
+	Sample* sample)
+{
+	if (fRemoteMode) {
+		BMessage message(ENGINE_COMMAND);
+		message.AddInt32("command", what);
+		message.AddInt32("pad", pad);
+		message.AddInt32("value", value);
+		message.AddFloat("gain", gain);
+		if (sample != NULL) {
+			// the host uses its own, from its cache
+			message.AddString("path", sample->Path());
+			sample->ReleaseReference();
+		}
+		_SendToHost(message);
+
+		if (what == kSetNote && pad >= 0 && pad < kPadCount)
+			fKit->pads[pad].note = value;
+		return true;
+	}
+
+	Command command = { what, pad, value, gain, sample, NULL, 0, NULL, NULL };
+	return fCommands.Push(command);
+}
+
+
+void
+AudioEngine::_LockWorkingMemory()
+{
+	if (fWorkingMemoryLocked)
+		return;
+
+	// voices, kits and queues are all the audio thread touches besides the
+	// samples themselves
+	const struct {
+		const void*	address;
+		size_t		size;
+	} regions[] = {
+		{ this, sizeof(*this) },
+		{ fCommands.Buffer(), fCommands.BufferSize() },
+		{ fMidiEvents.Buffer(), fMidiEvents.BufferSize() },
+		{ fReleased.Buffer(), fReleased.BufferSize() },
+		{ fReleasedKits.Buffer(), fReleasedKits.BufferSize() },
+		{ fReleasedPatterns.Buffer(), fReleasedPatterns.BufferSize() },
+		{ fKitSwaps.Buffer(), fKitSwaps.BufferSize() },
+		{ fReleasedGuests.Buffer(), fReleasedGuests.BufferSize() }
+	};
+	const int32 regionCount = sizeof(regions) / sizeof(regions[0]);
+
+	status_t status = B_OK;
+	int32 locked = 0;
+	while (locked < regionCount) {
+		status = fMemoryLocker.Lock(regions[locked].address, regions[locked].size);
+		if (status != B_OK)
+			break;
+		locked++;
+	}
+	if (status != B_OK) {
+		while (locked-- > 0)
+			fMemoryLocker.Unlock(regions[locked].address, regions[locked].size);
+	}
+
+	if (status == B_OK)
+		fWorkingMemoryLocked = true;
+	else {
+		BString text(B_TRANSLATE("⚠ Could not lock the audio engine into memory: "
+			"%error%"));
+		text.ReplaceFirst("%error%", strerror(status));
+		_PostStatus(text, true);
+	}
+}
+
+
+void
+AudioEngine::_ReportStatus()
+{
+	KitSwap swap;
+	while (fKitSwaps.Pop(swap)) {
+		BMessage message(swap.found ? KIT_SWAPPED : PROGRAM_NOT_RESIDENT);
+		message.AddInt32("program", swap.program);
+		message.AddInt64("requested", swap.requested);
+		message.AddInt64("time", swap.swapped);
+		fTarget.SendMessage(&message);
+	}
+
+	if (fPriorityReported || fPriorityStatus == B_NO_INIT)
+		return;
+
+	fPriorityReported = true;
+	status_t status = fPriorityStatus;
+	if (status != B_OK) {
+		BString text(B_TRANSLATE("⚠ Could not raise the audio thread to real-time "
+			"priority: %error%"));
+		text.ReplaceFirst("%error%", strerror(status));
+		_PostStatus(text, true);
+	}
+}
+
+
+void
+AudioEngine::_PostPinStatus(status_t status)
+{
+	BString text;
+	if (status == B_NO_MEMORY) {
+		text = B_TRANSLATE("⚠ Sample not locked into memory, the limit of "
+			"%limit% MiB is reached. The first hit may be delayed.");
+		BString limit;
+		limit << (uint64)(fSampleLocker->Limit() / (1024 * 1024));
+		text.ReplaceFirst("%limit%", limit);
+	} else if (status != B_OK) {
+		text = B_TRANSLATE("⚠ Sample not locked into memory: %error%. "
+			"The first hit may be delayed.");
+		text.ReplaceFirst("%error%", strerror(status));
+	} else {
+		text = B_TRANSLATE("%size% MiB locked into memory");
+		BString size;
+		size.SetToFormat("%.1f", fSampleLocker->LockedSize() / (1024.0 * 1024.0));
+		text.ReplaceFirst("%size%", size);
+	}
+	_PostStatus(text, status != B_OK);
+}
+
+
+void
+AudioEngine::_PostStatus(const char* text, bool warning)
+{
+	BMessage message(ENGINE_STATUS);
+	message.AddString("text", text);
+	message.AddBool("warning", warning);
+	fTarget.SendMessage(&message);
+}
+
+
+// #pragma mark - shared engine
+
+
+void
+AudioEngine::_ServeGuests()
+{
+	// the guests have no janitor of their own
+	for (int32 i = 0; i < kMaxGuests; i++) {
+		AudioEngine* guest = fGuests[i].load(std::memory_order_acquire);
+		if (guest == NULL)
+			continue;
+		guest->_CollectGarbage();
+		guest->_ReportStatus();
+	}
+
+	AudioEngine* guest;
+	while (fReleasedGuests.Pop(guest))
+		delete guest;
+}
+
+
+bool
+AudioEngine::_SendMidiToHost(uint8 status, uint8 data1, uint8 data2, bigtime_t time)
+{
+	GuestMidiEvent event = { fGuestId, time, status, data1, data2 };
+	uint8 buffer[kGuestMidiEventSize];
+	encode_guest_midi_event(event, buffer);
+
+	// never waits, a busy host drops the event rather than holding up MIDI
+	status_t result = write_port_etc(fRemotePort, kGuestMidiCode, buffer,
+		sizeof(buffer), B_RELATIVE_TIMEOUT, 0);
+	if (result == B_BAD_PORT_ID)
+		_HostLost();
+	return result == B_OK;
+}
+
+
+void
+AudioEngine::_HostLost()
+{
+	// any thread, the window lets this engine play from then on
+	if (fRemoteLost.exchange(true))
+		return;
+
+	BMessage message(ENGINE_HOST_LOST);
+	fTarget.SendMessage(&message);
+}
+
+
+void
+AudioEngine::_SendToHost(BMessage& message)
+{
+	// what doesn't reach the host is sent to this engine again
+	if (fRemoteLost)
+		return;
+	if (fRemote.SendMessage(&message, (BHandler*)NULL, kRemoteTimeout) != B_OK
+		&& !fRemote.IsValid())
+		_HostLost();
+}
+
+
+/*static*/ void
+AudioEngine::_ArchiveKit(const Kit& kit, BMessage& archive)
+{
+	for (int32 i = 0; i < kPadCount; i++) {
+		const PadSettings& settings = kit.pads[i];
+		BMessage pad;
+		if (settings.sample != NULL)
+			pad.AddString("path", settings.sample->Path());
+		pad.AddInt32("note", settings.note);
+		pad.AddBool("muted", settings.muted);
+		pad.AddBool("looping", settings.looping);
+		pad.AddBool("gate", settings.gate);
+		pad.AddFloat("gain", settings.gain);
+		pad.AddInt32("controller", settings.gainController);
+		pad.AddInt32("choke group", settings.chokeGroup);
+		pad.AddInt32("bus", settings.bus);
+		pad.AddInt32("filter", settings.filterType);
+		pad.AddFloat("cutoff", settings.cutoff);
+		pad.AddFloat("resonance", settings.resonance);
+		pad.AddFloat("attack", settings.attack);
+		pad.AddFloat("decay", settings.decay);
+		pad.AddFloat("release", settings.release);
+		pad.AddInt64("trim start", settings.trimStart);
+		pad.AddInt64("trim end", settings.trimEnd);
+		archive.AddMessage("pad", &pad);
+	}
+}
+
+
+/*static*/ AudioEngine::Kit*
+AudioEngine::_UnarchiveKit(const BMessage& archive, SampleCache* cache, Sample** samples)
+{
+	Kit* kit = new Kit;
+	BMessage pad;
+	for (int32 i = 0; i < kPadCount
+			&& archive.FindMessage("pad", i, &pad) == B_OK; i++) {
+		PadSettings& settings = kit->pads[i];
+		const char* path;
+		if (pad.FindString("path", &path) == B_OK) {
+			samples[i] = cache->Get(path);
+			settings.sample = samples[i];
+		}
+		settings.note = pad.GetInt32("note", settings.note);
+		settings.muted = pad.GetBool("muted", settings.muted);
+		settings.looping = pad.GetBool("looping", settings.looping);
+		settings.gate = pad.GetBool("gate", settings.gate);
+		settings.gain = pad.GetFloat("gain", settings.gain);
+		settings.gainController = pad.GetInt32("controller", settings.gainController);
+		settings.chokeGroup = pad.GetInt32("choke group", settings.chokeGroup);
+		settings.bus = pad.GetInt32("bus", settings.bus);
+		settings.filterType = pad.GetInt32("filter", settings.filterType);
+		settings.cutoff = pad.GetFloat("cutoff", settings.cutoff);
+		settings.resonance = pad.GetFloat("resonance", settings.resonance);
+		settings.attack = pad.GetFloat("attack", settings.attack);
+		settings.decay = pad.GetFloat("decay", settings.decay);
+		settings.release = pad.GetFloat("release", settings.release);
+		settings.trimStart = pad.GetInt64("trim start", settings.trimStart);
+		settings.trimEnd = pad.GetInt64("trim end", settings.trimEnd);
+	}
+	return kit;
+}
+
+
+/*static*/ void
+AudioEngine::_ArchivePattern(const Pattern& pattern, BMessage& archive)
+{
+	archive.AddData("steps", B_RAW_TYPE, pattern.steps, sizeof(pattern.steps));
+	archive.AddFloat("tempo", pattern.tempo);
+	archive.AddFloat("swing", pattern.swing);
+	archive.AddBool("sync", pattern.syncToClock);
+}
+
+
+/*static*/ AudioEngine::Pattern*
+AudioEngine::_UnarchivePattern(const BMessage& archive)
+{
+	Pattern* pattern = new Pattern;
+	const void* steps;
+	ssize_t size;
+	if (archive.FindData("steps", B_RAW_TYPE, &steps, &size) == B_OK
+		&& size == sizeof(pattern->steps))
+		memcpy(pattern->steps, steps, size);
+	pattern->tempo = archive.GetFloat("tempo", pattern->tempo);
+	pattern->swing = archive.GetFloat("swing", pattern->swing);
+	pattern->syncToClock = archive.GetBool("sync", pattern->syncToClock);
+	return pattern;
+}
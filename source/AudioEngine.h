@@ -0,0 +1,546 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef AUDIO_ENGINE_H
+#define AUDIO_ENGINE_H
+
+#include "Constants.h"
+#include "LockFreeQueue.h"
+#include "MemoryLocker.h"
+#include "VoiceLanes.h"
+
+#include <MediaDefs.h>
+#include <Messenger.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <vector>
+
+class BMessage;
+class BSoundPlayer;
+class Recorder;
+class Sample;
+class SampleCache;
+
+static const int kMaxVoices = kMaxLanes;	// a lane for each
+static const int kMaxResidentKits = 256;
+static const int kMidiBatchSize = 256;
+static const int kStepCount = 16;
+static const int kMasterMeter = -1;
+static const int kProcessFrames = kLaneFrames;
+static const int kBufferFrames = 256;
+static const int kMaxRenderThreads = 4;	// the audio thread and its workers
+static const int kParallelVoices = 16;	// below, one thread is faster
+static const int kMaxGuests = 8;
+static const size_t kDefaultMemoryLockLimit = 512 * 1024 * 1024;
+
+
+// Plays the pads' samples. All pad state the audio thread needs is changed
+// through a command queue that is drained at the start of every buffer, so
+// the audio thread never waits for a lock. Samples are released on a
+// low-priority janitor thread, never on the audio thread.
+//
+// The pad state lives in a kit, which can be replaced as a whole in a single
+// pointer swap. Voices keep their sample and gain, so they ring out over a
+// kit switch. Resident kits stay with the engine, so a program change can
+// select one of them right on the audio thread.
+//
+// MIDI events and keyboard hits go to their own queue and are handled in one
+// batch after the commands, so a burst of controller data can't crowd out
+// the pads. The batch is put in timestamp order first, that merges several
+// MIDI sources into one stream.
+//
+// The step sequencer runs on the audio thread, too. Its steps start their
+// voices at the exact frame within the buffer, following either its own
+// tempo or the MIDI clock.
+//
+// A recorder, if set, gets every played note and controller change right
+// as the audio thread handles it.
+//
+// While metering is on, the peak and RMS levels of every pad and of the
+// mix are taken in the same loop that sums the voices into the buffer.
+// With metering off, that loop is the plain sum.
+//
+// Voices of pads with a filter or an envelope are processed together: their
+// state is gathered into arrays with one lane per voice, so each step of
+// the filter runs on several voices at once in a vector register.
+// The filter coefficients only change with the pad's settings. Likewise, the
+// playhead of every pad is only published while someone follows it.
+//
+// Every pad plays on one of the output buses. The engine's media node has a
+// channel pair for each bus that is connected, and renders only those; a
+// pad on a bus that isn't connected plays on the main bus instead. Each
+// bus is summed into a buffer of its own in the one pass over the voices.
+//
+// With many voices, the plain ones are shared out among a few worker
+// threads: each takes the next voice that's left until none are, and sums
+// into buffers of its own that are added up at the end. Meanwhile the audio
+// thread processes the filtered voices, then helps with the plain ones.
+//
+// Several Samedis share the engine of the one started first. The engines
+// of the others send their commands to it instead of playing themselves,
+// see EngineHost. There each is a guest engine that is rendered right
+// after the host's voices and mixed into its buses. Its MIDI comes from the
+// guest, through the filters of that Samedi's own sources, and its meters
+// and playheads are sent back. When the host is gone, the guest's engine
+// starts and plays on its own.
+
+class AudioEngine {
+public:
+	struct Biquad {
+		float		b0;
+		float		b1;
+		float		b2;
+		float		a1;
+		float		a2;
+	};
+
+	struct PadSettings {
+		Sample*		sample;
+		int32		note;
+		bool		muted;
+		bool		looping;
+		bool		gate;
+		float		gain;
+		int32		gainController;
+		int32		chokeGroup;
+		int32		bus;
+
+		int32		filterType;
+		float		cutoff;		// Hz
+		float		resonance;	// Q
+		float		attack;		// seconds, 0 for none
+		float		decay;		// seconds to silence, 0 to hold
+		float		release;	// seconds after stopping, 0 to cut
+		int64		trimStart;	// frames played when not looping, an end
+		int64		trimEnd;	// of 0 for all of them
+
+		Biquad		filter;		// set by the engine
+
+		bool		IsProcessed() const;
+	};
+
+	struct Kit {
+					Kit();
+
+		PadSettings	pads[kPadCount];
+		bool		locked;		// set by the engine
+		bool		resident;	// set by the audio thread
+	};
+
+	struct Pattern {
+					Pattern();
+
+		uint8		steps[kPadCount][kStepCount];	// velocity, 0 is off
+		float		tempo;		// BPM, a step is a 16th note
+		float		swing;		// 0.5 is straight, up to 0.75
+		bool		syncToClock;
+	};
+
+					AudioEngine(BMessenger target);
+					~AudioEngine();
+
+	status_t		Start();
+	void			Stop();
+
+	// asks another Samedi to play for this one, waits up to a second
+	static status_t	RequestHost(const BMessenger& host, const BMessenger& target,
+						BMessage& reply);
+	// instead of Start(), with that reply: the host plays from then on, the
+	// window sends it what it had set before
+	status_t		AttachToHost(const BMessage& reply);
+	bool			IsRemote() const { return fRemoteMode.load(std::memory_order_relaxed); };
+	bool			IsPlaying() const { return fPlayer != NULL; };
+	// once the host is gone, the window sends everything again
+	status_t		PlayLocally();
+	// on the host, the guest is deleted by the engine after removal
+	status_t		AddGuest(AudioEngine* guest);
+	status_t		RemoveGuest(AudioEngine* guest);
+	// on a guest, what the remote engine sent
+	void			ApplyRemote(const BMessage* message, SampleCache* cache);
+	// the meters and playheads a guest follows, for the remote engine
+	void			ArchiveLevels(BMessage& message);
+	void			ApplyRemoteLevels(const BMessage* message);
+	// the connected buses, restarts the media node when it's running
+	status_t		SetOutputBuses(int32 count);
+	int32			OutputBuses() const { return fOutputBuses; };
+	// 0 for one per CPU, restarts the media node when it's running
+	status_t		SetRenderThreads(int32 count);
+	int32			RenderThreads() const { return fRenderThreads; };
+
+	void			SetSample(int32 pad, Sample* sample);
+	// like SetSample(), for a new version of the same sample: the voices
+	// playing the old one play it to its end
+	void			ReplaceSample(int32 pad, Sample* sample);
+	void			SetMuted(int32 pad, bool muted);
+	void			SetLooping(int32 pad, bool looping);
+	void			SetGain(int32 pad, float gain);
+	void			SetChokeGroup(int32 pad, int32 group);
+	void			SetNote(int32 pad, int32 note);
+	void			SetGate(int32 pad, bool gate);
+	void			SetGainController(int32 pad, int32 controller);
+	void			SetFilter(int32 pad, int32 type, float cutoff, float resonance);
+	void			SetEnvelope(int32 pad, float attack, float decay, float release);
+	void			SetBus(int32 pad, int32 bus);
+	void			SetTrim(int32 pad, int64 start, int64 end);
+	void			Trigger(int32 pad);
+	void			StopPad(int32 pad);
+
+	// take ownership of the kit, the engine adds its own sample references
+	void			SwapKit(Kit* kit, bigtime_t requested);
+	void			SetResidentKit(int32 program, Kit* kit);
+	void			ClearResidentKits();
+
+	// any thread, e.g. MIDI
+	void			SelectProgram(int32 program, bigtime_t requested);
+	bool			WantsMidiClock() const { return fWantsMidiClock.load(std::memory_order_relaxed); };
+	bool			HandleMidi(uint8 status, uint8 data1, uint8 data2,
+						bigtime_t time);
+	// the keyboard and the mouse have no velocity, they hit at full
+	bool			HitPad(int32 pad, bool down, bigtime_t time,
+						uint8 velocity = 127);
+	void			GetMidiStats(uint64& events, bigtime_t& time) const;
+
+	// take ownership of the pattern
+	void			SetPattern(Pattern* pattern);
+	void			StartSequencer();
+	void			StopSequencer();
+	bool			IsSequencerRunning() const { return fSequencerRunning.load(std::memory_order_relaxed); };
+	static double	StepLength(const Pattern& pattern, int32 step);
+	static void		ComputeFilter(PadSettings& pad);
+
+	// any thread, the peak is the highest since the last call
+	void			SetMetering(bool metering);
+	bool			IsMetering() const { return fMetering.load(std::memory_order_relaxed); };
+	void			GetLevels(int32 pad, float& peak, float& rms);
+	void			GetRenderTimes(bigtime_t& plain, bigtime_t& metered) const;
+	// per voice and buffer, in nanoseconds
+	void			GetVoiceTimes(bigtime_t& plain, bigtime_t& processed) const;
+	// of packed samples, per buffer in microseconds
+	bigtime_t		UnpackTime() const;
+	// of the plain voices, by how many threads took part, 0 if never
+	float			VoicesPerMillisecond(int32 threads) const;
+	// the same for plain voices of noise, rendered offline by that many
+	// threads, for "--render-threads"
+	static float	MeasureRenderThreads(int32 threads, int32 voiceCount);
+	void			SetTrackingPlayheads(bool tracking);
+	bool			IsTrackingPlayheads() const { return fTrackingPlayheads.load(std::memory_order_relaxed); };
+	// of the pad's latest voice, as a fraction of the sample, or -1
+	float			PlayheadOf(int32 pad) const;
+
+	// before Start(), the recorder has to outlive the engine
+	void			SetRecorder(Recorder* recorder);
+
+	status_t		PinSample(Sample* sample);
+	void			SetMemoryLockLimit(size_t limit);
+	size_t			MemoryLockLimit() const { return fMemoryLocker.Limit(); };
+
+	// audio thread only, the buffer has a channel pair for each bus
+	void			Render(float* buffer, int32 frameCount, int32 busCount = 1);
+
+	// instead of Start(), one stereo buffer for each bus; the frames the
+	// steps were played at are added to stepFrames
+	void			RenderOffline(float* const* buses, int32 busCount,
+						int32 frameCount, std::vector<int64>* stepFrames = NULL);
+
+private:
+	enum {
+		kSetSample,
+		kReplaceSample,
+		kSetMuted,
+		kSetLooping,
+		kSetGain,
+		kSetChokeGroup,
+		kSetNote,
+		kSetGate,
+		kSetGainController,
+		kSetFilterType,
+		kSetCutoff,
+		kSetResonance,
+		kSetAttack,
+		kSetDecay,
+		kSetRelease,
+		kSetBus,
+		kSetTrimStart,
+		kSetTrimEnd,
+		kTrigger,
+		kStop,
+		kSwapKit,
+		kSetResidentKit,
+		kClearResidentKits,
+		kSelectProgram,
+		kSetPattern,
+		kStartSequencer,
+		kStopSequencer,
+		kAddGuest,
+		kRemoveGuest,
+		kSetMetering,	// remote only
+		kTrackPlayheads
+	};
+
+	struct Command {
+		uint32		what;
+		int32		pad;
+		int32		value;
+		float		gain;
+		Sample*		sample;
+		Kit*		kit;
+		bigtime_t	time;
+		Pattern*	pattern;
+		AudioEngine*	guest;
+	};
+
+	// pad hits from the computer keyboard share the MIDI event queue with
+	// a status below 0x80, which MIDI never uses
+	enum {
+		kPadDown = 0x01,
+		kPadUp = 0x02
+	};
+
+	struct MidiEvent {
+		bigtime_t	time;
+		uint8		status;
+		uint8		data1;
+		uint8		data2;
+	};
+
+	struct KitSwap {
+		int32		program;
+		bool		found;
+		bigtime_t	requested;
+		bigtime_t	swapped;
+	};
+
+	enum {
+		kEnvelopeAttack,
+		kEnvelopeHold,
+		kEnvelopeDecay,
+		kEnvelopeRelease
+	};
+
+	typedef float	BusBuffer[kBufferFrames * kEngineChannels];
+
+	// what a worker sums, added to the buses at the end of the buffer
+	struct Slice {
+		alignas(64) BusBuffer	buses[kBusCount];
+		float		padPeaks[kPadCount];
+		float		padSquares[kPadCount];
+		uint32		generation;	// of the buffer it was cleared for
+	};
+
+	struct Worker {
+		AudioEngine*	engine;
+		int32		index;
+		thread_id	thread;
+	};
+
+	struct Meter {
+		std::atomic<float>	peak;
+		std::atomic<float>	meanSquare;
+	};
+
+	struct Voice {
+		Sample*		sample;
+		int64		position;
+		int64		end;		// of the trimmed frames, unless looping
+		float		fraction;	// towards the next frame, when bent
+		int32		pad;
+		int32		bus;
+		bool		looping;
+		int32		delay;		// frames until it starts
+		float		gain;
+		float		velocity;
+		float		damping;	// by aftertouch
+		int32		controller;	// the gain follows, if set
+		float		level;		// as played, follows the others smoothly
+		uint32		age;
+		int64		block;		// of a packed sample, unpacked; -1 if none
+
+		int32		stage;		// of the envelope
+		float		envelope;
+		float		envelopeMultiply;	// per frame, for decays
+		float		envelopeAdd;		// per frame, for the attack
+		float		z1[kEngineChannels];	// filter state
+		float		z2[kEngineChannels];
+	};
+
+	static void		_PlayBuffer(void* cookie, void* buffer, size_t size,
+						const media_raw_audio_format& format);
+	static status_t	_JanitorThread(void* data);
+	static status_t	_WorkerThread(void* data);
+	void			_Work(int32 index);
+	void			_StartWorkers();
+	void			_StopWorkers();
+	void			_Janitor();
+	void			_CollectGarbage();
+	void			_DiscardCommands();
+	void			_ServeGuests();
+	bool			_SendMidiToHost(uint8 status, uint8 data1, uint8 data2,
+						bigtime_t time);
+	void			_HostLost();
+
+	bool			_PushCommand(uint32 what, int32 pad, int32 value = 0,
+						float gain = 0.0f, Sample* sample = NULL);
+	void			_SendToHost(BMessage& message);
+	static void		_ArchiveKit(const Kit& kit, BMessage& archive);
+	static Kit*		_UnarchiveKit(const BMessage& archive, SampleCache* cache,
+						Sample** samples);
+	static void		_ArchivePattern(const Pattern& pattern, BMessage& archive);
+	static Pattern*	_UnarchivePattern(const BMessage& archive);
+	void			_ProcessCommands();
+	void			_ProcessMidiEvents();
+	void			_HandleMidiEvent(const MidiEvent& event);
+	void			_RecordPadHit(int32 pad, bool down, uint8 velocity,
+						bigtime_t time);
+	void			_SwapKit(Kit* kit, int32 program, bigtime_t requested);
+	void			_SetResidentKit(int32 program, Kit* kit);
+	void			_HandleMidiClock(const MidiEvent& event);
+	double			_FrameOf(bigtime_t time) const;
+	void			_RunSequencer(int32 frameCount);
+	void			_PlayStep(int32 step, int32 offset);
+	void			_StartVoice(int32 pad, int32 offset = 0,
+						float velocity = 1.0f);
+	void			_StopVoices(int32 pad);
+	void			_SetEnvelopeStage(Voice& voice, int32 stage);
+	void			_RenderBuses(int32 frameCount, int32 busCount);
+	float*			_BusOf(const Voice& voice, BusBuffer* buses);
+	void			_RenderPlainVoices(int32 frameCount);
+	void			_RenderParallel(int32 frameCount);
+	void			_WaitForWorkers();
+	bool			_ClaimVoice(uint32& generation, int32& index);
+	void			_RenderProcessedVoices(int32 frameCount);
+	void			_DampVoices(int32 note, int32 pressure);
+	void			_FreeVoice(Voice& voice);
+	float			_VoiceLevel(const Voice& voice) const;
+	// metered if peak and squares are set
+	void			_RenderVoice(Voice& voice, float* buffer, int32 frameCount,
+						float* peak = NULL, float* squares = NULL);
+	void			_RenderBentVoice(Voice& voice, float* buffer, int32 frameCount,
+						float* peak, float* squares);
+	inline const float*	_VoiceFrames(Voice& voice, int64 position,
+						int64& available);
+	void			_PublishLevels(int32 frameCount, int32 busCount);
+	void			_PublishPlayheads();
+	void			_ReleaseLater(Sample* sample);
+	void			_ReleaseLater(Kit* kit);
+	void			_ReleaseLater(Pattern* pattern);
+	void			_DeleteKit(Kit* kit);
+	Kit*			_PrepareKit(Kit* kit);
+	void			_PostPinStatus(status_t status);
+
+	void			_RaiseAudioThreadPriority();
+	void			_LockWorkingMemory();
+	void			_ReportStatus();
+	void			_PostStatus(const char* text, bool warning);
+
+	Kit*			fKit;
+	Kit*			fResidentKits[kMaxResidentKits];
+	Voice			fVoices[kMaxVoices];
+	// a block of a packed sample, and the frame after it, for each voice
+	float			fUnpacked[kMaxVoices][(kPackedBlockFrames + 1) * kEngineChannels];
+	std::atomic<bigtime_t>	fUnpackTime;
+	BusBuffer		fBuses[kBusCount];
+	int32			fBusesRendered;
+	int32			fOutputBuses;
+	uint32			fVoiceAge;
+	int16			fControllers[128];	// -1 until the first change
+	float			fPitchRate;
+
+	Pattern*		fPattern;
+	int32			fStep;
+	double			fStepFrame;		// of the next step, from the buffer start
+	int32			fClockTicks;
+	bigtime_t		fLastClockTime;
+	double			fClockFramesPerStep;
+	bigtime_t		fBufferTime;
+	int32			fBufferFrames;
+	int64			fRenderedFrames;
+	std::vector<int64>*	fStepLog;
+
+	LockFreeQueue<Command>	fCommands;
+	LockFreeQueue<MidiEvent>	fMidiEvents;
+	MidiEvent		fMidiBatch[kMidiBatchSize];
+	LockFreeQueue<Sample*>	fReleased;
+	LockFreeQueue<Kit*>		fReleasedKits;
+	LockFreeQueue<Pattern*>	fReleasedPatterns;
+	LockFreeQueue<KitSwap>	fKitSwaps;
+
+	std::atomic<AudioEngine*>	fGuests[kMaxGuests];	// set by the audio thread
+	LockFreeQueue<AudioEngine*>	fReleasedGuests;
+	BMessenger		fRemote;
+	port_id			fRemotePort;	// for MIDI and pad hits
+	int32			fGuestId;
+	std::atomic<bool>	fRemoteMode;
+	std::atomic<bool>	fRemoteLost;
+
+	MemoryLocker	fMemoryLocker;
+	// the host's for a guest, the cached samples it pins outlive the guest
+	MemoryLocker*	fSampleLocker;
+	bool			fWorkingMemoryLocked;
+
+	Recorder*		fRecorder;
+	bool			fRecorderLocked;
+
+	// per buffer, then published to the meters
+	bool			fMeteringBuffer;
+	float			fPadPeaks[kPadCount];
+	float			fPadSquares[kPadCount];
+	float			fMeanSquares[kPadCount + 1];
+	Meter			fMeters[kPadCount + 1];	// the mix last
+	std::atomic<bool>	fMetering;
+	std::atomic<bigtime_t>	fRenderTime[2];	// without and with metering
+	std::atomic<uint32>	fRenderCount[2];
+
+	int32			fPlain[kMaxVoices];
+	int32			fPlainCount;
+	int32			fProcessed[kMaxVoices];
+	int32			fProcessedCount;
+	VoiceLanes		fLanes;
+	float			fVoiceBuffer[kProcessFrames * kEngineChannels];
+	std::atomic<bigtime_t>	fVoiceTime[2];		// plain and processed
+	std::atomic<uint64>	fVoiceCount[2];
+
+	int32			fRenderThreads;
+	int32			fWorkerCount;
+	Worker			fWorkers[kMaxRenderThreads - 1];
+	Slice			fSlices[kMaxRenderThreads - 1];
+	sem_id			fWorkSem;
+	sem_id			fWorkDoneSem;
+	// set by the audio thread before it sleeps on the one above
+	std::atomic<bool>	fWaitingForWorkers;
+	// the buffer's generation above, the next plain voice below
+	std::atomic<uint64>	fNextVoice;
+	std::atomic<int32>	fVoicesDone;
+	uint32			fGeneration;
+	std::atomic<bigtime_t>	fThreadTime[kMaxRenderThreads];
+	std::atomic<uint64>	fThreadVoices[kMaxRenderThreads];
+
+	std::atomic<bool>	fTrackingPlayheads;
+	std::atomic<float>	fPlayheads[kPadCount];
+
+	BSoundPlayer*	fPlayer;
+	BMessenger		fTarget;
+
+	thread_id		fJanitorThread;
+	sem_id			fJanitorSem;
+	std::atomic<bool>	fQuitting;
+
+	std::atomic<uint64>	fMidiEventCount;
+	std::atomic<bigtime_t>	fMidiEventTime;
+
+	std::atomic<bool>	fSequencerRunning;
+	std::atomic<bool>	fWantsMidiClock;
+
+	std::atomic<status_t>	fPriorityStatus;
+	bool			fPriorityRequested;
+	bool			fPriorityReported;
+};
+
+
+#endif // AUDIO_ENGINE_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioFilter.h"
+
+#include <Entry.h>
+#include <Node.h>
+#include <NodeInfo.h>
+#include <Volume.h>
+
+#include <compat/sys/stat.h>
+
+
+AudioFilter::AudioFilter()
+	:
+	fCache(_ResolveLink, _KnowsMime, NULL),
+	fEntries(0),
+	fTime(0)
+{
+}
+
+
+bool
+AudioFilter::Filter(const entry_ref* ref, BNode* node, struct stat_beos* stat,
+	const char* fileType)
+{
+	bigtime_t start = system_time();
+	FilterEntry entry = { (mode_t)stat->st_mode, stat->st_dev, stat->st_ino,
+		stat->st_mtim.tv_sec, fileType, ref };
+	bool accepted = fCache.Accepts(entry);
+	fTime += system_time() - start;
+	fEntries++;
+	return accepted;
+}
+
+
+void
+AudioFilter::GetStats(int64& entries, bigtime_t& time) const
+{
+	entries = fEntries;
+	time = fTime;
+}
+
+
+// #pragma mark -
+
+
+/*static*/ bool
+AudioFilter::_ResolveLink(const void* ref, bool& _isDirectory, std::string& _type,
+	dev_t& _device, void* cookie)
+{
+	BEntry entry((const entry_ref*)ref, true); // traverse links
+	entry_ref target;
+	if (entry.GetRef(&target) != B_OK)
+		return false;
+
+	_isDirectory = entry.IsDirectory();
+	_device = target.device;
+
+	char mimeType[B_MIME_TYPE_LENGTH];
+	BNode traversedNode(&entry);
+	if (BNodeInfo(&traversedNode).GetType(mimeType) == B_OK)
+		_type = mimeType;
+	return true;
+}
+
+
+/*static*/ bool
+AudioFilter::_KnowsMime(dev_t device, void* cookie)
+{
+	return BVolume(device).KnowsMime();
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef AUDIO_FILTER_H
+#define AUDIO_FILTER_H
+
+#include "AudioFilterCache.h"
+
+#include <FilePanel.h>
+#include <OS.h>
+
+#include <atomic>
+#include <string>
+
+
+// Lets the sample open panel show just folders and audio files, or all
+// files on a volume without MIME types. The panel already hands over each
+// entry's stat and type, so a plain entry costs no file system call at all;
+// AudioFilterCache decides, this resolves its links and asks its volumes.
+//
+// The panel calls the filter from its window's thread only.
+
+class AudioFilter : public BRefFilter {
+public:
+					AudioFilter();
+
+	virtual	bool	Filter(const entry_ref* ref, BNode* node,
+						struct stat_beos* stat, const char* fileType);
+
+	// so far, to tell how fast the panel fills
+	void			GetStats(int64& entries, bigtime_t& time) const;
+
+private:
+	static	bool	_ResolveLink(const void* ref, bool& _isDirectory,
+						std::string& _type, dev_t& _device, void* cookie);
+	static	bool	_KnowsMime(dev_t device, void* cookie);
+
+	AudioFilterCache fCache;
+
+	std::atomic<int64>	fEntries;
+	std::atomic<bigtime_t> fTime;
+};
+
+
+#endif // AUDIO_FILTER_H
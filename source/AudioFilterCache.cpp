@@ -0,0 +1,87 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioFilterCache.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+
+bool
+AudioFilterCache::Key::operator<(const Key& other) const
+{
+	if (device != other.device)
+		return device < other.device;
+	if (node != other.node)
+		return node < other.node;
+	return modificationTime < other.modificationTime;
+}
+
+
+AudioFilterCache::AudioFilterCache(resolve_link_hook resolveLink,
+	knows_mime_hook knowsMime, void* cookie)
+	:
+	fResolveLink(resolveLink),
+	fKnowsMime(knowsMime),
+	fCookie(cookie),
+	fLookups(0)
+{
+}
+
+
+bool
+AudioFilterCache::Accepts(const FilterEntry& entry)
+{
+	// allow folders, audio files, and links of either
+	if (S_ISDIR(entry.mode))
+		return true;
+	if (S_ISLNK(entry.mode))
+		return _AcceptsLink(entry);
+
+	return _AcceptsType(entry.type, entry.device);
+}
+
+
+// #pragma mark -
+
+
+bool
+AudioFilterCache::_AcceptsLink(const FilterEntry& entry)
+{
+	Key key = { entry.device, entry.node, entry.modificationTime };
+	std::map<Key, bool>::iterator found = fLinks.find(key);
+	if (found != fLinks.end())
+		return found->second;
+
+	bool isDirectory = false;
+	std::string type;
+	dev_t device;
+	fLookups++;
+	bool accepted = fResolveLink(entry.ref, isDirectory, type, device, fCookie)
+		&& (isDirectory || _AcceptsType(type.c_str(), device));
+	fLinks[key] = accepted;
+	return accepted;
+}
+
+
+bool
+AudioFilterCache::_AcceptsType(const char* type, dev_t device)
+{
+	if (type != NULL && strncmp("audio/", type, 6) == 0)
+		return true;
+
+	// allow all, if the volume doesn't know MIME
+	std::map<dev_t, bool>::iterator found = fVolumes.find(device);
+	if (found == fVolumes.end()) {
+		fLookups++;
+		found = fVolumes.insert(std::make_pair(device,
+			fKnowsMime(device, fCookie))).first;
+	}
+	return !found->second;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef AUDIO_FILTER_CACHE_H
+#define AUDIO_FILTER_CACHE_H
+
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+
+// What the sample panel's AudioFilter shows: folders, audio files and links
+// of either, or all files on a volume without MIME types. An entry is
+// decided from the stat and type the panel hands over. Only a link asks the
+// file system, once per (device, inode, modification time) of the link, and
+// a volume is asked whether it knows MIME types once. Both go through hooks.
+//
+// No Haiku API, so it can be tested on other systems.
+
+struct FilterEntry {
+	mode_t		mode;
+	dev_t		device;
+	ino_t		node;
+	time_t		modificationTime;
+	const char*	type;		// MIME, may be NULL
+	const void*	ref;		// handed to the link hook
+};
+
+
+// where a link leads, false if it leads nowhere
+typedef bool (*resolve_link_hook)(const void* ref, bool& _isDirectory,
+				std::string& _type, dev_t& _device, void* cookie);
+typedef bool (*knows_mime_hook)(dev_t device, void* cookie);
+
+
+class AudioFilterCache {
+public:
+					AudioFilterCache(resolve_link_hook resolveLink,
+						knows_mime_hook knowsMime, void* cookie);
+
+	bool			Accepts(const FilterEntry& entry);
+
+	// the links resolved and volumes asked so far
+	int64_t			CountLookups() const { return fLookups; }
+
+private:
+	struct Key {
+		bool		operator<(const Key& other) const;
+
+		dev_t		device;
+		ino_t		node;
+		time_t		modificationTime;
+	};
+
+	bool			_AcceptsLink(const FilterEntry& entry);
+	bool			_AcceptsType(const char* type, dev_t device);
+
+	resolve_link_hook	fResolveLink;
+	knows_mime_hook	fKnowsMime;
+	void*			fCookie;
+
+	std::map<Key, bool>	fLinks;
+	std::map<dev_t, bool> fVolumes;
+	int64_t			fLookups;
+};
+
+
+#endif // AUDIO_FILTER_CACHE_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef BIT_READER_H
+#define BIT_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Reads a bitstream from the most significant bit of each byte on, through
+// a 64 bit cache. Bytes past the end are read as zeros, Overrun() tells.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+class BitReader {
+public:
+	BitReader(const uint8_t* data, size_t size)
+		:
+		fData(data),
+		fSize(size),
+		fPosition(0),
+		fCache(0),
+		fBits(0),
+		fConsumed(0)
+	{
+	}
+
+	// up to 32 bits
+	inline uint32_t Read(int32_t count)
+	{
+		if (count == 0)
+			return 0;
+		if (fBits < count)
+			_Refill();
+
+		uint32_t value = (uint32_t)(fCache >> (64 - count));
+		fCache <<= count;
+		fBits -= count;
+		fConsumed += count;
+		return value;
+	}
+
+	inline int32_t ReadSigned(int32_t count)
+	{
+		if (count == 0)
+			return 0;
+		return (int32_t)(Read(count) << (32 - count)) >> (32 - count);
+	}
+
+	// the zeros up to the next one
+	inline uint32_t ReadUnary()
+	{
+		uint32_t zeros = 0;
+		while (true) {
+			if (fCache == 0) {
+				// whatever is left of the cache is zeros, past the end, too
+				zeros += fBits;
+				fConsumed += fBits;
+				fBits = 0;
+				_Refill();
+				if (Overrun())
+					return zeros;
+				continue;
+			}
+
+			int32_t leading = __builtin_clzll(fCache);
+			zeros += leading;
+			fCache = leading < 63 ? fCache << (leading + 1) : 0;
+			fBits -= leading + 1;
+			fConsumed += leading + 1;
+			return zeros;
+		}
+	}
+
+	void AlignToByte()
+	{
+		Read((8 - fConsumed % 8) % 8);
+	}
+
+	size_t BytePosition() const { return fConsumed / 8; }
+	bool Overrun() const { return fConsumed > (uint64_t)fSize * 8; }
+
+private:
+	inline void _Refill()
+	{
+		while (fBits <= 56) {
+			uint64_t byte = fPosition < fSize ? fData[fPosition] : 0;
+			fCache |= byte << (56 - fBits);
+			fBits += 8;
+			fPosition++;
+		}
+	}
+
+	const uint8_t*	fData;
+	size_t			fSize;
+	size_t			fPosition;
+	uint64_t		fCache;		// the next bits, from the top
+	int32_t			fBits;
+	uint64_t		fConsumed;
+};
+
+
+#endif // BIT_READER_H
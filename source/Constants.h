@@ -10,6 +10,7 @@
 #define CONSTANTS_H
 
 #define FIRST_LAUNCH '1stl'
+#define STARTUP_TIMES 'stup'
 
 #define NOTE 'note'
 #define MUTE 'mute'
@@ -20,22 +21,129 @@
 #define STOP 'stop'
 #define OPEN_SAMPLE 'osam'
 #define LOAD_SAMPLE 'lsam'
+#define SET_GAIN 'gain'
+#define SET_CHOKE_GROUP 'chok'
+#define SET_GATE 'gate'
+#define SET_GAIN_CONTROLLER 'gctl'
+#define SET_FILTER 'filt'
+#define SET_ENVELOPE 'envl'
+#define SET_BUS 'sbus'
+#define TRIM_SILENCE 'trim'
+#define NORMALIZE_LOUDNESS 'nrml'
 
 #define DETECT_NOTE 'dtct'
 #define NEW_NOTE 'newn'
 
+#define ASSIGN_KEY 'askk'
+#define CLEAR_KEYS 'clkk'
+
 #define HELP 'help'
 #define OPEN_ENSEMBLE 'open'
 #define OPEN_RECENT 'opre'
 #define SAVE_ENSEMBLE 'save'
 #define SAVE_AS_ENSEMBLE 'saas'
+#define EXPORT_BUNDLE 'expb'
+#define EXPORT_BUNDLE_REQUESTED 'expr'
 #define CLEARALL 'clra'
+#define ENSEMBLE_LOADED 'enld'
+#define ENSEMBLE_PAD_LOADING 'enpl'
+#define ENSEMBLE_PAD_READY 'enpr'
+
+#define SETLIST_NEXT 'stnx'
+#define SETLIST_PREVIOUS 'stpv'
+#define SETLIST_SELECT 'stsl'
+#define SETLIST_ADD 'stad'
+#define SETLIST_CLEAR 'stcl'
+#define SETLIST_PRELOADED 'stpl'
+#define SETLIST_RESIDENT 'stre'
+
+#define SEQUENCER_SHOW 'sqsh'
+#define SEQUENCER_STEP 'sqst'
+#define SEQUENCER_TEMPO 'sqtp'
+#define SEQUENCER_SWING 'sqsw'
+#define SEQUENCER_SYNC 'sqsy'
+#define SEQUENCER_PLAY 'sqpl'
+#define SEQUENCER_RESEND 'sqrs'
+#define RENDER_PATTERN 'rpat'
+#define RENDER_PATTERN_REQUESTED 'rpar'
+
+#define RECORD_PERFORMANCE 'rcpf'
+#define EXPORT_RECORDING 'exrc'
+#define EXPORT_RECORDING_REQUESTED 'exrr'
+
+#define SHOW_METERS 'shmt'
+#define SHOW_WAVEFORMS 'shwf'
+#define UPDATE_DISPLAYS 'updp'
+#define SET_OUTPUT_BUSES 'obus'
+#define SET_RENDER_THREADS 'rthr'
+#define SET_SAMPLE_STORAGE 'sstg'
+#define ADD_LIBRARY_FOLDER 'adlf'
+#define ADD_LIBRARY_FOLDER_REQUESTED 'adlr'
+#define REMOVE_LIBRARY_FOLDER 'rmlf'
+#define LIBRARY_SET_FOLDERS 'lbsf'
+#define LIBRARY_SCAN 'lbsc'
+#define LIBRARY_SETTLED 'lbst'
+#define FIND_SAMPLE 'fnds'
+#define SEARCH_CHANGED 'srch'
+#define SEARCH_INVOKED 'srci'
+#define SAMPLE_WATCH_PATHS 'swpt'
+#define SAMPLE_WATCH_SETTLED 'swst'
+#define SAMPLE_RELOADED 'smrl'
 
 #define MIDI_IN_MENU 'miin'
+#define MIDI_CHANNEL_FILTER 'mich'
+#define MIDI_ROSTER_READY 'mirr'
+
+#define ENGINE_STATUS 'ests'
+#define ENGINE_ATTACH 'enat'
+#define ENGINE_COMMAND 'encm'
+#define ENGINE_DETACH 'endt'
+#define ENGINE_ATTACHED 'enad'
+#define ENGINE_HOST_LOST 'enhl'
+#define ENGINE_LEVELS 'enlv'
+#define KIT_SWAPPED 'kswp'
+#define PROGRAM_NOT_RESIDENT 'pgnr'
+
+extern const char* kApplicationSignature;
 
 static const int kPadCount = 8;
 static const int kMaxRecentEnsembles = 10;
 static const int kDefaultNote = 44;
+static const int kChokeGroupCount = 4;
+static const int kBusCount = 4;		// stereo outputs, the first is the main one
+
+// a pad's gain can follow a MIDI controller, optionally inverted, e.g. an
+// open hi-hat that gets quieter as the pedal closes
+static const int kGainControllerMask = 0x7f;
+static const int kGainControllerInverted = 0x80;
+
+// a pad's resonant filter
+enum {
+	kFilterOff = 0,
+	kFilterLowPass,
+	kFilterHighPass,
+	kFilterBandPass
+};
+static const float kDefaultCutoff = 1000.0f;	// Hz
+static const float kDefaultResonance = 0.707f;	// Q, no resonance
+
+static const int kBankSelectController = 0;
+// MIDI controllers that step through the setlist, undefined in the MIDI spec
+static const int kSetlistNextController = 102;
+static const int kSetlistPreviousController = 103;
+
+static const float kEngineFrameRate = 44100.0f;
+static const int kEngineChannels = 2;
+
+// how samples decoded from files are kept in memory; past the head, packed
+// ones are unpacked by the engine a block at a time
+enum {
+	kSampleFloat = 0,
+	kSample16Bit,
+	kSampleCompressed
+};
+static const int kPackedHeadFrames = 4096;	// always float, for the attack
+static const int kPackedBlockFrames = 1024;
 
 
 #endif // CONSTANTS_H
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "EngineHost.h"
+#include "AudioEngine.h"
+#include "Constants.h"
+#include "GuestMidi.h"
+
+#include <MessageRunner.h>
+
+
+static const int32 kMidiPortCapacity = 1024;
+static const bigtime_t kLevelsInterval = 33333;	// as the window shows them
+
+
+EngineHost::EngineHost(AudioEngine* engine, SampleCache* cache, BMessenger target,
+	int32 guestId)
+	:
+	BLooper("engine host"),
+	fEngine(engine),
+	fGuest(new AudioEngine(target)),
+	fCache(cache),
+	fTarget(target),
+	fGuestId(guestId),
+	fCommandSem(-1),
+	fCommandThread(-1),
+	fMidiPort(-1),
+	fMidiThread(-1),
+	fLevelsRunner(NULL)
+{
+}
+
+
+EngineHost::~EngineHost()
+{
+	_Detach();
+}
+
+
+status_t
+EngineHost::Attach()
+{
+	fCommandSem = create_sem(0, "samedi guest commands");
+	fMidiPort = create_port(kMidiPortCapacity, "samedi guest midi");
+	if (fCommandSem < 0 || fMidiPort < 0) {
+		delete fGuest;
+		fGuest = NULL;
+		return fCommandSem < 0 ? fCommandSem : fMidiPort;
+	}
+
+	status_t status = fEngine->AddGuest(fGuest);
+	if (status != B_OK) {
+		delete fGuest;
+		fGuest = NULL;
+		return status;
+	}
+
+	// a hit of the guest waits for nothing else
+	fCommandThread = spawn_thread(_CommandThread, "samedi guest commands",
+		B_NORMAL_PRIORITY, this);
+	fMidiThread = spawn_thread(_MidiThread, "samedi guest midi",
+		B_REAL_TIME_DISPLAY_PRIORITY, this);
+	if (fCommandThread < 0 || fMidiThread < 0)
+		return fCommandThread < 0 ? fCommandThread : fMidiThread;
+	resume_thread(fCommandThread);
+	resume_thread(fMidiThread);
+
+	BMessage levels(ENGINE_LEVELS);
+	fLevelsRunner = new BMessageRunner(BMessenger(this), &levels, kLevelsInterval);
+	return B_OK;
+}
+
+
+void
+EngineHost::MessageReceived(BMessage* msg)
+{
+	switch (msg->what) {
+		case ENGINE_COMMAND:
+		{
+			if (fGuest == NULL)
+				break;
+			fCommands.AddMessage(DetachCurrentMessage());
+			release_sem(fCommandSem);
+			break;
+		}
+		case ENGINE_LEVELS:
+		{
+			if (fGuest == NULL)
+				break;
+			BMessage levels(ENGINE_LEVELS);
+			fGuest->ArchiveLevels(levels);
+			if (!levels.IsEmpty())
+				fTarget.SendMessage(&levels, (BHandler*)NULL, 0);
+			break;
+		}
+		case ENGINE_DETACH:
+		{
+			// the guest quits, or this Samedi does and the guest plays on
+			// its own
+			_Detach();
+			BMessage lost(ENGINE_HOST_LOST);
+			fTarget.SendMessage(&lost, (BHandler*)NULL, 0);
+			if (msg->IsSourceWaiting())
+				msg->SendReply(B_REPLY);
+			Quit();
+			break;
+		}
+		default:
+		{
+			BLooper::MessageReceived(msg);
+			break;
+		}
+	}
+}
+
+
+// #pragma mark -
+
+
+/*static*/ status_t
+EngineHost::_CommandThread(void* data)
+{
+	((EngineHost*)data)->_ApplyCommands();
+	return B_OK;
+}
+
+
+void
+EngineHost::_ApplyCommands()
+{
+	// in the order they came, a kit is decoded before what follows it
+	while (acquire_sem(fCommandSem) == B_OK) {
+		BMessage* command = fCommands.NextMessage();
+		if (command == NULL)
+			continue;
+		fGuest->ApplyRemote(command, fCache);
+		delete command;
+	}
+}
+
+
+/*static*/ status_t
+EngineHost::_MidiThread(void* data)
+{
+	((EngineHost*)data)->_ReadMidi();
+	return B_OK;
+}
+
+
+void
+EngineHost::_ReadMidi()
+{
+	// larger, so a longer message isn't cut to the size of an event
+	uint8 buffer[kGuestMidiEventSize * 4];
+	while (true) {
+		int32 code;
+		ssize_t size = read_port(fMidiPort, &code, buffer, sizeof(buffer));
+		if (size == B_INTERRUPTED)
+			continue;
+		if (size < 0)
+			break;
+
+		GuestMidiEvent event;
+		if (code != kGuestMidiCode || !decode_guest_midi_event(buffer, size, kPadCount, event)
+			|| event.guest != fGuestId)
+			continue;
+		fGuest->HandleMidi(event.status, event.data1, event.data2, event.time);
+	}
+}
+
+
+void
+EngineHost::_Detach()
+{
+	// both threads are done with the guest before it's removed
+	delete fLevelsRunner;
+	fLevelsRunner = NULL;
+	if (fMidiPort >= 0) {
+		delete_port(fMidiPort);
+		fMidiPort = -1;
+	}
+	if (fCommandSem >= 0) {
+		delete_sem(fCommandSem);
+		fCommandSem = -1;
+	}
+	status_t result;
+	if (fMidiThread >= 0) {
+		wait_for_thread(fMidiThread, &result);
+		fMidiThread = -1;
+	}
+	if (fCommandThread >= 0) {
+		wait_for_thread(fCommandThread, &result);
+		fCommandThread = -1;
+	}
+
+	// once added, the guest belongs to the engine
+	if (fGuest != NULL)
+		fEngine->RemoveGuest(fGuest);
+	fGuest = NULL;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef ENGINE_HOST_H
+#define ENGINE_HOST_H
+
+#include <Looper.h>
+#include <MessageQueue.h>
+#include <Messenger.h>
+#include <OS.h>
+
+
+class AudioEngine;
+class BMessageRunner;
+class SampleCache;
+
+
+// Serves one Samedi that plays through this one's engine. The guest engine
+// is mixed in by the audio thread; what the other Samedi changes arrives
+// here and is applied to the guest, with samples from this one's cache.
+//
+// Kits are decoded by a thread of its own, so the looper always takes the
+// next command right away and the guest never waits on a full port. The
+// MIDI and pad hits of the guest come through a port that another thread
+// reads, and the meters and playheads it follows are sent back.
+
+class EngineHost : public BLooper {
+public:
+					EngineHost(AudioEngine* engine, SampleCache* cache,
+						BMessenger target, int32 guestId);
+	virtual			~EngineHost();
+
+	status_t		Attach();
+	port_id			MidiPort() const { return fMidiPort; };
+
+	virtual	void	MessageReceived(BMessage* msg);
+
+private:
+	static status_t	_CommandThread(void* data);
+	void			_ApplyCommands();
+	static status_t	_MidiThread(void* data);
+	void			_ReadMidi();
+	void			_Detach();
+
+	AudioEngine*	fEngine;
+	AudioEngine*	fGuest;
+	SampleCache*	fCache;
+	BMessenger		fTarget;
+	int32			fGuestId;
+
+	BMessageQueue	fCommands;
+	sem_id			fCommandSem;
+	thread_id		fCommandThread;
+	port_id			fMidiPort;
+	thread_id		fMidiThread;
+	BMessageRunner*	fLevelsRunner;
+};
+
+
+#endif // ENGINE_HOST_H
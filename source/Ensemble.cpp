@@ -0,0 +1,266 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioEngine.h"
+#include "Ensemble.h"
+#include "SampleCache.h"
+#include "SampleLibrary.h"
+
+#include <DataIO.h>
+#include <Message.h>
+#include <String.h>
+
+
+static const size_t kMaxLegacyEnsembleSize = 16 * 1024 * 1024;
+
+
+Ensemble::Ensemble(const entry_ref& ref)
+	:
+	fRef(ref),
+	fPath(&ref),
+	fLoadTime(0),
+	fRelinkCount(0),
+	fInitStatus(B_NO_INIT)
+{
+}
+
+
+Ensemble::~Ensemble()
+{
+}
+
+
+status_t
+Ensemble::Load(AudioEngine* engine, SampleCache* cache, SampleLibrary* library)
+{
+	bigtime_t start = system_time();
+
+	status_t status = _Read();
+	if (status == B_OK) {
+		// pads without a sample are done already
+		for (int32 i = 0; i < kPadCount; i++) {
+			bool empty = i >= (int32)fData.pads.size() || fData.pads[i].layers.empty()
+				|| fData.pads[i].layers[0].path.empty();
+			_ReportPad(i, empty);
+		}
+		_DecodeSamples(engine, cache, library);
+	}
+
+	fLoadTime = system_time() - start;
+	fInitStatus = status;
+	return status;
+}
+
+
+Sample*
+Ensemble::SampleAt(int32 pad) const
+{
+	if (pad < 0 || pad >= kPadCount)
+		return NULL;
+
+	return fSamples[pad].Get();
+}
+
+
+void
+Ensemble::Update(const EnsembleData& data, Sample* const* samples)
+{
+	// keep the flags, the ensemble stays a bundle if it was one
+	fData.pads = data.pads;
+	for (int32 i = 0; i < kPadCount; i++)
+		fSamples[i].SetTo(samples[i]);
+}
+
+
+// #pragma mark -
+
+
+status_t
+Ensemble::_Read()
+{
+	// Map the file instead of reading it: a bundle's samples are played
+	// right from the mapping, for plain ensembles it's a single read.
+	fFile.SetTo(new MappedFile(fRef), true);
+	status_t status = fFile->InitCheck();
+	if (status != B_OK)
+		return status;
+
+	const char* data = (const char*)fFile->Data();
+	size_t size = fFile->Size();
+
+	switch (parse_ensemble(data, size, fData)) {
+		case kEnsembleOK:
+			return B_OK;
+		case kEnsembleTooNew:
+			return B_NOT_SUPPORTED;
+		case kEnsembleNotBinary:
+			if (size <= kMaxLegacyEnsembleSize && _ReadLegacy(data, size))
+				return B_OK;
+			return B_BAD_DATA;
+		default:
+			return B_BAD_DATA;
+	}
+}
+
+
+bool
+Ensemble::_ReadLegacy(const char* buffer, size_t size)
+{
+	// Ensembles of Samedi 1.0 are flattened BMessages with notes and paths.
+	// Read through a BMemoryIO, so sizes in a damaged file can't take the
+	// unflattening past the end of the mapping.
+	BMemoryIO input(buffer, size);
+	BMessage message;
+	if (message.Unflatten(&input) != B_OK)
+		return false;
+
+	LegacyEnsemble legacy;
+	int32 note;
+	for (int32 i = 0; message.FindInt32("note", i, &note) == B_OK; i++)
+		legacy.notes.push_back(note);
+	const char* sample;
+	for (int32 i = 0; message.FindString("sample", i, &sample) == B_OK; i++)
+		legacy.samples.push_back(sample);
+
+	convert_legacy_ensemble(legacy, kPadCount, kDefaultNote, fData);
+	return true;
+}
+
+
+void
+Ensemble::_DecodeSamples(AudioEngine* engine, SampleCache* cache,
+	SampleLibrary* library)
+{
+	// bundles of a different engine format are loaded from the sample paths
+	DecodeJob job;
+	job.ensemble = this;
+	job.cache = cache;
+	job.library = library;
+	job.useBundle = fData.IsBundle() && fData.pcmFormat == kPCMFloat32
+		&& fData.pcmFrameRate == (uint32)kEngineFrameRate
+		&& fData.pcmChannels == kEngineChannels;
+	job.padCount = fData.pads.size() < (size_t)kPadCount ? fData.pads.size() : kPadCount;
+	job.nextPad = 0;
+	job.relinked = 0;
+
+	// the samples are independent of each other, each thread takes the next
+	// one until there are none left; this one helps
+	system_info info;
+	int32 threadCount = get_system_info(&info) == B_OK ? info.cpu_count : 1;
+	if (threadCount > job.padCount)
+		threadCount = job.padCount;
+
+	thread_id threads[kPadCount];
+	int32 spawned = 0;
+	for (int32 i = 1; i < threadCount; i++) {
+		thread_id thread = spawn_thread(_DecodeThread, "samedi sample decoder",
+			B_NORMAL_PRIORITY, &job);
+		if (thread < 0 || resume_thread(thread) != B_OK)
+			break;
+		threads[spawned++] = thread;
+	}
+	_DecodeWork(job);
+	for (int32 i = 0; i < spawned; i++) {
+		status_t result;
+		wait_for_thread(threads[i], &result);
+	}
+	fRelinkCount = job.relinked;
+
+	// locking now keeps the cost of it out of the switch, one at a time, as
+	// pads may share a sample
+	for (int32 i = 0; i < kPadCount && engine != NULL; i++) {
+		Sample* sample = fSamples[i].Get();
+		if (sample != NULL && sample->InitCheck() == B_OK)
+			engine->PinSample(sample);
+	}
+
+	if (!job.useBundle)
+		fFile.Unset();
+}
+
+
+/*static*/ status_t
+Ensemble::_DecodeThread(void* data)
+{
+	DecodeJob* job = (DecodeJob*)data;
+	job->ensemble->_DecodeWork(*job);
+	return B_OK;
+}
+
+
+void
+Ensemble::_DecodeWork(DecodeJob& job)
+{
+	while (true) {
+		int32 pad = job.nextPad.fetch_add(1);
+		if (pad >= job.padCount)
+			return;
+		_DecodeSample(pad, job);
+		_ReportPad(pad, true);
+	}
+}
+
+
+void
+Ensemble::_DecodeSample(int32 index, DecodeJob& job)
+{
+	// only the first layer is played for now, each thread has pads of its own
+	EnsemblePad& pad = fData.pads[index];
+	if (pad.layers.empty() || pad.layers[0].path.empty())
+		return;
+
+	EnsembleLayer& layer = pad.layers[0];
+	const char* path = layer.path.c_str();
+	SampleCache* cache = job.cache;
+	Sample* sample;
+	if (job.useBundle && layer.pcmFrames > 0) {
+		const float* data = (const float*)(fFile->Data() + layer.pcmOffset);
+		sample = cache != NULL
+			? cache->Get(path, fFile.Get(), data, layer.pcmFrames, layer.identity)
+			: new Sample(path, fFile.Get(), data, layer.pcmFrames, layer.identity);
+	} else {
+		// a sample that was moved or renamed is looked up by its content
+		BString newPath;
+		if (job.library != NULL && !BEntry(path).Exists()
+			&& job.library->Relink(layer.identity, layer.fingerprint, newPath)) {
+			layer.path = newPath.String();
+			path = layer.path.c_str();
+			job.relinked++;
+		}
+		sample = cache != NULL ? cache->Get(path) : new Sample(path);
+	}
+	fSamples[index].SetTo(sample, true);
+
+	// measured once, unless the file changed since the ensemble was saved
+	if (sample->InitCheck() != B_OK || sample->HasLoudness())
+		return;
+	if ((layer.flags & kLayerMeasured) != 0
+		&& same_file_version(layer.identity, sample->Identity()))
+		sample->SetLoudness(layer.loudness);
+	else
+		sample->MeasureLoudness();
+}
+
+
+void
+Ensemble::_ReportPad(int32 index, bool ready)
+{
+	if (!fProgressTarget.IsValid())
+		return;
+
+	// the pad's data is only touched by the thread that decodes it
+	BMessage message(ready ? ENSEMBLE_PAD_READY : ENSEMBLE_PAD_LOADING);
+	message.AddPointer("ensemble", this);
+	message.AddInt32("pad", index);
+	if (index < (int32)fData.pads.size() && !fData.pads[index].layers.empty())
+		message.AddString("path", fData.pads[index].layers[0].path.c_str());
+	Sample* sample = fSamples[index].Get();
+	message.AddBool("found", sample != NULL && sample->InitCheck() == B_OK);
+	fProgressTarget.SendMessage(&message);
+}
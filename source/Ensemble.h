@@ -0,0 +1,94 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "Constants.h"
+#include "EnsembleFormat.h"
+#include "MappedFile.h"
+#include "Sample.h"
+
+#include <Entry.h>
+#include <Messenger.h>
+#include <OS.h>
+#include <Path.h>
+#include <Referenceable.h>
+
+#include <atomic>
+
+class AudioEngine;
+class SampleCache;
+class SampleLibrary;
+
+
+// An ensemble file with all its samples decoded, ready to be handed to the
+// pads and the engine. Loading touches nothing but the object itself, so it
+// can be done on a background thread while another ensemble plays. The
+// samples are decoded and measured on as many threads as there are CPUs.
+// Samples no longer where the ensemble has them are looked up in the
+// sample library, if one is given.
+//
+// A progress target is told which pads are still loading as
+// ENSEMBLE_PAD_LOADING, and each one that's done as ENSEMBLE_PAD_READY.
+
+class Ensemble : public BReferenceable {
+public:
+					Ensemble(const entry_ref& ref);
+	virtual			~Ensemble();
+
+	status_t		Load(AudioEngine* engine = NULL, SampleCache* cache = NULL,
+						SampleLibrary* library = NULL);
+	status_t		InitCheck() const { return fInitStatus; };
+	// before Load()
+	void			SetProgressTarget(const BMessenger& target)
+						{ fProgressTarget = target; };
+
+	const BPath&	Path() const { return fPath; };
+	const EnsembleData&	Data() const { return fData; };
+	bool			IsBundle() const { return fData.IsBundle(); };
+	Sample*			SampleAt(int32 pad) const;
+	bigtime_t		LoadTime() const { return fLoadTime; };
+	// samples found in the library, their new paths are in Data()
+	int32			RelinkCount() const { return fRelinkCount; };
+
+	void			Update(const EnsembleData& data, Sample* const* samples);
+
+private:
+	status_t		_Read();
+	bool			_ReadLegacy(const char* buffer, size_t size);
+	struct DecodeJob {
+		Ensemble*	ensemble;
+		SampleCache*	cache;
+		SampleLibrary*	library;
+		bool		useBundle;
+		int32		padCount;
+		std::atomic<int32>	nextPad;
+		std::atomic<int32>	relinked;
+	};
+
+	void			_DecodeSamples(AudioEngine* engine, SampleCache* cache,
+						SampleLibrary* library);
+	static status_t	_DecodeThread(void* data);
+	void			_DecodeWork(DecodeJob& job);
+	void			_DecodeSample(int32 pad, DecodeJob& job);
+	void			_ReportPad(int32 pad, bool ready);
+
+	entry_ref		fRef;
+	BPath			fPath;
+	EnsembleData	fData;
+	BReference<MappedFile> fFile;
+	BReference<Sample>	fSamples[kPadCount];
+	bigtime_t		fLoadTime;
+	int32			fRelinkCount;
+	status_t		fInitStatus;
+	BMessenger		fProgressTarget;
+};
+
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,433 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "EnsembleFormat.h"
+
+#include <string.h>
+
+
+static const size_t kHeaderSize = 40;
+static const size_t kPadRecordSize = 44;
+static const size_t kPadRecordSizeV1 = 16;
+static const size_t kLayerRecordSize = 104;
+static const size_t kLayerRecordSizeMeasured = 96;
+static const size_t kLayerRecordSizeTrim = 88;
+static const size_t kLayerRecordSizeBundle = 72;
+static const size_t kLayerRecordSizeV1 = 56;
+
+
+static inline uint16_t
+get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+
+static inline uint32_t
+get32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static inline uint64_t
+get64(const uint8_t* p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+
+static inline float
+get_float(const uint8_t* p)
+{
+	uint32_t bits = get32(p);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+static inline void
+put16(uint8_t* p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+
+static inline void
+put32(uint8_t* p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+
+static inline void
+put64(uint8_t* p, uint64_t value)
+{
+	put32(p, (uint32_t)value);
+	put32(p + 4, (uint32_t)(value >> 32));
+}
+
+
+static inline void
+put_float(uint8_t* p, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put32(p, bits);
+}
+
+
+EnsembleLayer::EnsembleLayer()
+	:
+	velocityLow(0),
+	velocityHigh(127),
+	flags(0),
+	pcmOffset(0),
+	pcmFrames(0),
+	trimStart(0),
+	trimEnd(0),
+	peak(0.0f),
+	loudness(0.0f),
+	fingerprint(0)
+{
+	memset(&identity, 0, sizeof(identity));
+}
+
+
+EnsemblePad::EnsemblePad()
+	:
+	note(0),
+	modes(0),
+	chokeGroup(0),
+	gainController(0),
+	gain(1.0f),
+	filterType(0),
+	bus(0),
+	cutoff(1000.0f),
+	resonance(0.707f),
+	attack(0.0f),
+	decay(0.0f),
+	release(0.0f)
+{
+}
+
+
+EnsembleData::EnsembleData()
+	:
+	flags(0),
+	pcmFrameRate(0),
+	pcmChannels(0),
+	pcmFormat(0)
+{
+}
+
+
+// #pragma mark -
+
+
+static size_t
+metadata_size(const EnsembleData& ensemble, uint32_t* _layerCount,
+	uint32_t* _stringSize)
+{
+	uint32_t layerCount = 0;
+	uint32_t stringSize = 0;
+	for (size_t i = 0; i < ensemble.pads.size(); i++) {
+		const EnsemblePad& pad = ensemble.pads[i];
+		layerCount += pad.layers.size();
+		for (size_t j = 0; j < pad.layers.size(); j++)
+			stringSize += pad.layers[j].path.size();
+	}
+
+	if (_layerCount != NULL)
+		*_layerCount = layerCount;
+	if (_stringSize != NULL)
+		*_stringSize = stringSize;
+
+	return kHeaderSize + ensemble.pads.size() * kPadRecordSize
+		+ layerCount * kLayerRecordSize + stringSize;
+}
+
+
+bool
+is_binary_ensemble(const void* data, size_t size)
+{
+	return size >= sizeof(kEnsembleMagic)
+		&& memcmp(data, kEnsembleMagic, sizeof(kEnsembleMagic)) == 0;
+}
+
+
+ensemble_result
+parse_ensemble(const void* _data, size_t size, EnsembleData& ensemble)
+{
+	const uint8_t* data = (const uint8_t*)_data;
+	if (!is_binary_ensemble(data, size))
+		return kEnsembleNotBinary;
+	if (size < 8)
+		return kEnsembleCorrupt;
+
+	uint16_t version = get16(data + 4);
+	uint16_t headerSize = get16(data + 6);
+	if (version > kEnsembleVersion)
+		return kEnsembleTooNew;
+	if (headerSize < kHeaderSize || headerSize > size)
+		return kEnsembleCorrupt;
+
+	uint16_t padCount = get16(data + 8);
+	uint16_t padRecordSize = get16(data + 10);
+	uint32_t layerCount = get32(data + 12);
+	uint16_t layerRecordSize = get16(data + 16);
+	uint32_t stringOffset = get32(data + 20);
+	uint32_t stringSize = get32(data + 24);
+
+	ensemble.flags = get16(data + 18);
+	ensemble.pcmFrameRate = get32(data + 28);
+	ensemble.pcmChannels = get16(data + 32);
+	ensemble.pcmFormat = get16(data + 34);
+
+	if (padRecordSize < kPadRecordSizeV1 || layerRecordSize < kLayerRecordSizeV1)
+		return kEnsembleCorrupt;
+	if (ensemble.IsBundle() && layerRecordSize < kLayerRecordSizeBundle)
+		return kEnsembleCorrupt;
+
+	uint64_t padsEnd = headerSize + (uint64_t)padCount * padRecordSize;
+	uint64_t layersEnd = padsEnd + (uint64_t)layerCount * layerRecordSize;
+	if (layersEnd > size || stringOffset < layersEnd
+		|| (uint64_t)stringOffset + stringSize > size)
+		return kEnsembleCorrupt;
+
+	const uint8_t* strings = data + stringOffset;
+	const uint8_t* layers = data + padsEnd;
+
+	ensemble.pads.clear();
+	ensemble.pads.resize(padCount);
+
+	for (uint16_t i = 0; i < padCount; i++) {
+		const uint8_t* record = data + headerSize + (size_t)i * padRecordSize;
+		EnsemblePad& pad = ensemble.pads[i];
+		pad.note = record[0];
+		pad.modes = record[1];
+		pad.chokeGroup = record[2];
+		pad.gainController = record[3];
+		pad.gain = get_float(record + 4);
+		if (padRecordSize >= kPadRecordSize) {
+			pad.filterType = record[16];
+			pad.bus = record[17];
+			pad.cutoff = get_float(record + 20);
+			pad.resonance = get_float(record + 24);
+			pad.attack = get_float(record + 28);
+			pad.decay = get_float(record + 32);
+			pad.release = get_float(record + 36);
+		}
+
+		uint32_t firstLayer = get32(record + 8);
+		uint16_t padLayers = get16(record + 12);
+		if ((uint64_t)firstLayer + padLayers > layerCount)
+			return kEnsembleCorrupt;
+
+		pad.layers.resize(padLayers);
+		for (uint16_t j = 0; j < padLayers; j++) {
+			const uint8_t* layerRecord
+				= layers + (size_t)(firstLayer + j) * layerRecordSize;
+			EnsembleLayer& layer = pad.layers[j];
+			layer.velocityLow = layerRecord[0];
+			layer.velocityHigh = layerRecord[1];
+			layer.flags = layerRecord[2];
+
+			uint32_t pathOffset = get32(layerRecord + 4);
+			uint32_t pathLength = get32(layerRecord + 8);
+			if ((uint64_t)pathOffset + pathLength > stringSize)
+				return kEnsembleCorrupt;
+			layer.path.assign((const char*)strings + pathOffset, pathLength);
+
+			layer.identity.device = get64(layerRecord + 16);
+			layer.identity.inode = get64(layerRecord + 24);
+			layer.identity.size = get64(layerRecord + 32);
+			layer.identity.modificationTime = (int64_t)get64(layerRecord + 40);
+			layer.identity.contentHash = get64(layerRecord + 48);
+			if (layerRecordSize >= kLayerRecordSizeTrim) {
+				layer.trimStart = get64(layerRecord + 72);
+				layer.trimEnd = get64(layerRecord + 80);
+			}
+			if (layerRecordSize >= kLayerRecordSizeMeasured) {
+				layer.peak = get_float(layerRecord + 88);
+				layer.loudness = get_float(layerRecord + 92);
+			} else
+				layer.flags &= ~kLayerMeasured;
+			if (layerRecordSize >= kLayerRecordSize)
+				layer.fingerprint = get64(layerRecord + 96);
+
+			if (!ensemble.IsBundle())
+				continue;
+
+			layer.pcmOffset = get64(layerRecord + 56);
+			layer.pcmFrames = get64(layerRecord + 64);
+			if (layer.pcmFrames == 0)
+				continue;
+
+			// the samples are played from the mapped file as floats: they
+			// have to be inside it, aligned, and not where the records or
+			// the strings are
+			uint64_t frameSize = pcm_frame_size(ensemble);
+			if (frameSize == 0 || layer.pcmOffset < layersEnd || layer.pcmOffset > size
+				|| layer.pcmOffset % sizeof(float) != 0
+				|| layer.pcmFrames > (size - layer.pcmOffset) / frameSize)
+				return kEnsembleCorrupt;
+			uint64_t pcmEnd = layer.pcmOffset + layer.pcmFrames * frameSize;
+			if (layer.pcmOffset < (uint64_t)stringOffset + stringSize
+				&& pcmEnd > stringOffset)
+				return kEnsembleCorrupt;
+		}
+	}
+
+	return kEnsembleOK;
+}
+
+
+void
+write_ensemble(const EnsembleData& ensemble, std::vector<uint8_t>& output)
+{
+	uint32_t layerCount;
+	uint32_t stringSize;
+	metadata_size(ensemble, &layerCount, &stringSize);
+
+	size_t padsEnd = kHeaderSize + ensemble.pads.size() * kPadRecordSize;
+	size_t stringOffset = padsEnd + layerCount * kLayerRecordSize;
+
+	output.assign(stringOffset + stringSize, 0);
+	uint8_t* data = output.data();
+
+	memcpy(data, kEnsembleMagic, sizeof(kEnsembleMagic));
+	put16(data + 4, kEnsembleVersion);
+	put16(data + 6, kHeaderSize);
+	put16(data + 8, ensemble.pads.size());
+	put16(data + 10, kPadRecordSize);
+	put32(data + 12, layerCount);
+	put16(data + 16, kLayerRecordSize);
+	put16(data + 18, ensemble.flags);
+	put32(data + 20, stringOffset);
+	put32(data + 24, stringSize);
+	put32(data + 28, ensemble.pcmFrameRate);
+	put16(data + 32, ensemble.pcmChannels);
+	put16(data + 34, ensemble.pcmFormat);
+
+	uint32_t layerIndex = 0;
+	uint32_t stringPosition = 0;
+	for (size_t i = 0; i < ensemble.pads.size(); i++) {
+		const EnsemblePad& pad = ensemble.pads[i];
+		uint8_t* record = data + kHeaderSize + i * kPadRecordSize;
+		record[0] = pad.note;
+		record[1] = pad.modes;
+		record[2] = pad.chokeGroup;
+		record[3] = pad.gainController;
+		put_float(record + 4, pad.gain);
+		put32(record + 8, layerIndex);
+		put16(record + 12, pad.layers.size());
+		record[16] = pad.filterType;
+		record[17] = pad.bus;
+		put_float(record + 20, pad.cutoff);
+		put_float(record + 24, pad.resonance);
+		put_float(record + 28, pad.attack);
+		put_float(record + 32, pad.decay);
+		put_float(record + 36, pad.release);
+
+		for (size_t j = 0; j < pad.layers.size(); j++, layerIndex++) {
+			const EnsembleLayer& layer = pad.layers[j];
+			uint8_t* layerRecord = data + padsEnd + layerIndex * kLayerRecordSize;
+			layerRecord[0] = layer.velocityLow;
+			layerRecord[1] = layer.velocityHigh;
+			layerRecord[2] = layer.flags;
+			put32(layerRecord + 4, stringPosition);
+			put32(layerRecord + 8, layer.path.size());
+			put64(layerRecord + 16, layer.identity.device);
+			put64(layerRecord + 24, layer.identity.inode);
+			put64(layerRecord + 32, layer.identity.size);
+			put64(layerRecord + 40, (uint64_t)layer.identity.modificationTime);
+			put64(layerRecord + 48, layer.identity.contentHash);
+			put64(layerRecord + 56, layer.pcmOffset);
+			put64(layerRecord + 64, layer.pcmFrames);
+			put64(layerRecord + 72, layer.trimStart);
+			put64(layerRecord + 80, layer.trimEnd);
+			put_float(layerRecord + 88, layer.peak);
+			put_float(layerRecord + 92, layer.loudness);
+			put64(layerRecord + 96, layer.fingerprint);
+
+			memcpy(data + stringOffset + stringPosition, layer.path.data(),
+				layer.path.size());
+			stringPosition += layer.path.size();
+		}
+	}
+}
+
+
+uint64_t
+layout_bundle(EnsembleData& ensemble, uint32_t frameRate, uint16_t channels,
+	size_t pageSize)
+{
+	ensemble.flags |= kEnsembleBundle;
+	ensemble.pcmFrameRate = frameRate;
+	ensemble.pcmChannels = channels;
+	ensemble.pcmFormat = kPCMFloat32;
+
+	// every layer's PCM starts on its own page, so it can be mapped and
+	// locked into memory as is
+	uint64_t offset = metadata_size(ensemble, NULL, NULL);
+	size_t frameSize = pcm_frame_size(ensemble);
+	for (size_t i = 0; i < ensemble.pads.size(); i++) {
+		EnsemblePad& pad = ensemble.pads[i];
+		for (size_t j = 0; j < pad.layers.size(); j++) {
+			EnsembleLayer& layer = pad.layers[j];
+			if (layer.pcmFrames == 0) {
+				layer.pcmOffset = 0;
+				continue;
+			}
+			offset = (offset + pageSize - 1) / pageSize * pageSize;
+			layer.pcmOffset = offset;
+			offset += layer.pcmFrames * frameSize;
+		}
+	}
+
+	return offset;
+}
+
+
+size_t
+pcm_frame_size(const EnsembleData& ensemble)
+{
+	if (ensemble.pcmFormat != kPCMFloat32)
+		return 0;
+
+	return ensemble.pcmChannels * sizeof(float);
+}
+
+
+void
+convert_legacy_ensemble(const LegacyEnsemble& legacy, size_t padCount,
+	int32_t firstNote, EnsembleData& ensemble)
+{
+	// a pad without a note of its own takes the one after the pad before
+	ensemble = EnsembleData();
+	ensemble.pads.resize(padCount);
+	int32_t note = firstNote;
+	for (size_t i = 0; i < padCount; i++) {
+		if (i < legacy.notes.size())
+			note = legacy.notes[i];
+		ensemble.pads[i].note = note++;
+		if (i >= legacy.samples.size() || legacy.samples[i].empty())
+			continue;
+
+		EnsembleLayer layer;
+		layer.path = legacy.samples[i];
+		ensemble.pads[i].layers.push_back(layer);
+	}
+}
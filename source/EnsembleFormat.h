@@ -0,0 +1,149 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef ENSEMBLE_FORMAT_H
+#define ENSEMBLE_FORMAT_H
+
+#include "FileIdentity.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// Binary ensemble file, all values little endian:
+//
+//	header			fixed size, see below
+//	pad records		padCount * padRecordSize
+//	layer records	layerCount * layerRecordSize
+//	string table	UTF-8 sample paths, not null-terminated
+//	PCM data		bundles only, one block per layer at page-aligned offsets
+//
+// A bundle embeds the decoded samples in the engine's native format, so it
+// can be memory mapped and played without decoding anything.
+//
+// Readers skip unknown trailing bytes of records, so later versions can
+// append fields without breaking older readers. A newer major version is
+// refused.
+//
+// The parser is portable (no Haiku API), so it can be tested on other systems.
+
+static const char kEnsembleMagic[4] = { 'S', 'M', 'D', 'E' };
+static const uint16_t kEnsembleVersion = 1;
+
+enum {
+	kPadMuted	= 0x01,
+	kPadSolo	= 0x02,
+	kPadLooping	= 0x04,
+	kPadGate	= 0x08,		// stops on note off
+	kPadTrimmed	= 0x10,		// skips the silence around the sound
+	kPadNormalized	= 0x20	// brought to the loudness of the others
+};
+
+enum {
+	kLayerMeasured	= 0x01	// its peak and loudness are known
+};
+
+enum {
+	kEnsembleBundle	= 0x0001
+};
+
+enum {
+	kPCMFloat32		= 1		// little endian IEEE 754, interleaved
+};
+
+enum ensemble_result {
+	kEnsembleOK = 0,
+	kEnsembleNotBinary,		// no magic, may be a legacy BMessage ensemble
+	kEnsembleTooNew,
+	kEnsembleCorrupt
+};
+
+
+struct EnsembleLayer {
+					EnsembleLayer();
+
+	std::string		path;
+	uint8_t			velocityLow;
+	uint8_t			velocityHigh;
+	uint8_t			flags;		// was unused in 1.0
+	FileIdentity	identity;
+
+	// bundles only
+	uint64_t		pcmOffset;
+	uint64_t		pcmFrames;
+
+	// appended, the frames played of a trimmed pad, an end of 0 for all
+	uint64_t		trimStart;
+	uint64_t		trimEnd;
+	// appended, of the sample the identity is of
+	float			peak;
+	float			loudness;	// LUFS
+	// appended, of the sample's audio, 0 if not known
+	uint64_t		fingerprint;
+};
+
+
+struct EnsemblePad {
+					EnsemblePad();
+
+	uint8_t			note;
+	uint8_t			modes;
+	uint8_t			chokeGroup;
+	uint8_t			gainController;	// 0 for none, was unused in 1.0
+	float			gain;
+
+	// appended to the first pad records
+	uint8_t			filterType;
+	uint8_t			bus;			// 0 is the main output
+	float			cutoff;
+	float			resonance;
+	float			attack;
+	float			decay;
+	float			release;
+	std::vector<EnsembleLayer> layers;
+};
+
+
+// An ensemble of Samedi 1.0, a flattened BMessage with a "note" and a
+// "sample" per pad. The caller unflattens it.
+struct LegacyEnsemble {
+	std::vector<int32_t> notes;
+	std::vector<std::string> samples;
+};
+
+
+struct EnsembleData {
+					EnsembleData();
+
+	bool			IsBundle() const { return (flags & kEnsembleBundle) != 0; }
+
+	uint16_t		flags;
+	uint32_t		pcmFrameRate;
+	uint16_t		pcmChannels;
+	uint16_t		pcmFormat;
+	std::vector<EnsemblePad> pads;
+};
+
+
+bool			is_binary_ensemble(const void* data, size_t size);
+ensemble_result	parse_ensemble(const void* data, size_t size,
+					EnsembleData& ensemble);
+void			write_ensemble(const EnsembleData& ensemble,
+					std::vector<uint8_t>& output);
+
+uint64_t		layout_bundle(EnsembleData& ensemble, uint32_t frameRate,
+					uint16_t channels, size_t pageSize);
+size_t			pcm_frame_size(const EnsembleData& ensemble);
+
+void			convert_legacy_ensemble(const LegacyEnsemble& legacy,
+					size_t padCount, int32_t firstNote, EnsembleData& ensemble);
+
+
+#endif // ENSEMBLE_FORMAT_H
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "FileIdentity.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// XXH64, see https://github.com/Cyan4973/xxHash
+
+static const uint64_t kPrime1 = 11400714785074694791ULL;
+static const uint64_t kPrime2 = 14029467366897019727ULL;
+static const uint64_t kPrime3 = 1609587929392839161ULL;
+static const uint64_t kPrime4 = 9650029242287828579ULL;
+static const uint64_t kPrime5 = 2870177450012600261ULL;
+
+
+static inline uint64_t
+rotate_left(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+static inline uint64_t
+read64(const uint8_t* data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+
+static inline uint32_t
+read32(const uint8_t* data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+
+static inline uint64_t
+round64(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * kPrime2;
+	accumulator = rotate_left(accumulator, 31);
+	return accumulator * kPrime1;
+}
+
+
+static inline uint64_t
+merge_round(uint64_t accumulator, uint64_t value)
+{
+	accumulator ^= round64(0, value);
+	return accumulator * kPrime1 + kPrime4;
+}
+
+
+uint64_t
+hash_content(const void* _data, size_t length, uint64_t seed)
+{
+	// the words are read in host order, all our platforms are little endian
+	const uint8_t* data = (const uint8_t*)_data;
+	const uint8_t* end = data + length;
+	uint64_t hash;
+
+	if (length >= 32) {
+		const uint8_t* limit = end - 32;
+		uint64_t v1 = seed + kPrime1 + kPrime2;
+		uint64_t v2 = seed + kPrime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - kPrime1;
+
+		do {
+			v1 = round64(v1, read64(data));
+			v2 = round64(v2, read64(data + 8));
+			v3 = round64(v3, read64(data + 16));
+			v4 = round64(v4, read64(data + 24));
+			data += 32;
+		} while (data <= limit);
+
+		hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12)
+			+ rotate_left(v4, 18);
+		hash = merge_round(hash, v1);
+		hash = merge_round(hash, v2);
+		hash = merge_round(hash, v3);
+		hash = merge_round(hash, v4);
+	} else
+		hash = seed + kPrime5;
+
+	hash += length;
+
+	while (data + 8 <= end) {
+		hash ^= round64(0, read64(data));
+		hash = rotate_left(hash, 27) * kPrime1 + kPrime4;
+		data += 8;
+	}
+	if (data + 4 <= end) {
+		hash ^= (uint64_t)read32(data) * kPrime1;
+		hash = rotate_left(hash, 23) * kPrime2 + kPrime3;
+		data += 4;
+	}
+	while (data < end) {
+		hash ^= (*data) * kPrime5;
+		hash = rotate_left(hash, 11) * kPrime1;
+		data++;
+	}
+
+	hash ^= hash >> 33;
+	hash *= kPrime2;
+	hash ^= hash >> 29;
+	hash *= kPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+
+bool
+get_file_identity(const char* path, FileIdentity& identity, bool hashContent,
+	file_content_hook hook, void* cookie)
+{
+	memset(&identity, 0, sizeof(identity));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+
+	identity.device = st.st_dev;
+	identity.inode = st.st_ino;
+	identity.size = st.st_size;
+	identity.modificationTime = st.st_mtime;
+
+	if (!hashContent || st.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// samples are small enough to be hashed in one go
+	uint8_t* buffer = (uint8_t*)malloc(st.st_size);
+	if (buffer == NULL) {
+		close(fd);
+		return false;
+	}
+
+	size_t done = 0;
+	while (done < (size_t)st.st_size) {
+		ssize_t bytesRead = read(fd, buffer + done, st.st_size - done);
+		if (bytesRead <= 0)
+			break;
+		done += bytesRead;
+	}
+	close(fd);
+
+	bool complete = done == (size_t)st.st_size;
+	if (complete) {
+		identity.contentHash = hash_content(buffer, done);
+		if (hook != NULL)
+			hook(buffer, done, cookie);
+	}
+
+	free(buffer);
+	return complete;
+}
+
+
+bool
+same_file_version(const FileIdentity& a, const FileIdentity& b)
+{
+	if (a.contentHash != 0 && b.contentHash != 0)
+		return a.contentHash == b.contentHash;
+
+	return a.size == b.size && a.modificationTime == b.modificationTime;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef FILE_IDENTITY_H
+#define FILE_IDENTITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+struct FileIdentity {
+	uint64_t	device;
+	uint64_t	inode;
+	uint64_t	size;
+	int64_t		modificationTime;
+	uint64_t	contentHash;
+};
+
+
+// called with the content while it's in memory to be hashed, e.g. to
+// fingerprint the audio without reading the file again
+typedef void (*file_content_hook)(const uint8_t* data, size_t size,
+				void* cookie);
+
+// false if it isn't a regular file
+bool		get_file_identity(const char* path, FileIdentity& identity,
+				bool hashContent = true, file_content_hook hook = NULL,
+				void* cookie = NULL);
+bool		same_file_version(const FileIdentity& a, const FileIdentity& b);
+
+uint64_t	hash_content(const void* data, size_t length, uint64_t seed = 0);
+
+
+#endif // FILE_IDENTITY_H
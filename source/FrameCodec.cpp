@@ -0,0 +1,186 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "BitReader.h"
+#include "FrameCodec.h"
+
+#include <math.h>
+
+
+static const int32_t kChannels = 2;
+static const int32_t kHeaderSize = 6;		// the first frame, the Rice parameters
+static const uint32_t kEscapeZeros = 24;	// and a one, then the value as it is
+static const int32_t kEscapeBits = 20;
+static const float kScale = 32768.0f;
+
+
+class BitWriter {
+public:
+	BitWriter(std::vector<uint8_t>& output)
+		:
+		fOutput(output),
+		fCache(0),
+		fBits(0)
+	{
+	}
+
+	// up to 32 bits
+	void Write(uint32_t value, int32_t count)
+	{
+		fCache = fCache << count | (value & ((1ull << count) - 1));
+		fBits += count;
+		while (fBits >= 8) {
+			fBits -= 8;
+			fOutput.push_back(fCache >> fBits);
+		}
+	}
+
+	void Flush()
+	{
+		if (fBits > 0)
+			Write(0, 8 - fBits);
+	}
+
+private:
+	std::vector<uint8_t>&	fOutput;
+	uint64_t		fCache;
+	int32_t			fBits;
+};
+
+
+static inline int32_t
+predict(const int16_t* frames, int32_t frame, int32_t channel)
+{
+	// the first frame is stored as it is, the second follows the first
+	const int16_t* previous = frames + (frame - 1) * kChannels + channel;
+	if (frame == 1)
+		return previous[0];
+	return 2 * previous[0] - previous[-kChannels];
+}
+
+
+void
+quantize_frames(const float* source, int64_t frameCount, int16_t* target)
+{
+	for (int64_t i = 0; i < frameCount * kChannels; i++) {
+		float value = rintf(source[i] * kScale);
+		value = value > 32767.0f ? 32767.0f : value < -32768.0f ? -32768.0f : value;
+		target[i] = (int16_t)value;
+	}
+}
+
+
+void
+unquantize_frames(const int16_t* source, int64_t frameCount, float* target)
+{
+	for (int64_t i = 0; i < frameCount * kChannels; i++)
+		target[i] = source[i] * (1.0f / kScale);
+}
+
+
+void
+compress_block(const int16_t* frames, int32_t frameCount, std::vector<uint8_t>& output)
+{
+	// a Rice parameter per channel, from the average residual
+	uint32_t parameters[kChannels];
+	for (int32_t channel = 0; channel < kChannels; channel++) {
+		uint64_t sum = 0;
+		for (int32_t frame = 1; frame < frameCount; frame++) {
+			int32_t residual = frames[frame * kChannels + channel]
+				- predict(frames, frame, channel);
+			sum += residual < 0 ? -residual : residual;
+		}
+		uint64_t mean = frameCount > 1 ? sum / (frameCount - 1) : 0;
+		uint32_t parameter = 0;
+		while (parameter < 16 && (2ull << parameter) <= mean)
+			parameter++;
+		parameters[channel] = parameter;
+	}
+
+	for (int32_t channel = 0; channel < kChannels; channel++) {
+		uint16_t first = frames[channel];
+		output.push_back(first & 0xff);
+		output.push_back(first >> 8);
+	}
+	for (int32_t channel = 0; channel < kChannels; channel++)
+		output.push_back(parameters[channel]);
+
+	// interleaved like the frames, so they unpack in one go
+	BitWriter writer(output);
+	for (int32_t frame = 1; frame < frameCount; frame++) {
+		for (int32_t channel = 0; channel < kChannels; channel++) {
+			int32_t residual = frames[frame * kChannels + channel]
+				- predict(frames, frame, channel);
+			uint32_t value = residual >= 0 ? (uint32_t)residual << 1
+				: ((uint32_t)-residual << 1) - 1;
+			uint32_t parameter = parameters[channel];
+			uint32_t quotient = value >> parameter;
+			if (quotient >= kEscapeZeros) {
+				writer.Write(1, kEscapeZeros + 1);
+				writer.Write(value, kEscapeBits);
+				continue;
+			}
+			writer.Write(1, quotient + 1);
+			writer.Write(value, parameter);
+		}
+	}
+	writer.Flush();
+}
+
+
+bool
+expand_block(const uint8_t* data, size_t size, int32_t frameCount, float* target)
+{
+	if (size < (size_t)kHeaderSize)
+		return false;
+
+	int32_t previous[kChannels];
+	int32_t beforePrevious[kChannels];
+	uint32_t parameters[kChannels];
+	for (int32_t channel = 0; channel < kChannels; channel++) {
+		previous[channel] = (int16_t)(data[channel * 2] | data[channel * 2 + 1] << 8);
+		beforePrevious[channel] = previous[channel];
+		parameters[channel] = data[kChannels * 2 + channel];
+		if (parameters[channel] > 16)
+			return false;
+		target[channel] = previous[channel] * (1.0f / kScale);
+	}
+
+	BitReader reader(data + kHeaderSize, size - kHeaderSize);
+	for (int32_t frame = 1; frame < frameCount; frame++) {
+		for (int32_t channel = 0; channel < kChannels; channel++) {
+			uint32_t quotient = reader.ReadUnary();
+			uint32_t value;
+			if (quotient >= kEscapeZeros)
+				value = reader.Read(kEscapeBits);
+			else
+				value = quotient << parameters[channel] | reader.Read(parameters[channel]);
+			int32_t residual = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+
+			int32_t prediction = frame == 1 ? previous[channel]
+				: 2 * previous[channel] - beforePrevious[channel];
+			// clamped, only a damaged block leaves the 16 bits
+			int32_t sample = prediction + residual;
+			sample = sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample;
+			beforePrevious[channel] = previous[channel];
+			previous[channel] = sample;
+			target[frame * kChannels + channel] = sample * (1.0f / kScale);
+		}
+	}
+	return !reader.Overrun();
+}
+
+
+void
+first_frame_of_block(const uint8_t* data, float* target)
+{
+	for (int32_t channel = 0; channel < kChannels; channel++)
+		target[channel] = (int16_t)(data[channel * 2] | data[channel * 2 + 1] << 8)
+			* (1.0f / kScale);
+}
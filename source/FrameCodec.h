@@ -0,0 +1,37 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+// Stereo frames as 16 bit integers, and those losslessly compressed in
+// blocks that each unpack on their own: the first frame as it is, then what
+// a second order prediction misses, Rice coded per channel.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+// clipped to -1..1
+void	quantize_frames(const float* source, int64_t frameCount, int16_t* target);
+void	unquantize_frames(const int16_t* source, int64_t frameCount, float* target);
+
+// appended to the output
+void	compress_block(const int16_t* frames, int32_t frameCount,
+			std::vector<uint8_t>& output);
+bool	expand_block(const uint8_t* data, size_t size, int32_t frameCount,
+			float* target);
+// without unpacking the rest
+void	first_frame_of_block(const uint8_t* data, float* target);
+
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "GuestMidi.h"
+
+
+void
+encode_guest_midi_event(const GuestMidiEvent& event, uint8_t* buffer)
+{
+	uint32_t guest = (uint32_t)event.guest;
+	uint64_t time = (uint64_t)event.time;
+	for (int32_t i = 0; i < 4; i++)
+		buffer[i] = (uint8_t)(guest >> (i * 8));
+	for (int32_t i = 0; i < 8; i++)
+		buffer[4 + i] = (uint8_t)(time >> (i * 8));
+	buffer[12] = event.status;
+	buffer[13] = event.data1;
+	buffer[14] = event.data2;
+	buffer[15] = 0;
+}
+
+
+bool
+decode_guest_midi_event(const uint8_t* buffer, size_t size, int32_t padCount,
+	GuestMidiEvent& event)
+{
+	if (buffer == NULL || size != kGuestMidiEventSize)
+		return false;
+
+	uint32_t guest = 0;
+	uint64_t time = 0;
+	for (int32_t i = 0; i < 4; i++)
+		guest |= (uint32_t)buffer[i] << (i * 8);
+	for (int32_t i = 0; i < 8; i++)
+		time |= (uint64_t)buffer[4 + i] << (i * 8);
+	event.guest = (int32_t)guest;
+	event.time = (int64_t)time;
+	event.status = buffer[12];
+	event.data1 = buffer[13];
+	event.data2 = buffer[14];
+
+	if (event.status >= 0x80)
+		return true;
+	return (event.status == kGuestPadDown || event.status == kGuestPadUp)
+		&& event.data1 < padCount;
+}
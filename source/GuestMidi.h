@@ -0,0 +1,57 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef GUEST_MIDI_H
+#define GUEST_MIDI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// A Samedi that plays through another one's engine filters the MIDI of its
+// own sources, then sends what it took to the host, as well as the pads it
+// hits. The host hands each event to the guest engine with the id it gave
+// that Samedi when it attached.
+//
+// An event is a message of its own on the host's port, all values little
+// endian:
+//
+//	int32	guest
+//	int64	time		system_time() of the guest, the same clock
+//	uint8	status		MIDI, or kGuestPadDown or kGuestPadUp for a pad
+//						of the guest, with its number in data1
+//	uint8	data1
+//	uint8	data2
+//	uint8	reserved
+//
+// No Haiku API, so it can be tested on other systems.
+
+static const int32_t kGuestMidiCode = 'gmid';
+static const size_t kGuestMidiEventSize = 16;
+
+// as the engine's kPadDown and kPadUp
+static const uint8_t kGuestPadDown = 0x01;
+static const uint8_t kGuestPadUp = 0x02;
+
+struct GuestMidiEvent {
+	int32_t		guest;
+	int64_t		time;
+	uint8_t		status;
+	uint8_t		data1;
+	uint8_t		data2;
+};
+
+
+void		encode_guest_midi_event(const GuestMidiEvent& event, uint8_t* buffer);
+// false if it isn't an event of that size, or neither MIDI nor a hit of
+// one of the first padCount pads: the host's engine indexes its pads with it
+bool		decode_guest_midi_event(const uint8_t* buffer, size_t size,
+				int32_t padCount, GuestMidiEvent& event);
+
+
+#endif // GUEST_MIDI_H
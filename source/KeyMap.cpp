@@ -0,0 +1,150 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "Constants.h"
+#include "KeyMap.h"
+
+#include <Catalog.h>
+#include <InterfaceDefs.h>
+
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "KeyMap"
+
+
+KeyMap::KeyMap()
+{
+	SetDefaults();
+}
+
+
+void
+KeyMap::SetDefaults()
+{
+	// the number keys play the pads, as in Samedi 1.0
+	MakeEmpty();
+	for (int32 i = 0; i < kPadCount && i < 9; i++)
+		fPads['1' + i] = i;
+}
+
+
+void
+KeyMap::MakeEmpty()
+{
+	for (int32 i = 0; i < kKeyMapSize; i++)
+		fPads[i] = -1;
+}
+
+
+int32
+KeyMap::PadFor(int32 key) const
+{
+	if (key < 0 || key >= kKeyMapSize)
+		return -1;
+
+	return fPads[key];
+}
+
+
+void
+KeyMap::Assign(int32 key, int32 pad)
+{
+	if (key < 0 || key >= kKeyMapSize)
+		return;
+
+	fPads[key] = pad >= 0 && pad < kPadCount ? pad : -1;
+}
+
+
+void
+KeyMap::ClearPad(int32 pad)
+{
+	for (int32 i = 0; i < kKeyMapSize; i++) {
+		if (fPads[i] == pad)
+			fPads[i] = -1;
+	}
+}
+
+
+BString
+KeyMap::KeysFor(int32 pad) const
+{
+	BString keys;
+	for (int32 i = 0; i < kKeyMapSize; i++) {
+		if (fPads[i] != pad)
+			continue;
+		if (keys != "")
+			keys << ", ";
+		keys << KeyName(i);
+	}
+	return keys;
+}
+
+
+status_t
+KeyMap::Archive(BMessage* into) const
+{
+	for (int32 i = 0; i < kKeyMapSize; i++) {
+		if (fPads[i] < 0)
+			continue;
+
+		status_t status = into->AddInt32("keymap key", i);
+		if (status == B_OK)
+			status = into->AddInt32("keymap pad", fPads[i]);
+		if (status != B_OK)
+			return status;
+	}
+
+	// an empty map is saved, too, so it isn't replaced by the defaults
+	return into->AddBool("keymap", true);
+}
+
+
+status_t
+KeyMap::Unarchive(const BMessage* from)
+{
+	if (!from->GetBool("keymap", false))
+		return B_NAME_NOT_FOUND;
+
+	MakeEmpty();
+	int32 key;
+	int32 pad;
+	for (int32 i = 0; from->FindInt32("keymap key", i, &key) == B_OK
+		&& from->FindInt32("keymap pad", i, &pad) == B_OK; i++)
+		Assign(key, pad);
+
+	return B_OK;
+}
+
+
+/*static*/ BString
+KeyMap::KeyName(int32 key)
+{
+	BString name;
+	switch (key) {
+		case B_SPACE:
+			name = B_TRANSLATE_COMMENT("Space", "Key name");
+			break;
+		case B_TAB:
+			name = B_TRANSLATE_COMMENT("Tab", "Key name");
+			break;
+		case B_ENTER:
+			name = B_TRANSLATE_COMMENT("Enter", "Key name");
+			break;
+		case B_BACKSPACE:
+			name = B_TRANSLATE_COMMENT("Backspace", "Key name");
+			break;
+		default:
+			if (key > B_SPACE && key < 0x7f)
+				name << (char)key;
+			else
+				name.SetToFormat("#%" B_PRId32, key);
+			break;
+	}
+	return name;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef KEY_MAP_H
+#define KEY_MAP_H
+
+#include <Message.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+
+static const int32 kKeyMapSize = 256;
+
+
+// Which computer keys play which pad. Keys are the "raw_char" of a key
+// message, i.e. without modifiers, so Shift doesn't change the pad. A pad
+// can have any number of keys.
+
+class KeyMap {
+public:
+					KeyMap();
+
+	void			SetDefaults();
+	void			MakeEmpty();
+
+	int32			PadFor(int32 key) const;
+	void			Assign(int32 key, int32 pad);
+	void			ClearPad(int32 pad);
+	BString			KeysFor(int32 pad) const;
+
+	status_t		Archive(BMessage* into) const;
+	status_t		Unarchive(const BMessage* from);
+
+	static BString	KeyName(int32 key);
+
+private:
+	int32			fPads[kKeyMapSize];
+};
+
+
+#endif // KEY_MAP_H
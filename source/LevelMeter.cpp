@@ -0,0 +1,112 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "LevelMeter.h"
+
+#include <ControlLook.h>
+
+#include <math.h>
+
+
+static const float kMinDecibels = -60.0f;
+static const float kPeakFall = 0.85f;	// per update, about 15 dB/s at 30 Hz
+static const float kMinChange = 0.5f;	// pixels, below that it's not redrawn
+
+
+LevelMeter::LevelMeter(const char* name)
+	:
+	BView(name, B_WILL_DRAW),
+	fPeak(0.0f),
+	fRMS(0.0f),
+	fClipped(false)
+{
+	SetViewColor(B_TRANSPARENT_COLOR);
+
+	float height = be_control_look->DefaultLabelSpacing();
+	SetExplicitMinSize(BSize(height * 8, height));
+	SetExplicitMaxSize(BSize(height * 8, height));
+}
+
+
+void
+LevelMeter::Draw(BRect updateRect)
+{
+	BRect bounds = Bounds();
+	rgb_color base = ui_color(B_PANEL_BACKGROUND_COLOR);
+
+	SetHighColor(tint_color(base, B_DARKEN_2_TINT));
+	StrokeRect(bounds);
+	bounds.InsetBy(1, 1);
+
+	BRect bar(bounds);
+	bar.right = bounds.left + roundf(_Position(fRMS) * bounds.Width());
+	SetHighColor(ui_color(B_SUCCESS_COLOR));
+	if (bar.right > bar.left)
+		FillRect(bar);
+
+	BRect rest(bounds);
+	rest.left = bar.right + 1;
+	SetHighColor(tint_color(base, B_DARKEN_1_TINT));
+	if (rest.right >= rest.left)
+		FillRect(rest);
+
+	if (fPeak > 0.0f) {
+		float x = bounds.left + roundf(_Position(fPeak) * bounds.Width());
+		SetHighColor(fClipped ? ui_color(B_FAILURE_COLOR)
+			: tint_color(ui_color(B_SUCCESS_COLOR), B_DARKEN_3_TINT));
+		StrokeLine(BPoint(x, bounds.top), BPoint(x, bounds.bottom));
+	}
+}
+
+
+void
+LevelMeter::SetLevels(float peak, float rms)
+{
+	float width = Bounds().Width();
+	float oldPeak = _Position(fPeak) * width;
+	float oldRMS = _Position(fRMS) * width;
+	bool oldClipped = fClipped;
+
+	fPeak = peak > fPeak * kPeakFall ? peak : fPeak * kPeakFall;
+	fRMS = rms;
+	fClipped = fPeak >= 1.0f;
+
+	if (fabsf(_Position(fPeak) * width - oldPeak) >= kMinChange
+		|| fabsf(_Position(fRMS) * width - oldRMS) >= kMinChange
+		|| fClipped != oldClipped)
+		Invalidate();
+}
+
+
+void
+LevelMeter::Reset()
+{
+	fPeak = 0.0f;
+	fRMS = 0.0f;
+	fClipped = false;
+	Invalidate();
+}
+
+
+// #pragma mark -
+
+
+float
+LevelMeter::_Position(float level) const
+{
+	if (level <= 0.0f)
+		return 0.0f;
+
+	float decibels = 20.0f * log10f(level);
+	if (decibels <= kMinDecibels)
+		return 0.0f;
+	if (decibels >= 0.0f)
+		return 1.0f;
+	return 1.0f - decibels / kMinDecibels;
+}
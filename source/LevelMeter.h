@@ -0,0 +1,37 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef LEVEL_METER_H
+#define LEVEL_METER_H
+
+#include <View.h>
+
+
+// A horizontal bar for the RMS level with a line for the peak, on a dB
+// scale. The levels come from the engine; the peak falls back slowly here,
+// so short hits stay visible.
+
+class LevelMeter : public BView {
+public:
+					LevelMeter(const char* name);
+
+	virtual void	Draw(BRect updateRect);
+
+	void			SetLevels(float peak, float rms);
+	void			Reset();
+
+private:
+	float			_Position(float level) const;
+
+	float			fPeak;
+	float			fRMS;
+	bool			fClipped;
+};
+
+
+#endif // LEVEL_METER_H
@@ -0,0 +1,404 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "LibraryIndex.h"
+#include "AudioDecoder.h"
+#include "FileIdentity.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+
+static const char kLibraryMagic[4] = { 'S', 'M', 'D', 'L' };
+static const uint16_t kLibraryVersion = 1;
+static const size_t kHeaderSize = 12;
+static const size_t kEntryRecordSize = 36;
+
+// larger files aren't read, they are hardly samples
+static const uint64_t kMaxHashedSize = 512 * 1024 * 1024;
+
+
+static inline uint32_t
+get32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static inline uint64_t
+get64(const uint8_t* p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+
+static inline void
+put32(uint8_t* p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+
+static inline void
+put64(uint8_t* p, uint64_t value)
+{
+	put32(p, (uint32_t)value);
+	put32(p + 4, (uint32_t)(value >> 32));
+}
+
+
+bool
+is_sample_file_name(const char* name)
+{
+	static const char* kExtensions[] = {
+		"wav", "wave", "aif", "aiff", "aifc", "flac", "ogg", "oga", "mp3",
+		"m4a", "opus", "au", "snd", "raw"
+	};
+
+	const char* dot = strrchr(name, '.');
+	if (dot == NULL || name[0] == '.')
+		return false;
+
+	for (size_t i = 0; i < sizeof(kExtensions) / sizeof(kExtensions[0]); i++) {
+		if (strcasecmp(dot + 1, kExtensions[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+
+static void
+fingerprint_content(const uint8_t* data, size_t size, void* cookie)
+{
+	*(uint64_t*)cookie = AudioDecoder::Fingerprint(data, size);
+}
+
+
+// #pragma mark -
+
+
+LibraryIndex::LibraryIndex()
+{
+}
+
+
+/*static*/ bool
+LibraryIndex::Identify(const char* path, LibraryEntry& entry, bool hashContent)
+{
+	memset(&entry, 0, sizeof(entry));
+
+	FileIdentity identity;
+	if (!get_file_identity(path, identity, false))
+		return false;
+
+	// the same hash the ensembles store of their samples, the audio is
+	// fingerprinted from what was read for it
+	if (hashContent && identity.size > 0 && identity.size <= kMaxHashedSize
+		&& !get_file_identity(path, identity, true, fingerprint_content,
+			&entry.fingerprint))
+		return false;
+
+	entry.size = identity.size;
+	entry.modificationTime = identity.modificationTime;
+	entry.contentHash = identity.contentHash;
+	return true;
+}
+
+
+bool
+LibraryIndex::IsCurrent(const char* path, const LibraryEntry& entry) const
+{
+	EntryMap::const_iterator found = fEntries.find(path);
+	return found != fEntries.end() && found->second.size == entry.size
+		&& found->second.modificationTime == entry.modificationTime;
+}
+
+
+void
+LibraryIndex::Add(const char* path, const LibraryEntry& entry)
+{
+	Remove(path);
+
+	std::string key(path);
+	fEntries[key] = entry;
+	if (entry.contentHash != 0)
+		fByHash.insert(std::make_pair(entry.contentHash, key));
+	if (entry.fingerprint != 0)
+		fByFingerprint.insert(std::make_pair(entry.fingerprint, key));
+}
+
+
+bool
+LibraryIndex::Update(const char* path)
+{
+	LibraryEntry entry;
+	if (!Identify(path, entry, false)) {
+		Remove(path);
+		return false;
+	}
+	if (IsCurrent(path, entry))
+		return false;
+
+	if (!Identify(path, entry, true))
+		return false;
+	Add(path, entry);
+	return true;
+}
+
+
+void
+LibraryIndex::Remove(const char* path)
+{
+	EntryMap::iterator found = fEntries.find(path);
+	if (found == fEntries.end())
+		return;
+
+	_Unmap(fByHash, found->second.contentHash, found->first);
+	_Unmap(fByFingerprint, found->second.fingerprint, found->first);
+	fEntries.erase(found);
+}
+
+
+int32_t
+LibraryIndex::RemoveMissing(const char* folder)
+{
+	std::string prefix = _Prefix(folder);
+
+	// the paths below the folder are next to each other in the map
+	std::vector<std::string> missing;
+	EntryMap::const_iterator iterator = fEntries.lower_bound(prefix);
+	for (; iterator != fEntries.end(); iterator++) {
+		const std::string& path = iterator->first;
+		if (path.compare(0, prefix.size(), prefix) != 0)
+			break;
+
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			missing.push_back(path);
+	}
+
+	for (size_t i = 0; i < missing.size(); i++)
+		Remove(missing[i].c_str());
+	return missing.size();
+}
+
+
+int32_t
+LibraryIndex::RemoveOutside(const std::vector<std::string>& folders)
+{
+	std::vector<std::string> prefixes;
+	for (size_t i = 0; i < folders.size(); i++)
+		prefixes.push_back(_Prefix(folders[i]));
+
+	std::vector<std::string> outside;
+	EntryMap::const_iterator iterator = fEntries.begin();
+	for (; iterator != fEntries.end(); iterator++) {
+		const std::string& path = iterator->first;
+		bool inside = false;
+		for (size_t i = 0; i < prefixes.size() && !inside; i++)
+			inside = path.compare(0, prefixes[i].size(), prefixes[i]) == 0;
+		if (!inside)
+			outside.push_back(path);
+	}
+
+	for (size_t i = 0; i < outside.size(); i++)
+		Remove(outside[i].c_str());
+	return outside.size();
+}
+
+
+void
+LibraryIndex::MakeEmpty()
+{
+	fEntries.clear();
+	fByHash.clear();
+	fByFingerprint.clear();
+}
+
+
+bool
+LibraryIndex::FindByHash(uint64_t hash, std::string& path) const
+{
+	return _Find(fByHash, hash, path);
+}
+
+
+bool
+LibraryIndex::FindByFingerprint(uint64_t fingerprint, std::string& path) const
+{
+	return _Find(fByFingerprint, fingerprint, path);
+}
+
+
+void
+LibraryIndex::Search(const char* text, size_t maxCount,
+	std::vector<std::string>& paths) const
+{
+	paths.clear();
+
+	std::vector<std::string> words(1);
+	for (const char* c = text; *c != '\0'; c++) {
+		if (isspace((unsigned char)*c)) {
+			if (!words.back().empty())
+				words.push_back(std::string());
+		} else
+			words.back() += tolower((unsigned char)*c);
+	}
+	if (words.back().empty())
+		words.pop_back();
+	if (words.empty())
+		return;
+
+	std::string name;
+	EntryMap::const_iterator iterator = fEntries.begin();
+	for (; iterator != fEntries.end() && paths.size() < maxCount; iterator++) {
+		const std::string& path = iterator->first;
+		size_t slash = path.rfind('/');
+		name.assign(path, slash == std::string::npos ? 0 : slash + 1,
+			std::string::npos);
+		for (size_t i = 0; i < name.size(); i++)
+			name[i] = tolower((unsigned char)name[i]);
+
+		bool matches = true;
+		for (size_t i = 0; i < words.size() && matches; i++)
+			matches = name.find(words[i]) != std::string::npos;
+		if (matches)
+			paths.push_back(path);
+	}
+}
+
+
+void
+LibraryIndex::Flatten(std::vector<uint8_t>& output) const
+{
+	// header, then per entry its record and path, all little endian
+	size_t size = kHeaderSize;
+	EntryMap::const_iterator iterator = fEntries.begin();
+	for (; iterator != fEntries.end(); iterator++)
+		size += kEntryRecordSize + iterator->first.size();
+
+	output.assign(size, 0);
+	uint8_t* data = output.data();
+	memcpy(data, kLibraryMagic, sizeof(kLibraryMagic));
+	data[4] = kLibraryVersion;
+	data[5] = kLibraryVersion >> 8;
+	put32(data + 8, fEntries.size());
+	data += kHeaderSize;
+
+	for (iterator = fEntries.begin(); iterator != fEntries.end(); iterator++) {
+		const LibraryEntry& entry = iterator->second;
+		put64(data, entry.size);
+		put64(data + 8, (uint64_t)entry.modificationTime);
+		put64(data + 16, entry.contentHash);
+		put64(data + 24, entry.fingerprint);
+		put32(data + 32, iterator->first.size());
+		memcpy(data + kEntryRecordSize, iterator->first.data(),
+			iterator->first.size());
+		data += kEntryRecordSize + iterator->first.size();
+	}
+}
+
+
+bool
+LibraryIndex::Unflatten(const void* _data, size_t size)
+{
+	MakeEmpty();
+
+	const uint8_t* data = (const uint8_t*)_data;
+	if (size < kHeaderSize || memcmp(data, kLibraryMagic, sizeof(kLibraryMagic)) != 0)
+		return false;
+	// it's only a cache, a newer one is built anew
+	if ((data[4] | (data[5] << 8)) != kLibraryVersion)
+		return false;
+
+	uint32_t count = get32(data + 8);
+	const uint8_t* end = data + size;
+	data += kHeaderSize;
+	for (uint32_t i = 0; i < count; i++) {
+		if ((size_t)(end - data) < kEntryRecordSize)
+			break;
+
+		LibraryEntry entry;
+		entry.size = get64(data);
+		entry.modificationTime = (int64_t)get64(data + 8);
+		entry.contentHash = get64(data + 16);
+		entry.fingerprint = get64(data + 24);
+		uint32_t pathLength = get32(data + 32);
+		data += kEntryRecordSize;
+		if ((size_t)(end - data) < pathLength)
+			break;
+
+		std::string path((const char*)data, pathLength);
+		data += pathLength;
+		Add(path.c_str(), entry);
+	}
+
+	// whatever was read before a broken entry is kept
+	return fEntries.size() == count;
+}
+
+
+// #pragma mark -
+
+
+/*static*/ std::string
+LibraryIndex::_Prefix(const std::string& folder)
+{
+	if (!folder.empty() && folder[folder.size() - 1] == '/')
+		return folder;
+	return folder + '/';
+}
+
+
+/*static*/ void
+LibraryIndex::_Unmap(KeyMap& map, uint64_t key, const std::string& path)
+{
+	if (key == 0)
+		return;
+
+	std::pair<KeyMap::iterator, KeyMap::iterator> range = map.equal_range(key);
+	for (KeyMap::iterator iterator = range.first; iterator != range.second;
+			iterator++) {
+		if (iterator->second == path) {
+			map.erase(iterator);
+			return;
+		}
+	}
+}
+
+
+bool
+LibraryIndex::_Find(const KeyMap& map, uint64_t key, std::string& path) const
+{
+	if (key == 0)
+		return false;
+
+	// the index may lag behind the folders, the file has to be there still
+	// and unchanged
+	std::pair<KeyMap::const_iterator, KeyMap::const_iterator> range
+		= map.equal_range(key);
+	while (range.second != range.first) {
+		range.second--;
+		const std::string& candidate = range.second->second;
+		EntryMap::const_iterator entry = fEntries.find(candidate);
+		struct stat st;
+		if (entry != fEntries.end() && stat(candidate.c_str(), &st) == 0
+			&& (uint64_t)st.st_size == entry->second.size
+			&& st.st_mtime == entry->second.modificationTime) {
+			path = candidate;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef LIBRARY_INDEX_H
+#define LIBRARY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+// The sample files of some folders, found by the hash of their content or
+// the fingerprint of their audio. A file is only read and hashed again when
+// its size or modification time changed, so updating a known folder costs
+// little more than listing it.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+struct LibraryEntry {
+	uint64_t		size;
+	int64_t			modificationTime;
+	uint64_t		contentHash;
+	uint64_t		fingerprint;	// 0 if the audio isn't known
+};
+
+
+bool			is_sample_file_name(const char* name);
+
+
+class LibraryIndex {
+public:
+					LibraryIndex();
+
+	// just the size and modification time without hashing, which is enough
+	// to tell if an entry is current
+	static bool		Identify(const char* path, LibraryEntry& entry,
+						bool hashContent);
+	bool			IsCurrent(const char* path, const LibraryEntry& entry) const;
+	void			Add(const char* path, const LibraryEntry& entry);
+	// identifies the file if it changed, returns if it did
+	bool			Update(const char* path);
+
+	void			Remove(const char* path);
+	// of the files in and below the folder, those that are gone
+	int32_t			RemoveMissing(const char* folder);
+	// the files in none of the folders
+	int32_t			RemoveOutside(const std::vector<std::string>& folders);
+	void			MakeEmpty();
+
+	// a file that's still there, the one added last if there are several
+	bool			FindByHash(uint64_t hash, std::string& path) const;
+	bool			FindByFingerprint(uint64_t fingerprint,
+						std::string& path) const;
+	size_t			CountEntries() const { return fEntries.size(); }
+	// the files with all words of the text in their name, in any case
+	void			Search(const char* text, size_t maxCount,
+						std::vector<std::string>& paths) const;
+
+	void			Flatten(std::vector<uint8_t>& output) const;
+	bool			Unflatten(const void* data, size_t size);
+
+private:
+	typedef std::map<std::string, LibraryEntry> EntryMap;
+	typedef std::multimap<uint64_t, std::string> KeyMap;
+
+	static std::string	_Prefix(const std::string& folder);
+	static void		_Unmap(KeyMap& map, uint64_t key, const std::string& path);
+	bool			_Find(const KeyMap& map, uint64_t key,
+						std::string& path) const;
+
+	EntryMap		fEntries;
+	KeyMap			fByHash;
+	KeyMap			fByFingerprint;
+};
+
+
+#endif // LIBRARY_INDEX_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Bounded multi-producer/multi-consumer queue (after Dmitry Vyukov).
+// All storage is allocated up front, Push() and Pop() never allocate or
+// block, so both are safe to call from the audio thread.
+
+template<typename T>
+class LockFreeQueue {
+public:
+					LockFreeQueue(size_t capacity);
+					~LockFreeQueue();
+
+	bool			IsValid() const { return fCells != NULL; }
+
+	bool			Push(const T& item);
+	bool			Pop(T& item);
+
+	size_t			Capacity() const { return fMask + 1; }
+
+	// storage, so the owner can lock it into memory
+	void*			Buffer() const { return fCells; }
+	size_t			BufferSize() const { return sizeof(Cell) * (fMask + 1); }
+
+private:
+	struct Cell {
+		std::atomic<size_t>	sequence;
+		T					data;
+	};
+
+	Cell*			fCells;
+	size_t			fMask;
+
+	alignas(64) std::atomic<size_t>	fEnqueuePosition;
+	alignas(64) std::atomic<size_t>	fDequeuePosition;
+};
+
+
+template<typename T>
+LockFreeQueue<T>::LockFreeQueue(size_t capacity)
+	:
+	fCells(NULL),
+	fMask(0),
+	fEnqueuePosition(0),
+	fDequeuePosition(0)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+
+	fCells = new(std::nothrow) Cell[size];
+	if (fCells == NULL)
+		return;
+
+	fMask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		fCells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+template<typename T>
+LockFreeQueue<T>::~LockFreeQueue()
+{
+	delete[] fCells;
+}
+
+
+template<typename T>
+bool
+LockFreeQueue<T>::Push(const T& item)
+{
+	if (fCells == NULL)
+		return false;
+
+	Cell* cell;
+	size_t position = fEnqueuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &fCells[position & fMask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+		if (diff == 0) {
+			if (fEnqueuePosition.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return false; // full
+		else
+			position = fEnqueuePosition.load(std::memory_order_relaxed);
+	}
+
+	cell->data = item;
+	cell->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+
+template<typename T>
+bool
+LockFreeQueue<T>::Pop(T& item)
+{
+	if (fCells == NULL)
+		return false;
+
+	Cell* cell;
+	size_t position = fDequeuePosition.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &fCells[position & fMask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+		if (diff == 0) {
+			if (fDequeuePosition.compare_exchange_weak(position, position + 1,
+					std::memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return false; // empty
+		else
+			position = fDequeuePosition.load(std::memory_order_relaxed);
+	}
+
+	item = cell->data;
+	cell->sequence.store(position + fMask + 1, std::memory_order_release);
+	return true;
+}
+
+
+#endif // LOCK_FREE_QUEUE_H
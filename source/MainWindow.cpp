@@ -8,6 +8,8 @@
  */
 
 #include "MainWindow.h"
+#include "SampleAnalysis.h"
+#include "WavWriter.h"
 
 #include <Catalog.h>
 #include <ControlLook.h>
@@ -25,48 +27,23 @@
 #include <ScrollView.h>
 #include <SeparatorView.h>
 #include <StringView.h>
-#include <Volume.h>
+#include <TextView.h>
 
-#include <compat/sys/stat.h>
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <vector>
+
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "MainWindow"
 
 
-class AudioFilter : public BRefFilter {
-public:
-	bool	Filter(const entry_ref* entryRef, BNode* node,
-				struct stat_beos* stat, const char* fileType);
-};
-
-
-bool
-AudioFilter::Filter(const entry_ref* ref, BNode* node, struct stat_beos* stat,
-	const char* fileType)
-{
-	BEntry entry(ref, true); // traverse links
-
-	// allow folders and links of folders
-	if (entry.IsDirectory())
-		return true;
-
-	// allow audio and linked audio files
-	char mimeType[B_MIME_TYPE_LENGTH];
-	BNode traversedNode(&entry); // create a new node from the link-traversed BEntry
-	BNodeInfo(&traversedNode).GetType(mimeType);
-	if (strncmp("audio/", mimeType, 6) == 0)
-		return true;
-
-	// allow all, if volume doesn't know MIME
-	BVolume volume;
-	volume.SetTo((ref->device));
-	if (volume.KnowsMime() == false)
-		return true;
-
-	return false;
-}
+static const int32 kRenderLoops = 2;
+static const float kRenderTail = 1.0f;	// seconds
+static const int32 kRenderBufferFrames = 256;
+static const bigtime_t kDisplayInterval = 33333;	// about 30 Hz
 
 
 MainWindow::MainWindow()
@@ -74,8 +51,27 @@ MainWindow::MainWindow()
 	BWindow(BRect(200, 200, 600, 300), B_TRANSLATE_SYSTEM_NAME("Samedi"), B_TITLED_WINDOW,
 		B_NOT_ZOOMABLE | B_ASYNCHRONOUS_CONTROLS | B_QUIT_ON_WINDOW_CLOSE
 			| B_AUTO_UPDATE_SIZE_LIMITS),
+	fKeyLearnPad(-1),
+	fEnsembleIsBundle(false),
 	fRecentEnsemblePaths(10),
-	fSettings(NULL)
+	fActiveProgram(-1),
+	fLoadThread(-1),
+	fEnsembleQueued(false),
+	fQueuedRequested(0),
+	fQueuedIndex(-1),
+	fSwitchQueued(0),
+	fSwitchLoadTime(0),
+	fSwitchPreloaded(false),
+	fDisplayRunner(NULL),
+	fShowMeters(false),
+	fShowWaveforms(false),
+	fSettings(NULL),
+	fStartupLaunched(0),
+	fStartupShown(0),
+	fMidiThread(-1),
+	fAttachThread(-1),
+	fRoster(NULL),
+	fConsumer(NULL)
 {
 	_LoadSettings();
 
@@ -88,53 +84,94 @@ MainWindow::MainWindow()
 		}
 	}
 
-	// init file panels
+	// the file panels are built when they are first shown, each is a
+	// window of its own that reads its folder
 	BMessenger messenger(this);
-	entry_ref ref;
-
-	fSettings->FindRef("last sample folder", &ref);
-	fOpenSamplePanel = new BFilePanel(B_OPEN_PANEL, &messenger, &ref, B_FILE_NODE, false,
-		NULL, new AudioFilter());
-
-	fSettings->FindRef("last ensemble folder", &ref);
-	BMessage message(B_REFS_RECEIVED);
-	fOpenEnsemblePanel = new BFilePanel(B_OPEN_PANEL, &messenger, &ref, B_FILE_NODE, false,
-		&message);
-	fOpenEnsemblePanel->Window()->SetTitle(B_TRANSLATE("Samedi: Open ensemble"));
-
-	fSettings->FindRef("last ensemble save folder", &ref);
-	fSaveEnsemblePanel = new BFilePanel(B_SAVE_PANEL, &messenger, &ref, B_FILE_NODE, false);
-	fSaveEnsemblePanel->Window()->SetTitle(B_TRANSLATE("Samedi: Save ensemble"));
+	for (int32 i = 0; i < kFilePanelCount; i++)
+		fFilePanels[i] = NULL;
+	fAudioFilter = new AudioFilter();
+
+	// init audio engine and pads
+	fEngine = new AudioEngine(messenger);
+	int32 lockLimit;
+	if (fSettings->FindInt32("memory lock limit", &lockLimit) == B_OK && lockLimit > 0)
+		fEngine->SetMemoryLockLimit((size_t)lockLimit * 1024 * 1024);
+	fRecorder = new Recorder();
+	fEngine->SetRecorder(fRecorder);
 
-	// init pads
 	for (int32 i = 0; i < kPadCount; i++)
-		fPads[i] = new Pad(i, kDefaultNote + i);
+		fPads[i] = new Pad(i, kDefaultNote + i, fEngine);
+
+	// before any sample is decoded
+	Sample::SetStorage(fSettings->GetInt32("sample storage", kSampleFloat));
+	fSampleCache = new SampleCache();
+	fLibrary = new SampleLibrary();
+	fLibrary->Run();
+	fWatcher = new SampleWatcher(messenger, fSampleCache);
+	fWatcher->Run();
+	BStringList libraryFolders;
+	if (fSettings->FindStrings("library folder", &libraryFolders) == B_OK)
+		fLibrary->SetFolders(libraryFolders);
+	fSetlist = new Setlist(messenger, fEngine, fSampleCache, fLibrary);
+	BStringList setlist;
+	if (fSettings->FindStrings("setlist", &setlist) == B_OK)
+		fSetlist->SetPaths(setlist);
+	fSetlist->SetResident(fSettings->GetBool("setlist resident", false));
+	fKeyMap.Unarchive(fSettings);
+
+	fSettings->FindStrings("midi disabled source", &fDisabledMidiSources);
+	BString source;
+	int32 channels;
+	for (int32 i = 0; fSettings->FindString("midi filter source", i, &source) == B_OK
+		&& fSettings->FindInt32("midi filter channels", i, &channels) == B_OK; i++)
+		fMidiChannelFilters[source] = channels;
 
 	// build layouts
 	BMenuBar* menuBar = _BuildMenu();
 	BView* padView = _BuildPadViews();
 	BView* headerView = _BuildHeaderView();
+	BView* statusView = _BuildStatusView();
 
 	BLayoutBuilder::Group<>(this, B_VERTICAL, 0)
 		.Add(menuBar)
 		.Add(headerView)
 		.Add(new BSeparatorView(B_HORIZONTAL))
 		.Add(padView)
+		.Add(new BSeparatorView(B_HORIZONTAL))
+		.Add(statusView)
 		.End();
 
-	// create MidiConsumer
+	fEngine->SetOutputBuses(fSettings->GetInt32("output buses", 1));
+	fEngine->SetRenderThreads(fSettings->GetInt32("render threads", 0));
+	_ShowMeters(fSettings->GetBool("show meters", false));
+	_ShowWaveforms(fSettings->GetBool("show waveforms", false));
+
+	// runs hidden until it's shown from the menu
+	fSequencerWindow = new SequencerWindow(messenger, fEngine, fSettings);
+	fSequencerWindow->Hide();
+	fSequencerWindow->Show();
+	fSearchWindow = new SampleSearchWindow(messenger, fLibrary);
+	fSearchWindow->Hide();
+	fSearchWindow->Show();
+
+	// the first call to the MIDI roster waits for the MIDI server, so
+	// that's done in the background
 	fMessenger = new BMessenger(this, NULL);
-	fConsumer = new MidiConsumer(fMessenger);
-	fRoster = BMidiRoster::MidiRoster();
-	fRoster->StartWatching(fMessenger);
-
-	// Auto-connect, to first MIDI producer found
-	int32 id = 0;
-	BMidiProducer* producer = NULL;
-	if ((producer = fRoster->NextProducer(&id)) != NULL) {
-		if (producer->IsValid())
-			producer->Connect(fConsumer);
-	}
+	fMidiThread = spawn_thread(_MidiThread, "samedi midi roster", B_NORMAL_PRIORITY,
+		fMessenger);
+	if (fMidiThread < 0)
+		_StartMidi();
+	else
+		resume_thread(fMidiThread);
+
+	// a Samedi that's busy takes a while to answer whether it plays for
+	// this one, the engine starts once that's settled
+	fAttachThread = spawn_thread(_AttachThread, "samedi attach", B_NORMAL_PRIORITY,
+		fMessenger);
+	if (fAttachThread < 0)
+		fEngine->Start();
+	else
+		resume_thread(fAttachThread);
 }
 
 
@@ -142,10 +179,44 @@ MainWindow::~MainWindow()
 {
 	_SaveSettings();
 
-	fConsumer->Release();
-	delete fOpenSamplePanel;
-	delete fOpenEnsemblePanel;
-	delete fSaveEnsemblePanel;
+	delete fDisplayRunner;
+	if (fMidiThread >= 0) {
+		status_t result;
+		wait_for_thread(fMidiThread, &result);
+	}
+	if (fAttachThread >= 0) {
+		status_t result;
+		wait_for_thread(fAttachThread, &result);
+	}
+	if (fConsumer != NULL)
+		fConsumer->Release();
+	if (fSequencerWindow->Lock())
+		fSequencerWindow->Quit();
+	if (fSearchWindow->Lock())
+		fSearchWindow->Quit();
+
+	// everything holding samples goes before the engine, which locked them
+	if (fLoadThread >= 0) {
+		status_t result;
+		wait_for_thread(fLoadThread, &result);
+	}
+	fLoadingEnsemble.Unset();
+	delete fSetlist;
+	if (fLibrary->Lock())
+		fLibrary->Quit();
+	if (fWatcher->Lock())
+		fWatcher->Quit();
+	for (int32 i = 0; i < kPadCount; i++) {
+		fPads[i]->RemoveSelf();
+		delete fPads[i];
+	}
+	fEnsemble.Unset();
+	fSwappedEnsemble.Unset();
+	delete fSampleCache;
+	delete fEngine;
+	delete fRecorder;
+	for (int32 i = 0; i < kFilePanelCount; i++)
+		delete fFilePanels[i];
 	delete fMessenger;
 }
 
@@ -153,11 +224,58 @@ MainWindow::~MainWindow()
 // #pragma mark -
 
 
+void
+MainWindow::DispatchMessage(BMessage* msg, BHandler* handler)
+{
+	// Pads are played from the keyboard right here, before the message
+	// goes anywhere else.
+	if ((msg->what == B_KEY_DOWN || msg->what == B_KEY_UP) && _HandleKey(msg))
+		return;
+
+	BWindow::DispatchMessage(msg, handler);
+}
+
+
 void
 MainWindow::MenusBeginning()
 {
 	_PopulateMidiInMenu();
 	_PopulateOpenRecentMenu();
+	_PopulateSetlistMenu();
+
+	fMetersMenu->SetMarked(fShowMeters);
+	fWaveformsMenu->SetMarked(fShowWaveforms);
+	for (int32 i = 0; i < fOutputsMenu->CountItems(); i++) {
+		BMenuItem* item = fOutputsMenu->ItemAt(i);
+		item->SetMarked(item->Message()->GetInt32("buses", 0) == fEngine->OutputBuses());
+	}
+	_PopulateRenderThreadsMenu();
+	_PopulateSampleMemoryMenu();
+	_PopulateLibraryMenu();
+	bigtime_t plain, metered, processed;
+	fEngine->GetRenderTimes(plain, metered);
+	BString text(B_TRANSLATE("Mixing: %plain% µs per buffer, %metered% µs with meters"));
+	BString number;
+	number << plain;
+	text.ReplaceFirst("%plain%", number);
+	number = "";
+	number << metered;
+	text.ReplaceFirst("%metered%", number);
+	fRenderTimeMenu->SetLabel(text);
+
+	fEngine->GetVoiceTimes(plain, processed);
+	text = B_TRANSLATE("Per voice: %plain% ns plain, %processed% ns with filter or envelope");
+	number = "";
+	number << plain;
+	text.ReplaceFirst("%plain%", number);
+	number = "";
+	number << processed;
+	text.ReplaceFirst("%processed%", number);
+	fVoiceTimeMenu->SetLabel(text);
+
+	fRecordMenu->SetMarked(fRecorder->IsRecording());
+	fExportRecordingMenu->SetEnabled(fRecorder->CountEvents() > 0
+		|| fRecorder->IsRecording());
 }
 
 
@@ -187,6 +305,59 @@ MainWindow::MessageReceived(BMessage* msg)
 			_HandleMIDI(msg);
 			break;
 		}
+		case ENGINE_STATUS:
+		{
+			BString text;
+			if (msg->FindString("text", &text) == B_OK)
+				_SetStatus(text, msg->GetBool("warning", false));
+			break;
+		}
+		case ENGINE_ATTACHED:
+		{
+			status_t result;
+			wait_for_thread(fAttachThread, &result);
+			fAttachThread = -1;
+
+			BMessage reply;
+			if (msg->FindMessage("host", &reply) == B_OK
+				&& fEngine->AttachToHost(reply) == B_OK) {
+				_ShowRemote(true);
+				_SendEngineState();
+			} else
+				fEngine->Start();
+			break;
+		}
+		case ENGINE_HOST_LOST:
+		{
+			if (!fEngine->IsRemote())
+				break;
+			fEngine->PlayLocally();
+			_ShowRemote(false);
+			_SendEngineState();
+			break;
+		}
+		case ENGINE_LEVELS:
+		{
+			fEngine->ApplyRemoteLevels(msg);
+			break;
+		}
+		case KIT_SWAPPED:
+		{
+			_FollowKitSwap(msg);
+			break;
+		}
+		case PROGRAM_NOT_RESIDENT:
+		{
+			// not in the engine (yet), switch to it the slow way
+			int32 program = msg->GetInt32("program", -1);
+			bigtime_t requested = msg->GetInt64("requested", system_time());
+			Ensemble* ensemble = fSetlist->ResidentAt(program);
+			if (ensemble == NULL)
+				_SwitchToSetlistEntry(program, requested);
+			else if (_SwitchEnsemble(ensemble, requested, true))
+				fSetlist->SetCurrentIndex(program);
+			break;
+		}
 
 		case HELP:
 		{
@@ -195,7 +366,7 @@ MainWindow::MessageReceived(BMessage* msg)
 		}
 		case OPEN_ENSEMBLE:
 		{
-			fOpenEnsemblePanel->Show();
+			_FilePanel(kOpenEnsemblePanel)->Show();
 			break;
 		}
 		case OPEN_RECENT:
@@ -212,12 +383,15 @@ MainWindow::MessageReceived(BMessage* msg)
 		}
 		case SAVE_ENSEMBLE:
 		{
-			_SaveEnsemble();
+			if (fEnsembleIsBundle)
+				_ExportBundle(fEnsemblePath);
+			else
+				_SaveEnsemble();
 			break;
 		}
 		case SAVE_AS_ENSEMBLE:
 		{
-			fSaveEnsemblePanel->Show();
+			_FilePanel(kSaveEnsemblePanel)->Show();
 			break;
 		}
 		case B_SAVE_REQUESTED:
@@ -229,10 +403,209 @@ MainWindow::MessageReceived(BMessage* msg)
 				BDirectory directory(&ref);
 				BEntry entry(&directory, name);
 				fEnsemblePath = BPath(&entry);
+				fEnsembleIsBundle = false;
 				_SaveEnsemble();
 			}
 			break;
 		}
+		case EXPORT_BUNDLE:
+		{
+			_FilePanel(kExportBundlePanel)->Show();
+			break;
+		}
+		case EXPORT_BUNDLE_REQUESTED:
+		{
+			entry_ref ref;
+			const char* name;
+			if (msg->FindRef("directory", &ref) == B_OK
+				&& msg->FindString("name", &name) == B_OK) {
+				BDirectory directory(&ref);
+				BEntry entry(&directory, name);
+				_ExportBundle(BPath(&entry));
+			}
+			break;
+		}
+		case SEQUENCER_SHOW:
+		{
+			if (fSequencerWindow->Lock()) {
+				if (fSequencerWindow->IsHidden())
+					fSequencerWindow->Show();
+				else
+					fSequencerWindow->Activate();
+				fSequencerWindow->Unlock();
+			}
+			break;
+		}
+		case RENDER_PATTERN:
+		{
+			_FilePanel(kRenderPatternPanel)->Show();
+			break;
+		}
+		case RENDER_PATTERN_REQUESTED:
+		{
+			entry_ref ref;
+			const char* name;
+			if (msg->FindRef("directory", &ref) == B_OK
+				&& msg->FindString("name", &name) == B_OK) {
+				BDirectory directory(&ref);
+				BEntry entry(&directory, name);
+				_RenderPattern(BPath(&entry));
+			}
+			break;
+		}
+		case SET_OUTPUT_BUSES:
+		{
+			status_t status = fEngine->SetOutputBuses(msg->GetInt32("buses", 1));
+			if (status != B_OK) {
+				BString text(B_TRANSLATE("⚠ Could not change the outputs: %error%"));
+				text.ReplaceFirst("%error%", strerror(status));
+				_SetStatus(text, true);
+			}
+			break;
+		}
+		case SET_RENDER_THREADS:
+		{
+			status_t status = fEngine->SetRenderThreads(msg->GetInt32("threads", 0));
+			if (status != B_OK) {
+				BString text(B_TRANSLATE("⚠ Could not change the render threads: %error%"));
+				text.ReplaceFirst("%error%", strerror(status));
+				_SetStatus(text, true);
+			}
+			break;
+		}
+		case SET_SAMPLE_STORAGE:
+		{
+			Sample::SetStorage(msg->GetInt32("storage", kSampleFloat));
+			_SetStatus(B_TRANSLATE("The sample memory applies to the samples loaded from now on"),
+				false);
+			break;
+		}
+		case ADD_LIBRARY_FOLDER:
+		{
+			_FilePanel(kLibraryFolderPanel)->Show();
+			break;
+		}
+		case ADD_LIBRARY_FOLDER_REQUESTED:
+		{
+			entry_ref ref;
+			if (msg->FindRef("refs", &ref) == B_OK)
+				_SetLibraryFolder(BPath(&ref).Path(), true);
+			break;
+		}
+		case REMOVE_LIBRARY_FOLDER:
+		{
+			const char* folder;
+			if (msg->FindString("folder", &folder) == B_OK)
+				_SetLibraryFolder(folder, false);
+			break;
+		}
+		case SHOW_METERS:
+		{
+			_ShowMeters(!fShowMeters);
+			break;
+		}
+		case SHOW_WAVEFORMS:
+		{
+			_ShowWaveforms(!fShowWaveforms);
+			break;
+		}
+		case UPDATE_DISPLAYS:
+		{
+			_UpdateDisplays();
+			break;
+		}
+		case RECORD_PERFORMANCE:
+		{
+			_ToggleRecording();
+			break;
+		}
+		case EXPORT_RECORDING:
+		{
+			if (fRecorder->IsRecording())
+				_ToggleRecording();
+			_FilePanel(kExportRecordingPanel)->Show();
+			break;
+		}
+		case EXPORT_RECORDING_REQUESTED:
+		{
+			entry_ref ref;
+			const char* name;
+			if (msg->FindRef("directory", &ref) == B_OK
+				&& msg->FindString("name", &name) == B_OK) {
+				BDirectory directory(&ref);
+				BEntry entry(&directory, name);
+				_ExportRecording(BPath(&entry));
+			}
+			break;
+		}
+		case SETLIST_NEXT:
+		case SETLIST_PREVIOUS:
+		{
+			// MIDI and menu messages carry the time they were triggered
+			int32 index = fSetlist->CurrentIndex() + (msg->what == SETLIST_NEXT ? 1 : -1);
+			_SwitchToSetlistEntry(index, msg->GetInt64("when", system_time()));
+			break;
+		}
+		case SETLIST_SELECT:
+		{
+			int32 index;
+			if (msg->FindInt32("index", &index) == B_OK)
+				_SwitchToSetlistEntry(index, msg->GetInt64("when", system_time()));
+			break;
+		}
+		case SETLIST_ADD:
+		{
+			if (fEnsemblePath.InitCheck() != B_OK)
+				break;
+
+			fSetlist->Add(fEnsemblePath.Path());
+			fSetlist->SetCurrentIndex(fSetlist->CountEntries() - 1);
+			break;
+		}
+		case SETLIST_CLEAR:
+		{
+			_SetResident(false);
+			fSetlist->MakeEmpty();
+			break;
+		}
+		case SETLIST_RESIDENT:
+		{
+			_SetResident(!fSetlist->IsResident());
+			break;
+		}
+		case ENSEMBLE_LOADED:
+		{
+			_EnsembleLoaded(msg);
+			break;
+		}
+		case ENSEMBLE_PAD_LOADING:
+		case ENSEMBLE_PAD_READY:
+		{
+			_ShowPadLoading(msg);
+			break;
+		}
+		case STARTUP_TIMES:
+		{
+			// drawn right now, the first update may still be pending
+			UpdateIfNeeded();
+			fStartupLaunched = msg->GetInt64("launched", system_time());
+			fStartupShown = system_time();
+			entry_ref ref;
+			if (msg->FindRef("refs", &ref) == B_OK)
+				_LoadEnsemble(ref);
+			else
+				_ReportStartupTimes(B_OK);
+			break;
+		}
+		case SETLIST_PRELOADED:
+		{
+			int32 index = fSetlist->PreloadFinished(msg);
+			if (index >= 0) {
+				fEngine->SetResidentKit(index, _CreateKit(fSetlist->ResidentAt(index)));
+				_ReportResidentMemory();
+			}
+			break;
+		}
 		case CLEARALL:
 		{
 			int32 note = kDefaultNote;
@@ -243,65 +616,109 @@ MainWindow::MessageReceived(BMessage* msg)
 			}
 			break;
 		}
+		case MIDI_ROSTER_READY:
+		{
+			status_t result;
+			wait_for_thread(fMidiThread, &result);
+			fMidiThread = -1;
+			_StartMidi();
+			break;
+		}
 		case MIDI_IN_MENU:
 		{
 			int32 id = msg->FindInt32("port_id");
 			BMidiProducer* producer = fRoster->FindProducer(id);
 			if (producer) {
-				if (producer->IsConnected(fConsumer))
+				if (producer->IsConnected(fConsumer)) {
 					producer->Disconnect(fConsumer);
-				else
+					fDisabledMidiSources.Add(producer->Name());
+				} else {
 					producer->Connect(fConsumer);
+					fDisabledMidiSources.Remove(producer->Name());
+				}
+				producer->Release();
 			}
 			break;
 		}
+		case MIDI_CHANNEL_FILTER:
+		{
+			int32 id = msg->GetInt32("port_id", -1);
+			int32 channel = msg->GetInt32("channel", -1);
+			BMidiProducer* producer = fRoster->FindProducer(id);
+			if (producer == NULL)
+				break;
+
+			uint16 channels = fConsumer->ChannelFilter(id);
+			if (channel < 0)
+				channels = channels == kAllMidiChannels ? 0 : kAllMidiChannels;
+			else
+				channels ^= 1 << channel;
+			fConsumer->SetChannelFilter(id, channels);
+			fMidiChannelFilters[producer->Name()] = channels;
+			producer->Release();
+			break;
+		}
 		case SOLO:
 		{
 			int32 soloPad;
 			int32 state;
 			if ((msg->FindInt32("pad", &soloPad) == B_OK) &&
-				(msg->FindInt32("solo", &state) == B_OK)) {
-
-				if (state == B_CONTROL_ON) {
-					for (int32 i = 0; i < kPadCount; i++) {
-						// mute all other pads
-						if (i != soloPad)
-							fPads[i]->Mute(B_CONTROL_ON);
-						// unmute the solo pad
-						else
-							fPads[i]->Mute(B_CONTROL_OFF);
-					}
-				} else {
-					for (int32 i = 0; i < kPadCount; i++)
-						fPads[i]->Mute(B_CONTROL_OFF);
-				}
-			}
+				(msg->FindInt32("solo", &state) == B_OK))
+				_SoloPad(soloPad, state);
 			break;
 		}
-		case PLAY:
+		case NEW_NOTE:
 		{
 			int32 note;
 			if (msg->FindInt32("note", &note) == B_OK) {
 				for (int32 i = 0; i < kPadCount; i++)
-					fPads[i]->Play(note);
+					fPads[i]->DetectNote(note);
 			}
 			break;
 		}
+		case ASSIGN_KEY:
+		{
+			_LearnKey(msg->GetInt32("pad", -1));
+			break;
+		}
+		case CLEAR_KEYS:
+		{
+			int32 pad = msg->GetInt32("pad", -1);
+			fKeyMap.ClearPad(pad);
+			if (pad == fKeyLearnPad)
+				_LearnKey(-1);
+			break;
+		}
 		case OPEN_SAMPLE:
 		{
 			int32 pad;
 			if (msg->FindInt32("pad", &pad) == B_OK) {
+				BFilePanel* panel = _FilePanel(kOpenSamplePanel);
 				BMessage* openMsg = new BMessage(LOAD_SAMPLE);
 				openMsg->AddInt32("pad", pad);
-				fOpenSamplePanel->SetMessage(openMsg);
+				panel->SetMessage(openMsg);
 
 				BString title(B_TRANSLATE("Samedi: Open sample"));
 				title << " #" << pad + 1;
-				fOpenSamplePanel->Window()->SetTitle(title);
-				fOpenSamplePanel->Show();
+				panel->Window()->SetTitle(title);
+				panel->Show();
 			}
 			break;
 		}
+		case FIND_SAMPLE:
+		{
+			fSearchWindow->ShowForPad(msg->GetInt32("pad", 0));
+			break;
+		}
+		case SAMPLE_RELOADED:
+		{
+			Sample* sample;
+			if (msg->FindPointer("sample", (void**)&sample) != B_OK)
+				break;
+			_ReloadSample(sample);
+			sample->ReleaseReference();
+			break;
+		}
 		case LOAD_SAMPLE:
 		{
 			entry_ref ref;
@@ -343,6 +760,79 @@ MainWindow::_BuildMenu()
 
 	menu->AddSeparatorItem();
 
+	fMetersMenu = new BMenuItem(B_TRANSLATE("Show level meters"), new BMessage(SHOW_METERS));
+	menu->AddItem(fMetersMenu);
+	fWaveformsMenu = new BMenuItem(B_TRANSLATE("Show waveforms"), new BMessage(SHOW_WAVEFORMS));
+	menu->AddItem(fWaveformsMenu);
+
+	// the channel pairs of the media node, one for each bus
+	fOutputsMenu = new BMenu(B_TRANSLATE("Outputs"));
+	fOutputsMenu->SetRadioMode(true);
+	for (int32 i = 1; i <= kBusCount; i *= 2) {
+		BMessage* msg = new BMessage(SET_OUTPUT_BUSES);
+		msg->AddInt32("buses", i);
+		BString label;
+		if (i == 1)
+			label = B_TRANSLATE("Main only (2 channels)");
+		else {
+			label = B_TRANSLATE("Main and buses 2 to %last% (%channels% channels)");
+			BString number;
+			number << i;
+			label.ReplaceFirst("%last%", number);
+			number = "";
+			number << i * kEngineChannels;
+			label.ReplaceFirst("%channels%", number);
+		}
+		fOutputsMenu->AddItem(new BMenuItem(label, msg));
+	}
+	menu->AddItem(fOutputsMenu);
+
+	// the voices per millisecond each thread count managed are added when
+	// the menu opens, so they can be compared
+	fRenderThreadsMenu = new BMenu(B_TRANSLATE("Render threads"));
+	for (int32 i = 0; i <= kMaxRenderThreads; i = i == 0 ? 1 : i * 2) {
+		BMessage* msg = new BMessage(SET_RENDER_THREADS);
+		msg->AddInt32("threads", i);
+		BString label;
+		if (i == 0)
+			label = B_TRANSLATE("One per CPU");
+		else if (i == 1)
+			label = B_TRANSLATE("1 thread");
+		else {
+			label = B_TRANSLATE("%threads% threads");
+			BString number;
+			number << i;
+			label.ReplaceFirst("%threads%", number);
+		}
+		fRenderThreadsMenu->AddItem(new BMenuItem(label, msg));
+	}
+	fRenderThreadsMenu->AddSeparatorItem();
+	menu->AddItem(fRenderThreadsMenu);
+	fRenderTimeMenu = new BMenuItem("", NULL);
+	fRenderTimeMenu->SetEnabled(false);
+	menu->AddItem(fRenderTimeMenu);
+	fVoiceTimeMenu = new BMenuItem("", NULL);
+	fVoiceTimeMenu->SetEnabled(false);
+	menu->AddItem(fVoiceTimeMenu);
+
+	// what packing saved and what unpacking costs are added when the menu
+	// opens
+	fSampleMemoryMenu = new BMenu(B_TRANSLATE("Sample memory"));
+	const char* storages[] = {
+		B_TRANSLATE("Float (32 bit)"),
+		B_TRANSLATE("16 bit"),
+		B_TRANSLATE("Compressed (16 bit)")
+	};
+	for (int32 i = kSampleFloat; i <= kSampleCompressed; i++) {
+		BMessage* msg = new BMessage(SET_SAMPLE_STORAGE);
+		msg->AddInt32("storage", i);
+		fSampleMemoryMenu->AddItem(new BMenuItem(storages[i], msg));
+	}
+	fSampleMemoryMenu->AddSeparatorItem();
+	menu->AddItem(fSampleMemoryMenu);
+
+	menu->AddSeparatorItem();
+
 	item = new BMenuItem(B_TRANSLATE("Quit"), new BMessage(B_QUIT_REQUESTED), 'Q');
 	menu->AddItem(item);
 	menuBar->AddItem(menu);
@@ -365,12 +855,47 @@ MainWindow::_BuildMenu()
 		new BMessage(SAVE_AS_ENSEMBLE), 'S', B_SHIFT_KEY);
 	menu->AddItem(item);
 
+	item = new BMenuItem(B_TRANSLATE("Export bundle" B_UTF8_ELLIPSIS),
+		new BMessage(EXPORT_BUNDLE), 'E');
+	menu->AddItem(item);
+
+	menu->AddSeparatorItem();
+
+	// the folders and what's indexed of them are added when the menu opens
+	fLibraryMenu = new BMenu(B_TRANSLATE("Sample library"));
+	item = new BMenuItem(B_TRANSLATE("Add folder" B_UTF8_ELLIPSIS),
+		new BMessage(ADD_LIBRARY_FOLDER));
+	fLibraryMenu->AddItem(item);
+	menu->AddItem(fLibraryMenu);
+
 	menu->AddSeparatorItem();
 
 	item = new BMenuItem(B_TRANSLATE("Clear all pads"),	new BMessage(CLEARALL), 'D', B_SHIFT_KEY);
 	menu->AddItem(item);
 	menuBar->AddItem(menu);
 
+	// menu Setlist
+	fSetlistMenu = new BMenu(B_TRANSLATE("Setlist"));
+	menuBar->AddItem(fSetlistMenu);
+
+	// menu Sequencer
+	menu = new BMenu(B_TRANSLATE("Sequencer"));
+	item = new BMenuItem(B_TRANSLATE("Show sequencer"), new BMessage(SEQUENCER_SHOW), 'T');
+	menu->AddItem(item);
+	item = new BMenuItem(B_TRANSLATE("Render pattern to file" B_UTF8_ELLIPSIS),
+		new BMessage(RENDER_PATTERN));
+	menu->AddItem(item);
+
+	menu->AddSeparatorItem();
+
+	fRecordMenu = new BMenuItem(B_TRANSLATE("Record performance"),
+		new BMessage(RECORD_PERFORMANCE), 'R');
+	menu->AddItem(fRecordMenu);
+	fExportRecordingMenu = new BMenuItem(B_TRANSLATE("Export recording as MIDI file" B_UTF8_ELLIPSIS),
+		new BMessage(EXPORT_RECORDING));
+	menu->AddItem(fExportRecordingMenu);
+	menuBar->AddItem(menu);
+
 	// menu Midi in
 	fMidiInMenu = new BMenu(B_TRANSLATE("MIDI in"));
 	menuBar->AddItem(fMidiInMenu);
@@ -425,12 +950,10 @@ MainWindow::_BuildHeaderView()
 	sample->SetFont(&font, B_FONT_SIZE);
 	dummy->SetFont(&font, B_FONT_SIZE);
 
-	float width, height;
-	fPads[0]->FindView("notecontrol")->GetPreferredSize(&width, &height);
-	pad->SetExplicitSize(BSize(width, B_SIZE_UNSET));
+	float height = fPads[0]->CellHeight();
+	pad->SetExplicitSize(BSize(fPads[0]->NoteWidth(), B_SIZE_UNSET));
 	modes->SetExplicitSize(BSize(height * 3, B_SIZE_UNSET));
-	fPads[0]->FindView("sample")->GetPreferredSize(&width, &height);
-	sample->SetExplicitSize(BSize(width, B_SIZE_UNSET));
+	sample->SetExplicitSize(BSize(fPads[0]->SampleWidth(), B_SIZE_UNSET));
 	dummy->SetExplicitSize(BSize(height * 3, B_SIZE_UNSET));
 
 	const float kSpacing = be_control_look->DefaultItemSpacing();
@@ -453,54 +976,176 @@ MainWindow::_BuildHeaderView()
 	return headerView;
 }
 
+BView*
+MainWindow::_BuildStatusView()
+{
+	fStatusView = new BStringView("status", "");
+	fStatusView->SetExplicitMinSize(BSize(0, B_SIZE_UNSET));
+
+	BFont font(be_plain_font);
+	font.SetSize(ceilf(font.Size() * 0.8));
+	fStatusView->SetFont(&font, B_FONT_SIZE);
+
+	fMasterMeter = new LevelMeter("master meter");
+	fMasterMeter->SetToolTip(B_TRANSLATE("Level of the loudest output"));
+	fMasterMeter->Hide();
+
+	const float kSpacing = be_control_look->DefaultItemSpacing();
+	BView* statusView = new BView("statusView", B_SUPPORTS_LAYOUT);
+	BLayoutBuilder::Group<>(statusView, B_HORIZONTAL, 0)
+		.SetInsets(B_USE_WINDOW_SPACING, kSpacing / 4, B_USE_WINDOW_SPACING, kSpacing / 4)
+		.Add(fStatusView)
+		.AddStrut(B_USE_SMALL_SPACING)
+		.Add(fMasterMeter)
+	.End();
+
+	return statusView;
+}
+
+
 void
 MainWindow::_PopulateMidiInMenu()
 {
 	fMidiInMenu->RemoveItems(0, fMidiInMenu->CountItems(), true);
+	if (fRoster == NULL) {
+		BMenuItem* item = new BMenuItem(B_TRANSLATE("Looking for MIDI sources…"), NULL);
+		item->SetEnabled(false);
+		fMidiInMenu->AddItem(item);
+		return;
+	}
 
 	int32 id = 0;
 	BMidiProducer* producer = NULL;
 
+	// all sources are merged, each one can be limited to some channels
 	while ((producer = fRoster->NextProducer(&id)) != NULL) {
 		if (producer->IsValid()) {
+			bool connected = producer->IsConnected(fConsumer);
+			BMenu* sourceMenu = new BMenu(producer->Name());
+
 			BMessage* msg = new BMessage(MIDI_IN_MENU);
 			msg->AddInt32("port_id", id);
-			BMenuItem* item = new BMenuItem(producer->Name(), msg);
+			BMenuItem* item = new BMenuItem(B_TRANSLATE("Connected"), msg);
+			item->SetMarked(connected);
+			sourceMenu->AddItem(item);
+			sourceMenu->AddSeparatorItem();
+
+			uint16 channels = fConsumer->ChannelFilter(id);
+			for (int32 channel = -1; channel < 16; channel++) {
+				msg = new BMessage(MIDI_CHANNEL_FILTER);
+				msg->AddInt32("port_id", id);
+				msg->AddInt32("channel", channel);
+				BString label;
+				if (channel < 0)
+					label = B_TRANSLATE("All channels");
+				else {
+					label = B_TRANSLATE("Channel %channel%");
+					BString number;
+					number << channel + 1;
+					label.ReplaceFirst("%channel%", number);
+				}
+				item = new BMenuItem(label, msg);
+				item->SetMarked(channel < 0 ? channels == kAllMidiChannels
+					: (channels & (1 << channel)) != 0);
+				item->SetEnabled(connected);
+				sourceMenu->AddItem(item);
+			}
+			sourceMenu->SetTargetForItems(this);
+
+			item = new BMenuItem(sourceMenu);
+			item->SetMarked(connected);
 			fMidiInMenu->AddItem(item);
-			if (producer->IsConnected(fConsumer))
-				item->SetMarked(true);
-			else
-				item->SetMarked(false);
 		}
+		producer->Release();
 	}
 
-	// Auto-connect, if only one MIDI producer was found
-	if (fMidiInMenu->CountItems() == 1) {
-		int32 id = 0;
-		BMidiProducer* producer = NULL;
-		if ((producer = fRoster->NextProducer(&id)) != NULL) {
-			if (producer->IsValid()) {
-				producer->Connect(fConsumer);
-				fMidiInMenu->ItemAt(0)->SetMarked(true);
-			}
-		}
+	uint64 events;
+	bigtime_t time;
+	fEngine->GetMidiStats(events, time);
+	uint64 filtered = fConsumer->FilteredCount();
+	if (events > 0 || filtered > 0)
+		fMidiInMenu->AddSeparatorItem();
+
+	if (events > 0) {
+		BString text(B_TRANSLATE("%events% events handled, %time% µs each"));
+		BString number;
+		number << events;
+		text.ReplaceFirst("%events%", number);
+		number.SetToFormat("%.2f", (double)time / events);
+		text.ReplaceFirst("%time%", number);
+		BMenuItem* item = new BMenuItem(text, NULL);
+		item->SetEnabled(false);
+		fMidiInMenu->AddItem(item);
+	}
+	if (filtered > 0) {
+		BString text(B_TRANSLATE("%filtered% messages filtered"));
+		BString number;
+		number << filtered;
+		text.ReplaceFirst("%filtered%", number);
+		BMenuItem* item = new BMenuItem(text, NULL);
+		item->SetEnabled(false);
+		fMidiInMenu->AddItem(item);
 	}
-
 }
 
 
 void
-MainWindow::_PopulateOpenRecentMenu()
+MainWindow::_ConnectMidiSource(BMidiProducer* producer)
 {
-	fOpenRecentMenu->RemoveItems(0, fOpenRecentMenu->CountItems(), true);
+	if (!producer->IsValid() || producer->IsConnected(fConsumer))
+		return;
 
-	int32 menu = 0;
-	BString filepath;
-	for (int32 i = fRecentEnsemblePaths.CountStrings() - 1; i >= 0; i--) {
-		filepath = fRecentEnsemblePaths.StringAt(i);
-		BMessage* msg = new BMessage(OPEN_RECENT);
-		msg->AddInt32("menu", menu++);
-		msg->AddString("filepath", filepath);
+	// sources are remembered by name, their IDs change with every session
+	BString name = producer->Name();
+	std::map<BString, uint16>::iterator found = fMidiChannelFilters.find(name);
+	if (found != fMidiChannelFilters.end())
+		fConsumer->SetChannelFilter(producer->ID(), found->second);
+
+	if (!fDisabledMidiSources.HasString(name))
+		producer->Connect(fConsumer);
+}
+
+
+/*static*/ status_t
+MainWindow::_MidiThread(void* data)
+{
+	BMidiRoster::MidiRoster();
+
+	BMessenger* messenger = (BMessenger*)data;
+	messenger->SendMessage(MIDI_ROSTER_READY);
+	return B_OK;
+}
+
+
+void
+MainWindow::_StartMidi()
+{
+	fConsumer = new MidiConsumer(fMessenger, fEngine);
+	fRoster = BMidiRoster::MidiRoster();
+	fRoster->StartWatching(fMessenger);
+
+	// connect all MIDI sources, except those turned off before
+	int32 id = 0;
+	BMidiProducer* producer = NULL;
+	while ((producer = fRoster->NextProducer(&id)) != NULL) {
+		_ConnectMidiSource(producer);
+		producer->Release();
+	}
+}
+
+
+void
+MainWindow::_PopulateOpenRecentMenu()
+{
+	fOpenRecentMenu->RemoveItems(0, fOpenRecentMenu->CountItems(), true);
+
+	int32 menu = 0;
+	BString filepath;
+	for (int32 i = fRecentEnsemblePaths.CountStrings() - 1; i >= 0; i--) {
+		filepath = fRecentEnsemblePaths.StringAt(i);
+		BMessage* msg = new BMessage(OPEN_RECENT);
+		msg->AddInt32("menu", menu++);
+		msg->AddString("filepath", filepath);
 		BPath path(filepath.String());
 		BMenuItem* item = new BMenuItem(path.Leaf(), msg);
 		fOpenRecentMenu->AddItem(item);
@@ -512,6 +1157,58 @@ MainWindow::_PopulateOpenRecentMenu()
 }
 
 
+void
+MainWindow::_PopulateSetlistMenu()
+{
+	fSetlistMenu->RemoveItems(0, fSetlistMenu->CountItems(), true);
+
+	int32 count = fSetlist->CountEntries();
+	int32 current = fSetlist->CurrentIndex();
+
+	BMenuItem* item = new BMenuItem(B_TRANSLATE("Next ensemble"),
+		new BMessage(SETLIST_NEXT), B_RIGHT_ARROW);
+	item->SetEnabled(current + 1 < count);
+	fSetlistMenu->AddItem(item);
+
+	item = new BMenuItem(B_TRANSLATE("Previous ensemble"),
+		new BMessage(SETLIST_PREVIOUS), B_LEFT_ARROW);
+	item->SetEnabled(current > 0);
+	fSetlistMenu->AddItem(item);
+
+	if (count > 0)
+		fSetlistMenu->AddSeparatorItem();
+
+	for (int32 i = 0; i < count; i++) {
+		BString filepath = fSetlist->EntryAt(i);
+		BMessage* msg = new BMessage(SETLIST_SELECT);
+		msg->AddInt32("index", i);
+		BString label;
+		label << i + 1 << ". " << BPath(filepath.String()).Leaf();
+		item = new BMenuItem(label, msg);
+		item->SetMarked(i == current);
+		item->SetEnabled(BEntry(filepath.String()).Exists());
+		fSetlistMenu->AddItem(item);
+	}
+
+	fSetlistMenu->AddSeparatorItem();
+
+	item = new BMenuItem(B_TRANSLATE("Add current ensemble"), new BMessage(SETLIST_ADD));
+	item->SetEnabled(fEnsemblePath.InitCheck() == B_OK);
+	fSetlistMenu->AddItem(item);
+
+	item = new BMenuItem(B_TRANSLATE("Clear setlist"), new BMessage(SETLIST_CLEAR));
+	item->SetEnabled(count > 0);
+	fSetlistMenu->AddItem(item);
+
+	fSetlistMenu->AddSeparatorItem();
+
+	item = new BMenuItem(B_TRANSLATE("Keep setlist in memory"),
+		new BMessage(SETLIST_RESIDENT));
+	item->SetMarked(fSetlist->IsResident());
+	fSetlistMenu->AddItem(item);
+}
+
+
 void
 MainWindow::_HandleMIDI(BMessage* msg)
 {
@@ -523,11 +1220,11 @@ MainWindow::_HandleMIDI(BMessage* msg)
 	switch (op) {
 		case B_MIDI_REGISTERED:
 		{
-			int32 id = 0;
-			BMidiProducer* producer;
-			if ((producer = fRoster->NextProducer(&id)) != NULL) {
-				printf("Found producer %" B_PRId32 ": %s\n", id, producer->Name());
-				producer->Connect(fConsumer);
+			// only the new source, not just the first one there is
+			BMidiProducer* producer = fRoster->FindProducer(id);
+			if (producer != NULL) {
+				_ConnectMidiSource(producer);
+				producer->Release();
 			}
 			break;
 		}
@@ -541,6 +1238,74 @@ MainWindow::_HandleMIDI(BMessage* msg)
 }
 
 
+bool
+MainWindow::_HandleKey(BMessage* msg)
+{
+	// leave shortcuts and typing into the note fields alone
+	if ((msg->GetInt32("modifiers", 0) & (B_COMMAND_KEY | B_CONTROL_KEY | B_OPTION_KEY))
+			!= 0
+		|| dynamic_cast<BTextView*>(CurrentFocus()) != NULL)
+		return false;
+
+	bool down = msg->what == B_KEY_DOWN;
+	int32 key = msg->GetInt32("raw_char", -1);
+	if (down && key == B_ESCAPE) {
+		if (fKeyLearnPad >= 0)
+			_LearnKey(-1);
+		for (int32 i = 0; i < kPadCount; i++)
+			fPads[i]->CancelDetect();
+		return true;
+	}
+
+	if (fKeyLearnPad >= 0) {
+		if (down) {
+			fKeyMap.Assign(key, fKeyLearnPad);
+			BString text(B_TRANSLATE("Key %key% plays pad %pad%"));
+			text.ReplaceFirst("%key%", KeyMap::KeyName(key));
+			BString pad;
+			pad << fKeyLearnPad + 1;
+			text.ReplaceFirst("%pad%", pad);
+			fKeyLearnPad = -1;
+			_SetStatus(text, false);
+		}
+		return true;
+	}
+
+	int32 pad = fKeyMap.PadFor(key);
+	if (pad < 0)
+		return false;
+
+	// a held key would retrigger the pad many times a second
+	if (down && msg->GetInt32("be:key_repeat", 0) > 0)
+		return true;
+
+	fEngine->HitPad(pad, down, msg->GetInt64("when", system_time()));
+	return true;
+}
+
+
+void
+MainWindow::_LearnKey(int32 pad)
+{
+	fKeyLearnPad = pad >= 0 && pad < kPadCount ? pad : -1;
+	if (fKeyLearnPad < 0) {
+		_SetStatus("", false);
+		return;
+	}
+
+	BString keys = fKeyMap.KeysFor(pad);
+	if (keys == "")
+		keys = B_TRANSLATE_COMMENT("none", "Keys of a pad");
+	BString text(B_TRANSLATE("Press a key for pad %pad% (now: %keys%), "
+		"Escape cancels"));
+	BString number;
+	number << pad + 1;
+	text.ReplaceFirst("%pad%", number);
+	text.ReplaceFirst("%keys%", keys);
+	_SetStatus(text, false);
+}
+
+
 void
 MainWindow::_LoadSettings()
 {
@@ -572,19 +1337,53 @@ MainWindow::_SaveSettings()
 
 	BMessage settings;
 	settings.AddRect("main window frame", Frame());
+	settings.AddInt32("memory lock limit", fEngine->MemoryLockLimit() / (1024 * 1024));
 
 	for (int32 i = 0; i < fRecentEnsemblePaths.CountStrings(); i++)
 		settings.AddString("recent ensemble", fRecentEnsemblePaths.StringAt(i));
 
-	entry_ref ref;
-	fOpenSamplePanel->GetPanelDirectory(&ref);
-	settings.AddRef("last sample folder", &ref);
+	for (int32 i = 0; i < fSetlist->CountEntries(); i++)
+		settings.AddString("setlist", fSetlist->EntryAt(i));
+	settings.AddBool("setlist resident", fSetlist->IsResident());
+	settings.AddBool("show meters", fShowMeters);
+	settings.AddBool("show waveforms", fShowWaveforms);
+	settings.AddInt32("output buses", fEngine->OutputBuses());
+	settings.AddInt32("render threads", fEngine->RenderThreads());
+	settings.AddInt32("sample storage", Sample::Storage());
+	settings.AddStrings("library folder", fLibrary->Folders());
+	fKeyMap.Archive(&settings);
+	if (fSequencerWindow->Lock()) {
+		fSequencerWindow->SaveSettings(&settings);
+		fSequencerWindow->Unlock();
+	}
 
-	fOpenEnsemblePanel->GetPanelDirectory(&ref);
-	settings.AddRef("last ensemble folder", &ref);
+	for (int32 i = 0; i < fDisabledMidiSources.CountStrings(); i++)
+		settings.AddString("midi disabled source", fDisabledMidiSources.StringAt(i));
+	std::map<BString, uint16>::iterator filter = fMidiChannelFilters.begin();
+	for (; filter != fMidiChannelFilters.end(); filter++) {
+		if (filter->second == kAllMidiChannels)
+			continue;
+		settings.AddString("midi filter source", filter->first);
+		settings.AddInt32("midi filter channels", filter->second);
+	}
 
-	fSaveEnsemblePanel->GetPanelDirectory(&ref);
-	settings.AddRef("last ensemble save folder", &ref);
+	// a panel that wasn't shown is still where it was
+	const struct {
+		int32		panel;
+		const char*	name;
+	} folders[] = {
+		{ kOpenSamplePanel, "last sample folder" },
+		{ kOpenEnsemblePanel, "last ensemble folder" },
+		{ kSaveEnsemblePanel, "last ensemble save folder" }
+	};
+	for (size_t i = 0; i < sizeof(folders) / sizeof(folders[0]); i++) {
+		entry_ref ref;
+		if (fFilePanels[folders[i].panel] != NULL)
+			fFilePanels[folders[i].panel]->GetPanelDirectory(&ref);
+		else if (fSettings->FindRef(folders[i].name, &ref) != B_OK)
+			continue;
+		settings.AddRef(folders[i].name, &ref);
+	}
 
 	path.Append("Samedi_settings");
 	BFile file(path.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
@@ -593,6 +1392,146 @@ MainWindow::_SaveSettings()
 }
 
 
+/*static*/ status_t
+MainWindow::_AttachThread(void* data)
+{
+	// only the first Samedi plays, the others through its engine
+	BMessenger* messenger = (BMessenger*)data;
+	BMessage attached(ENGINE_ATTACHED);
+	BList teams;
+	be_roster->GetAppList(kApplicationSignature, &teams);
+	for (int32 i = 0; i < teams.CountItems(); i++) {
+		team_id team = (team_id)(addr_t)teams.ItemAt(i);
+		if (team == be_app->Team())
+			continue;
+
+		BMessenger host(kApplicationSignature, team);
+		BMessage reply;
+		if (host.IsValid()
+			&& AudioEngine::RequestHost(host, *messenger, reply) == B_OK) {
+			attached.AddMessage("host", &reply);
+			break;
+		}
+	}
+	messenger->SendMessage(&attached);
+	return B_OK;
+}
+
+
+void
+MainWindow::_ShowRemote(bool remote)
+{
+	// the first Samedi's outputs and threads are used
+	fOutputsMenu->SetEnabled(!remote);
+	fRenderThreadsMenu->SetEnabled(!remote);
+	if (remote)
+		_SetStatus(B_TRANSLATE("Playing through the Samedi started first"), false);
+	else {
+		_SetStatus(B_TRANSLATE("⚠ The Samedi that played for this one has quit, "
+			"it plays on its own now"), true);
+	}
+}
+
+
+void
+MainWindow::_SendEngineState()
+{
+	// to an engine that has nothing yet: the host's, or this one's own once
+	// the host is gone
+	fEngine->SwapKit(_CreatePadKit(), 0);
+	for (int32 i = 0; i < fSetlist->CountEntries(); i++) {
+		Ensemble* ensemble = fSetlist->ResidentAt(i);
+		if (ensemble != NULL)
+			fEngine->SetResidentKit(i, _CreateKit(ensemble));
+	}
+	BMessenger(fSequencerWindow).SendMessage(SEQUENCER_RESEND);
+}
+
+
+BFilePanel*
+MainWindow::_FilePanel(int32 which)
+{
+	if (fFilePanels[which] != NULL)
+		return fFilePanels[which];
+
+	file_panel_mode mode = B_SAVE_PANEL;
+	uint32 nodeFlavors = B_FILE_NODE;
+	BMessage message(B_REFS_RECEIVED);
+	const char* folder = "last ensemble save folder";
+	BRefFilter* filter = NULL;
+	BString title;
+	switch (which) {
+		case kOpenSamplePanel:
+			// the message and title are set for each pad
+			mode = B_OPEN_PANEL;
+			folder = "last sample folder";
+			filter = fAudioFilter;
+			break;
+		case kOpenEnsemblePanel:
+			mode = B_OPEN_PANEL;
+			folder = "last ensemble folder";
+			title = B_TRANSLATE("Samedi: Open ensemble");
+			break;
+		case kSaveEnsemblePanel:
+			message.what = B_SAVE_REQUESTED;
+			title = B_TRANSLATE("Samedi: Save ensemble");
+			break;
+		case kExportBundlePanel:
+			message.what = EXPORT_BUNDLE_REQUESTED;
+			title = B_TRANSLATE("Samedi: Export bundle");
+			break;
+		case kRenderPatternPanel:
+			message.what = RENDER_PATTERN_REQUESTED;
+			title = B_TRANSLATE("Samedi: Render pattern");
+			break;
+		case kExportRecordingPanel:
+			message.what = EXPORT_RECORDING_REQUESTED;
+			title = B_TRANSLATE("Samedi: Export recording");
+			break;
+		case kLibraryFolderPanel:
+			mode = B_OPEN_PANEL;
+			nodeFlavors = B_DIRECTORY_NODE;
+			message.what = ADD_LIBRARY_FOLDER_REQUESTED;
+			folder = NULL;
+			title = B_TRANSLATE("Samedi: Add sample library folder");
+			break;
+	}
+
+	BMessenger messenger(this);
+	entry_ref ref;
+	if (folder != NULL)
+		fSettings->FindRef(folder, &ref);
+	BFilePanel* panel = new BFilePanel(mode, &messenger, folder != NULL ? &ref : NULL,
+		nodeFlavors, false, &message, filter);
+	if (!title.IsEmpty())
+		panel->Window()->SetTitle(title);
+
+	fFilePanels[which] = panel;
+	return panel;
+}
+
+
+void
+MainWindow::_ReportStartupTimes(status_t status)
+{
+	// for the startup-times make target, on the terminal Samedi was started
+	// from
+	printf("Time to first window: %.1f ms\n",
+		(fStartupShown - fStartupLaunched) / 1000.0);
+	if (status == B_OK) {
+		printf("Time to ready: %.1f ms\n", (system_time() - fStartupLaunched) / 1000.0);
+		if (fEnsemble.Get() != NULL) {
+			printf("Ensemble: %s, decoded in %.1f ms\n", fEnsemblePath.Leaf(),
+				fSwitchLoadTime / 1000.0);
+		}
+	} else
+		printf("The ensemble could not be loaded: %s\n", strerror(status));
+
+	fStartupLaunched = 0;
+	be_app->PostMessage(B_QUIT_REQUESTED);
+}
+
+
 void
 MainWindow::_OpenHelp()
 {
@@ -621,44 +1560,976 @@ MainWindow::_OpenHelp()
 void
 MainWindow::_LoadEnsemble(entry_ref ref)
 {
-	BFile file(&ref, B_READ_ONLY);
-	BMessage ensemble;
+	_StartLoading(ref, system_time(), -1);
+}
 
-	if (file.InitCheck() == B_OK && ensemble.Unflatten(&file) == B_OK) {
-		int32 note = kDefaultNote;
-		BString samplepath = "";
-		for (int32 i = 0; i < kPadCount; i++) {
-			ensemble.FindInt32("note", i, &note);
-			ensemble.FindString("sample", i, &samplepath);
-			_SetNote(i, note++);
-			_SetSample(i, samplepath);
+
+void
+MainWindow::_StartLoading(const entry_ref& ref, bigtime_t requested,
+	int32 setlistIndex)
+{
+	// the one loading now is dropped when it's done
+	if (fLoadThread >= 0) {
+		fEnsembleQueued = true;
+		fQueuedRef = ref;
+		fQueuedRequested = requested;
+		fQueuedIndex = setlistIndex;
+		return;
+	}
+
+	// decoded in the background, the pads show which samples are in
+	LoadJob* job = new LoadJob;
+	job->target = BMessenger(this);
+	job->engine = fEngine;
+	job->cache = fSampleCache;
+	job->library = fLibrary;
+	job->ensemble = new Ensemble(ref);
+	job->ensemble->SetProgressTarget(job->target);
+	job->requested = requested;
+	job->setlistIndex = setlistIndex;
+	fLoadingEnsemble.SetTo(job->ensemble);
+
+	fLoadThread = spawn_thread(_LoadThread, "samedi ensemble loader", B_NORMAL_PRIORITY,
+		job);
+	if (fLoadThread < 0) {
+		_LoadThread(job);
+		return;
+	}
+	resume_thread(fLoadThread);
+}
+
+
+/*static*/ status_t
+MainWindow::_LoadThread(void* data)
+{
+	LoadJob* job = (LoadJob*)data;
+	job->ensemble->Load(job->engine, job->cache, job->library);
+
+	// the message takes over the reference
+	BMessage message(ENSEMBLE_LOADED);
+	message.AddPointer("ensemble", job->ensemble);
+	message.AddInt64("requested", job->requested);
+	message.AddInt32("index", job->setlistIndex);
+	if (job->target.SendMessage(&message) != B_OK)
+		job->ensemble->ReleaseReference();
+
+	delete job;
+	return B_OK;
+}
+
+
+void
+MainWindow::_EnsembleLoaded(BMessage* msg)
+{
+	Ensemble* ensemble;
+	if (msg->FindPointer("ensemble", (void**)&ensemble) != B_OK)
+		return;
+
+	BReference<Ensemble> reference(ensemble, true);
+	if (ensemble != fLoadingEnsemble.Get())
+		return;
+
+	if (fLoadThread >= 0) {
+		status_t result;
+		wait_for_thread(fLoadThread, &result);
+		fLoadThread = -1;
+	}
+	fLoadingEnsemble.Unset();
+
+	if (fEnsembleQueued) {
+		fEnsembleQueued = false;
+		_StartLoading(fQueuedRef, fQueuedRequested, fQueuedIndex);
+		return;
+	}
+
+	for (int32 i = 0; i < kPadCount; i++)
+		fPads[i]->EndLoading();
+
+	if (_SwitchEnsemble(ensemble, msg->GetInt64("requested", 0), false)) {
+		// the setlist may have changed meanwhile, and one opened from
+		// elsewhere may be in it, too
+		int32 index = msg->GetInt32("index", -1);
+		BString path(fEnsemblePath.Path());
+		if (index < 0 || index >= fSetlist->CountEntries()
+			|| fSetlist->EntryAt(index) != path)
+			index = fSetlist->IndexOf(path);
+		if (index >= 0)
+			fSetlist->SetCurrentIndex(index);
+	}
+
+	if (fStartupLaunched > 0)
+		_ReportStartupTimes(ensemble->InitCheck());
+}
+
+
+void
+MainWindow::_ShowPadLoading(BMessage* msg)
+{
+	// the progress of an ensemble that's dropped isn't shown
+	Ensemble* ensemble;
+	int32 pad = msg->GetInt32("pad", -1);
+	if (msg->FindPointer("ensemble", (void**)&ensemble) != B_OK
+		|| ensemble != fLoadingEnsemble.Get() || fEnsembleQueued
+		|| pad < 0 || pad >= kPadCount)
+		return;
+
+	fPads[pad]->ShowLoading(msg->GetString("path", NULL),
+		msg->what == ENSEMBLE_PAD_READY, msg->GetBool("found", false));
+}
+
+
+void
+MainWindow::_SwitchToSetlistEntry(int32 index, bigtime_t requested)
+{
+	if (index < 0 || index >= fSetlist->CountEntries())
+		return;
+
+	// a resident ensemble is selected right on the audio thread, the
+	// window follows when the engine reports the switch
+	if (fSetlist->ResidentAt(index) != NULL) {
+		fEngine->SelectProgram(index, requested);
+		return;
+	}
+
+	BReference<Ensemble> ensemble(fSetlist->TakePreloaded(index), true);
+	if (ensemble.Get() != NULL) {
+		if (_SwitchEnsemble(ensemble.Get(), requested, true))
+			fSetlist->SetCurrentIndex(index);
+		return;
+	}
+
+	BString filepath = fSetlist->EntryAt(index);
+	entry_ref ref;
+	if (get_ref_for_path(filepath.String(), &ref) != B_OK) {
+		BString text(B_TRANSLATE("⚠ Could not open '%ensemble%': %error%"));
+		text.ReplaceFirst("%ensemble%", BPath(filepath.String()).Leaf());
+		text.ReplaceFirst("%error%", strerror(B_ENTRY_NOT_FOUND));
+		_SetStatus(text, true);
+		return;
+	}
+	_StartLoading(ref, requested, index);
+}
+
+
+bool
+MainWindow::_SwitchEnsemble(Ensemble* ensemble, bigtime_t requested, bool preloaded)
+{
+	status_t status = ensemble->InitCheck();
+	if (status != B_OK) {
+		BString text;
+		if (status == B_NOT_SUPPORTED) {
+			text = B_TRANSLATE("⚠ '%ensemble%' was saved by a newer version of "
+				"Samedi.");
+		} else if (status == B_BAD_DATA)
+			text = B_TRANSLATE("⚠ '%ensemble%' is not a valid ensemble.");
+		else {
+			text = B_TRANSLATE("⚠ Could not open '%ensemble%': %error%");
+			text.ReplaceFirst("%error%", strerror(status));
 		}
-		fSaveMenu->SetEnabled(true);
-		BPath path(&ref);
-		fEnsemblePath = path;
-		_AddRecentEnsemble(path.Path());
-		_UpdateWindowTitle();
+		text.ReplaceFirst("%ensemble%", ensemble->Path().Leaf());
+		_SetStatus(text, true);
+		return false;
+	}
+
+	// Hand the whole ensemble to the engine in one go, it's swapped in at
+	// the start of the next audio buffer.
+	fEngine->SwapKit(_CreateKit(ensemble), requested);
+
+	fSwitchQueued = system_time();
+	fSwitchLoadTime = ensemble->LoadTime();
+	fSwitchPreloaded = preloaded;
+	fSwappedEnsemble.SetTo(ensemble);
+
+	_ShowEnsemble(ensemble, -1);
+	return true;
+}
+
+
+static void
+get_trim(const EnsemblePad& pad, Sample* sample, int64& start, int64& end)
+{
+	// ensembles saved before trimming was have none, they are taken from the
+	// sample then
+	start = 0;
+	end = 0;
+	if ((pad.modes & kPadTrimmed) == 0 || pad.layers.empty())
+		return;
+
+	const EnsembleLayer& layer = pad.layers[0];
+	if (layer.trimEnd > 0) {
+		start = layer.trimStart;
+		end = layer.trimEnd;
+	} else if (sample != NULL && sample->InitCheck() == B_OK) {
+		start = sample->Onset();
+		end = sample->DecayEnd();
 	}
 }
 
 
+AudioEngine::Kit*
+MainWindow::_CreateKit(Ensemble* ensemble)
+{
+	const EnsembleData& data = ensemble->Data();
+	int32 soloPad = -1;
+	for (int32 i = 0; i < kPadCount && i < (int32)data.pads.size(); i++) {
+		if ((data.pads[i].modes & kPadSolo) != 0)
+			soloPad = i;
+	}
+
+	AudioEngine::Kit* kit = new AudioEngine::Kit;
+	for (int32 i = 0; i < kPadCount && i < (int32)data.pads.size(); i++) {
+		const EnsemblePad& pad = data.pads[i];
+		AudioEngine::PadSettings& settings = kit->pads[i];
+		Sample* sample = ensemble->SampleAt(i);
+		if (sample != NULL && sample->InitCheck() == B_OK)
+			settings.sample = sample;
+		settings.muted = soloPad >= 0 ? i != soloPad : (pad.modes & kPadMuted) != 0;
+		settings.note = pad.note;
+		settings.looping = (pad.modes & kPadLooping) != 0;
+		settings.gate = (pad.modes & kPadGate) != 0;
+		settings.gain = pad.gain;
+		if ((pad.modes & kPadNormalized) != 0 && settings.sample != NULL
+			&& settings.sample->HasLoudness()) {
+			settings.gain *= normalization_gain(settings.sample->Peak(),
+				settings.sample->Loudness());
+		}
+		settings.gainController = pad.gainController;
+		settings.chokeGroup = pad.chokeGroup;
+		settings.bus = pad.bus < kBusCount ? pad.bus : 0;
+		settings.filterType = pad.filterType;
+		settings.cutoff = pad.cutoff;
+		settings.resonance = pad.resonance;
+		settings.attack = pad.attack;
+		settings.decay = pad.decay;
+		settings.release = pad.release;
+		get_trim(pad, sample, settings.trimStart, settings.trimEnd);
+	}
+	return kit;
+}
+
+
+AudioEngine::Kit*
+MainWindow::_CreatePadKit()
+{
+	// the pads as they are now, not as their ensemble was loaded
+	AudioEngine::Kit* kit = new AudioEngine::Kit;
+	for (int32 i = 0; i < kPadCount; i++) {
+		AudioEngine::PadSettings& settings = kit->pads[i];
+		Sample* sample = fPads[i]->GetSample();
+		if (sample != NULL && sample->InitCheck() == B_OK)
+			settings.sample = sample;
+		settings.note = fPads[i]->GetNote();
+		settings.muted = fPads[i]->IsMuted();
+		settings.looping = fPads[i]->IsLooping();
+		settings.gate = fPads[i]->IsGate();
+		settings.gain = fPads[i]->GetOutputGain();
+		settings.gainController = fPads[i]->GetGainController();
+		settings.chokeGroup = fPads[i]->GetChokeGroup();
+		settings.bus = fPads[i]->GetBus();
+		settings.filterType = fPads[i]->GetFilterType();
+		settings.cutoff = fPads[i]->GetCutoff();
+		settings.resonance = fPads[i]->GetResonance();
+		settings.attack = fPads[i]->GetAttack();
+		settings.decay = fPads[i]->GetDecay();
+		settings.release = fPads[i]->GetRelease();
+		settings.trimStart = fPads[i]->GetTrimStart();
+		settings.trimEnd = fPads[i]->GetTrimEnd();
+	}
+	return kit;
+}
+
+
 void
-MainWindow::_SaveEnsemble()
+MainWindow::_ShowEnsemble(Ensemble* ensemble, int32 program)
+{
+	// Changes made to the pads went to the engine's kit, so they are kept
+	// with the ensemble, too. A resident kit comes back with them.
+	if (fEnsemble.Get() != NULL) {
+		EnsembleData data;
+		_CollectEnsemble(data);
+		Sample* samples[kPadCount];
+		for (int32 i = 0; i < kPadCount; i++)
+			samples[i] = fPads[i]->GetSample();
+		fEnsemble->Update(data, samples);
+	}
+
+	const EnsembleData& data = ensemble->Data();
+	int32 soloPad = -1;
+	for (int32 i = 0; i < kPadCount && i < (int32)data.pads.size(); i++) {
+		if ((data.pads[i].modes & kPadSolo) != 0)
+			soloPad = i;
+	}
+
+	for (int32 i = 0; i < kPadCount; i++) {
+		EnsemblePad pad;
+		pad.note = kDefaultNote + i;
+		if (i < (int32)data.pads.size())
+			pad = data.pads[i];
+
+		// only the first layer is played for now
+		PadState state;
+		if (!pad.layers.empty() && !pad.layers[0].path.empty())
+			state.samplePath.SetTo(pad.layers[0].path.c_str());
+		state.sample = ensemble->SampleAt(i);
+		state.note = pad.note;
+		state.gain = pad.gain;
+		state.gainController = pad.gainController;
+		state.chokeGroup = pad.chokeGroup;
+		state.bus = pad.bus < kBusCount ? pad.bus : 0;
+		state.filterType = pad.filterType;
+		state.cutoff = pad.cutoff;
+		state.resonance = pad.resonance;
+		state.attack = pad.attack;
+		state.decay = pad.decay;
+		state.release = pad.release;
+		state.trimmed = (pad.modes & kPadTrimmed) != 0;
+		state.normalized = (pad.modes & kPadNormalized) != 0;
+		get_trim(pad, state.sample, state.trimStart, state.trimEnd);
+		state.muted = soloPad >= 0 ? i != soloPad : (pad.modes & kPadMuted) != 0;
+		state.solo = i == soloPad;
+		state.looping = (pad.modes & kPadLooping) != 0;
+		state.gate = (pad.modes & kPadGate) != 0;
+		fPads[i]->ShowState(state);
+	}
+
+	fEnsemble.SetTo(ensemble);
+	fActiveProgram = program;
+	fSampleCache->Prune();
+	_WatchSamples();
+
+	fSaveMenu->SetEnabled(true);
+	fEnsemblePath = ensemble->Path();
+	fEnsembleIsBundle = ensemble->IsBundle();
+	_AddRecentEnsemble(fEnsemblePath.Path());
+	_UpdateWindowTitle();
+}
+
+
+void
+MainWindow::_FollowKitSwap(BMessage* msg)
+{
+	int32 program = msg->GetInt32("program", -1);
+	bigtime_t requested = msg->GetInt64("requested", 0);
+	bigtime_t swapped = msg->GetInt64("time", 0);
+	// the pads sent to another engine, nothing was switched
+	if (program < 0 && requested == 0)
+		return;
+
+	// the switch may have come from MIDI, or overtaken another one
+	Ensemble* ensemble = program >= 0
+		? fSetlist->ResidentAt(program) : fSwappedEnsemble.Get();
+	if (ensemble == NULL)
+		return;
+
+	if (program != fActiveProgram || ensemble != fEnsemble.Get())
+		_ShowEnsemble(ensemble, program);
+	if (program >= 0)
+		fSetlist->SetCurrentIndex(program);
+
+	BString text;
+	if (program >= 0) {
+		text = B_TRANSLATE("Switched to '%ensemble%' in %total% ms "
+			"(kept in memory)");
+	} else if (fSwitchPreloaded) {
+		text = B_TRANSLATE("Switched to '%ensemble%' in %total% ms "
+			"(%wait% ms until the next audio buffer)");
+	} else {
+		text = B_TRANSLATE("Loaded '%ensemble%' in %total% ms "
+			"(%load% ms loading samples)");
+	}
+
+	BString total;
+	total.SetToFormat("%.1f", (swapped - requested) / 1000.0);
+	BString wait;
+	wait.SetToFormat("%.1f", (swapped - fSwitchQueued) / 1000.0);
+	BString load;
+	load.SetToFormat("%.1f", fSwitchLoadTime / 1000.0);
+
+	text.ReplaceFirst("%ensemble%", ensemble->Path().Leaf());
+	text.ReplaceFirst("%total%", total);
+	text.ReplaceFirst("%wait%", wait);
+	text.ReplaceFirst("%load%", load);
+
+	// samples that had moved, kept in memory they were found already
+	if (program < 0 && ensemble->RelinkCount() > 0) {
+		BString relinked(B_TRANSLATE(", %count% moved samples found in the library"));
+		BString number;
+		number << ensemble->RelinkCount();
+		relinked.ReplaceFirst("%count%", number);
+		text << relinked;
+	}
+	_SetStatus(text, false);
+}
+
+
+void
+MainWindow::_SetResident(bool resident)
 {
-	BMessage ensemble;
+	if (resident == fSetlist->IsResident())
+		return;
+
+	if (!resident) {
+		// the active kit stays until it's switched away from
+		fEngine->ClearResidentKits();
+		if (fActiveProgram >= 0) {
+			fSwappedEnsemble = fEnsemble;
+			fActiveProgram = -1;
+		}
+	}
+
+	fSetlist->SetResident(resident);
+	fSampleCache->Prune();
+	_ReportResidentMemory();
+}
+
+
+void
+MainWindow::_ReportResidentMemory()
+{
+	int32 count;
+	size_t size;
+	size_t shared;
+	fSetlist->GetResidentMemory(count, size, shared);
+
+	BString text(B_TRANSLATE("%count% ensembles kept in memory, %size% MiB "
+		"(%shared% MiB saved by sharing samples)"));
+	BString number;
+	number << count;
+	text.ReplaceFirst("%count%", number);
+	number.SetToFormat("%.1f", size / (1024.0 * 1024.0));
+	text.ReplaceFirst("%size%", number);
+	number.SetToFormat("%.1f", shared / (1024.0 * 1024.0));
+	text.ReplaceFirst("%shared%", number);
+	_SetStatus(text, false);
+}
+
+
+void
+MainWindow::_CollectEnsemble(EnsembleData& ensemble)
+{
+	ensemble.pads.resize(kPadCount);
 
 	for (int32 i = 0; i < kPadCount; i++) {
-		ensemble.AddInt32("note", fPads[i]->GetNote());
-		ensemble.AddString("sample", fPads[i]->GetSamplePath());
+		EnsemblePad& pad = ensemble.pads[i];
+		pad.note = fPads[i]->GetNote();
+		pad.gain = fPads[i]->GetGain();
+		pad.chokeGroup = fPads[i]->GetChokeGroup();
+		pad.gainController = fPads[i]->GetGainController();
+		pad.bus = fPads[i]->GetBus();
+		pad.filterType = fPads[i]->GetFilterType();
+		pad.cutoff = fPads[i]->GetCutoff();
+		pad.resonance = fPads[i]->GetResonance();
+		pad.attack = fPads[i]->GetAttack();
+		pad.decay = fPads[i]->GetDecay();
+		pad.release = fPads[i]->GetRelease();
+		if (fPads[i]->IsMuted())
+			pad.modes |= kPadMuted;
+		if (fPads[i]->IsSolo())
+			pad.modes |= kPadSolo;
+		if (fPads[i]->IsLooping())
+			pad.modes |= kPadLooping;
+		if (fPads[i]->IsGate())
+			pad.modes |= kPadGate;
+		if (fPads[i]->IsTrimmed())
+			pad.modes |= kPadTrimmed;
+		if (fPads[i]->IsNormalized())
+			pad.modes |= kPadNormalized;
+
+		BString samplepath = fPads[i]->GetSamplePath();
+		if (samplepath != "") {
+			EnsembleLayer layer;
+			layer.path = samplepath.String();
+			Sample* sample = fPads[i]->GetSample();
+			if (sample != NULL) {
+				layer.identity = sample->Identity();
+				layer.fingerprint = sample->Fingerprint();
+				if (sample->HasLoudness()) {
+					layer.flags |= kLayerMeasured;
+					layer.peak = sample->Peak();
+					layer.loudness = sample->Loudness();
+				}
+			}
+			layer.trimStart = fPads[i]->GetTrimStart();
+			layer.trimEnd = fPads[i]->GetTrimEnd();
+			pad.layers.push_back(layer);
+		}
 	}
+}
 
-	BFile file(fEnsemblePath.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
-	if (file.InitCheck() == B_OK) {
-		ensemble.Flatten(&file);
+
+void
+MainWindow::_SaveEnsemble()
+{
+	EnsembleData ensemble;
+	_CollectEnsemble(ensemble);
+
+	std::vector<uint8> output;
+	write_ensemble(ensemble, output);
+
+	// write a new file and move it over the old one, the old one may still
+	// be mapped as a bundle
+	BString tempPath(fEnsemblePath.Path());
+	tempPath << ".tmp";
+	BFile file(tempPath.String(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() == B_OK
+		&& file.Write(output.data(), output.size()) == (ssize_t)output.size()
+		&& rename(tempPath.String(), fEnsemblePath.Path()) == 0) {
 		fSaveMenu->SetEnabled(true);
 		_AddRecentEnsemble(fEnsemblePath.Path());
 		_UpdateWindowTitle();
+	} else
+		BEntry(tempPath.String()).Remove();
+}
+
+
+void
+MainWindow::_ExportBundle(BPath path)
+{
+	EnsembleData ensemble;
+	_CollectEnsemble(ensemble);
+
+	// embed the decoded samples, as they are in memory: stereo float in host
+	// order, which is little endian on all platforms Haiku runs on
+	for (int32 i = 0; i < kPadCount; i++) {
+		Sample* sample = fPads[i]->GetSample();
+		if (sample != NULL && !ensemble.pads[i].layers.empty())
+			ensemble.pads[i].layers[0].pcmFrames = sample->FrameCount();
+	}
+
+	uint64 size = layout_bundle(ensemble, (uint32)kEngineFrameRate, kEngineChannels,
+		B_PAGE_SIZE);
+	std::vector<uint8> metadata;
+	write_ensemble(ensemble, metadata);
+
+	BString tempPath(path.Path());
+	tempPath << ".tmp";
+	BFile file(tempPath.String(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	status_t status = file.InitCheck();
+	if (status == B_OK
+		&& file.WriteAt(0, metadata.data(), metadata.size()) != (ssize_t)metadata.size())
+		status = B_IO_ERROR;
+
+	for (int32 i = 0; i < kPadCount && status == B_OK; i++) {
+		Sample* sample = fPads[i]->GetSample();
+		if (sample == NULL || ensemble.pads[i].layers.empty())
+			continue;
+
+		const EnsembleLayer& layer = ensemble.pads[i].layers[0];
+		if (!sample->IsPacked()) {
+			if (file.WriteAt(layer.pcmOffset, sample->Data(), sample->DecodedSize())
+					!= (ssize_t)sample->DecodedSize())
+				status = B_IO_ERROR;
+			continue;
+		}
+
+		// a bundle holds float frames, a packed sample is unpacked in chunks
+		std::vector<float> frames(kPackedBlockFrames * kEngineChannels);
+		int64 frameCount = sample->FrameCount();
+		for (int64 start = 0; start < frameCount && status == B_OK;
+				start += kPackedBlockFrames) {
+			int64 count = frameCount - start < kPackedBlockFrames
+				? frameCount - start : kPackedBlockFrames;
+			sample->ReadFrames(start, count, frames.data());
+			size_t size = count * kEngineChannels * sizeof(float);
+			if (file.WriteAt(layer.pcmOffset + start * kEngineChannels * sizeof(float),
+					frames.data(), size) != (ssize_t)size)
+				status = B_IO_ERROR;
+		}
 	}
+
+	if (status == B_OK)
+		status = file.SetSize(size);
+	if (status == B_OK && rename(tempPath.String(), path.Path()) != 0)
+		status = errno;
+
+	if (status != B_OK) {
+		BEntry(tempPath.String()).Remove();
+		BString text(B_TRANSLATE("⚠ Could not export bundle '%bundle%': %error%"));
+		text.ReplaceFirst("%bundle%", path.Leaf());
+		text.ReplaceFirst("%error%", strerror(status));
+		_SetStatus(text, true);
+		return;
+	}
+
+	BString text(B_TRANSLATE("Exported bundle '%bundle%' (%size% MiB)"));
+	text.ReplaceFirst("%bundle%", path.Leaf());
+	BString sizeText;
+	sizeText.SetToFormat("%.1f", size / (1024.0 * 1024.0));
+	text.ReplaceFirst("%size%", sizeText);
+	_SetStatus(text, false);
+
+	fEnsemblePath = path;
+	fEnsembleIsBundle = true;
+	fSaveMenu->SetEnabled(true);
+	_AddRecentEnsemble(path.Path());
+	_UpdateWindowTitle();
+}
+
+
+void
+MainWindow::_RenderPattern(BPath path)
+{
+	if (!fSequencerWindow->Lock())
+		return;
+	AudioEngine::Pattern pattern = fSequencerWindow->Pattern();
+	fSequencerWindow->Unlock();
+	pattern.syncToClock = false;
+
+	// An engine of its own that is never started plays the pads through
+	// the same code as live, just as fast as it can.
+	AudioEngine engine((BMessenger()));
+	engine.SwapKit(_CreatePadKit(), 0);
+	engine.SetPattern(new AudioEngine::Pattern(pattern));
+	engine.StartSequencer();
+
+	// where the steps belong, to check the timing of the rendered ones
+	std::vector<double> expected;
+	double position = 0.0;
+	for (int32 loop = 0; loop < kRenderLoops; loop++) {
+		for (int32 step = 0; step < kStepCount; step++) {
+			expected.push_back(position);
+			position += AudioEngine::StepLength(pattern, step);
+		}
+	}
+	int64 loopsEnd = (int64)position;
+	int64 frameCount = loopsEnd + (int64)(kRenderTail * kEngineFrameRate);
+
+	// a file for every bus a pad plays on, the main one as chosen, the
+	// others next to it, e.g. "Pattern bus 2.wav"
+	int32 busCount = 1;
+	for (int32 i = 0; i < kPadCount; i++) {
+		if (fPads[i]->GetBus() >= busCount)
+			busCount = fPads[i]->GetBus() + 1;
+	}
+
+	WavWriter writers[kBusCount];
+	float buffers[kBusCount][kRenderBufferFrames * kEngineChannels];
+	float* buses[kBusCount];
+	bool ok = true;
+	for (int32 bus = 0; bus < busCount; bus++) {
+		BString busPath(path.Path());
+		if (bus > 0) {
+			int32 extension = busPath.FindLast('.');
+			if (extension <= busPath.FindLast('/'))
+				extension = busPath.Length();
+			BString suffix;
+			suffix << " bus " << bus + 1;
+			busPath.Insert(suffix, extension);
+		}
+		ok = writers[bus].Open(busPath, kEngineChannels, (uint32)kEngineFrameRate) && ok;
+		buses[bus] = buffers[bus];
+	}
+
+	std::vector<int64> stepFrames;
+	int64 done = 0;
+	while (ok && done < frameCount) {
+		// the last loop ends at a buffer boundary, so the sequencer can be
+		// stopped right there and only the tail rings out after it
+		int64 end = done < loopsEnd ? loopsEnd : frameCount;
+		int32 count = end - done < kRenderBufferFrames ? end - done : kRenderBufferFrames;
+		engine.RenderOffline(buses, busCount, count, &stepFrames);
+		for (int32 bus = 0; bus < busCount; bus++)
+			ok = writers[bus].Write(buffers[bus], count) && ok;
+		done += count;
+		if (done == loopsEnd)
+			engine.StopSequencer();
+	}
+	for (int32 bus = 0; bus < busCount; bus++)
+		ok = writers[bus].Close() && ok;
+
+	if (!ok) {
+		BString text(B_TRANSLATE("⚠ Could not render the pattern to '%file%'"));
+		text.ReplaceFirst("%file%", path.Leaf());
+		_SetStatus(text, true);
+		return;
+	}
+
+	double maxError = 0.0;
+	for (size_t i = 0; i < expected.size(); i++) {
+		double error = i < stepFrames.size()
+			? fabs(stepFrames[i] - expected[i]) : kEngineFrameRate;
+		if (error > maxError)
+			maxError = error;
+	}
+
+	BString text(B_TRANSLATE("Rendered '%file%', the steps are within %error% "
+		"frames of their exact time"));
+	text.ReplaceFirst("%file%", path.Leaf());
+	BString number;
+	number.SetToFormat("%.1f", maxError);
+	text.ReplaceFirst("%error%", number);
+	_SetStatus(text, maxError >= 1.0);
+}
+
+
+void
+MainWindow::_PopulateRenderThreadsMenu()
+{
+	// the choices, then what was measured after the separator
+	int32 choices = fRenderThreadsMenu->CountItems() - 1;
+	for (int32 i = 0; i < fRenderThreadsMenu->CountItems(); i++) {
+		BMenuItem* item = fRenderThreadsMenu->ItemAt(i);
+		if (item->Message() == NULL) {
+			choices = i;
+			break;
+		}
+		item->SetMarked(item->Message()->GetInt32("threads", -1)
+			== fEngine->RenderThreads());
+	}
+	while (fRenderThreadsMenu->CountItems() > choices + 1)
+		delete fRenderThreadsMenu->RemoveItem(choices + 1);
+
+	for (int32 threads = 1; threads <= kMaxRenderThreads; threads++) {
+		float voices = fEngine->VoicesPerMillisecond(threads);
+		if (voices <= 0.0f)
+			continue;
+
+		BString text(B_TRANSLATE("%threads% thread(s): %voices% voices per ms"));
+		BString number;
+		number << threads;
+		text.ReplaceFirst("%threads%", number);
+		number.SetToFormat("%.0f", voices);
+		text.ReplaceFirst("%voices%", number);
+		BMenuItem* item = new BMenuItem(text, NULL);
+		item->SetEnabled(false);
+		fRenderThreadsMenu->AddItem(item);
+	}
+}
+
+
+void
+MainWindow::_PopulateSampleMemoryMenu()
+{
+	// the choices, then what was measured after the separator
+	int32 choices = fSampleMemoryMenu->CountItems() - 1;
+	for (int32 i = 0; i < fSampleMemoryMenu->CountItems(); i++) {
+		BMenuItem* item = fSampleMemoryMenu->ItemAt(i);
+		if (item->Message() == NULL) {
+			choices = i;
+			break;
+		}
+		item->SetMarked(item->Message()->GetInt32("storage", -1) == Sample::Storage());
+	}
+	while (fSampleMemoryMenu->CountItems() > choices + 1)
+		delete fSampleMemoryMenu->RemoveItem(choices + 1);
+
+	size_t held, decoded;
+	fSampleCache->GetMemory(held, decoded);
+	BString text(B_TRANSLATE("Samples: %held% MiB, %saved% MiB saved"));
+	BString number;
+	number.SetToFormat("%.1f", held / (1024.0 * 1024.0));
+	text.ReplaceFirst("%held%", number);
+	number.SetToFormat("%.1f", (decoded > held ? decoded - held : 0) / (1024.0 * 1024.0));
+	text.ReplaceFirst("%saved%", number);
+	BMenuItem* item = new BMenuItem(text, NULL);
+	item->SetEnabled(false);
+	fSampleMemoryMenu->AddItem(item);
+
+	text = B_TRANSLATE("Unpacking: %time% µs per buffer");
+	number = "";
+	number << fEngine->UnpackTime();
+	text.ReplaceFirst("%time%", number);
+	item = new BMenuItem(text, NULL);
+	item->SetEnabled(false);
+	fSampleMemoryMenu->AddItem(item);
+}
+
+
+void
+MainWindow::_PopulateLibraryMenu()
+{
+	// "Add folder…" stays, the rest is filled in anew
+	while (fLibraryMenu->CountItems() > 1)
+		delete fLibraryMenu->RemoveItem(1);
+
+	BStringList folders = fLibrary->Folders();
+	BMenu* removeMenu = new BMenu(B_TRANSLATE("Remove folder"));
+	for (int32 i = 0; i < folders.CountStrings(); i++) {
+		BMessage* msg = new BMessage(REMOVE_LIBRARY_FOLDER);
+		msg->AddString("folder", folders.StringAt(i));
+		removeMenu->AddItem(new BMenuItem(folders.StringAt(i), msg));
+	}
+	removeMenu->SetEnabled(!folders.IsEmpty());
+	fLibraryMenu->AddItem(removeMenu);
+	fLibraryMenu->AddSeparatorItem();
+
+	BString text;
+	if (fLibrary->IsScanning())
+		text = B_TRANSLATE("Indexing" B_UTF8_ELLIPSIS);
+	else {
+		text = B_TRANSLATE("%count% samples indexed");
+		BString number;
+		number << fLibrary->CountSamples();
+		text.ReplaceFirst("%count%", number);
+	}
+	BMenuItem* item = new BMenuItem(text, NULL);
+	item->SetEnabled(false);
+	fLibraryMenu->AddItem(item);
+
+	int64 entries;
+	bigtime_t time;
+	fAudioFilter->GetStats(entries, time);
+	if (entries > 0) {
+		text = B_TRANSLATE("Open panel: %rate% entries filtered per second");
+		BString number;
+		number << (int64)(entries * 1000000.0 / (time > 0 ? time : 1));
+		text.ReplaceFirst("%rate%", number);
+		item = new BMenuItem(text, NULL);
+		item->SetEnabled(false);
+		fLibraryMenu->AddItem(item);
+	}
+}
+
+
+void
+MainWindow::_SetLibraryFolder(const char* folder, bool add)
+{
+	BStringList folders = fLibrary->Folders();
+	if (add) {
+		if (folders.HasString(folder))
+			return;
+		folders.Add(folder);
+	} else if (!folders.Remove(folder))
+		return;
+
+	fLibrary->SetFolders(folders);
+	if (add) {
+		BString text(B_TRANSLATE("Indexing the samples in '%folder%'"));
+		text.ReplaceFirst("%folder%", BPath(folder).Leaf());
+		_SetStatus(text, false);
+	}
+}
+
+
+void
+MainWindow::_ShowMeters(bool show)
+{
+	if (show == fShowMeters)
+		return;
+
+	// Hidden meters cost nothing: the engine sums without measuring and
+	// there are no updates.
+	fShowMeters = show;
+	fEngine->SetMetering(show);
+	for (int32 i = 0; i < kPadCount; i++)
+		fPads[i]->ShowMeter(show);
+
+	fMasterMeter->Reset();
+	if (show)
+		fMasterMeter->Show();
+	else
+		fMasterMeter->Hide();
+	_UpdateDisplayRunner();
+}
+
+
+void
+MainWindow::_ShowWaveforms(bool show)
+{
+	if (show == fShowWaveforms)
+		return;
+
+	fShowWaveforms = show;
+	fEngine->SetTrackingPlayheads(show);
+	for (int32 i = 0; i < kPadCount; i++)
+		fPads[i]->ShowWaveform(show);
+	_UpdateDisplayRunner();
+}
+
+
+void
+MainWindow::_UpdateDisplayRunner()
+{
+	// meters and playheads share one update, it only runs while they show
+	bool running = fShowMeters || fShowWaveforms;
+	if (running == (fDisplayRunner != NULL))
+		return;
+
+	if (running) {
+		BMessage message(UPDATE_DISPLAYS);
+		fDisplayRunner = new BMessageRunner(BMessenger(this), &message, kDisplayInterval);
+	} else {
+		delete fDisplayRunner;
+		fDisplayRunner = NULL;
+	}
+}
+
+
+void
+MainWindow::_UpdateDisplays()
+{
+	if (fShowWaveforms) {
+		for (int32 i = 0; i < kPadCount; i++)
+			fPads[i]->UpdatePlayhead();
+	}
+
+	if (fShowMeters) {
+		for (int32 i = 0; i < kPadCount; i++)
+			fPads[i]->UpdateMeter();
+
+		float peak, rms;
+		fEngine->GetLevels(kMasterMeter, peak, rms);
+		fMasterMeter->SetLevels(peak, rms);
+	}
+}
+
+
+void
+MainWindow::_ToggleRecording()
+{
+	if (fRecorder->IsRecording()) {
+		fRecorder->Stop();
+		BString text(B_TRANSLATE("Recorded %events% events"));
+		BString number;
+		number << fRecorder->CountEvents();
+		text.ReplaceFirst("%events%", number);
+		if (fRecorder->CountDropped() > 0) {
+			text = B_TRANSLATE("⚠ Recorded %events% events, %dropped% were lost");
+			text.ReplaceFirst("%events%", number);
+			number = "";
+			number << fRecorder->CountDropped();
+			text.ReplaceFirst("%dropped%", number);
+		}
+		_SetStatus(text, fRecorder->CountDropped() > 0);
+		return;
+	}
+
+	// the journal grows on disk while recording, so a long session doesn't
+	// take more memory than a short one
+	BPath path;
+	status_t status = find_directory(B_SYSTEM_TEMP_DIRECTORY, &path);
+	if (status == B_OK)
+		status = path.Append("samedi-performance");
+	if (status == B_OK)
+		status = fRecorder->Start(path.Path());
+
+	if (status != B_OK) {
+		BString text(B_TRANSLATE("⚠ Could not start recording: %error%"));
+		text.ReplaceFirst("%error%", strerror(status));
+		_SetStatus(text, true);
+	} else
+		_SetStatus(B_TRANSLATE("Recording" B_UTF8_ELLIPSIS), false);
+}
+
+
+void
+MainWindow::_ExportRecording(BPath path)
+{
+	status_t status = fRecorder->Export(path.Path());
+	if (status != B_OK) {
+		BString text(B_TRANSLATE("⚠ Could not export the recording to '%file%': %error%"));
+		text.ReplaceFirst("%file%", path.Leaf());
+		text.ReplaceFirst("%error%", strerror(status));
+		_SetStatus(text, true);
+		return;
+	}
+
+	BNode node(path.Path());
+	BNodeInfo(&node).SetType("audio/midi");
+
+	BString text(B_TRANSLATE("Exported the recording to '%file%'"));
+	text.ReplaceFirst("%file%", path.Leaf());
+	_SetStatus(text, false);
 }
 
 
@@ -690,6 +2561,17 @@ MainWindow::_UpdateWindowTitle()
 }
 
 
+void
+MainWindow::_SetStatus(const char* text, bool warning)
+{
+	fStatusView->SetText(text);
+	if (warning)
+		fStatusView->SetHighUIColor(B_FAILED_COLOR);
+	else
+		fStatusView->SetHighUIColor(B_PANEL_TEXT_COLOR);
+}
+
+
 void
 MainWindow::_SendSample(BMessage* msg, entry_ref ref)
 {
@@ -702,6 +2584,7 @@ MainWindow::_SendSample(BMessage* msg, entry_ref ref)
 		BRect rect = fPads[i]->ConvertToScreen(fPads[i]->Bounds());
 		if (rect.Contains(point)) {
 			fPads[i]->SetSample(path.Path());
+			_WatchSamples();
 			return;
 		}
 	}
@@ -713,6 +2596,42 @@ MainWindow::_SetSample(int32 pad, BString samplepath)
 {
 	BPath path(samplepath.String());
 	fPads[pad]->SetSample(path);
+	_WatchSamples();
+}
+
+
+void
+MainWindow::_WatchSamples()
+{
+	// a pad ejecting its sample by itself leaves it watched, a change of
+	// a file on no pad is just dropped
+	BStringList paths;
+	for (int32 i = 0; i < kPadCount; i++)
+		paths.Add(fPads[i]->GetSamplePath());
+	fWatcher->SetPaths(paths);
+}
+
+
+void
+MainWindow::_ReloadSample(Sample* sample)
+{
+	// on every pad with that file, voices already playing it finish with
+	// the old version
+	int32 count = 0;
+	for (int32 i = 0; i < kPadCount; i++) {
+		if (fPads[i]->GetSamplePath() != sample->Path()
+			|| fPads[i]->GetSample() == sample)
+			continue;
+		fPads[i]->ReloadSample(sample);
+		count++;
+	}
+	if (count == 0)
+		return;
+
+	fSampleCache->Prune();
+	BString text(B_TRANSLATE("Reloaded %samplefile%"));
+	text.ReplaceFirst("%samplefile%", BPath(sample->Path()).Leaf());
+	_SetStatus(text, false);
 }
 
 
@@ -721,3 +2640,22 @@ MainWindow::_SetNote(int32 pad, int32 note)
 {
 	fPads[pad]->SetNote(note);
 }
+
+
+void
+MainWindow::_SoloPad(int32 soloPad, int32 state)
+{
+	if (state == B_CONTROL_ON) {
+		for (int32 i = 0; i < kPadCount; i++) {
+			// mute all other pads
+			if (i != soloPad)
+				fPads[i]->Mute(B_CONTROL_ON);
+			// unmute the solo pad
+			else
+				fPads[i]->Mute(B_CONTROL_OFF);
+		}
+	} else {
+		for (int32 i = 0; i < kPadCount; i++)
+			fPads[i]->Mute(B_CONTROL_OFF);
+	}
+}
@@ -9,67 +9,202 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "AudioEngine.h"
+#include "AudioFilter.h"
 #include "Constants.h"
+#include "Ensemble.h"
+#include "EnsembleFormat.h"
+#include "KeyMap.h"
+#include "LevelMeter.h"
 #include "MidiConsumer.h"
 #include "Pad.h"
+#include "Recorder.h"
+#include "SampleCache.h"
+#include "SampleLibrary.h"
+#include "SampleSearchWindow.h"
+#include "SampleWatcher.h"
+#include "SequencerWindow.h"
+#include "Setlist.h"
 
 #include <FilePanel.h>
 #include <Menu.h>
+#include <MessageRunner.h>
 #include <Messenger.h>
 #include <MidiProducer.h>
 #include <MidiRoster.h>
 #include <StringList.h>
+#include <StringView.h>
 #include <Window.h>
 
+#include <map>
+
 
 class MainWindow : public BWindow {
 public:
 					MainWindow();
 	virtual			~MainWindow();
 
+	virtual void	DispatchMessage(BMessage* msg, BHandler* handler);
 	virtual void	MenusBeginning();
 	virtual void	MessageReceived(BMessage* msg);
 
+	AudioEngine*	Engine() const { return fEngine; };
+	SampleCache*	Cache() const { return fSampleCache; };
+
 private:
+	enum {
+		kOpenSamplePanel,
+		kOpenEnsemblePanel,
+		kSaveEnsemblePanel,
+		kExportBundlePanel,
+		kRenderPatternPanel,
+		kExportRecordingPanel,
+		kLibraryFolderPanel,
+		kFilePanelCount
+	};
+
+	struct LoadJob {
+		BMessenger		target;
+		AudioEngine*	engine;
+		SampleCache*	cache;
+		SampleLibrary*	library;
+		Ensemble*		ensemble;
+		bigtime_t		requested;
+		int32			setlistIndex;
+	};
+
 	BMenuBar*		_BuildMenu();
 	BView*			_BuildPadViews();
 	BView*			_BuildHeaderView();
+	BView*			_BuildStatusView();
 
 	void			_PopulateOpenRecentMenu();
+	void			_PopulateSetlistMenu();
 	void			_PopulateMidiInMenu();
 	void			_HandleMIDI(BMessage* msg);
+	void			_ConnectMidiSource(BMidiProducer* producer);
+	static status_t	_MidiThread(void* data);
+	void			_StartMidi();
+	bool			_HandleKey(BMessage* msg);
+	void			_LearnKey(int32 pad);
 
 	void			_LoadSettings();
 	void			_SaveSettings();
+	static status_t	_AttachThread(void* data);
+	void			_ShowRemote(bool remote);
+	void			_SendEngineState();
+	BFilePanel*		_FilePanel(int32 which);
+	void			_ReportStartupTimes(status_t status);
 
 	void			_OpenHelp();
 	void			_LoadEnsemble(entry_ref ref);
+	void			_StartLoading(const entry_ref& ref, bigtime_t requested,
+						int32 setlistIndex);
+	static status_t	_LoadThread(void* data);
+	void			_EnsembleLoaded(BMessage* msg);
+	void			_ShowPadLoading(BMessage* msg);
+	void			_SwitchToSetlistEntry(int32 index, bigtime_t requested);
+	bool			_SwitchEnsemble(Ensemble* ensemble, bigtime_t requested,
+						bool preloaded);
+	AudioEngine::Kit*	_CreateKit(Ensemble* ensemble);
+	AudioEngine::Kit*	_CreatePadKit();
+	void			_RenderPattern(BPath path);
+	void			_ToggleRecording();
+	void			_ExportRecording(BPath path);
+	void			_PopulateRenderThreadsMenu();
+	void			_PopulateSampleMemoryMenu();
+	void			_PopulateLibraryMenu();
+	void			_SetLibraryFolder(const char* folder, bool add);
+	void			_ShowMeters(bool show);
+	void			_ShowWaveforms(bool show);
+	void			_UpdateDisplayRunner();
+	void			_UpdateDisplays();
+	void			_ShowEnsemble(Ensemble* ensemble, int32 program);
+	void			_FollowKitSwap(BMessage* msg);
+	void			_SetResident(bool resident);
+	void			_ReportResidentMemory();
+	void			_CollectEnsemble(EnsembleData& ensemble);
 	void			_SaveEnsemble();
+	void			_ExportBundle(BPath path);
 	void			_AddRecentEnsemble(BString path);
 
 	void			_UpdateWindowTitle();
+	void			_SetStatus(const char* text, bool warning);
 
 	void			_SendSample(BMessage* msg, entry_ref ref);
 	void			_SetSample(int32 pad, BString samplepath);
+	void			_WatchSamples();
+	void			_ReloadSample(Sample* sample);
 	void			_SetNote(int32 pad, int32 note);
+	void			_SoloPad(int32 soloPad, int32 state);
 
 	Pad*			fPads[kPadCount];
+	KeyMap			fKeyMap;
+	int32			fKeyLearnPad;
 
-	BFilePanel*		fOpenSamplePanel;
-	BFilePanel*		fOpenEnsemblePanel;
-	BFilePanel*		fSaveEnsemblePanel;
+	// built when first shown
+	BFilePanel*		fFilePanels[kFilePanelCount];
+	AudioFilter*	fAudioFilter;
 
 	BPath			fEnsemblePath;
+	bool			fEnsembleIsBundle;
 	BStringList		fRecentEnsemblePaths;
 
+	BReference<Ensemble> fEnsemble;
+	BReference<Ensemble> fSwappedEnsemble;
+	int32			fActiveProgram;
+
+	// one ensemble loads at a time, the last one opened meanwhile is next
+	BReference<Ensemble> fLoadingEnsemble;
+	thread_id		fLoadThread;
+	bool			fEnsembleQueued;
+	entry_ref		fQueuedRef;
+	bigtime_t		fQueuedRequested;
+	int32			fQueuedIndex;
+
+	Setlist*		fSetlist;
+	SampleCache*	fSampleCache;
+	SampleLibrary*	fLibrary;
+	SampleWatcher*	fWatcher;
+	bigtime_t		fSwitchQueued;
+	bigtime_t		fSwitchLoadTime;
+	bool			fSwitchPreloaded;
+
 	BMenu*			fOpenRecentMenu;
+	BMenu*			fSetlistMenu;
 	BMenu*			fMidiInMenu;
 	BMenuItem*		fSaveMenu;
+	BMenuItem*		fRecordMenu;
+	BMenuItem*		fMetersMenu;
+	BMenuItem*		fWaveformsMenu;
+	BMenu*			fOutputsMenu;
+	BMenu*			fRenderThreadsMenu;
+	BMenuItem*		fRenderTimeMenu;
+	BMenuItem*		fVoiceTimeMenu;
+	BMenu*			fSampleMemoryMenu;
+	BMenu*			fLibraryMenu;
+	BMenuItem*		fExportRecordingMenu;
+	BStringView*	fStatusView;
+	LevelMeter*		fMasterMeter;
+	BMessageRunner*	fDisplayRunner;
+	bool			fShowMeters;
+	bool			fShowWaveforms;
+
+	AudioEngine*	fEngine;
+	SequencerWindow*	fSequencerWindow;
+	SampleSearchWindow*	fSearchWindow;
+	Recorder*		fRecorder;
 
 	BMessage*		fSettings;
+	bigtime_t		fStartupLaunched;	// only when the start is measured
+	bigtime_t		fStartupShown;
 	BMessenger*		fMessenger;
-	BMidiRoster*	fRoster;
+	thread_id		fMidiThread;
+	thread_id		fAttachThread;
+	BMidiRoster*	fRoster;	// both NULL until the MIDI server answered
 	MidiConsumer*	fConsumer;
+	BStringList		fDisabledMidiSources;
+	std::map<BString, uint16> fMidiChannelFilters;
 };
 
 #endif /* MAINWINDOW_H */
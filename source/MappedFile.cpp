@@ -0,0 +1,58 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "MappedFile.h"
+
+#include <Path.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+MappedFile::MappedFile(const entry_ref& ref)
+	:
+	fData(NULL),
+	fSize(0),
+	fInitStatus(B_NO_INIT)
+{
+	BPath path(&ref);
+	int fd = open(path.Path(), O_RDONLY);
+	if (fd < 0) {
+		fInitStatus = errno;
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		fInitStatus = B_BAD_DATA;
+		close(fd);
+		return;
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fInitStatus = errno;
+		return;
+	}
+
+	fData = (uint8*)data;
+	fSize = st.st_size;
+	fInitStatus = B_OK;
+}
+
+
+MappedFile::~MappedFile()
+{
+	if (fData != NULL)
+		munmap(fData, fSize);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <Entry.h>
+#include <Referenceable.h>
+#include <SupportDefs.h>
+
+
+// A whole file mapped read-only into memory. Samples of an ensemble bundle
+// point right into the mapping and keep it alive with a reference.
+
+class MappedFile : public BReferenceable {
+public:
+					MappedFile(const entry_ref& ref);
+	virtual			~MappedFile();
+
+	status_t		InitCheck() const { return fInitStatus; };
+
+	const uint8*	Data() const { return fData; };
+	size_t			Size() const { return fSize; };
+
+private:
+	uint8*			fData;
+	size_t			fSize;
+	status_t		fInitStatus;
+};
+
+
+#endif // MAPPED_FILE_H
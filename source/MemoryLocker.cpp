@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "MemoryLocker.h"
+
+#include <OS.h>
+
+#include <errno.h>
+#include <sys/mman.h>
+
+
+MemoryLocker::MemoryLocker(size_t limit)
+	:
+	fLockedSize(0),
+	fLimit(limit)
+{
+}
+
+
+status_t
+MemoryLocker::Lock(const void* address, size_t size)
+{
+	if (address == NULL || size == 0)
+		return B_BAD_VALUE;
+
+	// reserve our share of the limit first, other threads may lock concurrently
+	size_t locked = fLockedSize.fetch_add(size);
+	if (locked + size > fLimit) {
+		fLockedSize.fetch_sub(size);
+		// still page it in, it's just not guaranteed to stay there
+		Prefault(address, size);
+		return B_NO_MEMORY;
+	}
+
+	if (mlock(address, size) != 0) {
+		fLockedSize.fetch_sub(size);
+		Prefault(address, size);
+		return errno;
+	}
+
+	Prefault(address, size);
+	return B_OK;
+}
+
+
+void
+MemoryLocker::Unlock(const void* address, size_t size)
+{
+	if (address == NULL || size == 0)
+		return;
+
+	munlock(address, size);
+	fLockedSize.fetch_sub(size);
+}
+
+
+/*static*/ void
+MemoryLocker::Prefault(const void* address, size_t size)
+{
+	// touch every page once, so none of them is faulted in on the audio thread
+	const volatile uint8* bytes = (const volatile uint8*)address;
+	uint8 sum = 0;
+	for (size_t offset = 0; offset < size; offset += B_PAGE_SIZE)
+		sum += bytes[offset];
+	if (size > 0)
+		sum += bytes[size - 1];
+	(void)sum;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef MEMORY_LOCKER_H
+#define MEMORY_LOCKER_H
+
+#include <SupportDefs.h>
+
+#include <atomic>
+
+
+// Keeps memory the audio thread touches resident in RAM, so a sample that
+// hasn't been played for a while doesn't have to be paged in on the next hit.
+// The total amount of locked memory is capped.
+
+class MemoryLocker {
+public:
+					MemoryLocker(size_t limit);
+
+	void			SetLimit(size_t limit) { fLimit = limit; };
+	size_t			Limit() const { return fLimit; };
+	size_t			LockedSize() const { return fLockedSize; };
+
+	status_t		Lock(const void* address, size_t size);
+	void			Unlock(const void* address, size_t size);
+
+	static void		Prefault(const void* address, size_t size);
+
+private:
+	std::atomic<size_t>	fLockedSize;
+	std::atomic<size_t>	fLimit;
+};
+
+
+#endif // MEMORY_LOCKER_H
@@ -9,11 +9,15 @@
 
 #include "MidiConsumer.h"
 
+#include <string.h>
 
-MidiConsumer::MidiConsumer(BMessenger* messenger)
+
+MidiConsumer::MidiConsumer(BMessenger* messenger, AudioEngine* engine)
 	:
-	fCaller(messenger)
+	fCaller(messenger),
+	fEngine(engine)
 {
+	memset(fBank, 0, sizeof(fBank));
 }
 
 
@@ -22,14 +26,119 @@ MidiConsumer::~MidiConsumer()
 }
 
 
+void
+MidiConsumer::SetChannelFilter(int32 producer, uint16 channels)
+{
+	fFilter.SetChannelFilter(producer, channels);
+}
+
+
+uint16
+MidiConsumer::ChannelFilter(int32 producer) const
+{
+	return fFilter.ChannelFilter(producer);
+}
+
+
+// #pragma mark -
+
+
+void
+MidiConsumer::Data(uchar* data, size_t length, bool atomic, bigtime_t time)
+{
+	if (length > 0 && atomic
+		&& !fFilter.Accepts(GetProducerID(), data[0], fEngine->WantsMidiClock()))
+		return;
+
+	BMidiLocalConsumer::Data(data, length, atomic, time);
+}
+
+
 void
 MidiConsumer::NoteOn(uchar channel, uchar note, uchar velocity, bigtime_t time)
 {
-	int32 id = GetProducerID();
-	printf("%" B_PRId64 ": [Producer %" B_PRId32 "][Channel %d / Note %d]  Note on with velocity %d\n", time, id,
-		channel, note, velocity);
+	// The engine maps the note to its pads, the window only needs it for
+	// pads that detect their note. It mustn't hold up the MIDI thread.
+	fEngine->HandleMidi(B_NOTE_ON | channel, note, velocity, time);
+
+	if (velocity > 0) {
+		BMessage msg(NEW_NOTE);
+		msg.AddInt32("note", note);
+		fCaller->SendMessage(&msg, (BHandler*)NULL, 0);
+	}
+}
+
+
+void
+MidiConsumer::NoteOff(uchar channel, uchar note, uchar velocity, bigtime_t time)
+{
+	fEngine->HandleMidi(B_NOTE_OFF | channel, note, velocity, time);
+}
+
+
+void
+MidiConsumer::KeyPressure(uchar channel, uchar note, uchar pressure, bigtime_t time)
+{
+	fEngine->HandleMidi(B_KEY_PRESSURE | channel, note, pressure, time);
+}
+
+
+void
+MidiConsumer::ControlChange(uchar channel, uchar controlNumber, uchar controlValue,
+	bigtime_t time)
+{
+	fEngine->HandleMidi(B_CONTROL_CHANGE | channel, controlNumber, controlValue, time);
+
+	if (controlNumber == kBankSelectController) {
+		fBank[channel & 0x0f] = controlValue;
+		return;
+	}
+
+	// step through the setlist with a foot switch or button
+	if (controlValue < 64)
+		return;
+
+	uint32 what;
+	if (controlNumber == kSetlistNextController)
+		what = SETLIST_NEXT;
+	else if (controlNumber == kSetlistPreviousController)
+		what = SETLIST_PREVIOUS;
+	else
+		return;
+
+	// like a note, it mustn't hold up the MIDI thread while the window is
+	// busy, e.g. loading an ensemble; a press lost then is pressed again
+	BMessage msg(what);
+	msg.AddInt64("when", time);
+	fCaller->SendMessage(&msg, (BHandler*)NULL, 0);
+}
+
+
+void
+MidiConsumer::ProgramChange(uchar channel, uchar programNumber, bigtime_t time)
+{
+	// Selects an ensemble of the setlist right on the audio thread, if it's
+	// kept in memory. The bank (MSB) counts in steps of 128 programs.
+	fEngine->SelectProgram(fBank[channel & 0x0f] * 128 + programNumber, time);
+}
+
 
-	BMessage* msg = new BMessage(PLAY);
-	msg->AddInt32("note", note);
-	fCaller->SendMessage(msg);
+void
+MidiConsumer::PitchBend(uchar channel, uchar lsb, uchar msb, bigtime_t time)
+{
+	fEngine->HandleMidi(B_PITCH_BEND | channel, lsb, msb, time);
+}
+
+
+void
+MidiConsumer::SystemRealTime(uchar status, bigtime_t time)
+{
+	switch (status) {
+		case B_TIMING_CLOCK:
+		case B_START:
+		case B_CONTINUE:
+		case B_STOP:
+			fEngine->HandleMidi(status, 0, 0, time);
+			break;
+	}
 }
@@ -11,23 +11,47 @@
 #ifndef _H_MIDI_CONSUMER
 #define _H_MIDI_CONSUMER
 
+#include "AudioEngine.h"
 #include "Constants.h"
+#include "MidiFilter.h"
 
 #include <Messenger.h>
 #include <MidiConsumer.h>
+#include <MidiDefs.h>
 #include <SupportDefs.h>
-#include <cstdio>
+
+
+// Merges all connected MIDI sources, what they send passes the MidiFilter
+// first.
 
 
 class MidiConsumer : public BMidiLocalConsumer{
 public:
-				MidiConsumer(BMessenger* messenger);
+				MidiConsumer(BMessenger* messenger, AudioEngine* engine);
 	virtual		~MidiConsumer();
 
+	// window thread
+	void		SetChannelFilter(int32 producer, uint16 channels);
+	uint16		ChannelFilter(int32 producer) const;
+	uint64		FilteredCount() const { return fFilter.FilteredCount(); };
+
 private:
+	void		Data(uchar* data, size_t length, bool atomic, bigtime_t time);
+
 	void		NoteOn(uchar channel, uchar note, uchar velocity, bigtime_t time);
+	void		NoteOff(uchar channel, uchar note, uchar velocity, bigtime_t time);
+	void		KeyPressure(uchar channel, uchar note, uchar pressure, bigtime_t time);
+	void		ControlChange(uchar channel, uchar controlNumber, uchar controlValue,
+					bigtime_t time);
+	void		ProgramChange(uchar channel, uchar programNumber, bigtime_t time);
+	void		PitchBend(uchar channel, uchar lsb, uchar msb, bigtime_t time);
+	void		SystemRealTime(uchar status, bigtime_t time);
 
 	BMessenger*	fCaller;
+	AudioEngine*	fEngine;
+	uchar		fBank[16];
+
+	MidiFilter	fFilter;
 };
 
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "MidiFilter.h"
+
+#include <MidiDefs.h>
+
+
+MidiFilter::MidiFilter()
+	:
+	fFiltered(0)
+{
+	for (int32 i = 0; i < kMaxMidiSources; i++) {
+		fFilters[i].producer = -1;
+		fFilters[i].channels = kAllMidiChannels;
+	}
+}
+
+
+void
+MidiFilter::SetChannelFilter(int32 producer, uint16 channels)
+{
+	// the MIDI thread only reads the table, a slot is never given up
+	int32 free = -1;
+	for (int32 i = 0; i < kMaxMidiSources; i++) {
+		int32 id = fFilters[i].producer.load();
+		if (id == producer) {
+			fFilters[i].channels = channels;
+			return;
+		}
+		if (id < 0 && free < 0)
+			free = i;
+	}
+	if (free < 0 || channels == kAllMidiChannels)
+		return;
+
+	fFilters[free].channels = channels;
+	fFilters[free].producer = producer;
+}
+
+
+uint16
+MidiFilter::ChannelFilter(int32 producer) const
+{
+	for (int32 i = 0; i < kMaxMidiSources; i++) {
+		if (fFilters[i].producer.load(std::memory_order_acquire) == producer)
+			return fFilters[i].channels.load(std::memory_order_relaxed);
+	}
+	return kAllMidiChannels;
+}
+
+
+bool
+MidiFilter::Accepts(int32 producer, uint8 status, bool wantsClock)
+{
+	// a busy controller sends these many times a second, the clock is only
+	// needed by a synced sequencer
+	if ((status == B_TIMING_CLOCK && !wantsClock) || status == B_ACTIVE_SENSING) {
+		fFiltered.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	if (status >= 0x80 && status < 0xf0
+		&& (ChannelFilter(producer) & (1 << (status & 0x0f))) == 0) {
+		fFiltered.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
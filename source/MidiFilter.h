@@ -0,0 +1,52 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef MIDI_FILTER_H
+#define MIDI_FILTER_H
+
+#include <SupportDefs.h>
+
+#include <atomic>
+
+
+static const int32 kMaxMidiSources = 32;
+static const uint16 kAllMidiChannels = 0xffff;
+
+
+// What a Samedi takes from its MIDI sources. Each source can be limited to
+// some channels; that, as well as dropping clock and active sensing, is
+// decided by the MIDI thread right as the data comes in, before it's parsed
+// or queued anywhere. A Samedi playing through another one's engine filters
+// with its own, too.
+//
+// No Haiku API, so it can be tested on other systems.
+
+class MidiFilter {
+public:
+				MidiFilter();
+
+	// window thread
+	void		SetChannelFilter(int32 producer, uint16 channels);
+	uint16		ChannelFilter(int32 producer) const;
+	uint64		FilteredCount() const { return fFiltered.load(std::memory_order_relaxed); };
+
+	// MIDI thread, by the status byte of what the producer sent
+	bool		Accepts(int32 producer, uint8 status, bool wantsClock);
+
+private:
+	struct SourceFilter {
+		std::atomic<int32>	producer;
+		std::atomic<uint16>	channels;
+	};
+
+	SourceFilter	fFilters[kMaxMidiSources];
+	std::atomic<uint64>	fFiltered;
+};
+
+
+#endif // MIDI_FILTER_H
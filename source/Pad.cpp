@@ -7,149 +7,215 @@
  *
  */
 
+#include "AudioEngine.h"
 #include "Constants.h"
 #include "Pad.h"
+#include "Sample.h"
+#include "SampleAnalysis.h"
 
+#include <Bitmap.h>
+#include <Button.h>
 #include <Catalog.h>
 #include <ControlLook.h>
-#include <LayoutBuilder.h>
+#include <MenuItem.h>
+#include <PopUpMenu.h>
+#include <TextControl.h>
+#include <TextView.h>
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <new>
+#include <vector>
+
 #undef B_TRANSLATION_CONTEXT
 #define B_TRANSLATION_CONTEXT "Pad"
 
 static const char* kNoSample = B_TRANSLATE_MARK("<click to load a sample>");
 static const char* kSampleNotFound = B_TRANSLATE_MARK("⚠ - Failed loading '%samplefile%'");
+static const char* kSampleLoading = B_TRANSLATE_MARK("⌛ %samplefile%");
+
+static const char* kCellLabels[] = { NULL, "", "M", "S", "∞", NULL, "⯈", "⏹", "⏏" };
+
+static const float kGainSteps[] = { 6, 3, 0, -3, -6, -12, -18 };
+static const float kCutoffSteps[] = { 250, 500, 1000, 2000, 4000, 8000 };
+static const float kResonanceSteps[] = { kDefaultResonance, 2, 5, 10 };
+static const float kAttackSteps[] = { 0, 0.005f, 0.02f, 0.1f };
+static const float kFadeSteps[] = { 0, 0.05f, 0.2f, 1.0f };	// decay and release
+
+
+// Edits the note in place of the drawn field. Enter or leaving it applies
+// the note, Escape keeps the old one. Either way, the pad is told with a
+// NOTE message and removes the editor.
+
+class NoteEditor : public BTextView {
+public:
+	NoteEditor(BRect frame, Pad* pad)
+		:
+		BTextView(frame, "noteeditor", frame.OffsetToCopy(B_ORIGIN), B_FOLLOW_NONE,
+			B_WILL_DRAW),
+		fPad(pad),
+		fDone(false)
+	{
+		// only allow numbers
+		for (uint32 i = 0; i < '0'; i++)
+			DisallowChar(i);
+		for (uint32 i = '9' + 1; i < 255; i++)
+			DisallowChar(i);
+
+		// one line, in the middle of the field
+		font_height fontHeight;
+		be_plain_font->GetHeight(&fontHeight);
+		float lineHeight = ceilf(fontHeight.ascent + fontHeight.descent
+			+ fontHeight.leading);
+		BRect textRect(Bounds());
+		textRect.InsetBy(1, 0);
+		textRect.top = floorf((textRect.Height() - lineHeight) / 2);
+		SetTextRect(textRect);
+		SetWordWrap(false);
+	}
+
+	virtual void KeyDown(const char* bytes, int32 numBytes)
+	{
+		if (numBytes == 1 && (bytes[0] == B_ENTER || bytes[0] == B_ESCAPE)) {
+			_Done(bytes[0] == B_ESCAPE);
+			return;
+		}
+		BTextView::KeyDown(bytes, numBytes);
+	}
+
+	virtual void MakeFocus(bool focus = true)
+	{
+		BTextView::MakeFocus(focus);
+		if (!focus)
+			_Done(false);
+	}
+
+private:
+	void _Done(bool cancel)
+	{
+		// only once, the focus also goes when the pad removes the editor
+		if (fDone || Window() == NULL)
+			return;
+
+		fDone = true;
+		BMessage message(NOTE);
+		message.AddBool("cancel", cancel);
+		Window()->PostMessage(&message, fPad);
+	}
+
+	Pad*	fPad;
+	bool	fDone;
+};
+
+
+static const int32 kDrawPasses = 10;
+
+
+static size_t
+team_memory()
+{
+	size_t size = 0;
+	ssize_t cookie = 0;
+	area_info info;
+	while (get_next_area_info(B_CURRENT_TEAM, &cookie, &info) == B_OK)
+		size += info.ram_size;
+	return size;
+}
+
+
+static int32
+count_views(BView* view)
+{
+	int32 count = 1;
+	for (BView* child = view->ChildAt(0); child != NULL; child = child->NextSibling())
+		count += count_views(child);
+	return count;
+}
+
+
+static void
+draw_views(BView* view)
+{
+	// all of it, as an update of the whole window would
+	if (view->IsHidden())
+		return;
+	view->Draw(view->Bounds());
+	for (BView* child = view->ChildAt(0); child != NULL; child = child->NextSibling())
+		draw_views(child);
+}
+
+
+// #pragma mark -
 
 
-Pad::Pad(int32 number, int32 note)
+Pad::Pad(int32 number, int32 note, AudioEngine* engine)
 	:
-	BView("pad", B_WILL_DRAW | B_SUPPORTS_LAYOUT),
+	BView("pad", B_WILL_DRAW | B_NAVIGABLE | B_FRAME_EVENTS | B_FULL_UPDATE_ON_RESIZE),
 	fPadNumber(number),
 	fNote(note),
 	fSamplePath(""),
-	fPlayer(NULL)
-{
-	BString padNr;
-	padNr << fPadNumber + 1;
-	BString noteNr;
-	noteNr << fNote;
-	fNoteControl = new BTextControl("notecontrol", padNr, noteNr, new BMessage(NOTE));
-	// only allow numbers
-	for (uint32 i = 0; i < '0'; i++)
-		fNoteControl->TextView()->DisallowChar(i);
-	for (uint32 i = '9' + 1; i < 255; i++)
-		fNoteControl->TextView()->DisallowChar(i);
-
-	fDetectButton = new BButton("detect" , new BMessage(DETECT_NOTE));
-	fDetectButton->SetBehavior(BButton::B_TOGGLE_BEHAVIOR);
-	fDetectButton->SetToolTip(B_TRANSLATE("Detect MIDI note"));
-
-	fMuteButton = new BButton("M", new BMessage(MUTE));
-	fMuteButton->SetBehavior(BButton::B_TOGGLE_BEHAVIOR);
-	fMuteButton->SetToolTip(B_TRANSLATE("Mute"));
-
-	fSoloButton = new BButton("S" , new BMessage(SOLO));
-	fSoloButton->SetBehavior(BButton::B_TOGGLE_BEHAVIOR);
-	fSoloButton->SetToolTip(B_TRANSLATE("Solo"));
-
-	fLoopButton = new BButton("∞" , new BMessage(LOOP));
-	fLoopButton->SetBehavior(BButton::B_TOGGLE_BEHAVIOR);
-	fLoopButton->SetToolTip(B_TRANSLATE("Loop"));
-
-	fSampleButton = new BButton("sample", B_TRANSLATE_NOCOLLECT(kNoSample), new BMessage(OPEN_SAMPLE));
-	fSampleButton->SetFlat(true);
-	fSampleButton->SetExplicitMaxSize(BSize(B_SIZE_UNLIMITED, B_SIZE_UNLIMITED));
-
-	fPlayButton = new BButton("⯈" , new BMessage(PLAY));
-	fStopButton = new BButton("⏹" , new BMessage(STOP));
-	fEjectButton = new BButton("⏏" , new BMessage(EJECT));
-
-	// limit widget sizes
-	float height;
-	fNoteControl->GetPreferredSize(NULL, &height);
-	BSize size(height + 2, height);
-	fMuteButton->SetExplicitSize(size);
-	fSoloButton->SetExplicitSize(size);
-	fLoopButton->SetExplicitSize(size);
-	fPlayButton->SetExplicitSize(size);
-	fStopButton->SetExplicitSize(size);
-	fEjectButton->SetExplicitSize(size);
-
-	float width = height * 0.7;
-	size = BSize(width, height);
-	fDetectButton->SetExplicitSize(size);
-
-	width = be_plain_font->StringWidth("XXXXX");
-	size = BSize(width, height);
-	fNoteControl->SetExplicitSize(size);
-
-	fSampleButton->SetExplicitMinSize(BSize(B_SIZE_UNSET, B_SIZE_UNSET));
-
-	const float kSpacing = be_control_look->DefaultItemSpacing();
-
-	BLayoutBuilder::Group<>(this, B_HORIZONTAL, 0)
-		.SetInsets(B_USE_WINDOW_SPACING, kSpacing / 2, B_USE_WINDOW_SPACING, kSpacing / 2)
-		.Add(fNoteControl)
-		.Add(fDetectButton)
-		.AddStrut(B_USE_SMALL_SPACING)
-		.Add(fMuteButton)
-		.Add(fSoloButton)
-		.Add(fLoopButton)
-		.AddStrut(B_USE_SMALL_SPACING)
-		.Add(fSampleButton)
-		.AddStrut(B_USE_SMALL_SPACING)
-		.Add(fPlayButton)
-		.Add(fStopButton)
-		.Add(fEjectButton)
-	.End();
-
-	SetEventMask(B_KEYBOARD_EVENTS);
-}
+	fGain(1.0f),
+	fChokeGroup(0),
+	fGate(false),
+	fGainController(0),
+	fBus(0),
+	fFilterType(kFilterOff),
+	fCutoff(kDefaultCutoff),
+	fResonance(kDefaultResonance),
+	fAttack(0.0f),
+	fDecay(0.0f),
+	fRelease(0.0f),
+	fTrimmed(true),
+	fNormalized(true),
+	fTrimStart(0),
+	fTrimEnd(0),
+	fMuted(false),
+	fSolo(false),
+	fLooping(false),
+	fDetecting(false),
+	fSampleLabel(B_TRANSLATE_NOCOLLECT(kNoSample)),
+	fPressedCell(-1),
+	fPressedInside(false),
+	fHoverCell(-1),
+	fFocusedCell(kNoteCell),
+	fNoteEditor(NULL),
+	fEngine(engine)
+{
+	SetViewUIColor(B_PANEL_BACKGROUND_COLOR);
 
+	// as high as a text control, the note field as wide as five digits
+	font_height fontHeight;
+	be_plain_font->GetHeight(&fontHeight);
+	fCellHeight = ceilf(fontHeight.ascent + fontHeight.descent + fontHeight.leading) + 6;
+	fNoteWidth = ceilf(be_plain_font->StringWidth("XXXXX"));
+	fSampleWidth = ceilf(be_plain_font->StringWidth(B_TRANSLATE_NOCOLLECT(kNoSample))
+		+ 2 * be_control_look->DefaultLabelSpacing());
 
-Pad::~Pad()
-{
-	if (fPlayer != NULL) {
-		fPlayer->StopPlaying();
-		fPlayer = NULL;
-		delete fPlayer;
-	}
+	fMeter = new LevelMeter("meter");
+	fMeter->Hide();
+	AddChild(fMeter);
+
+	fWaveform = new WaveformView("waveform");
+	fWaveform->Hide();
+	AddChild(fWaveform);
+
+	// MIDI notes are mapped to the pads by the engine
+	fEngine->SetNote(fPadNumber, fNote);
 }
 
 
-void
-Pad::AttachedToWindow()
+Pad::~Pad()
 {
-	fNoteControl->SetTarget(this);
-	fDetectButton->SetTarget(this);
-	fMuteButton->SetTarget(this);
-	fSoloButton->SetTarget(this);
-	fLoopButton->SetTarget(this);
-	fSampleButton->SetTarget(this);
-	fPlayButton->SetTarget(this);
-	fStopButton->SetTarget(this);
-	fEjectButton->SetTarget(this);
 }
 
 
 void
-Pad::KeyDown(const char* bytes, int32 numBytes)
+Pad::AttachedToWindow()
 {
-	if (Window()->IsActive() == false)
-		return;
-
-	if (bytes[0] == B_ESCAPE) {
-		if (fDetectButton->Value() == B_CONTROL_ON)
-			_SetDetectMode(false);
-	} else {
-		uint8 key = bytes[0];
-		if (key == '0' + fPadNumber + 1)
-			BMessenger(this).SendMessage(new BMessage(PLAY));
-	}
-	BView::KeyDown(bytes, numBytes);
+	_LayoutCells();
 }
 
 
@@ -159,45 +225,103 @@ Pad::MessageReceived(BMessage* msg)
 	switch (msg->what) {
 		case NOTE:
 		{
-			BString newNote = fNoteControl->Text();
-			if (newNote == "") {
-				newNote << fNote;
-				fNoteControl->SetText(newNote);
-			} else
-				fNote = atoi(newNote);
-
-			fNoteControl->MakeFocus(false);
-
-			if (fDetectButton->Value() == B_CONTROL_ON)
-				_SetDetectMode(false);
+			// a late one from an editor that's gone already
+			if (fNoteEditor == NULL)
+				break;
 
+			if (!msg->GetBool("cancel", false) && fNoteEditor->TextLength() > 0)
+				SetNote(atoi(fNoteEditor->Text()));
+			_EndNoteEdit();
 			break;
 		}
 		case DETECT_NOTE:
 		{
-			if (fDetectButton->Value() == B_CONTROL_ON) {
-				fNoteControl->SetText("?");
-				_SetDetectMode(true);
-			} else
-				_SetDetectMode(false);
-
+			_SetDetectMode(fDetecting);
 			break;
 		}
 		case MUTE:
 		{
-			Mute(fMuteButton->Value());
+			Mute(fMuted ? B_CONTROL_ON : B_CONTROL_OFF);
 			break;
 		}
 		case SOLO:
 		{
 			msg->AddInt32("pad", fPadNumber);
-			msg->AddInt32("solo", fSoloButton->Value());
+			msg->AddInt32("solo", fSolo ? B_CONTROL_ON : B_CONTROL_OFF);
 			Window()->PostMessage(msg);
 			break;
 		}
 		case LOOP:
 		{
-			SetSample(fSamplePath);
+			fEngine->SetLooping(fPadNumber, fLooping);
+			break;
+		}
+		case SET_GAIN:
+		{
+			float gain;
+			if (msg->FindFloat("gain", &gain) == B_OK)
+				SetGain(gain);
+			break;
+		}
+		case SET_CHOKE_GROUP:
+		{
+			int32 group;
+			if (msg->FindInt32("group", &group) == B_OK)
+				SetChokeGroup(group);
+			break;
+		}
+		case SET_GATE:
+		{
+			bool gate;
+			if (msg->FindBool("gate", &gate) == B_OK)
+				SetGate(gate);
+			break;
+		}
+		case SET_GAIN_CONTROLLER:
+		{
+			int32 controller;
+			if (msg->FindInt32("controller", &controller) == B_OK)
+				SetGainController(controller);
+			break;
+		}
+		case SET_BUS:
+		{
+			int32 bus;
+			if (msg->FindInt32("bus", &bus) == B_OK)
+				SetBus(bus);
+			break;
+		}
+		case SET_FILTER:
+		{
+			// any of them, the others stay
+			int32 type = fFilterType;
+			float cutoff = fCutoff;
+			float resonance = fResonance;
+			msg->FindInt32("type", &type);
+			msg->FindFloat("cutoff", &cutoff);
+			msg->FindFloat("resonance", &resonance);
+			SetFilter(type, cutoff, resonance);
+			break;
+		}
+		case SET_ENVELOPE:
+		{
+			float attack = fAttack;
+			float decay = fDecay;
+			float release = fRelease;
+			msg->FindFloat("attack", &attack);
+			msg->FindFloat("decay", &decay);
+			msg->FindFloat("release", &release);
+			SetEnvelope(attack, decay, release);
+			break;
+		}
+		case TRIM_SILENCE:
+		{
+			SetTrimmed(!fTrimmed);
+			break;
+		}
+		case NORMALIZE_LOUDNESS:
+		{
+			SetNormalized(!fNormalized);
 			break;
 		}
 		case OPEN_SAMPLE:
@@ -208,14 +332,13 @@ Pad::MessageReceived(BMessage* msg)
 		}
 		case PLAY:
 		{
-			if ((fPlayer != NULL) && (fMuteButton->Value() == B_CONTROL_OFF))
-				fPlayer->StartPlaying();
+			if (fSample.Get() != NULL && !fMuted)
+				fEngine->Trigger(fPadNumber);
 			break;
 		}
 		case STOP:
 		{
-			if (fPlayer != NULL)
-				fPlayer->StopPlaying();
+			fEngine->StopPad(fPadNumber);
 			break;
 		}
 		case EJECT:
@@ -232,38 +355,720 @@ Pad::MessageReceived(BMessage* msg)
 }
 
 
-// #pragma mark -
+void
+Pad::Draw(BRect updateRect)
+{
+	// only what's asked for, a meter or playhead next to it redraws often
+	if (fCells[kNoteCell].Intersects(updateRect))
+		_DrawNote(updateRect);
+
+	for (int32 cell = kDetectCell; cell < kCellCount; cell++) {
+		if (fCells[cell].IsValid() && fCells[cell].Intersects(updateRect))
+			_DrawButton(cell, updateRect);
+	}
+}
 
 
 void
-Pad::Mute(int32 state)
+Pad::FrameResized(float width, float height)
 {
-	fMuteButton->SetValue(state);
+	_LayoutCells();
+}
+
+
+void
+Pad::KeyDown(const char* bytes, int32 numBytes)
+{
+	if (numBytes != 1) {
+		BView::KeyDown(bytes, numBytes);
+		return;
+	}
 
-	if (state == B_CONTROL_ON) {
-		fSoloButton->SetValue(B_CONTROL_OFF); // in case this pad was in solo mode
-		if (fPlayer != NULL)
-			fPlayer->StopPlaying();
+	switch (bytes[0]) {
+		case B_LEFT_ARROW:
+		case B_RIGHT_ARROW:
+		{
+			// to the next cell there is, the sample's may have no room
+			int32 step = bytes[0] == B_LEFT_ARROW ? -1 : 1;
+			for (int32 cell = fFocusedCell + step; cell >= 0 && cell < kCellCount;
+					cell += step) {
+				if (fCells[cell].IsValid()) {
+					_FocusCell(cell);
+					break;
+				}
+			}
+			break;
+		}
+		case B_UP_ARROW:
+		case B_DOWN_ARROW:
+			_FocusNeighbour(bytes[0] == B_DOWN_ARROW);
+			break;
+		case B_SPACE:
+		case B_ENTER:
+			if (fFocusedCell == kNoteCell)
+				_StartNoteEdit();
+			else
+				_Invoke(fFocusedCell);
+			break;
+		default:
+			BView::KeyDown(bytes, numBytes);
+			break;
 	}
 }
 
 
 void
-Pad::Play(int32 note)
+Pad::MakeFocus(bool focus)
 {
-	if (fDetectButton->Value() == B_CONTROL_ON) {
-		SetNote(note);
+	BView::MakeFocus(focus);
+	_InvalidateCell(fFocusedCell);
+}
+
+
+void
+Pad::WindowActivated(bool active)
+{
+	// the focus is only shown in the active window
+	if (IsFocus())
+		_InvalidateCell(fFocusedCell);
+}
+
+
+void
+Pad::MouseDown(BPoint where)
+{
+	// a click next to the editor applies the note
+	if (fNoteEditor != NULL)
+		fNoteEditor->MakeFocus(false);
+
+	int32 cell = _CellAt(where);
+	int32 buttons = 0;
+	Window()->CurrentMessage()->FindInt32("buttons", &buttons);
+	if ((buttons & B_SECONDARY_MOUSE_BUTTON) != 0) {
+		if (cell == kSampleCell)
+			ShowContextMenu(ConvertToScreen(where));
 		return;
 	}
 
-	if (fMuteButton->Value() == B_CONTROL_ON)
+	if (cell < 0)
+		return;
+
+	// the keyboard goes on from what was clicked
+	_FocusCell(cell);
+	if (cell == kNoteCell) {
+		_StartNoteEdit();
+		return;
+	}
+
+	// like a button, it's invoked if the mouse is released over it
+	fPressedCell = cell;
+	fPressedInside = true;
+	_InvalidateCell(cell);
+	SetMouseEventMask(B_POINTER_EVENTS, B_LOCK_WINDOW_FOCUS);
+}
+
+
+void
+Pad::MouseMoved(BPoint where, uint32 transit, const BMessage* dragMessage)
+{
+	int32 cell = -1;
+	if (transit != B_EXITED_VIEW && transit != B_OUTSIDE_VIEW)
+		cell = _CellAt(where);
+
+	if (fPressedCell >= 0 && (cell == fPressedCell) != fPressedInside) {
+		fPressedInside = cell == fPressedCell;
+		_InvalidateCell(fPressedCell);
+	}
+
+	if (cell != fHoverCell) {
+		// each cell has its own tool tip
+		HideToolTip();
+		_InvalidateCell(fHoverCell);
+		fHoverCell = cell;
+		_InvalidateCell(fHoverCell);
+	}
+}
+
+
+void
+Pad::MouseUp(BPoint where)
+{
+	int32 cell = fPressedCell;
+	if (cell < 0)
+		return;
+
+	fPressedCell = -1;
+	_InvalidateCell(cell);
+	if (fPressedInside)
+		_Invoke(cell);
+}
+
+
+bool
+Pad::GetToolTipAt(BPoint point, BToolTip** _tip)
+{
+	const char* text = NULL;
+	switch (_CellAt(point)) {
+		case kNoteCell:
+			if (fDetecting)
+				text = B_TRANSLATE("Press key");
+			break;
+		case kDetectCell:
+			text = B_TRANSLATE("Detect MIDI note");
+			break;
+		case kMuteCell:
+			text = B_TRANSLATE("Mute");
+			break;
+		case kSoloCell:
+			text = B_TRANSLATE("Solo");
+			break;
+		case kLoopCell:
+			text = B_TRANSLATE("Loop");
+			break;
+		case kSampleCell:
+			text = B_TRANSLATE("Right-click for gain and choke group");
+			break;
+	}
+	if (text == NULL)
+		return false;
+
+	SetToolTip(text);
+	*_tip = ToolTip();
+	return true;
+}
+
+
+BSize
+Pad::MinSize()
+{
+	float spacing = be_control_look->DefaultItemSpacing();
+	return BSize(_RowWidth(fSampleWidth), fCellHeight + spacing);
+}
+
+
+BSize
+Pad::MaxSize()
+{
+	return BSize(B_SIZE_UNLIMITED, MinSize().height);
+}
+
+
+BSize
+Pad::PreferredSize()
+{
+	return MinSize();
+}
+
+
+// #pragma mark -
+
+
+void
+Pad::Mute(int32 state)
+{
+	fMuted = state == B_CONTROL_ON;
+	fEngine->SetMuted(fPadNumber, fMuted);
+
+	if (fMuted)
+		fSolo = false; // in case this pad was in solo mode
+	_InvalidateCell(kMuteCell);
+	_InvalidateCell(kSoloCell);
+}
+
+
+void
+Pad::CancelDetect()
+{
+	if (fDetecting)
+		_SetDetectMode(false);
+}
+
+
+void
+Pad::DetectNote(int32 note)
+{
+	// the engine plays the note, the pad only learns it
+	if (fDetecting)
+		SetNote(note);
+}
+
+
+void
+Pad::SetSolo(int32 state)
+{
+	fSolo = state == B_CONTROL_ON;
+	_InvalidateCell(kSoloCell);
+}
+
+
+void
+Pad::SetLooping(bool looping)
+{
+	fLooping = looping;
+	_InvalidateCell(kLoopCell);
+	fEngine->SetLooping(fPadNumber, looping);
+}
+
+
+void
+Pad::SetGain(float gain)
+{
+	fGain = gain;
+	fEngine->SetGain(fPadNumber, GetOutputGain());
+}
+
+
+void
+Pad::SetNormalized(bool normalized)
+{
+	fNormalized = normalized;
+	fEngine->SetGain(fPadNumber, GetOutputGain());
+}
+
+
+float
+Pad::GetOutputGain()
+{
+	// worked out here once, a hit still only multiplies by the pad's gain
+	Sample* sample = fSample.Get();
+	if (!fNormalized || sample == NULL || !sample->HasLoudness())
+		return fGain;
+
+	return fGain * normalization_gain(sample->Peak(), sample->Loudness());
+}
+
+
+void
+Pad::SetChokeGroup(int32 group)
+{
+	fChokeGroup = group;
+	fEngine->SetChokeGroup(fPadNumber, group);
+}
+
+
+void
+Pad::SetGate(bool gate)
+{
+	fGate = gate;
+	fEngine->SetGate(fPadNumber, gate);
+}
+
+
+void
+Pad::SetGainController(int32 controller)
+{
+	fGainController = controller;
+	fEngine->SetGainController(fPadNumber, controller);
+}
+
+
+void
+Pad::SetBus(int32 bus)
+{
+	fBus = bus;
+	fEngine->SetBus(fPadNumber, bus);
+}
+
+
+void
+Pad::SetFilter(int32 type, float cutoff, float resonance)
+{
+	fFilterType = type;
+	fCutoff = cutoff;
+	fResonance = resonance;
+	fEngine->SetFilter(fPadNumber, type, cutoff, resonance);
+}
+
+
+void
+Pad::SetEnvelope(float attack, float decay, float release)
+{
+	fAttack = attack;
+	fDecay = decay;
+	fRelease = release;
+	fEngine->SetEnvelope(fPadNumber, attack, decay, release);
+}
+
+
+void
+Pad::SetTrimmed(bool trimmed)
+{
+	fTrimmed = trimmed;
+	_UpdateTrim();
+}
+
+
+void
+Pad::ShowMeter(bool show)
+{
+	if (show == !fMeter->IsHidden(this))
 		return;
 
-	if (note != fNote)
+	fMeter->Reset();
+	if (show)
+		fMeter->Show();
+	else
+		fMeter->Hide();
+
+	// the sample makes room for it
+	_LayoutCells();
+	InvalidateLayout();
+	Invalidate();
+}
+
+
+void
+Pad::UpdateMeter()
+{
+	float peak, rms;
+	fEngine->GetLevels(fPadNumber, peak, rms);
+	fMeter->SetLevels(peak, rms);
+}
+
+
+void
+Pad::ShowWaveform(bool show)
+{
+	if (show == !fWaveform->IsHidden(this))
 		return;
 
-	if (fPlayer != NULL)
-		fPlayer->StartPlaying();
+	fWaveform->SetPlayhead(-1.0f);
+	if (show)
+		fWaveform->Show();
+	else
+		fWaveform->Hide();
+
+	_LayoutCells();
+	InvalidateLayout();
+	Invalidate();
+}
+
+
+void
+Pad::UpdatePlayhead()
+{
+	fWaveform->SetPlayhead(fEngine->PlayheadOf(fPadNumber));
+}
+
+
+void
+Pad::ShowContextMenu(BPoint where)
+{
+	BPopUpMenu* menu = new BPopUpMenu("padmenu", false, false);
+	BMenu* gainMenu = new BMenu(B_TRANSLATE("Gain"));
+	BMenu* chokeMenu = new BMenu(B_TRANSLATE("Choke group"));
+	BMenu* playbackMenu = new BMenu(B_TRANSLATE("Playback"));
+	BMenu* controllerMenu = new BMenu(B_TRANSLATE("Gain follows controller"));
+	BMenu* busMenu = new BMenu(B_TRANSLATE("Output"));
+	BMenu* filterMenu = new BMenu(B_TRANSLATE("Filter"));
+	BMenu* envelopeMenu = new BMenu(B_TRANSLATE("Envelope"));
+	gainMenu->SetRadioMode(true);
+	chokeMenu->SetRadioMode(true);
+	playbackMenu->SetRadioMode(true);
+	controllerMenu->SetRadioMode(true);
+	busMenu->SetRadioMode(true);
+
+	for (size_t i = 0; i < sizeof(kGainSteps) / sizeof(kGainSteps[0]); i++) {
+		float gain = powf(10.0f, kGainSteps[i] / 20.0f);
+		BMessage* msg = new BMessage(SET_GAIN);
+		msg->AddFloat("gain", gain);
+		BString label;
+		label.SetToFormat("%+.0f dB", kGainSteps[i]);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(gain - fGain) < 0.001f);
+		gainMenu->AddItem(item);
+	}
+
+	for (int32 i = 0; i <= kChokeGroupCount; i++) {
+		BMessage* msg = new BMessage(SET_CHOKE_GROUP);
+		msg->AddInt32("group", i);
+		BString label;
+		if (i == 0)
+			label = B_TRANSLATE_COMMENT("None", "Choke group");
+		else
+			label << i;
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(i == fChokeGroup);
+		chokeMenu->AddItem(item);
+	}
+
+	for (int32 i = 0; i < 2; i++) {
+		BMessage* msg = new BMessage(SET_GATE);
+		msg->AddBool("gate", i == 1);
+		BMenuItem* item = new BMenuItem(i == 0
+			? B_TRANSLATE("One-shot") : B_TRANSLATE("Gate (stop on note off)"), msg);
+		item->SetMarked(fGate == (i == 1));
+		playbackMenu->AddItem(item);
+	}
+
+	const struct {
+		int32		controller;
+		const char*	label;
+	} kControllers[] = {
+		{ 0, NULL },
+		{ 1, B_TRANSLATE_MARK("Modulation (CC 1)") },
+		{ 4, B_TRANSLATE_MARK("Foot controller (CC 4)") },
+		{ 4 | kGainControllerInverted,
+			B_TRANSLATE_MARK("Foot controller, inverted (CC 4)") },
+		{ 7, B_TRANSLATE_MARK("Volume (CC 7)") },
+		{ 11, B_TRANSLATE_MARK("Expression (CC 11)") }
+	};
+	for (size_t i = 0; i < sizeof(kControllers) / sizeof(kControllers[0]); i++) {
+		BMessage* msg = new BMessage(SET_GAIN_CONTROLLER);
+		msg->AddInt32("controller", kControllers[i].controller);
+		BMenuItem* item = new BMenuItem(kControllers[i].label == NULL
+			? B_TRANSLATE_COMMENT("None", "Gain controller")
+			: B_TRANSLATE_NOCOLLECT(kControllers[i].label), msg);
+		item->SetMarked(kControllers[i].controller == fGainController);
+		controllerMenu->AddItem(item);
+	}
+
+	for (int32 i = 0; i < kBusCount; i++) {
+		BMessage* msg = new BMessage(SET_BUS);
+		msg->AddInt32("bus", i);
+		BString label;
+		if (i == 0)
+			label = B_TRANSLATE("Main");
+		else {
+			label = B_TRANSLATE("Bus %number%");
+			BString number;
+			number << i + 1;
+			label.ReplaceFirst("%number%", number);
+		}
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(i == fBus);
+		busMenu->AddItem(item);
+	}
+
+	const char* kFilterTypes[] = {
+		B_TRANSLATE_MARK("Off"),
+		B_TRANSLATE_MARK("Low-pass"),
+		B_TRANSLATE_MARK("High-pass"),
+		B_TRANSLATE_MARK("Band-pass")
+	};
+	for (int32 i = kFilterOff; i <= kFilterBandPass; i++) {
+		BMessage* msg = new BMessage(SET_FILTER);
+		msg->AddInt32("type", i);
+		BMenuItem* item = new BMenuItem(B_TRANSLATE_NOCOLLECT(kFilterTypes[i]), msg);
+		item->SetMarked(i == fFilterType);
+		filterMenu->AddItem(item);
+	}
+	filterMenu->AddSeparatorItem();
+	for (size_t i = 0; i < sizeof(kCutoffSteps) / sizeof(kCutoffSteps[0]); i++) {
+		BMessage* msg = new BMessage(SET_FILTER);
+		msg->AddFloat("cutoff", kCutoffSteps[i]);
+		BString label;
+		if (kCutoffSteps[i] >= 1000)
+			label.SetToFormat(B_TRANSLATE("Cutoff %g kHz"), kCutoffSteps[i] / 1000);
+		else
+			label.SetToFormat(B_TRANSLATE("Cutoff %g Hz"), kCutoffSteps[i]);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(kCutoffSteps[i] - fCutoff) < 0.5f);
+		item->SetEnabled(fFilterType != kFilterOff);
+		filterMenu->AddItem(item);
+	}
+	filterMenu->AddSeparatorItem();
+	for (size_t i = 0; i < sizeof(kResonanceSteps) / sizeof(kResonanceSteps[0]); i++) {
+		BMessage* msg = new BMessage(SET_FILTER);
+		msg->AddFloat("resonance", kResonanceSteps[i]);
+		BString label;
+		label.SetToFormat(B_TRANSLATE("Resonance %.1f"), kResonanceSteps[i]);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(kResonanceSteps[i] - fResonance) < 0.01f);
+		item->SetEnabled(fFilterType != kFilterOff);
+		filterMenu->AddItem(item);
+	}
+
+	for (size_t i = 0; i < sizeof(kAttackSteps) / sizeof(kAttackSteps[0]); i++) {
+		BMessage* msg = new BMessage(SET_ENVELOPE);
+		msg->AddFloat("attack", kAttackSteps[i]);
+		BString label;
+		if (kAttackSteps[i] == 0)
+			label = B_TRANSLATE("No attack");
+		else
+			label.SetToFormat(B_TRANSLATE("Attack %g ms"), kAttackSteps[i] * 1000);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(kAttackSteps[i] - fAttack) < 0.0005f);
+		envelopeMenu->AddItem(item);
+	}
+	envelopeMenu->AddSeparatorItem();
+	for (size_t i = 0; i < sizeof(kFadeSteps) / sizeof(kFadeSteps[0]); i++) {
+		BMessage* msg = new BMessage(SET_ENVELOPE);
+		msg->AddFloat("decay", kFadeSteps[i]);
+		BString label;
+		if (kFadeSteps[i] == 0)
+			label = B_TRANSLATE("No decay");
+		else
+			label.SetToFormat(B_TRANSLATE("Decay %g ms"), kFadeSteps[i] * 1000);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(kFadeSteps[i] - fDecay) < 0.0005f);
+		envelopeMenu->AddItem(item);
+	}
+	envelopeMenu->AddSeparatorItem();
+	for (size_t i = 0; i < sizeof(kFadeSteps) / sizeof(kFadeSteps[0]); i++) {
+		BMessage* msg = new BMessage(SET_ENVELOPE);
+		msg->AddFloat("release", kFadeSteps[i]);
+		BString label;
+		if (kFadeSteps[i] == 0)
+			label = B_TRANSLATE("No release");
+		else
+			label.SetToFormat(B_TRANSLATE("Release %g ms"), kFadeSteps[i] * 1000);
+		BMenuItem* item = new BMenuItem(label, msg);
+		item->SetMarked(fabsf(kFadeSteps[i] - fRelease) < 0.0005f);
+		envelopeMenu->AddItem(item);
+	}
+
+	gainMenu->SetTargetForItems(this);
+	chokeMenu->SetTargetForItems(this);
+	playbackMenu->SetTargetForItems(this);
+	controllerMenu->SetTargetForItems(this);
+	busMenu->SetTargetForItems(this);
+	filterMenu->SetTargetForItems(this);
+	envelopeMenu->SetTargetForItems(this);
+	menu->AddItem(gainMenu);
+	menu->AddItem(chokeMenu);
+	menu->AddItem(playbackMenu);
+	menu->AddItem(controllerMenu);
+	menu->AddItem(busMenu);
+	menu->AddItem(filterMenu);
+	menu->AddItem(envelopeMenu);
+	menu->AddSeparatorItem();
+
+	BMenuItem* trimItem = new BMenuItem(B_TRANSLATE("Trim silence"),
+		new BMessage(TRIM_SILENCE));
+	trimItem->SetMarked(fTrimmed);
+	trimItem->SetTarget(this);
+	menu->AddItem(trimItem);
+	if (fTrimmed && fTrimEnd > 0 && fSample.Get() != NULL) {
+		BString label(B_TRANSLATE("Skips %start% ms before, %end% ms after"));
+		BString number;
+		number.SetToFormat("%.0f", fTrimStart * 1000 / kEngineFrameRate);
+		label.ReplaceFirst("%start%", number);
+		number.SetToFormat("%.0f",
+			(fSample->FrameCount() - fTrimEnd) * 1000 / kEngineFrameRate);
+		label.ReplaceFirst("%end%", number);
+		BMenuItem* item = new BMenuItem(label, NULL);
+		item->SetEnabled(false);
+		menu->AddItem(item);
+	}
+
+	BMenuItem* normalizeItem = new BMenuItem(B_TRANSLATE("Normalize loudness"),
+		new BMessage(NORMALIZE_LOUDNESS));
+	normalizeItem->SetMarked(fNormalized);
+	normalizeItem->SetTarget(this);
+	menu->AddItem(normalizeItem);
+	if (fSample.Get() != NULL && fSample->HasLoudness()) {
+		BString label(B_TRANSLATE("%loudness% LUFS, peak %peak% dB"));
+		BString number;
+		number.SetToFormat("%.1f", fSample->Loudness());
+		label.ReplaceFirst("%loudness%", number);
+		number.SetToFormat("%.1f", fSample->Peak() > 0.0f
+			? 20.0f * log10f(fSample->Peak()) : -INFINITY);
+		label.ReplaceFirst("%peak%", number);
+		if (fNormalized) {
+			label << B_TRANSLATE(", %gain% dB added");
+			number.SetToFormat("%+.1f", 20.0f * log10f(
+				normalization_gain(fSample->Peak(), fSample->Loudness())));
+			label.ReplaceFirst("%gain%", number);
+		}
+		BMenuItem* item = new BMenuItem(label, NULL);
+		item->SetEnabled(false);
+		menu->AddItem(item);
+	}
+	menu->AddSeparatorItem();
+
+	BMessage* msg = new BMessage(FIND_SAMPLE);
+	msg->AddInt32("pad", fPadNumber);
+	BMenuItem* item = new BMenuItem(B_TRANSLATE("Find in sample library" B_UTF8_ELLIPSIS),
+		msg);
+	item->SetTarget(Window());
+	menu->AddItem(item);
+
+	msg = new BMessage(ASSIGN_KEY);
+	msg->AddInt32("pad", fPadNumber);
+	item = new BMenuItem(B_TRANSLATE("Assign key" B_UTF8_ELLIPSIS), msg);
+	item->SetTarget(Window());
+	menu->AddItem(item);
+
+	msg = new BMessage(CLEAR_KEYS);
+	msg->AddInt32("pad", fPadNumber);
+	item = new BMenuItem(B_TRANSLATE("Clear keys"), msg);
+	item->SetTarget(Window());
+	menu->AddItem(item);
+
+	menu->SetAsyncAutoDestruct(true);
+	menu->Go(where, true, false, true);
+}
+
+
+/*static*/ status_t
+Pad::MeasureDrawing(int32 count, PadDrawCost& _pads, PadDrawCost& _controls)
+{
+	// with an engine of their own that doesn't play, the first pad is laid
+	// out to place the controls
+	AudioEngine engine((BMessenger()));
+	Pad* layoutPad = new Pad(0, kDefaultNote, &engine);
+	BSize size = layoutPad->PreferredSize();
+	float width = ceilf(size.width);
+	float height = ceilf(size.height);
+
+	BRect bounds(0, 0, width - 1, (2 * count + 1) * height - 1);
+	BBitmap* bitmap = new(std::nothrow) BBitmap(bounds, B_BITMAP_ACCEPTS_VIEWS,
+		B_RGB32);
+	status_t status = bitmap != NULL ? bitmap->InitCheck() : B_NO_MEMORY;
+	if (status != B_OK) {
+		delete bitmap;
+		delete layoutPad;
+		return status;
+	}
+
+	BView* container = new BView(bounds, "rows", B_FOLLOW_NONE, B_WILL_DRAW);
+	bitmap->AddChild(container);
+	bitmap->Lock();
+	layoutPad->ResizeTo(width - 1, height - 1);
+	container->AddChild(layoutPad);
+
+	// both kinds are built before either is measured, so neither gets the
+	// memory the other one freed
+	PadDrawCost* costs[2] = { &_pads, &_controls };
+	std::vector<BView*> rows[2];
+	for (int32 kind = 0; kind < 2; kind++) {
+		size_t memory = team_memory();
+		for (int32 i = 0; i < count; i++) {
+			BRect frame(bounds.left, (1 + kind * count + i) * height, bounds.right,
+				(2 + kind * count + i) * height - 1);
+			BView* row;
+			if (kind == 0) {
+				row = new Pad(i, kDefaultNote + i % 128, &engine);
+				row->MoveTo(frame.LeftTop());
+				row->ResizeTo(frame.Width(), frame.Height());
+			} else
+				row = layoutPad->_MakeControlRow(i, frame);
+			container->AddChild(row);
+			rows[kind].push_back(row);
+		}
+		container->Sync();
+		size_t used = team_memory();
+		costs[kind]->memory = used > memory ? (used - memory) / count : 0;
+		costs[kind]->views = count_views(rows[kind][0]);
+	}
+
+	// the app_server's part is in it, too; the fastest pass counts
+	for (int32 kind = 0; kind < 2; kind++) {
+		bigtime_t fastest = B_INFINITE_TIMEOUT;
+		for (int32 pass = 0; pass < kDrawPasses; pass++) {
+			bigtime_t start = system_time();
+			for (int32 i = 0; i < count; i++)
+				draw_views(rows[kind][i]);
+			container->Sync();
+			fastest = std::min(fastest, system_time() - start);
+		}
+		costs[kind]->drawTime = fastest;
+	}
+
+	bitmap->Unlock();
+	delete bitmap;
+	return B_OK;
 }
 
 
@@ -271,6 +1076,7 @@ void
 Pad::SetNote(int32 note)
 {
 	fNote = note;
+	fEngine->SetNote(fPadNumber, note);
 	_SetDetectMode(false);
 }
 
@@ -283,52 +1089,471 @@ Pad::SetSample(BPath sample)
 		return;
 	}
 
-	fSamplePath = sample;
-	if (fPlayer != NULL) {
-		fPlayer->StopPlaying();
-		fPlayer = NULL;
-		delete fPlayer;
+	BReference<Sample> decoded(new Sample(sample.Path()), true);
+	SetDecodedSample(sample, decoded.Get());
+}
+
+
+void
+Pad::SetDecodedSample(BPath sample, Sample* decoded)
+{
+	_ShowSample(sample, decoded);
+	if (fSample.Get() != NULL && !fSample->HasLoudness())
+		fSample->MeasureLoudness();
+	fEngine->SetSample(fPadNumber, fSample.Get());
+	fEngine->SetGain(fPadNumber, GetOutputGain());
+	_UpdateTrim();
+}
+
+
+void
+Pad::ReloadSample(Sample* decoded)
+{
+	_ShowSample(fSamplePath, decoded);
+	if (fSample.Get() != NULL && !fSample->HasLoudness())
+		fSample->MeasureLoudness();
+	fEngine->ReplaceSample(fPadNumber, fSample.Get());
+	fEngine->SetGain(fPadNumber, GetOutputGain());
+	_UpdateTrim();
+}
+
+
+void
+Pad::ShowState(const PadState& state)
+{
+	// only the view, the engine already plays this state, e.g. after a kit
+	// switch
+	fNote = state.note;
+	_SetDetectMode(false);
+	fGain = state.gain;
+	fGainController = state.gainController;
+	fChokeGroup = state.chokeGroup;
+	fBus = state.bus;
+	fFilterType = state.filterType;
+	fCutoff = state.cutoff;
+	fResonance = state.resonance;
+	fAttack = state.attack;
+	fDecay = state.decay;
+	fRelease = state.release;
+	fTrimmed = state.trimmed;
+	fNormalized = state.normalized;
+	fTrimStart = state.trimStart;
+	fTrimEnd = state.trimEnd;
+	fGate = state.gate;
+	fMuted = state.muted;
+	fSolo = state.solo;
+	fLooping = state.looping;
+	_ShowSample(state.samplePath, state.sample);
+	Invalidate();
+}
+
+
+void
+Pad::ShowLoading(const char* sample, bool ready, bool found)
+{
+	BPath path;
+	if (sample == NULL || path.SetTo(sample) != B_OK) {
+		_SetSampleLabel(B_TRANSLATE_NOCOLLECT(kNoSample));
+		return;
 	}
 
-	fPlayer = new BFileGameSound(fSamplePath.Path(), fLoopButton->Value() == B_CONTROL_ON);
-	if (fPlayer->InitCheck() == B_OK) {
-		fPlayer->Preload();
-		fSampleButton->SetLabel(fSamplePath.Leaf());
-	} else {
-		BString label(B_TRANSLATE_NOCOLLECT(kSampleNotFound));
-		label.ReplaceFirst("%samplefile%", fSamplePath.Leaf());
-		fSampleButton->SetLabel(label);
+	BString label(B_TRANSLATE_NOCOLLECT(kSampleLoading));
+	if (ready)
+		label = found ? "%samplefile%" : B_TRANSLATE_NOCOLLECT(kSampleNotFound);
+	label.ReplaceFirst("%samplefile%", path.Leaf());
+	_SetSampleLabel(label);
+}
+
+
+void
+Pad::EndLoading()
+{
+	_ShowSample(fSamplePath, fSample.Get());
+}
+
+
+void
+Pad::_LayoutCells()
+{
+	BRect bounds(Bounds());
+	float top = floorf(bounds.top + (bounds.Height() + 1 - fCellHeight) / 2);
+	float inset = BControlLook::ComposeSpacing(B_USE_WINDOW_SPACING);
+	float smallSpacing = BControlLook::ComposeSpacing(B_USE_SMALL_SPACING);
+	float buttonWidth = fCellHeight + 2;
+	float sampleWidth = fmaxf(0, bounds.Width() + 1 - _RowWidth(0));
+
+	const float kWidths[] = { fNoteWidth, ceilf(fCellHeight * 0.7f), buttonWidth,
+		buttonWidth, buttonWidth, sampleWidth, buttonWidth, buttonWidth, buttonWidth };
+
+	float x = bounds.left + inset;
+	for (int32 cell = 0; cell < kCellCount; cell++) {
+		fCells[cell].Set(x, top, x + kWidths[cell] - 1, top + fCellHeight - 1);
+		x += kWidths[cell];
+
+		if (cell == kDetectCell || cell == kLoopCell)
+			x += smallSpacing;
+		else if (cell == kSampleCell) {
+			// the waveform goes right after the sample, the meter before
+			// the playback buttons
+			if (!fWaveform->IsHidden(this)) {
+				float width = fWaveform->MinSize().width;
+				fWaveform->MoveTo(x, top);
+				fWaveform->ResizeTo(width - 1, fCellHeight - 1);
+				x += width;
+			}
+			x += smallSpacing;
+			if (!fMeter->IsHidden(this)) {
+				BSize size = fMeter->MinSize();
+				fMeter->MoveTo(x, floorf(top + (fCellHeight - size.height) / 2));
+				fMeter->ResizeTo(size.width - 1, size.height - 1);
+				x += size.width;
+			}
+			x += smallSpacing;
+		}
+	}
+
+	if (fNoteEditor != NULL) {
+		BRect frame(_NoteFieldFrame());
+		fNoteEditor->MoveTo(frame.left + 2, frame.top + 2);
+	}
+}
+
+
+float
+Pad::_RowWidth(float sampleWidth)
+{
+	float width = 2 * BControlLook::ComposeSpacing(B_USE_WINDOW_SPACING)
+		+ 4 * BControlLook::ComposeSpacing(B_USE_SMALL_SPACING)
+		+ fNoteWidth + ceilf(fCellHeight * 0.7f) + 6 * (fCellHeight + 2) + sampleWidth;
+	if (!fWaveform->IsHidden(this))
+		width += fWaveform->MinSize().width;
+	if (!fMeter->IsHidden(this))
+		width += fMeter->MinSize().width;
+	return width;
+}
+
+
+int32
+Pad::_CellAt(BPoint where)
+{
+	for (int32 cell = 0; cell < kCellCount; cell++) {
+		if (fCells[cell].IsValid() && fCells[cell].Contains(where))
+			return cell;
+	}
+	return -1;
+}
+
+
+BRect
+Pad::_NoteFieldFrame()
+{
+	// after the pad's number, the same for all pads
+	BRect frame(fCells[kNoteCell]);
+	frame.left += ceilf(be_plain_font->StringWidth("8")
+		+ be_control_look->DefaultLabelSpacing());
+	return frame;
+}
+
+
+void
+Pad::_DrawNote(BRect updateRect)
+{
+	BRect frame(_NoteFieldFrame());
+	font_height fontHeight;
+	GetFontHeight(&fontHeight);
+	float baseline = floorf(frame.top + (frame.Height() + 1 + fontHeight.ascent
+		- fontHeight.descent) / 2);
+
+	BString text;
+	text << fPadNumber + 1;
+	SetHighUIColor(B_PANEL_TEXT_COLOR);
+	SetLowColor(ViewColor());
+	DrawString(text, BPoint(fCells[kNoteCell].left, baseline));
+
+	uint32 flags = 0;
+	if (fDetecting)
+		flags |= BControlLook::B_INVALID;
+	if (fNoteEditor != NULL || (fFocusedCell == kNoteCell && IsFocus()
+			&& Window()->IsActive()))
+		flags |= BControlLook::B_FOCUSED;
+	be_control_look->DrawTextControlBorder(this, frame, updateRect, ViewColor(), flags);
+
+	// the border leaves the field inside
+	SetHighUIColor(B_DOCUMENT_BACKGROUND_COLOR);
+	FillRect(frame);
+	if (fNoteEditor != NULL)
+		return;
+
+	text = "?";
+	if (!fDetecting) {
+		text = "";
+		text << fNote;
+	}
+	SetHighUIColor(B_DOCUMENT_TEXT_COLOR);
+	SetLowUIColor(B_DOCUMENT_BACKGROUND_COLOR);
+	DrawString(text, BPoint(frame.left + 2, baseline));
+}
+
+
+void
+Pad::_DrawButton(int32 cell, BRect updateRect)
+{
+	bool on = (cell == kDetectCell && fDetecting) || (cell == kMuteCell && fMuted)
+		|| (cell == kSoloCell && fSolo) || (cell == kLoopCell && fLooping);
+
+	uint32 flags = 0;
+	if (on || (cell == fPressedCell && fPressedInside))
+		flags |= BControlLook::B_ACTIVATED;
+	if (cell == fHoverCell)
+		flags |= BControlLook::B_HOVER;
+
+	if (cell == fFocusedCell && IsFocus() && Window()->IsActive())
+		flags |= BControlLook::B_FOCUSED;
+
+	// the sample's button is flat, until the mouse or the focus is on it
+	rgb_color base = ui_color(B_CONTROL_BACKGROUND_COLOR);
+	if (cell == kSampleCell && flags == 0) {
+		flags |= BControlLook::B_FLAT;
+		base = ViewColor();
+	}
+
+	BRect frame(fCells[cell]);
+	be_control_look->DrawButtonFrame(this, frame, updateRect, base, ViewColor(), flags);
+	be_control_look->DrawButtonBackground(this, frame, updateRect, base, flags);
+
+	BString label(kCellLabels[cell]);
+	if (cell == kSampleCell) {
+		label = fSampleLabel;
+		TruncateString(&label, B_TRUNCATE_END,
+			frame.Width() - 2 * be_control_look->DefaultLabelSpacing());
+	}
+	be_control_look->DrawLabel(this, label, frame, updateRect, base, flags,
+		BAlignment(B_ALIGN_CENTER, B_ALIGN_MIDDLE));
+}
+
+
+void
+Pad::_InvalidateCell(int32 cell)
+{
+	if (cell >= 0 && cell < kCellCount && fCells[cell].IsValid())
+		Invalidate(fCells[cell]);
+}
+
+
+void
+Pad::_FocusCell(int32 cell)
+{
+	if (cell == fFocusedCell)
+		return;
+
+	_InvalidateCell(fFocusedCell);
+	fFocusedCell = cell;
+	_InvalidateCell(fFocusedCell);
+}
+
+
+void
+Pad::_FocusNeighbour(bool below)
+{
+	// the pads are siblings, with separators between them
+	BView* view = below ? NextSibling() : PreviousSibling();
+	while (view != NULL) {
+		Pad* pad = dynamic_cast<Pad*>(view);
+		if (pad != NULL) {
+			pad->_FocusCell(fFocusedCell);
+			pad->MakeFocus(true);
+			return;
+		}
+		view = below ? view->NextSibling() : view->PreviousSibling();
 	}
 }
 
 
+void
+Pad::_Invoke(int32 cell)
+{
+	// toggles switch first, as a button's value does
+	uint32 what;
+	switch (cell) {
+		case kDetectCell:
+			fDetecting = !fDetecting;
+			what = DETECT_NOTE;
+			break;
+		case kMuteCell:
+			fMuted = !fMuted;
+			what = MUTE;
+			break;
+		case kSoloCell:
+			fSolo = !fSolo;
+			what = SOLO;
+			break;
+		case kLoopCell:
+			fLooping = !fLooping;
+			what = LOOP;
+			break;
+		case kSampleCell:
+			what = OPEN_SAMPLE;
+			break;
+		case kPlayCell:
+			what = PLAY;
+			break;
+		case kStopCell:
+			what = STOP;
+			break;
+		case kEjectCell:
+			what = EJECT;
+			break;
+		default:
+			return;
+	}
+	_InvalidateCell(cell);
+	Window()->PostMessage(what, this);
+}
+
+
+void
+Pad::_StartNoteEdit()
+{
+	if (fNoteEditor != NULL)
+		return;
+	if (fDetecting)
+		_SetDetectMode(false);
+
+	// inside the drawn border
+	BRect frame(_NoteFieldFrame());
+	frame.InsetBy(2, 2);
+	fNoteEditor = new NoteEditor(frame, this);
+	AddChild(fNoteEditor);
+
+	BString text;
+	text << fNote;
+	fNoteEditor->SetText(text);
+	fNoteEditor->SelectAll();
+	fNoteEditor->MakeFocus(true);
+	_InvalidateCell(kNoteCell);
+}
+
+
+void
+Pad::_EndNoteEdit()
+{
+	if (fNoteEditor == NULL)
+		return;
+
+	// after Enter or Escape, the keyboard stays with the pad
+	BTextView* editor = fNoteEditor;
+	fNoteEditor = NULL;
+	if (editor->IsFocus())
+		MakeFocus(true);
+	editor->RemoveSelf();
+	delete editor;
+	_InvalidateCell(kNoteCell);
+}
+
+
+BView*
+Pad::_MakeControlRow(int32 number, BRect frame)
+{
+	BView* row = new BView(frame, "controls", B_FOLLOW_NONE, B_WILL_DRAW);
+	row->SetViewUIColor(B_PANEL_BACKGROUND_COLOR);
+
+	for (int32 cell = 0; cell < kCellCount; cell++) {
+		if (cell == kNoteCell) {
+			BString padNumber;
+			padNumber << number + 1;
+			BString note;
+			note << kDefaultNote + number % 128;
+			row->AddChild(new BTextControl(fCells[cell], "notecontrol", padNumber,
+				note, NULL));
+			continue;
+		}
+
+		BButton* button = new BButton(fCells[cell], "button", cell == kSampleCell
+			? B_TRANSLATE_NOCOLLECT(kNoSample) : kCellLabels[cell], NULL);
+		if (cell == kSampleCell)
+			button->SetFlat(true);
+		row->AddChild(button);
+	}
+
+	// hidden, as on a pad
+	LevelMeter* meter = new LevelMeter("meter");
+	meter->Hide();
+	row->AddChild(meter);
+	WaveformView* waveform = new WaveformView("waveform");
+	waveform->Hide();
+	row->AddChild(waveform);
+	return row;
+}
+
+
+void
+Pad::_SetSampleLabel(const char* label)
+{
+	fSampleLabel = label;
+	_InvalidateCell(kSampleCell);
+}
+
+
 void
 Pad::_Eject()
 {
-	fSampleButton->SetLabel(B_TRANSLATE_NOCOLLECT(kNoSample));
-	fSamplePath = BPath("");
-	if (fPlayer != NULL) {
-		fPlayer->StopPlaying();
-		fPlayer = NULL;
-		delete fPlayer;
+	_ShowSample(BPath(""), NULL);
+	fEngine->SetSample(fPadNumber, NULL);
+	_UpdateTrim();
+}
+
+
+void
+Pad::_ShowSample(BPath sample, Sample* decoded)
+{
+	if (sample.InitCheck() != B_OK) {
+		_SetSampleLabel(B_TRANSLATE_NOCOLLECT(kNoSample));
+		fSamplePath = BPath("");
+		fSample.Unset();
+		fWaveform->SetSample(NULL);
+		return;
 	}
+
+	fSamplePath = sample;
+
+	if (decoded != NULL && decoded->InitCheck() == B_OK) {
+		fSample.SetTo(decoded);
+		_SetSampleLabel(fSamplePath.Leaf());
+	} else {
+		fSample.Unset();
+		BString label(B_TRANSLATE_NOCOLLECT(kSampleNotFound));
+		label.ReplaceFirst("%samplefile%", fSamplePath.Leaf());
+		_SetSampleLabel(label);
+	}
+	fWaveform->SetSample(fSample.Get());
+	fWaveform->SetTrim(fTrimStart, fTrimEnd);
 }
 
 
 void
 Pad::_SetDetectMode(bool state)
 {
-	if (state == true) {
-		fDetectButton->SetValue(B_CONTROL_ON);
-		fNoteControl->SetToolTip(B_TRANSLATE("Press key"));
-		fNoteControl->MarkAsInvalid(true);
-	} else {
-		fDetectButton->SetValue(B_CONTROL_OFF);
-		BString text;
-		text << fNote;
-		fNoteControl->SetText(text);
-		fNoteControl->SetToolTip("");
-		fNoteControl->MakeFocus(false);
-		fNoteControl->MarkAsInvalid(false);
+	// the field shows a "?" while waiting for a key
+	if (state)
+		_EndNoteEdit();
+
+	fDetecting = state;
+	_InvalidateCell(kNoteCell);
+	_InvalidateCell(kDetectCell);
+}
+
+
+void
+Pad::_UpdateTrim()
+{
+	// from the sample as it is now, an ensemble may have kept other ones
+	Sample* sample = fSample.Get();
+	fTrimStart = 0;
+	fTrimEnd = 0;
+	if (fTrimmed && sample != NULL) {
+		fTrimStart = sample->Onset();
+		fTrimEnd = sample->DecayEnd();
 	}
+	fEngine->SetTrim(fPadNumber, fTrimStart, fTrimEnd);
+	fWaveform->SetTrim(fTrimStart, fTrimEnd);
 }
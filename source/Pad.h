@@ -10,52 +10,226 @@
 #define PAD_H
 
 
-#include <Button.h>
-#include <FileGameSound.h>
+#include "LevelMeter.h"
+#include "Sample.h"
+#include "WaveformView.h"
+
 #include <Path.h>
-#include <StringView.h>
+#include <String.h>
 #include <SupportDefs.h>
-#include <TextControl.h>
 #include <View.h>
 
+class AudioEngine;
+class BTextView;
+
+
+struct PadState {
+	BPath			samplePath;
+	Sample*			sample;
+	int32			note;
+	float			gain;
+	int32			gainController;
+	int32			chokeGroup;
+	int32			bus;
+	int32			filterType;
+	float			cutoff;
+	float			resonance;
+	float			attack;
+	float			decay;
+	float			release;
+	bool			trimmed;
+	bool			normalized;
+	int64			trimStart;
+	int64			trimEnd;
+	bool			muted;
+	bool			solo;
+	bool			looping;
+	bool			gate;
+};
+
+
+// what drawing a row of the pad list costs, for "--pad-drawing"
+struct PadDrawCost {
+	int32			views;		// per row, with the hidden meter and waveform
+	size_t			memory;		// per row, of the team's memory
+	bigtime_t		drawTime;	// to draw all rows once
+};
+
+
+// One row of the pad list. The buttons and the note field are only drawn,
+// not views of their own, so many pads stay cheap to lay out and redraw.
+// The note is edited in a text view that exists only while editing.
+// With the keyboard, the arrow keys go from cell to cell and from pad to
+// pad, space or Enter invokes the focused cell.
 
 class Pad : public BView {
 public:
-					Pad(int32 number, int32 note);
+					Pad(int32 number, int32 note, AudioEngine* engine);
 	virtual			~Pad();
 
 	virtual	void	AttachedToWindow();
-	virtual void	KeyDown(const char* bytes, int32 numBytes);
 	virtual void	MessageReceived(BMessage* msg);
+	virtual void	Draw(BRect updateRect);
+	virtual void	FrameResized(float width, float height);
+	virtual void	KeyDown(const char* bytes, int32 numBytes);
+	virtual void	MakeFocus(bool focus = true);
+	virtual void	WindowActivated(bool active);
+	virtual void	MouseDown(BPoint where);
+	virtual void	MouseMoved(BPoint where, uint32 transit,
+						const BMessage* dragMessage);
+	virtual void	MouseUp(BPoint where);
+	virtual bool	GetToolTipAt(BPoint point, BToolTip** _tip);
+
+	virtual BSize	MinSize();
+	virtual BSize	MaxSize();
+	virtual BSize	PreferredSize();
 
-	void			Play(int32 note);
+	// for the header above the pads
+	float			CellHeight() { return fCellHeight; };
+	float			NoteWidth() { return fNoteWidth; };
+	float			SampleWidth() { return fSampleWidth; };
+
+	void			DetectNote(int32 note);
+	void			CancelDetect();
 	void			Mute(int32 state);
+	bool			IsMuted() { return fMuted; };
+	void			SetSolo(int32 state);
+	bool			IsSolo() { return fSolo; };
+	void			SetLooping(bool looping);
+	bool			IsLooping() { return fLooping; };
+
+	void			SetGain(float gain);
+	float			GetGain() { return fGain; };
+	// the gain times what brings the sample to the loudness of the others
+	void			SetNormalized(bool normalized);
+	bool			IsNormalized() { return fNormalized; };
+	float			GetOutputGain();
+	void			SetChokeGroup(int32 group);
+	int32			GetChokeGroup() { return fChokeGroup; };
+	void			SetGate(bool gate);
+	bool			IsGate() { return fGate; };
+	void			SetGainController(int32 controller);
+	int32			GetGainController() { return fGainController; };
+	void			SetBus(int32 bus);
+	int32			GetBus() { return fBus; };
+	void			SetFilter(int32 type, float cutoff, float resonance);
+	int32			GetFilterType() { return fFilterType; };
+	float			GetCutoff() { return fCutoff; };
+	float			GetResonance() { return fResonance; };
+	void			SetEnvelope(float attack, float decay, float release);
+	float			GetAttack() { return fAttack; };
+	float			GetDecay() { return fDecay; };
+	float			GetRelease() { return fRelease; };
+	// to the sound of the sample, without the silence around it
+	void			SetTrimmed(bool trimmed);
+	bool			IsTrimmed() { return fTrimmed; };
+	int64			GetTrimStart() { return fTrimStart; };
+	int64			GetTrimEnd() { return fTrimEnd; };
 
 	void			SetNote(int32 note);
 	int32			GetNote() { return fNote; };
 
 	void			SetSample(BPath sample);
+	void			SetDecodedSample(BPath sample, Sample* decoded);
+	// a new version of the sample's file, playing voices finish the old one
+	void			ReloadSample(Sample* decoded);
 	BString			GetSamplePath() { return fSamplePath.Path(); };
+	Sample*			GetSample() { return fSample.Get(); };
+
+	void			ShowState(const PadState& state);
+	// only the label, the pad plays its sample until the ensemble that is
+	// loading is shown
+	void			ShowLoading(const char* sample, bool ready, bool found);
+	void			EndLoading();
+
+	void			ShowMeter(bool show);
+	void			UpdateMeter();
+	void			ShowWaveform(bool show);
+	void			UpdatePlayhead();
+
+	void			ShowContextMenu(BPoint where);
+
+	// draws count pads into a bitmap, and as many rows of the text control
+	// and buttons a pad was made of before
+	static status_t	MeasureDrawing(int32 count, PadDrawCost& _pads,
+						PadDrawCost& _controls);
 
 private:
+	enum {
+		kNoteCell = 0,
+		kDetectCell,
+		kMuteCell,
+		kSoloCell,
+		kLoopCell,
+		kSampleCell,
+		kPlayCell,
+		kStopCell,
+		kEjectCell,
+		kCellCount
+	};
+
+	void			_LayoutCells();
+	float			_RowWidth(float sampleWidth);
+	int32			_CellAt(BPoint where);
+	BRect			_NoteFieldFrame();
+	void			_DrawNote(BRect updateRect);
+	void			_DrawButton(int32 cell, BRect updateRect);
+	void			_InvalidateCell(int32 cell);
+	void			_FocusCell(int32 cell);
+	void			_FocusNeighbour(bool below);
+	void			_Invoke(int32 cell);
+	void			_StartNoteEdit();
+	void			_EndNoteEdit();
+	void			_SetSampleLabel(const char* label);
+	// a text control and buttons in this pad's cells, as a pad was before
+	BView*			_MakeControlRow(int32 number, BRect frame);
+
 	void			_Eject();
+	void			_ShowSample(BPath sample, Sample* decoded);
 	void			_SetDetectMode(bool state);
+	void			_UpdateTrim();
 
 	int32			fPadNumber;
 	int32			fNote;
 	BPath			fSamplePath;
+	BReference<Sample>	fSample;
+	float			fGain;
+	int32			fChokeGroup;
+	bool			fGate;
+	int32			fGainController;
+	int32			fBus;
+	int32			fFilterType;
+	float			fCutoff;
+	float			fResonance;
+	float			fAttack;
+	float			fDecay;
+	float			fRelease;
+	bool			fTrimmed;
+	bool			fNormalized;
+	int64			fTrimStart;
+	int64			fTrimEnd;
+
+	bool			fMuted;
+	bool			fSolo;
+	bool			fLooping;
+	bool			fDetecting;
+	BString			fSampleLabel;
+
+	BRect			fCells[kCellCount];
+	float			fCellHeight;
+	float			fNoteWidth;
+	float			fSampleWidth;
+	int32			fPressedCell;
+	bool			fPressedInside;
+	int32			fHoverCell;
+	int32			fFocusedCell;
+
+	LevelMeter*		fMeter;
+	WaveformView*	fWaveform;
+	// only while the note is edited
+	BTextView*		fNoteEditor;
 
-	BButton*		fDetectButton;
-	BButton*		fMuteButton;
-	BButton*		fSoloButton;
-	BButton*		fLoopButton;
-	BButton*		fSampleButton;
-	BButton*		fPlayButton;
-	BButton*		fStopButton;
-	BButton*		fEjectButton;
-
-	BTextControl*	fNoteControl;
-	BFileGameSound*	fPlayer;
+	AudioEngine*	fEngine;
 };
 
 
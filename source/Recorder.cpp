@@ -0,0 +1,262 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "Recorder.h"
+
+#include <string.h>
+
+
+static const size_t kJournalQueueSize = 8192;
+static const int32 kChunkSize = 1024;
+static const bigtime_t kFlushInterval = 50000;
+
+// 120 BPM, so a quarter note is half a second
+static const uint16 kTicksPerQuarter = 480;
+static const uint32 kMicrosecondsPerQuarter = 500000;
+
+
+static inline void
+put16(uint8* p, uint16 value)
+{
+	p[0] = value >> 8;
+	p[1] = value;
+}
+
+
+static inline void
+put32(uint8* p, uint32 value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+
+static inline size_t
+put_variable_length(uint8* p, uint32 value)
+{
+	// seven bits per byte, most significant first, all but the last one
+	// with the high bit set
+	uint8 bytes[5];
+	size_t count = 0;
+	do {
+		bytes[count++] = value & 0x7f;
+		value >>= 7;
+	} while (value > 0);
+
+	for (size_t i = 0; i < count; i++)
+		p[i] = bytes[count - 1 - i] | (i < count - 1 ? 0x80 : 0);
+	return count;
+}
+
+
+Recorder::Recorder()
+	:
+	fJournal(kJournalQueueSize),
+	fChunk(new Event[kChunkSize]),
+	fChunkCount(0),
+	fJournalFile(NULL),
+	fStartTime(0),
+	fEventCount(0),
+	fFailed(false),
+	fFlushThread(-1),
+	fRecording(false),
+	fQuitting(false),
+	fDropped(0)
+{
+}
+
+
+Recorder::~Recorder()
+{
+	Stop();
+	if (fJournalPath != "")
+		remove(fJournalPath.String());
+	delete[] fChunk;
+}
+
+
+status_t
+Recorder::Start(const char* journalPath)
+{
+	if (IsRecording())
+		return B_OK;
+	if (!fJournal.IsValid())
+		return B_NO_MEMORY;
+
+	fJournalFile = fopen(journalPath, "wb");
+	if (fJournalFile == NULL)
+		return B_ERROR;
+
+	// whatever was left from a recording that ended while it was played
+	Event event;
+	while (fJournal.Pop(event))
+		;
+
+	fJournalPath = journalPath;
+	fChunkCount = 0;
+	fEventCount = 0;
+	fFailed = false;
+	fDropped = 0;
+	fQuitting = false;
+
+	fFlushThread = spawn_thread(_FlushThread, "samedi recorder", B_LOW_PRIORITY, this);
+	if (fFlushThread < 0) {
+		fclose(fJournalFile);
+		fJournalFile = NULL;
+		return fFlushThread;
+	}
+	resume_thread(fFlushThread);
+
+	fStartTime = system_time();
+	fRecording = true;
+	return B_OK;
+}
+
+
+void
+Recorder::Stop()
+{
+	if (fFlushThread < 0)
+		return;
+
+	fRecording = false;
+	fQuitting = true;
+	status_t result;
+	wait_for_thread(fFlushThread, &result);
+	fFlushThread = -1;
+
+	if (fclose(fJournalFile) != 0)
+		fFailed = true;
+	fJournalFile = NULL;
+}
+
+
+status_t
+Recorder::Export(const char* path)
+{
+	if (IsRecording() || fJournalPath == "")
+		return B_NOT_ALLOWED;
+	if (fFailed)
+		return B_IO_ERROR;
+
+	FILE* journal = fopen(fJournalPath.String(), "rb");
+	if (journal == NULL)
+		return B_ERROR;
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		fclose(journal);
+		return B_ERROR;
+	}
+
+	// a format 0 file, its single track with the tempo first; the track
+	// length is patched in at the end
+	uint8 header[] = {
+		'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 0,
+		'M', 'T', 'r', 'k', 0, 0, 0, 0,
+		0, 0xff, 0x51, 3, 0, 0, 0
+	};
+	put16(header + 12, kTicksPerQuarter);
+	header[26] = (kMicrosecondsPerQuarter >> 16) & 0xff;
+	header[27] = (kMicrosecondsPerQuarter >> 8) & 0xff;
+	header[28] = kMicrosecondsPerQuarter & 0xff;
+	bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	uint32 trackSize = 7;
+
+	// 5 bytes delta time and 3 of event at most
+	uint8 buffer[kChunkSize * 8];
+	uint64 lastTick = 0;
+	size_t count;
+	while (ok && (count = fread(fChunk, sizeof(Event), kChunkSize, journal)) > 0) {
+		size_t size = 0;
+		for (size_t i = 0; i < count; i++) {
+			const Event& event = fChunk[i];
+			bigtime_t time = event.time > fStartTime ? event.time - fStartTime : 0;
+			uint64 tick = (uint64)time * kTicksPerQuarter / kMicrosecondsPerQuarter;
+
+			// the sources are merged per buffer, a late event is moved up
+			uint64 delta = tick > lastTick ? tick - lastTick : 0;
+			if (delta > 0x0fffffff)
+				delta = 0x0fffffff;
+			lastTick += delta;
+
+			size += put_variable_length(buffer + size, delta);
+			buffer[size++] = event.status;
+			buffer[size++] = event.data1;
+			buffer[size++] = event.data2;
+		}
+		ok = fwrite(buffer, 1, size, file) == size;
+		trackSize += size;
+	}
+	ok = ok && !ferror(journal);
+
+	const uint8 endOfTrack[] = { 0, 0xff, 0x2f, 0 };
+	ok = ok && fwrite(endOfTrack, 1, sizeof(endOfTrack), file) == sizeof(endOfTrack);
+	trackSize += sizeof(endOfTrack);
+
+	uint8 size[4];
+	put32(size, trackSize);
+	ok = ok && fseek(file, 18, SEEK_SET) == 0 && fwrite(size, 1, 4, file) == 4;
+
+	fclose(journal);
+	ok = fclose(file) == 0 && ok;
+	return ok ? B_OK : B_IO_ERROR;
+}
+
+
+// #pragma mark -
+
+
+/*static*/ status_t
+Recorder::_FlushThread(void* data)
+{
+	Recorder* recorder = (Recorder*)data;
+	while (!recorder->fQuitting) {
+		recorder->_Flush();
+		snooze(kFlushInterval);
+	}
+
+	// what came in after the last round
+	recorder->_Flush();
+	return B_OK;
+}
+
+
+void
+Recorder::_Flush()
+{
+	Event event;
+	while (fJournal.Pop(event)) {
+		fChunk[fChunkCount++] = event;
+		if (fChunkCount == kChunkSize)
+			_WriteChunk();
+	}
+
+	// keep the journal on disk current, in case the session ends badly
+	_WriteChunk();
+	if (fflush(fJournalFile) != 0)
+		fFailed = true;
+}
+
+
+bool
+Recorder::_WriteChunk()
+{
+	if (fChunkCount == 0)
+		return true;
+
+	size_t written = fwrite(fChunk, sizeof(Event), fChunkCount, fJournalFile);
+	if (written != (size_t)fChunkCount)
+		fFailed = true;
+	fEventCount += written;
+	fChunkCount = 0;
+
+	return !fFailed;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "LockFreeQueue.h"
+
+#include <OS.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <stdio.h>
+
+
+// Records what's played on the pads, MIDI as well as keyboard hits, and
+// exports it as a Standard MIDI File.
+//
+// The audio thread only pushes each event into a preallocated queue. A
+// low-priority thread drains it in chunks into a journal file, so a long
+// session needs no more memory than a short one. When the queue is full,
+// events are dropped and counted instead of blocking the audio thread.
+
+class Recorder {
+public:
+					Recorder();
+					~Recorder();
+
+	status_t		Start(const char* journalPath);
+	void			Stop();
+	bool			IsRecording() const { return fRecording.load(std::memory_order_relaxed); };
+
+	// audio thread
+	void			Record(uint8 status, uint8 data1, uint8 data2, bigtime_t time)
+					{
+						if (!fRecording.load(std::memory_order_relaxed))
+							return;
+						Event event = { time, status, data1, data2 };
+						if (!fJournal.Push(event))
+							fDropped.fetch_add(1, std::memory_order_relaxed);
+					}
+
+	// after Stop()
+	status_t		Export(const char* path);
+	uint32			CountEvents() const { return fEventCount; };
+	uint32			CountDropped() const { return fDropped.load(std::memory_order_relaxed); };
+
+	// storage, so the engine can lock it into memory
+	void*			Buffer() const { return fJournal.Buffer(); };
+	size_t			BufferSize() const { return fJournal.BufferSize(); };
+
+private:
+	struct Event {
+		bigtime_t	time;
+		uint8		status;
+		uint8		data1;
+		uint8		data2;
+	};
+
+	static status_t	_FlushThread(void* data);
+	void			_Flush();
+	bool			_WriteChunk();
+
+	LockFreeQueue<Event>	fJournal;
+	Event*			fChunk;
+	int32			fChunkCount;
+
+	BString			fJournalPath;
+	FILE*			fJournalFile;
+	bigtime_t		fStartTime;
+	uint32			fEventCount;
+	bool			fFailed;
+
+	thread_id		fFlushThread;
+	std::atomic<bool>	fRecording;
+	std::atomic<bool>	fQuitting;
+	std::atomic<uint32>	fDropped;
+};
+
+
+#endif // RECORDER_H
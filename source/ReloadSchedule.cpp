@@ -0,0 +1,56 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "ReloadSchedule.h"
+
+#include <algorithm>
+
+
+ReloadSchedule::ReloadSchedule(bigtime_t settleTime)
+	:
+	fSettleTime(settleTime)
+{
+}
+
+
+bigtime_t
+ReloadSchedule::Changed(const std::string& path, bigtime_t now)
+{
+	bigtime_t settled = now + fSettleTime;
+	fPending[path] = settled;
+	return settled;
+}
+
+
+void
+ReloadSchedule::TakeSettled(bigtime_t now, std::vector<std::string>& _paths)
+{
+	_paths.clear();
+	std::map<std::string, bigtime_t>::iterator it = fPending.begin();
+	while (it != fPending.end()) {
+		if (it->second <= now) {
+			_paths.push_back(it->first);
+			fPending.erase(it++);
+		} else
+			it++;
+	}
+}
+
+
+void
+ReloadSchedule::KeepOnly(const std::vector<std::string>& paths)
+{
+	std::map<std::string, bigtime_t>::iterator it = fPending.begin();
+	while (it != fPending.end()) {
+		if (std::find(paths.begin(), paths.end(), it->first) == paths.end())
+			fPending.erase(it++);
+		else
+			it++;
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef RELOAD_SCHEDULE_H
+#define RELOAD_SCHEDULE_H
+
+#include <SupportDefs.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+// When the SampleWatcher decodes a changed file: once it has been left alone
+// for the settle time. Every change puts it off again, so a burst of saves,
+// or a file written in several goes, is decoded once, after the last one.
+// The watcher asks at the time a change returns; a check that comes too
+// early for a file changed since just finds nothing settled.
+//
+// No Haiku API, so it can be tested on other systems.
+
+class ReloadSchedule {
+public:
+					ReloadSchedule(bigtime_t settleTime);
+
+	// returns when to check for it
+	bigtime_t		Changed(const std::string& path, bigtime_t now);
+
+	// the files left alone long enough, taken off the schedule
+	void			TakeSettled(bigtime_t now, std::vector<std::string>& _paths);
+
+	// forgets the files not among these, e.g. no longer on a pad
+	void			KeepOnly(const std::vector<std::string>& paths);
+
+	int32			CountPending() const { return fPending.size(); }
+
+private:
+	bigtime_t		fSettleTime;
+	// when a changed file is decoded, if it isn't changed again till then
+	std::map<std::string, bigtime_t> fPending;
+};
+
+
+#endif // RELOAD_SCHEDULE_H
@@ -0,0 +1,488 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioDecoder.h"
+#include "Constants.h"
+#include "FrameCodec.h"
+#include "MemoryLocker.h"
+#include "Sample.h"
+#include "SampleAnalysis.h"
+
+#include <Entry.h>
+#include <MediaFile.h>
+#include <MediaTrack.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+
+static const size_t kDefaultReadBufferSize = 16384;
+
+// below the peak, in dB
+static const float kOnsetThreshold = -48.0f;
+static const float kDecayThreshold = -60.0f;
+// kept around the sound, in seconds
+static const float kOnsetLead = 0.001f;
+static const float kDecayTail = 0.01f;
+
+std::atomic<int32> Sample::sStorage(kSampleFloat);
+
+
+static inline float
+read_sample(const uint8* data, uint32 format)
+{
+	switch (format) {
+		case media_raw_audio_format::B_AUDIO_FLOAT:
+			return *(const float*)data;
+		case media_raw_audio_format::B_AUDIO_INT:
+			return *(const int32*)data / 2147483648.0f;
+		case media_raw_audio_format::B_AUDIO_SHORT:
+			return *(const int16*)data / 32768.0f;
+		case media_raw_audio_format::B_AUDIO_UCHAR:
+			return ((int32)*data - 128) / 128.0f;
+		case media_raw_audio_format::B_AUDIO_CHAR:
+			return *(const int8*)data / 128.0f;
+	}
+	return 0.0f;
+}
+
+
+Sample::Sample(const char* path)
+	:
+	fPath(path),
+	fFingerprint(0),
+	fData(NULL),
+	fFrameCount(0),
+	fSize(0),
+	fHeadFrames(0),
+	fStorage(kSampleFloat),
+	fBlockOffsets(NULL),
+	fPacked(NULL),
+	fOnset(0),
+	fDecayEnd(0),
+	fPeak(0.0f),
+	fLoudness(kSilentLoudness),
+	fHasLoudness(false),
+	fLocker(NULL)
+{
+	memset(&fIdentity, 0, sizeof(fIdentity));
+	fInitStatus = _Decode();
+	if (fInitStatus == B_OK) {
+		get_file_identity(path, fIdentity);
+		fSize = DecodedSize();
+		fHeadFrames = fFrameCount;
+		fPeaks.Build(fData, fFrameCount, kEngineChannels);
+		_Analyze();
+
+		int32 storage = sStorage.load(std::memory_order_relaxed);
+		if (storage != kSampleFloat)
+			_Pack(storage);
+		if (IsPacked())
+			fPeaks.DropFrames();
+	}
+}
+
+
+Sample::Sample(const char* path, MappedFile* file, const float* data,
+	int64 frameCount, const FileIdentity& identity)
+	:
+	fPath(path),
+	fIdentity(identity),
+	fFingerprint(0),
+	fData(data),
+	fFile(file),
+	fFrameCount(frameCount),
+	fSize(frameCount * kEngineChannels * sizeof(float)),
+	fHeadFrames(frameCount),
+	fStorage(kSampleFloat),
+	fBlockOffsets(NULL),
+	fPacked(NULL),
+	fOnset(0),
+	fDecayEnd(frameCount),
+	fPeak(0.0f),
+	fLoudness(kSilentLoudness),
+	fHasLoudness(false),
+	fInitStatus(data != NULL && frameCount > 0 ? B_OK : B_BAD_VALUE),
+	fLocker(NULL)
+{
+	if (fInitStatus == B_OK) {
+		fPeaks.Build(fData, fFrameCount, kEngineChannels);
+		_Analyze();
+	}
+}
+
+
+Sample::~Sample()
+{
+	if (fLocker != NULL)
+		fLocker->Unlock(fData, Size());
+	if (fFile.Get() == NULL)
+		free((void*)fData);
+}
+
+
+size_t
+Sample::DecodedSize() const
+{
+	return fFrameCount * kEngineChannels * sizeof(float);
+}
+
+
+int32
+Sample::UnpackBlock(int64 block, float* target) const
+{
+	int64 packedFrames = fFrameCount - fHeadFrames;
+	int64 start = block * kPackedBlockFrames;
+	int32 count = packedFrames - start < kPackedBlockFrames
+		? packedFrames - start : kPackedBlockFrames;
+	bool last = start + count >= packedFrames;
+
+	if (fStorage == kSample16Bit) {
+		const int16* frames = (const int16*)fPacked + start * kEngineChannels;
+		unquantize_frames(frames, count + (last ? 0 : 1), target);
+		return count;
+	}
+
+	const uint8* data = fPacked + fBlockOffsets[block];
+	if (!expand_block(data, fBlockOffsets[block + 1] - fBlockOffsets[block], count, target))
+		memset(target, 0, count * kEngineChannels * sizeof(float));
+	if (!last)
+		first_frame_of_block(fPacked + fBlockOffsets[block + 1], target + count * kEngineChannels);
+	return count;
+}
+
+
+void
+Sample::ReadFrames(int64 start, int64 count, float* target) const
+{
+	if (start < fHeadFrames) {
+		int64 headCount = fHeadFrames - start < count ? fHeadFrames - start : count;
+		memcpy(target, fData + start * kEngineChannels,
+			headCount * kEngineChannels * sizeof(float));
+		start += headCount;
+		count -= headCount;
+		target += headCount * kEngineChannels;
+	}
+
+	float frames[(kPackedBlockFrames + 1) * kEngineChannels];
+	while (count > 0) {
+		int64 block = (start - fHeadFrames) / kPackedBlockFrames;
+		int64 offset = start - fHeadFrames - block * kPackedBlockFrames;
+		int64 available = UnpackBlock(block, frames) - offset;
+		if (available > count)
+			available = count;
+		memcpy(target, frames + offset * kEngineChannels,
+			available * kEngineChannels * sizeof(float));
+		start += available;
+		count -= available;
+		target += available * kEngineChannels;
+	}
+}
+
+
+/*static*/ void
+Sample::SetStorage(int32 storage)
+{
+	sStorage.store(storage, std::memory_order_relaxed);
+}
+
+
+/*static*/ int32
+Sample::Storage()
+{
+	return sStorage.load(std::memory_order_relaxed);
+}
+
+
+void
+Sample::MeasureLoudness()
+{
+	if (fInitStatus != B_OK)
+		return;
+
+	// a packed sample is unpacked a block at a time for it
+	LoudnessMeter meter(kEngineChannels, kEngineFrameRate);
+	if (!IsPacked())
+		meter.Process(fData, fFrameCount);
+	else {
+		float frames[kPackedBlockFrames * kEngineChannels];
+		for (int64 start = 0; start < fFrameCount; start += kPackedBlockFrames) {
+			int64 count = fFrameCount - start < kPackedBlockFrames
+				? fFrameCount - start : kPackedBlockFrames;
+			ReadFrames(start, count, frames);
+			meter.Process(frames, count);
+		}
+	}
+	SetLoudness(meter.Loudness());
+}
+
+
+void
+Sample::SetLoudness(float loudness)
+{
+	fLoudness = loudness;
+	fHasLoudness = true;
+}
+
+
+status_t
+Sample::Pin(MemoryLocker* locker)
+{
+	if (fInitStatus != B_OK)
+		return fInitStatus;
+	if (fLocker != NULL)
+		return B_OK;
+
+	status_t status = locker->Lock(fData, Size());
+	if (status == B_OK)
+		fLocker = locker;
+
+	return status;
+}
+
+
+// #pragma mark -
+
+
+status_t
+Sample::_Decode()
+{
+	entry_ref ref;
+	status_t status = get_ref_for_path(fPath.String(), &ref);
+	if (status != B_OK)
+		return status;
+
+	// WAV, AIFF and FLAC right from the mapped file, anything else, or what
+	// the decoder here doesn't handle, through the media kit
+	float* frames = NULL;
+	int64 frameCount = 0;
+	double frameRate = 0.0;
+	AudioDecoder::Result result = AudioDecoder::kUnknownFormat;
+	{
+		BReference<MappedFile> file(new MappedFile(ref), true);
+		AudioDecoder decoder;
+		if (file->InitCheck() == B_OK) {
+			result = decoder.Decode(file->Data(), file->Size());
+			fFingerprint = AudioDecoder::Fingerprint(file->Data(), file->Size());
+		}
+		if (result == AudioDecoder::kOK) {
+			frameCount = decoder.FrameCount();
+			frameRate = decoder.FrameRate();
+			frames = decoder.DetachFrames();
+		}
+	}
+	if (result == AudioDecoder::kNoMemory)
+		return B_NO_MEMORY;
+	if (result != AudioDecoder::kOK) {
+		status = _DecodeMediaFile(ref, frames, frameCount, frameRate);
+		if (status != B_OK)
+			return status;
+	}
+
+	// resample to the engine's rate once here, so playback is a plain copy
+	int64 targetCount = frameCount;
+	if (frameRate > 0 && frameRate != kEngineFrameRate)
+		targetCount = (int64)(frameCount * (double)kEngineFrameRate / frameRate);
+	if (targetCount < 1)
+		targetCount = 1;
+
+	// page aligned, so the data can be locked into memory without neighbours
+	size_t size = targetCount * kEngineChannels * sizeof(float);
+	float* data;
+	if (posix_memalign((void**)&data, B_PAGE_SIZE, size) != 0) {
+		free(frames);
+		return B_NO_MEMORY;
+	}
+
+	if (targetCount == frameCount)
+		memcpy(data, frames, size);
+	else {
+		double step = frameRate / kEngineFrameRate;
+		for (int64 i = 0; i < targetCount; i++) {
+			double position = i * step;
+			int64 index = (int64)position;
+			float fraction = position - index;
+			int64 next = index + 1 < frameCount ? index + 1 : index;
+			for (int32 channel = 0; channel < kEngineChannels; channel++) {
+				float a = frames[index * kEngineChannels + channel];
+				float b = frames[next * kEngineChannels + channel];
+				data[i * kEngineChannels + channel] = a + (b - a) * fraction;
+			}
+		}
+	}
+
+	free(frames);
+	fData = data;
+	fFrameCount = targetCount;
+	return B_OK;
+}
+
+
+status_t
+Sample::_DecodeMediaFile(const entry_ref& ref, float*& _frames, int64& _frameCount,
+	double& _frameRate)
+{
+	BMediaFile mediaFile(&ref);
+	status_t status = mediaFile.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	// use the first track that decodes to raw audio, preferably as float
+	BMediaTrack* track = NULL;
+	media_format format;
+	for (int32 i = 0; i < mediaFile.CountTracks(); i++) {
+		track = mediaFile.TrackAt(i);
+		format.type = B_MEDIA_RAW_AUDIO;
+		format.u.raw_audio = media_multi_audio_format::wildcard;
+		format.u.raw_audio.format = media_raw_audio_format::B_AUDIO_FLOAT;
+		format.u.raw_audio.byte_order = B_MEDIA_HOST_ENDIAN;
+		if (track->DecodedFormat(&format) == B_OK && format.type == B_MEDIA_RAW_AUDIO)
+			break;
+
+		mediaFile.ReleaseTrack(track);
+		track = NULL;
+	}
+	if (track == NULL)
+		return B_MEDIA_BAD_FORMAT;
+
+	const media_raw_audio_format& raw = format.u.raw_audio;
+	uint32 channels = raw.channel_count;
+	size_t sampleSize = raw.format & media_raw_audio_format::B_AUDIO_SIZE_MASK;
+	size_t frameSize = channels * sampleSize;
+	if (channels == 0 || sampleSize == 0) {
+		mediaFile.ReleaseTrack(track);
+		return B_MEDIA_BAD_FORMAT;
+	}
+
+	size_t bufferSize = raw.buffer_size > 0 ? raw.buffer_size : kDefaultReadBufferSize;
+	uint8* buffer = (uint8*)malloc(bufferSize);
+
+	int64 capacity = track->CountFrames() > 0 ? track->CountFrames() : 65536;
+	float* frames = (float*)malloc(capacity * kEngineChannels * sizeof(float));
+	int64 frameCount = 0;
+
+	while (buffer != NULL && frames != NULL) {
+		int64 count = 0;
+		if (track->ReadFrames(buffer, &count) != B_OK || count <= 0)
+			break;
+
+		if (frameCount + count > capacity) {
+			capacity = (frameCount + count) * 2;
+			float* grown = (float*)realloc(frames, capacity * kEngineChannels * sizeof(float));
+			if (grown == NULL)
+				break;
+			frames = grown;
+		}
+
+		// convert to stereo float, mono is played on both channels
+		const uint8* source = buffer;
+		float* target = frames + frameCount * kEngineChannels;
+		for (int64 i = 0; i < count; i++) {
+			target[0] = read_sample(source, raw.format);
+			target[1] = channels > 1 ? read_sample(source + sampleSize, raw.format) : target[0];
+			source += frameSize;
+			target += kEngineChannels;
+		}
+		frameCount += count;
+	}
+
+	mediaFile.ReleaseTrack(track);
+	free(buffer);
+
+	if (frames == NULL || frameCount == 0) {
+		free(frames);
+		return frames == NULL ? B_NO_MEMORY : B_MEDIA_BAD_FORMAT;
+	}
+
+	_frames = frames;
+	_frameCount = frameCount;
+	_frameRate = raw.frame_rate;
+	return B_OK;
+}
+
+
+void
+Sample::_Analyze()
+{
+	// Only leading and trailing frames are looked at, besides the peak. A
+	// sample that's all silence is played whole.
+	fOnset = 0;
+	fDecayEnd = fFrameCount;
+	float peak = find_peak(fData, fFrameCount, kEngineChannels);
+	fPeak = peak;
+	if (peak <= 0.0f)
+		return;
+
+	int64 onset = find_onset(fData, fFrameCount, kEngineChannels,
+		peak * powf(10.0f, kOnsetThreshold / 20.0f));
+	int64 end = find_decay_end(fData, fFrameCount, kEngineChannels,
+		peak * powf(10.0f, kDecayThreshold / 20.0f));
+	if (onset >= end)
+		return;
+
+	onset -= (int64)(kOnsetLead * kEngineFrameRate);
+	end += (int64)(kDecayTail * kEngineFrameRate);
+	fOnset = onset > 0 ? onset : 0;
+	fDecayEnd = end < fFrameCount ? end : fFrameCount;
+}
+
+
+void
+Sample::_Pack(int32 storage)
+{
+	// short samples are played from their head alone
+	if (fFrameCount <= kPackedHeadFrames + 1)
+		return;
+
+	int64 packedFrames = fFrameCount - kPackedHeadFrames;
+	std::vector<int16> quantized(packedFrames * kEngineChannels);
+	quantize_frames(fData + kPackedHeadFrames * kEngineChannels, packedFrames,
+		quantized.data());
+
+	std::vector<uint8> compressed;
+	std::vector<uint32> offsets;
+	if (storage == kSampleCompressed) {
+		for (int64 start = 0; start < packedFrames; start += kPackedBlockFrames) {
+			int32 count = packedFrames - start < kPackedBlockFrames
+				? packedFrames - start : kPackedBlockFrames;
+			offsets.push_back(compressed.size());
+			compress_block(&quantized[start * kEngineChannels], count, compressed);
+		}
+		offsets.push_back(compressed.size());
+	}
+
+	// all in one page aligned allocation, to be locked into memory: the head
+	// with the first packed frame, the offsets of the blocks, the blocks
+	size_t headSize = (kPackedHeadFrames + 1) * kEngineChannels * sizeof(float);
+	size_t offsetsSize = offsets.size() * sizeof(uint32);
+	size_t packedSize = storage == kSampleCompressed
+		? compressed.size() : quantized.size() * sizeof(int16);
+	size_t size = headSize + offsetsSize + packedSize;
+	uint8* data;
+	if (posix_memalign((void**)&data, B_PAGE_SIZE, size) != 0)
+		return;
+
+	memcpy(data, fData, headSize - kEngineChannels * sizeof(float));
+	unquantize_frames(quantized.data(), 1,
+		(float*)data + kPackedHeadFrames * kEngineChannels);
+	memcpy(data + headSize, offsets.data(), offsetsSize);
+	memcpy(data + headSize + offsetsSize, storage == kSampleCompressed
+		? (const void*)compressed.data() : (const void*)quantized.data(), packedSize);
+
+	free((void*)fData);
+	fData = (const float*)data;
+	fSize = size;
+	fHeadFrames = kPackedHeadFrames;
+	fStorage = storage;
+	fBlockOffsets = (const uint32*)(data + headSize);
+	fPacked = data + headSize + offsetsSize;
+}
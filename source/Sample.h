@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "Constants.h"
+#include "FileIdentity.h"
+#include "MappedFile.h"
+#include "WaveformPeaks.h"
+
+#include <Referenceable.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <atomic>
+
+class MemoryLocker;
+struct entry_ref;
+
+
+// A sample file decoded into the engine's native format: interleaved stereo
+// float at kEngineFrameRate. The data is either decoded from the file, or
+// taken as is from a memory mapped ensemble bundle. Its waveform peaks and
+// the silence before and after its sound are found right away, too, so they
+// are cached along with the data.
+//
+// A decoded sample can be packed, as 16 bit or compressed, all but its head.
+// The head stays float, with the first packed frame after it, so a voice
+// starts right away and can interpolate into the packed frames.
+
+class Sample : public BReferenceable {
+public:
+					Sample(const char* path);
+					Sample(const char* path, MappedFile* file, const float* data,
+						int64 frameCount, const FileIdentity& identity);
+	virtual			~Sample();
+
+	status_t		InitCheck() const { return fInitStatus; };
+
+	const char*		Path() const { return fPath.String(); };
+	const float*	Data() const { return fData; };
+	int64			FrameCount() const { return fFrameCount; };
+	// as held in memory, and as float
+	size_t			Size() const { return fSize; };
+	size_t			DecodedSize() const;
+
+	// all frames when it isn't packed
+	int64			HeadFrames() const { return fHeadFrames; };
+	bool			IsPacked() const { return fStorage != kSampleFloat; };
+	// the block's frames past the head and the first of the next block, if
+	// any, returns the frames of the block
+	int32			UnpackBlock(int64 block, float* target) const;
+	void			ReadFrames(int64 start, int64 count, float* target) const;
+
+	// for the samples decoded from then on
+	static void		SetStorage(int32 storage);
+	static int32	Storage();
+
+	// where the sound starts and has faded out, the silence around it
+	// can be skipped
+	int64			Onset() const { return fOnset; };
+	int64			DecayEnd() const { return fDecayEnd; };
+
+	// over all frames; the loudness in LUFS is measured separately, as it
+	// may be known from an ensemble already
+	float			Peak() const { return fPeak; };
+	float			Loudness() const { return fLoudness; };
+	bool			HasLoudness() const { return fHasLoudness; };
+	void			MeasureLoudness();
+	void			SetLoudness(float loudness);
+
+	const FileIdentity&	Identity() const { return fIdentity; };
+	// of the file's audio, to find it again after its tags changed; 0 if
+	// not known
+	uint64			Fingerprint() const { return fFingerprint; };
+	const WaveformPeaks&	Peaks() const { return fPeaks; };
+
+	status_t		Pin(MemoryLocker* locker);
+	bool			IsPinned() const { return fLocker != NULL; };
+
+private:
+	status_t		_Decode();
+	status_t		_DecodeMediaFile(const entry_ref& ref, float*& frames,
+						int64& frameCount, double& frameRate);
+	void			_Analyze();
+	void			_Pack(int32 storage);
+
+	BString			fPath;
+	FileIdentity	fIdentity;
+	uint64			fFingerprint;
+	const float*	fData;
+	BReference<MappedFile> fFile;
+	int64			fFrameCount;
+	size_t			fSize;
+	int64			fHeadFrames;
+	int32			fStorage;
+	const uint32*	fBlockOffsets;	// into the packed frames, when compressed
+	const uint8*	fPacked;
+	int64			fOnset;
+	int64			fDecayEnd;
+	float			fPeak;
+	std::atomic<float>	fLoudness;
+	std::atomic<bool>	fHasLoudness;
+	status_t		fInitStatus;
+	MemoryLocker*	fLocker;
+	WaveformPeaks	fPeaks;
+
+	static std::atomic<int32>	sStorage;
+};
+
+
+#endif // SAMPLE_H
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "SampleAnalysis.h"
+
+#include <math.h>
+#include <string.h>
+
+
+static const int64_t kLevelFrames = 64;	// the level of the silence is taken from
+static const int32_t kMaxChannels = 8;
+
+static const float kTargetLoudness = -18.0f;	// LUFS
+static const float kMaxNormalization = 24.0f;	// dB
+static const float kStepTime = 0.1f;			// seconds, a quarter of a block
+static const float kRelativeGate = -10.0f;		// LU
+
+
+static inline float
+block_loudness(double meanSquare)
+{
+	return meanSquare > 0.0 ? -0.691f + 10.0f * log10f(meanSquare) : -INFINITY;
+}
+
+
+static void
+silence_level(const float* data, int64_t frameCount, int32_t channels,
+	float* level)
+{
+	int64_t count = frameCount < kLevelFrames ? frameCount : kLevelFrames;
+	for (int32_t channel = 0; channel < channels; channel++) {
+		float sum = 0.0f;
+		for (int64_t i = 0; i < count; i++)
+			sum += data[i * channels + channel];
+		level[channel] = count > 0 ? sum / count : 0.0f;
+	}
+}
+
+
+static inline bool
+is_audible(const float* frame, int32_t channels, const float* level,
+	float threshold)
+{
+	for (int32_t channel = 0; channel < channels; channel++) {
+		if (fabsf(frame[channel] - level[channel]) > threshold)
+			return true;
+	}
+	return false;
+}
+
+
+float
+find_peak(const float* data, int64_t frameCount, int32_t channels)
+{
+	// a plain loop over all samples, the compiler vectorizes it
+	float peak = 0.0f;
+	int64_t count = frameCount * channels;
+	for (int64_t i = 0; i < count; i++) {
+		float magnitude = fabsf(data[i]);
+		peak = magnitude > peak ? magnitude : peak;
+	}
+	return peak;
+}
+
+
+int64_t
+find_onset(const float* data, int64_t frameCount, int32_t channels,
+	float threshold)
+{
+	if (channels <= 0 || channels > kMaxChannels)
+		return 0;
+
+	float level[kMaxChannels];
+	silence_level(data, frameCount, channels, level);
+
+	for (int64_t frame = 0; frame < frameCount; frame++) {
+		if (is_audible(data + frame * channels, channels, level, threshold))
+			return frame;
+	}
+	return frameCount;
+}
+
+
+int64_t
+find_decay_end(const float* data, int64_t frameCount, int32_t channels,
+	float threshold)
+{
+	if (channels <= 0 || channels > kMaxChannels)
+		return frameCount;
+
+	float level[kMaxChannels];
+	int64_t count = frameCount < kLevelFrames ? frameCount : kLevelFrames;
+	silence_level(data + (frameCount - count) * channels, count, channels, level);
+
+	for (int64_t frame = frameCount; frame > 0; frame--) {
+		if (is_audible(data + (frame - 1) * channels, channels, level, threshold))
+			return frame;
+	}
+	return 0;
+}
+
+
+float
+normalization_gain(float peak, float loudness)
+{
+	if (peak <= 0.0f || loudness <= kSilentLoudness)
+		return 1.0f;
+
+	float gain = kTargetLoudness - loudness;
+	if (gain > kMaxNormalization)
+		gain = kMaxNormalization;
+	float linear = powf(10.0f, gain / 20.0f);
+	return linear * peak > 1.0f ? 1.0f / peak : linear;
+}
+
+
+// #pragma mark -
+
+
+LoudnessMeter::LoudnessMeter(int32_t channels, float frameRate)
+	:
+	fChannels(channels > 0 && channels <= kMaxChannels ? channels : 0),
+	fStepFrames((int64_t)(kStepTime * frameRate)),
+	fFrameCount(0)
+{
+	memset(fShelfState, 0, sizeof(fShelfState));
+	memset(fHighPassState, 0, sizeof(fHighPassState));
+
+	// the filters of the standard, for any frame rate rather than just 48 kHz
+	double k = tan(M_PI * 1681.974450955533 / frameRate);
+	double q = 0.7071752369554196;
+	double vh = pow(10.0, 3.999843853973347 / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	fShelf.b0 = (vh + vb * k / q + k * k) / a0;
+	fShelf.b1 = 2.0 * (k * k - vh) / a0;
+	fShelf.b2 = (vh - vb * k / q + k * k) / a0;
+	fShelf.a1 = 2.0 * (k * k - 1.0) / a0;
+	fShelf.a2 = (1.0 - k / q + k * k) / a0;
+
+	k = tan(M_PI * 38.13547087602444 / frameRate);
+	q = 0.5003270373238773;
+	a0 = 1.0 + k / q + k * k;
+	fHighPass.b0 = 1.0;
+	fHighPass.b1 = -2.0;
+	fHighPass.b2 = 1.0;
+	fHighPass.a1 = 2.0 * (k * k - 1.0) / a0;
+	fHighPass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+
+void
+LoudnessMeter::Process(const float* data, int64_t frameCount)
+{
+	if (fChannels == 0 || fStepFrames <= 0)
+		return;
+
+	for (int64_t frame = 0; frame < frameCount; frame++, fFrameCount++) {
+		if (fFrameCount % fStepFrames == 0)
+			fSteps.push_back(0.0);
+
+		double sum = 0.0;
+		for (int32_t channel = 0; channel < fChannels; channel++) {
+			double value = _Filter(fShelf, fShelfState[channel],
+				data[frame * fChannels + channel]);
+			value = _Filter(fHighPass, fHighPassState[channel], value);
+			sum += value * value;
+		}
+		fSteps.back() += sum;
+	}
+}
+
+
+float
+LoudnessMeter::Loudness() const
+{
+	if (fFrameCount == 0)
+		return kSilentLoudness;
+
+	// blocks of 400 ms overlap by three steps, a hit shorter than that is a
+	// block of its own
+	std::vector<double> blocks;
+	if (fSteps.size() < 4) {
+		double sum = 0.0;
+		for (size_t i = 0; i < fSteps.size(); i++)
+			sum += fSteps[i];
+		blocks.push_back(sum / fFrameCount);
+	} else {
+		for (size_t i = 0; i + 4 <= fSteps.size(); i++) {
+			blocks.push_back((fSteps[i] + fSteps[i + 1] + fSteps[i + 2] + fSteps[i + 3])
+				/ (4 * fStepFrames));
+		}
+	}
+
+	// gated absolutely, then relative to the loudness of what passed
+	double sum = 0.0;
+	int32_t count = 0;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		if (block_loudness(blocks[i]) > kSilentLoudness) {
+			sum += blocks[i];
+			count++;
+		}
+	}
+	if (count == 0)
+		return kSilentLoudness;
+
+	float gate = block_loudness(sum / count) + kRelativeGate;
+	sum = 0.0;
+	count = 0;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		if (block_loudness(blocks[i]) > gate) {
+			sum += blocks[i];
+			count++;
+		}
+	}
+	return count > 0 ? block_loudness(sum / count) : kSilentLoudness;
+}
+
+
+/*static*/ inline double
+LoudnessMeter::_Filter(const Biquad& biquad, double* z, double input)
+{
+	double output = biquad.b0 * input + z[0];
+	z[0] = biquad.b1 * input - biquad.a1 * output + z[1];
+	z[1] = biquad.b2 * input - biquad.a2 * output;
+	return output;
+}
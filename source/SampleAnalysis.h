@@ -0,0 +1,77 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_ANALYSIS_H
+#define SAMPLE_ANALYSIS_H
+
+#include <stdint.h>
+
+#include <vector>
+
+
+// Finds where the sound of a sample starts and where its decay has faded
+// out, so the silence around it can be skipped when it's played. Silence is
+// whatever stays within the threshold of the level the sample starts or
+// ends on, so a DC offset counts as silence, too.
+//
+// Measures how loud a sample is, too, so samples of different libraries can
+// be brought to the same loudness.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+static const float kSilentLoudness = -70.0f;	// LUFS
+
+
+// over all channels
+float			find_peak(const float* data, int64_t frameCount, int32_t channels);
+// to bring a sample to the same loudness as the others, as far as its peak
+// stays below full scale
+float			normalization_gain(float peak, float loudness);
+
+// the first frame beyond the threshold, frameCount if there is none
+int64_t			find_onset(const float* data, int64_t frameCount, int32_t channels,
+					float threshold);
+// the frame after the last one beyond the threshold, 0 if there is none
+int64_t			find_decay_end(const float* data, int64_t frameCount,
+					int32_t channels, float threshold);
+
+
+// The loudness integrated over all frames passed, in LUFS, as ITU-R BS.1770
+// measures it. The frames can be passed in any number of pieces. Channels
+// beyond the first two are weighted like them.
+
+class LoudnessMeter {
+public:
+					LoudnessMeter(int32_t channels, float frameRate);
+
+	void			Process(const float* data, int64_t frameCount);
+	float			Loudness() const;
+
+private:
+	struct Biquad {
+		double		b0, b1, b2, a1, a2;
+	};
+
+	enum {
+		kMaxChannels = 8
+	};
+
+	static inline double _Filter(const Biquad& biquad, double* z, double input);
+
+	int32_t			fChannels;
+	Biquad			fShelf;
+	Biquad			fHighPass;
+	double			fShelfState[kMaxChannels][2];
+	double			fHighPassState[kMaxChannels][2];
+	int64_t			fStepFrames;
+	int64_t			fFrameCount;
+	std::vector<double> fSteps;	// the weighted squares, summed over 100 ms
+};
+
+
+#endif // SAMPLE_ANALYSIS_H
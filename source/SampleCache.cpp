@@ -0,0 +1,153 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "SampleCache.h"
+
+#include <Autolock.h>
+
+
+SampleCache::SampleCache()
+	:
+	fLock("sample cache")
+{
+}
+
+
+SampleCache::~SampleCache()
+{
+	for (SampleMap::iterator it = fSamples.begin(); it != fSamples.end(); it++)
+		it->second->ReleaseReference();
+}
+
+
+Sample*
+SampleCache::Get(const char* path)
+{
+	FileIdentity identity;
+	if (!get_file_identity(path, identity, false))
+		return new Sample(path);
+
+	Key key = _KeyFor(identity);
+	Sample* sample = _Lookup(key);
+	if (sample != NULL)
+		return sample;
+
+	// decode outside of the lock, other threads may look up other samples
+	// meanwhile
+	return _Insert(key, new Sample(path));
+}
+
+
+Sample*
+SampleCache::Get(const char* path, MappedFile* file, const float* data,
+	int64 frameCount, const FileIdentity& identity)
+{
+	// ensembles of Samedi 1.0 have no identities to go by
+	if (identity.inode == 0)
+		return new Sample(path, file, data, frameCount, identity);
+
+	Key key = _KeyFor(identity);
+	Sample* sample = _Lookup(key);
+	if (sample != NULL)
+		return sample;
+
+	return _Insert(key, new Sample(path, file, data, frameCount, identity));
+}
+
+
+void
+SampleCache::Prune()
+{
+	BAutolock _(fLock);
+
+	// drop the samples nobody but the cache uses anymore
+	SampleMap::iterator it = fSamples.begin();
+	while (it != fSamples.end()) {
+		if (it->second->CountReferences() == 1) {
+			it->second->ReleaseReference();
+			fSamples.erase(it++);
+		} else
+			it++;
+	}
+}
+
+
+void
+SampleCache::GetMemory(size_t& held, size_t& decoded)
+{
+	BAutolock _(fLock);
+
+	held = 0;
+	decoded = 0;
+	for (SampleMap::iterator it = fSamples.begin(); it != fSamples.end(); it++) {
+		held += it->second->Size();
+		decoded += it->second->DecodedSize();
+	}
+}
+
+
+// #pragma mark -
+
+
+bool
+SampleCache::Key::operator<(const Key& other) const
+{
+	if (device != other.device)
+		return device < other.device;
+	if (inode != other.inode)
+		return inode < other.inode;
+	if (size != other.size)
+		return size < other.size;
+	return modificationTime < other.modificationTime;
+}
+
+
+/*static*/ SampleCache::Key
+SampleCache::_KeyFor(const FileIdentity& identity)
+{
+	Key key = { identity.device, identity.inode, identity.size,
+		identity.modificationTime };
+	return key;
+}
+
+
+Sample*
+SampleCache::_Lookup(const Key& key)
+{
+	BAutolock _(fLock);
+
+	SampleMap::iterator found = fSamples.find(key);
+	if (found == fSamples.end())
+		return NULL;
+
+	found->second->AcquireReference();
+	return found->second;
+}
+
+
+Sample*
+SampleCache::_Insert(const Key& key, Sample* sample)
+{
+	if (sample->InitCheck() != B_OK)
+		return sample;
+
+	BAutolock _(fLock);
+
+	// another thread may have been quicker decoding the same file
+	SampleMap::iterator found = fSamples.find(key);
+	if (found != fSamples.end()) {
+		sample->ReleaseReference();
+		found->second->AcquireReference();
+		return found->second;
+	}
+
+	sample->AcquireReference();
+	fSamples[key] = sample;
+	return sample;
+}
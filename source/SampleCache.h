@@ -0,0 +1,59 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include "FileIdentity.h"
+#include "Sample.h"
+
+#include <Locker.h>
+
+#include <map>
+
+
+// Shares the decoded samples between ensembles, so a sample used by several
+// ensembles kept in memory is decoded and stored only once. Samples are
+// found by the identity of their file, a changed file is decoded anew.
+// Safe to use from several threads.
+
+class SampleCache {
+public:
+					SampleCache();
+					~SampleCache();
+
+	Sample*			Get(const char* path);
+	Sample*			Get(const char* path, MappedFile* file, const float* data,
+						int64 frameCount, const FileIdentity& identity);
+
+	void			Prune();
+	// of the cached samples, as held in memory and as float
+	void			GetMemory(size_t& held, size_t& decoded);
+
+private:
+	struct Key {
+		bool		operator<(const Key& other) const;
+
+		uint64		device;
+		uint64		inode;
+		uint64		size;
+		int64		modificationTime;
+	};
+
+	typedef std::map<Key, Sample*> SampleMap;
+
+	static Key		_KeyFor(const FileIdentity& identity);
+	Sample*			_Lookup(const Key& key);
+	Sample*			_Insert(const Key& key, Sample* sample);
+
+	BLocker			fLock;
+	SampleMap		fSamples;
+};
+
+
+#endif // SAMPLE_CACHE_H
@@ -0,0 +1,471 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "SampleLibrary.h"
+#include "Constants.h"
+
+#include <Autolock.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+#include <FindDirectory.h>
+#include <MessageRunner.h>
+#include <NodeMonitor.h>
+#include <Path.h>
+
+#include <string>
+
+
+// of work per scan message, so node monitor messages and quitting don't wait
+static const bigtime_t kScanSlice = 20000;
+// a file added is left alone this long before it's indexed
+static const bigtime_t kSettleTime = 500000;
+
+
+SampleLibrary::SampleLibrary()
+	:
+	BLooper("sample library", B_LOW_PRIORITY),
+	fLock("sample library"),
+	fDirty(false),
+	fScanning(false)
+{
+	_Load();
+}
+
+
+SampleLibrary::~SampleLibrary()
+{
+	stop_watching(this);
+	_Save();
+}
+
+
+void
+SampleLibrary::MessageReceived(BMessage* msg)
+{
+	switch (msg->what) {
+		case LIBRARY_SET_FOLDERS:
+		{
+			BStringList folders;
+			msg->FindStrings("folder", &folders);
+			_SetFolders(folders);
+			break;
+		}
+		case LIBRARY_SCAN:
+		{
+			_ScanNext();
+			break;
+		}
+		case LIBRARY_SETTLED:
+		{
+			_AddSettled();
+			break;
+		}
+		case B_NODE_MONITOR:
+		{
+			_HandleNodeMonitor(msg);
+			break;
+		}
+		default:
+		{
+			BLooper::MessageReceived(msg);
+			break;
+		}
+	}
+}
+
+
+void
+SampleLibrary::SetFolders(const BStringList& folders)
+{
+	{
+		BAutolock lock(fLock);
+		fFolders = folders;
+	}
+
+	BMessage message(LIBRARY_SET_FOLDERS);
+	message.AddStrings("folder", folders);
+	PostMessage(&message);
+}
+
+
+BStringList
+SampleLibrary::Folders()
+{
+	BAutolock lock(fLock);
+	return fFolders;
+}
+
+
+int32
+SampleLibrary::CountSamples()
+{
+	BAutolock lock(fLock);
+	return fIndex.CountEntries();
+}
+
+
+void
+SampleLibrary::Search(const char* text, int32 maxCount, BStringList& _paths)
+{
+	std::vector<std::string> paths;
+	{
+		BAutolock lock(fLock);
+		fIndex.Search(text, maxCount, paths);
+	}
+
+	_paths.MakeEmpty();
+	for (size_t i = 0; i < paths.size(); i++)
+		_paths.Add(paths[i].c_str());
+}
+
+
+bool
+SampleLibrary::Relink(const FileIdentity& identity, uint64 fingerprint,
+	BString& _path)
+{
+	BAutolock lock(fLock);
+
+	// the same file first, then the same audio with other tags
+	std::string path;
+	if (!fIndex.FindByHash(identity.contentHash, path)
+		&& !fIndex.FindByFingerprint(fingerprint, path))
+		return false;
+
+	_path = path.c_str();
+	return true;
+}
+
+
+// #pragma mark -
+
+
+void
+SampleLibrary::_SetFolders(const BStringList& folders)
+{
+	stop_watching(this);
+	fWatched.clear();
+	fWatchedFiles.clear();
+	fSettling.clear();
+	fPendingDirectories.clear();
+	fPendingFiles.clear();
+
+	for (int32 i = 0; i < folders.CountStrings(); i++)
+		fPendingDirectories.push_back(folders.StringAt(i));
+	_StartScan();
+}
+
+
+void
+SampleLibrary::_StartScan()
+{
+	if (fScanning)
+		return;
+
+	fScanning = true;
+	PostMessage(LIBRARY_SCAN);
+}
+
+
+void
+SampleLibrary::_ScanNext()
+{
+	bigtime_t start = system_time();
+	while (system_time() - start < kScanSlice) {
+		if (!fPendingFiles.empty()) {
+			BString path = fPendingFiles.back();
+			fPendingFiles.pop_back();
+			_AddFile(path);
+		} else if (!fPendingDirectories.empty()) {
+			BString path = fPendingDirectories.back();
+			fPendingDirectories.pop_back();
+			_ScanDirectory(path);
+		} else {
+			// all there is has been seen, what wasn't is gone, as are the
+			// files of folders no longer in the library
+			BAutolock lock(fLock);
+			std::vector<std::string> folders;
+			for (int32 i = 0; i < fFolders.CountStrings(); i++) {
+				folders.push_back(fFolders.StringAt(i).String());
+				if (fIndex.RemoveMissing(fFolders.StringAt(i)) > 0)
+					fDirty = true;
+			}
+			if (fIndex.RemoveOutside(folders) > 0)
+				fDirty = true;
+			lock.Unlock();
+
+			fScanning = false;
+			_Save();
+			return;
+		}
+	}
+
+	PostMessage(LIBRARY_SCAN);
+}
+
+
+void
+SampleLibrary::_ScanDirectory(const char* path)
+{
+	BDirectory directory(path);
+	node_ref nodeRef;
+	if (directory.InitCheck() != B_OK || directory.GetNodeRef(&nodeRef) != B_OK
+		|| fWatched.find(nodeRef) != fWatched.end())
+		return;
+
+	// watched before it's read, so nothing added meanwhile is missed
+	if (watch_node(&nodeRef, B_WATCH_DIRECTORY, this) == B_OK)
+		fWatched[nodeRef] = path;
+
+	BEntry entry;
+	while (directory.GetNextEntry(&entry) == B_OK) {
+		BPath entryPath;
+		if (entry.GetPath(&entryPath) != B_OK)
+			continue;
+		if (entry.IsDirectory())
+			fPendingDirectories.push_back(entryPath.Path());
+		else if (is_sample_file_name(entryPath.Leaf()))
+			fPendingFiles.push_back(entryPath.Path());
+	}
+}
+
+
+void
+SampleLibrary::_AddFile(const char* path)
+{
+	LibraryEntry entry;
+	if (!LibraryIndex::Identify(path, entry, false))
+		return;
+
+	{
+		BAutolock lock(fLock);
+		if (fIndex.IsCurrent(path, entry))
+			return;
+	}
+
+	// hashed without the lock, ensembles may be relinking meanwhile
+	if (!LibraryIndex::Identify(path, entry, true))
+		return;
+
+	BAutolock lock(fLock);
+	fIndex.Add(path, entry);
+	fDirty = true;
+}
+
+
+void
+SampleLibrary::_HandleNodeMonitor(BMessage* msg)
+{
+	int32 opcode;
+	if (msg->FindInt32("opcode", &opcode) != B_OK)
+		return;
+
+	node_ref directory;
+	directory.device = msg->GetInt32("device", -1);
+	switch (opcode) {
+		case B_STAT_CHANGED:
+		{
+			// a file added that is still being written
+			int32 fields = msg->GetInt32("fields", 0);
+			if ((fields & (B_STAT_MODIFICATION_TIME | B_STAT_SIZE)) == 0)
+				break;
+
+			node_ref file;
+			file.device = directory.device;
+			file.node = msg->GetInt64("node", -1);
+			std::map<node_ref, BString>::iterator found = fWatchedFiles.find(file);
+			if (found != fWatchedFiles.end())
+				_Changed(found->second);
+			break;
+		}
+		case B_ENTRY_CREATED:
+		{
+			directory.node = msg->GetInt64("directory", -1);
+			_EntryAdded(directory, msg->GetString("name", NULL));
+			break;
+		}
+		case B_ENTRY_REMOVED:
+		{
+			// a watched folder may be the one removed
+			node_ref removed;
+			removed.device = directory.device;
+			removed.node = msg->GetInt64("node", -1);
+			std::map<node_ref, BString>::iterator found = fWatched.find(removed);
+			if (found != fWatched.end()) {
+				BString removedPath(found->second);
+				_Forget(removedPath);
+			}
+
+			directory.node = msg->GetInt64("directory", -1);
+			_EntryGone(directory);
+			break;
+		}
+		case B_ENTRY_MOVED:
+		{
+			const char* name = msg->GetString("name", NULL);
+			directory.node = msg->GetInt64("from directory", -1);
+			std::map<node_ref, BString>::iterator found = fWatched.find(directory);
+			if (found != fWatched.end() && name != NULL) {
+				BString oldPath(found->second);
+				oldPath << "/" << name;
+				_Forget(oldPath);
+				_EntryGone(directory);
+			}
+
+			directory.node = msg->GetInt64("to directory", -1);
+			_EntryAdded(directory, name);
+			break;
+		}
+	}
+}
+
+
+void
+SampleLibrary::_EntryAdded(const node_ref& directory, const char* name)
+{
+	std::map<node_ref, BString>::iterator found = fWatched.find(directory);
+	if (found == fWatched.end() || name == NULL)
+		return;
+
+	BPath path(found->second.String(), name);
+	BEntry entry(path.Path());
+	if (entry.IsDirectory()) {
+		fPendingDirectories.push_back(path.Path());
+		_StartScan();
+		return;
+	}
+	if (!is_sample_file_name(name))
+		return;
+
+	// created empty and then written, or copied over a while
+	node_ref nodeRef;
+	if (entry.GetNodeRef(&nodeRef) == B_OK
+		&& fWatchedFiles.find(nodeRef) == fWatchedFiles.end()
+		&& watch_node(&nodeRef, B_WATCH_STAT, this) == B_OK)
+		fWatchedFiles[nodeRef] = path.Path();
+	_Changed(path.Path());
+}
+
+
+void
+SampleLibrary::_Changed(const BString& path)
+{
+	// every change puts it off again, the check after the last one adds it
+	fSettling[path] = system_time() + kSettleTime;
+
+	BMessage message(LIBRARY_SETTLED);
+	BMessageRunner::StartSending(BMessenger(this), &message, kSettleTime, 1);
+}
+
+
+void
+SampleLibrary::_AddSettled()
+{
+	bigtime_t now = system_time();
+	std::map<BString, bigtime_t>::iterator it = fSettling.begin();
+	while (it != fSettling.end()) {
+		if (it->second > now) {
+			it++;
+			continue;
+		}
+
+		BString path(it->first);
+		fSettling.erase(it++);
+
+		std::map<node_ref, BString>::iterator file = fWatchedFiles.begin();
+		while (file != fWatchedFiles.end()) {
+			if (file->second == path) {
+				watch_node(&file->first, B_STOP_WATCHING, this);
+				fWatchedFiles.erase(file++);
+			} else
+				file++;
+		}
+		// gone again meanwhile, Identify() fails
+		_AddFile(path);
+	}
+}
+
+
+void
+SampleLibrary::_EntryGone(const node_ref& directory)
+{
+	// the message doesn't tell the name, whatever is missing in there is it
+	std::map<node_ref, BString>::iterator found = fWatched.find(directory);
+	if (found == fWatched.end())
+		return;
+
+	BAutolock lock(fLock);
+	if (fIndex.RemoveMissing(found->second) > 0)
+		fDirty = true;
+}
+
+
+void
+SampleLibrary::_Forget(const BString& path)
+{
+	// the folder and those below it aren't where they were anymore
+	BString prefix(path);
+	prefix << "/";
+	std::map<node_ref, BString>::iterator iterator = fWatched.begin();
+	while (iterator != fWatched.end()) {
+		if (iterator->second == path || iterator->second.StartsWith(prefix)) {
+			watch_node(&iterator->first, B_STOP_WATCHING, this);
+			fWatched.erase(iterator++);
+		} else
+			iterator++;
+	}
+}
+
+
+// #pragma mark -
+
+
+void
+SampleLibrary::_Load()
+{
+	BPath path;
+	if (find_directory(B_USER_SETTINGS_DIRECTORY, &path) != B_OK)
+		return;
+
+	path.Append("Samedi_library");
+	BFile file(path.Path(), B_READ_ONLY);
+	off_t size;
+	if (file.InitCheck() != B_OK || file.GetSize(&size) != B_OK || size <= 0)
+		return;
+
+	std::vector<uint8> data(size);
+	if (file.Read(data.data(), size) != size)
+		return;
+
+	BAutolock lock(fLock);
+	fIndex.Unflatten(data.data(), data.size());
+}
+
+
+void
+SampleLibrary::_Save()
+{
+	BAutolock lock(fLock);
+	if (!fDirty)
+		return;
+
+	BPath path;
+	if (find_directory(B_USER_SETTINGS_DIRECTORY, &path) != B_OK)
+		return;
+
+	path.Append("Samedi_library");
+	BFile file(path.Path(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK)
+		return;
+
+	std::vector<uint8> data;
+	fIndex.Flatten(data);
+	if (file.Write(data.data(), data.size()) == (ssize_t)data.size())
+		fDirty = false;
+}
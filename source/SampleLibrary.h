@@ -0,0 +1,90 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_LIBRARY_H
+#define SAMPLE_LIBRARY_H
+
+#include "FileIdentity.h"
+#include "LibraryIndex.h"
+
+#include <Locker.h>
+#include <Looper.h>
+#include <Node.h>
+#include <String.h>
+#include <StringList.h>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+
+// The index of the sample folders, so a sample that was moved or renamed
+// can be found again by its content. The folders are scanned on the
+// library's own thread, a few files per message, and watched for files
+// added, removed and moved afterwards. A file added is only indexed once it
+// has been left alone for a moment, so one that is still being copied or
+// written isn't hashed half done. Files changed in place are picked up by
+// the next scan. The index is kept in the settings folder, so a scan
+// only has to hash what changed since.
+//
+// Relink() is safe to call from any thread, e.g. while an ensemble loads.
+
+class SampleLibrary : public BLooper {
+public:
+					SampleLibrary();
+	virtual			~SampleLibrary();
+
+	virtual	void	MessageReceived(BMessage* msg);
+
+	void			SetFolders(const BStringList& folders);
+	BStringList		Folders();
+
+	int32			CountSamples();
+	bool			IsScanning() const { return fScanning; };
+
+	// the samples with all words of the text in their name
+	void			Search(const char* text, int32 maxCount,
+						BStringList& _paths);
+
+	// where a file of that content, or else that audio, is now
+	bool			Relink(const FileIdentity& identity, uint64 fingerprint,
+						BString& _path);
+
+private:
+	void			_SetFolders(const BStringList& folders);
+	void			_ScanNext();
+	void			_StartScan();
+	void			_ScanDirectory(const char* path);
+	void			_AddFile(const char* path);
+	void			_HandleNodeMonitor(BMessage* msg);
+	void			_EntryAdded(const node_ref& directory, const char* name);
+	void			_Changed(const BString& path);
+	void			_AddSettled();
+	void			_EntryGone(const node_ref& directory);
+	void			_Forget(const BString& path);
+
+	void			_Load();
+	void			_Save();
+
+	BLocker			fLock;
+	LibraryIndex	fIndex;
+	BStringList		fFolders;
+	bool			fDirty;
+
+	// only touched by the library's thread
+	std::vector<BString> fPendingDirectories;
+	std::vector<BString> fPendingFiles;
+	std::map<node_ref, BString> fWatched;
+	// the files added, indexed if they aren't changed again till then
+	std::map<node_ref, BString> fWatchedFiles;
+	std::map<BString, bigtime_t> fSettling;
+	std::atomic<bool> fScanning;
+};
+
+
+#endif // SAMPLE_LIBRARY_H
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "Constants.h"
+#include "SampleLibrary.h"
+#include "SampleSearchWindow.h"
+
+#include <Catalog.h>
+#include <ControlLook.h>
+#include <Entry.h>
+#include <LayoutBuilder.h>
+#include <Path.h>
+#include <ScrollView.h>
+#include <String.h>
+
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "SampleSearchWindow"
+
+static const int32 kMaxResults = 500;
+
+
+SampleSearchWindow::SampleSearchWindow(BMessenger target, SampleLibrary* library)
+	:
+	BWindow(BRect(260, 260, 660, 560), B_TRANSLATE("Samedi: Find sample"), B_TITLED_WINDOW,
+		B_NOT_ZOOMABLE | B_ASYNCHRONOUS_CONTROLS | B_AUTO_UPDATE_SIZE_LIMITS),
+	fTarget(target),
+	fLibrary(library),
+	fPad(-1)
+{
+	// searched anew with every key, the index is in memory
+	fSearchControl = new BTextControl("search", B_TRANSLATE("Name:"), "",
+		new BMessage(SEARCH_INVOKED));
+	fSearchControl->SetModificationMessage(new BMessage(SEARCH_CHANGED));
+
+	fResultList = new BListView("results");
+	fResultList->SetInvocationMessage(new BMessage(SEARCH_INVOKED));
+	BScrollView* scrollView = new BScrollView("scroll", fResultList, 0, false, true);
+
+	fCountView = new BStringView("count", "");
+
+	float spacing = be_control_look->DefaultLabelSpacing();
+	scrollView->SetExplicitMinSize(BSize(spacing * 60, spacing * 30));
+
+	BLayoutBuilder::Group<>(this, B_VERTICAL)
+		.SetInsets(B_USE_WINDOW_SPACING)
+		.Add(fSearchControl)
+		.Add(scrollView)
+		.Add(fCountView)
+	.End();
+}
+
+
+bool
+SampleSearchWindow::QuitRequested()
+{
+	// the main window quits this one when it goes
+	if (!fTarget.IsValid())
+		return true;
+
+	Hide();
+	return false;
+}
+
+
+void
+SampleSearchWindow::MessageReceived(BMessage* msg)
+{
+	switch (msg->what) {
+		case SEARCH_CHANGED:
+		{
+			_Search();
+			break;
+		}
+		case SEARCH_INVOKED:
+		{
+			// the selected sample, or the first one when Enter is pressed
+			// while typing
+			int32 index = fResultList->CurrentSelection();
+			_Choose(index >= 0 ? index : 0);
+			break;
+		}
+		default:
+		{
+			BWindow::MessageReceived(msg);
+			break;
+		}
+	}
+}
+
+
+void
+SampleSearchWindow::ShowForPad(int32 pad)
+{
+	if (!Lock())
+		return;
+
+	fPad = pad;
+	BString title(B_TRANSLATE("Samedi: Find sample"));
+	title << " #" << pad + 1;
+	SetTitle(title);
+	_Search();
+
+	if (IsHidden())
+		Show();
+	else
+		Activate();
+	fSearchControl->MakeFocus(true);
+	Unlock();
+}
+
+
+// #pragma mark -
+
+
+void
+SampleSearchWindow::_Search()
+{
+	fResultList->MakeEmpty();
+	fLibrary->Search(fSearchControl->Text(), kMaxResults, fPaths);
+
+	// the name, and the folder it's in
+	for (int32 i = 0; i < fPaths.CountStrings(); i++) {
+		BPath path(fPaths.StringAt(i));
+		BPath folder;
+		path.GetParent(&folder);
+		BString label(path.Leaf());
+		label << "  —  " << folder.Leaf();
+		fResultList->AddItem(new BStringItem(label));
+	}
+	if (!fPaths.IsEmpty())
+		fResultList->Select(0);
+
+	BString text;
+	int32 count = fLibrary->CountSamples();
+	if (count == 0 && !fLibrary->IsScanning()) {
+		text = B_TRANSLATE("No samples indexed, add folders in "
+			"Ensemble ▸ Sample library");
+	} else if (fPaths.CountStrings() >= kMaxResults) {
+		text = B_TRANSLATE("The first %found% of %count% samples");
+	} else
+		text = B_TRANSLATE("%found% of %count% samples");
+	BString number;
+	number << fPaths.CountStrings();
+	text.ReplaceFirst("%found%", number);
+	number = "";
+	number << count;
+	text.ReplaceFirst("%count%", number);
+	fCountView->SetText(text);
+}
+
+
+void
+SampleSearchWindow::_Choose(int32 index)
+{
+	entry_ref ref;
+	if (index < 0 || index >= fPaths.CountStrings()
+		|| get_ref_for_path(fPaths.StringAt(index), &ref) != B_OK)
+		return;
+
+	BMessage message(LOAD_SAMPLE);
+	message.AddRef("refs", &ref);
+	message.AddInt32("pad", fPad);
+	fTarget.SendMessage(&message);
+	Hide();
+}
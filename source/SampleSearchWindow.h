@@ -0,0 +1,51 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_SEARCH_WINDOW_H
+#define SAMPLE_SEARCH_WINDOW_H
+
+#include <ListView.h>
+#include <Messenger.h>
+#include <StringList.h>
+#include <StringView.h>
+#include <TextControl.h>
+#include <Window.h>
+
+class SampleLibrary;
+
+
+// Finds samples in the sample library by name while typing, without
+// going through the folders. The chosen one is sent to the target as
+// LOAD_SAMPLE for the pad the window was shown for. Closing the window
+// only hides it.
+
+class SampleSearchWindow : public BWindow {
+public:
+					SampleSearchWindow(BMessenger target, SampleLibrary* library);
+
+	virtual bool	QuitRequested();
+	virtual void	MessageReceived(BMessage* msg);
+
+	void			ShowForPad(int32 pad);
+
+private:
+	void			_Search();
+	void			_Choose(int32 index);
+
+	BMessenger		fTarget;
+	SampleLibrary*	fLibrary;
+	int32			fPad;
+	BStringList		fPaths;
+
+	BTextControl*	fSearchControl;
+	BListView*		fResultList;
+	BStringView*	fCountView;
+};
+
+
+#endif // SAMPLE_SEARCH_WINDOW_H
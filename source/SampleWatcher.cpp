@@ -0,0 +1,223 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "SampleWatcher.h"
+#include "Constants.h"
+#include "SampleCache.h"
+
+#include <Entry.h>
+#include <MessageRunner.h>
+#include <NodeMonitor.h>
+#include <Path.h>
+
+
+// editors may write a file in several goes, or save it again right away
+static const bigtime_t kSettleTime = 500000;
+
+
+SampleWatcher::SampleWatcher(BMessenger target, SampleCache* cache)
+	:
+	BLooper("sample watcher", B_LOW_PRIORITY),
+	fTarget(target),
+	fCache(cache),
+	fSchedule(kSettleTime)
+{
+}
+
+
+SampleWatcher::~SampleWatcher()
+{
+	stop_watching(this);
+}
+
+
+void
+SampleWatcher::MessageReceived(BMessage* msg)
+{
+	switch (msg->what) {
+		case SAMPLE_WATCH_PATHS:
+		{
+			BStringList paths;
+			msg->FindStrings("path", &paths);
+			_SetPaths(paths);
+			break;
+		}
+		case SAMPLE_WATCH_SETTLED:
+		{
+			_ReloadSettled();
+			break;
+		}
+		case B_NODE_MONITOR:
+		{
+			_HandleNodeMonitor(msg);
+			break;
+		}
+		default:
+		{
+			BLooper::MessageReceived(msg);
+			break;
+		}
+	}
+}
+
+
+void
+SampleWatcher::SetPaths(const BStringList& paths)
+{
+	BMessage message(SAMPLE_WATCH_PATHS);
+	message.AddStrings("path", paths);
+	PostMessage(&message);
+}
+
+
+// #pragma mark -
+
+
+void
+SampleWatcher::_SetPaths(const BStringList& paths)
+{
+	stop_watching(this);
+	fPaths.MakeEmpty();
+	fFiles.clear();
+	fFolders.clear();
+
+	for (int32 i = 0; i < paths.CountStrings(); i++) {
+		const BString& path = paths.StringAt(i);
+		if (path.IsEmpty() || fPaths.HasString(path))
+			continue;
+
+		fPaths.Add(path);
+		_Watch(path);
+	}
+
+	// a file no longer on a pad isn't decoded anymore
+	std::vector<std::string> kept;
+	for (int32 i = 0; i < fPaths.CountStrings(); i++)
+		kept.push_back(fPaths.StringAt(i).String());
+	fSchedule.KeepOnly(kept);
+}
+
+
+void
+SampleWatcher::_Watch(const BString& path)
+{
+	BEntry entry(path.String());
+	node_ref nodeRef;
+	if (entry.GetNodeRef(&nodeRef) == B_OK
+		&& watch_node(&nodeRef, B_WATCH_STAT, this) == B_OK)
+		fFiles[nodeRef] = path;
+
+	// also when the file is missing, it may come back
+	BEntry folder;
+	BPath folderPath;
+	if (entry.GetParent(&folder) != B_OK || folder.GetNodeRef(&nodeRef) != B_OK
+		|| fFolders.find(nodeRef) != fFolders.end()
+		|| folder.GetPath(&folderPath) != B_OK)
+		return;
+
+	if (watch_node(&nodeRef, B_WATCH_DIRECTORY, this) == B_OK)
+		fFolders[nodeRef] = folderPath.Path();
+}
+
+
+void
+SampleWatcher::_HandleNodeMonitor(BMessage* msg)
+{
+	int32 opcode;
+	if (msg->FindInt32("opcode", &opcode) != B_OK)
+		return;
+
+	node_ref nodeRef;
+	nodeRef.device = msg->GetInt32("device", -1);
+	switch (opcode) {
+		case B_STAT_CHANGED:
+		{
+			// just what the file holds, not e.g. its permissions
+			int32 fields = msg->GetInt32("fields", 0);
+			if ((fields & (B_STAT_MODIFICATION_TIME | B_STAT_SIZE)) == 0)
+				break;
+
+			nodeRef.node = msg->GetInt64("node", -1);
+			std::map<node_ref, BString>::iterator found = fFiles.find(nodeRef);
+			if (found != fFiles.end())
+				_Changed(found->second);
+			break;
+		}
+		case B_ENTRY_CREATED:
+		case B_ENTRY_MOVED:
+		{
+			// a file saved anew and renamed to the watched one's name
+			nodeRef.node = msg->GetInt64(opcode == B_ENTRY_CREATED
+				? "directory" : "to directory", -1);
+			std::map<node_ref, BString>::iterator found = fFolders.find(nodeRef);
+			const char* name = msg->GetString("name", NULL);
+			if (found == fFolders.end() || name == NULL)
+				break;
+
+			BPath path(found->second.String(), name);
+			if (fPaths.HasString(path.Path()))
+				_Changed(path.Path());
+			break;
+		}
+	}
+}
+
+
+void
+SampleWatcher::_Changed(const BString& path)
+{
+	// every change puts it off again, the check after the last one decodes
+	bigtime_t now = system_time();
+	bigtime_t settled = fSchedule.Changed(path.String(), now);
+
+	BMessage message(SAMPLE_WATCH_SETTLED);
+	BMessageRunner::StartSending(BMessenger(this), &message, settled - now, 1);
+}
+
+
+void
+SampleWatcher::_ReloadSettled()
+{
+	std::vector<std::string> settled;
+	fSchedule.TakeSettled(system_time(), settled);
+	for (size_t i = 0; i < settled.size(); i++)
+		_Reload(settled[i].c_str());
+}
+
+
+void
+SampleWatcher::_Reload(const BString& path)
+{
+	// a file replaced by another one is another node now
+	std::map<node_ref, BString>::iterator it = fFiles.begin();
+	while (it != fFiles.end()) {
+		if (it->second == path) {
+			watch_node(&it->first, B_STOP_WATCHING, this);
+			fFiles.erase(it++);
+		} else
+			it++;
+	}
+	_Watch(path);
+
+	// the changed file has another identity, so the cache decodes it anew,
+	// next to the old version that may still be playing
+	Sample* sample = fCache->Get(path.String());
+	if (sample->InitCheck() != B_OK) {
+		// e.g. removed, or not written completely, a later change tries again
+		sample->ReleaseReference();
+		return;
+	}
+	if (!sample->HasLoudness())
+		sample->MeasureLoudness();
+
+	BMessage message(SAMPLE_RELOADED);
+	message.AddPointer("sample", sample);
+	if (fTarget.SendMessage(&message) != B_OK)
+		sample->ReleaseReference();
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SAMPLE_WATCHER_H
+#define SAMPLE_WATCHER_H
+
+#include <Looper.h>
+#include <Messenger.h>
+#include <Node.h>
+#include <String.h>
+#include <StringList.h>
+
+#include "ReloadSchedule.h"
+
+#include <map>
+
+class SampleCache;
+
+
+// Watches the files of the samples on the pads, e.g. while they are edited
+// in another application. A changed file is decoded anew through the cache
+// once it has been left alone for a moment, so a burst of saves is decoded
+// only once. The new version is sent to the target as SAMPLE_RELOADED,
+// the message takes over the reference to it.
+//
+// Saving to a new file that replaces the old one is noticed in the folder,
+// as the watched node itself is just removed then.
+
+class SampleWatcher : public BLooper {
+public:
+					SampleWatcher(BMessenger target, SampleCache* cache);
+	virtual			~SampleWatcher();
+
+	virtual void	MessageReceived(BMessage* msg);
+
+	// replaces the watched files with these, empty paths are left out
+	void			SetPaths(const BStringList& paths);
+
+private:
+	void			_SetPaths(const BStringList& paths);
+	void			_Watch(const BString& path);
+	void			_HandleNodeMonitor(BMessage* msg);
+	void			_Changed(const BString& path);
+	void			_ReloadSettled();
+	void			_Reload(const BString& path);
+
+	BMessenger		fTarget;
+	SampleCache*	fCache;
+
+	BStringList		fPaths;
+	std::map<node_ref, BString> fFiles;
+	std::map<node_ref, BString> fFolders;
+	ReloadSchedule	fSchedule;
+};
+
+
+#endif // SAMPLE_WATCHER_H
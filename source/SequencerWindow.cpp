@@ -0,0 +1,323 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "Constants.h"
+#include "SequencerWindow.h"
+
+#include <Catalog.h>
+#include <ControlLook.h>
+#include <LayoutBuilder.h>
+#include <Screen.h>
+#include <String.h>
+
+#include <math.h>
+#include <string.h>
+
+#undef B_TRANSLATION_CONTEXT
+#define B_TRANSLATION_CONTEXT "SequencerWindow"
+
+static const int32 kMinTempo = 40;
+static const int32 kMaxTempo = 240;
+static const uint8 kStepVelocity = 127;
+
+
+// One row of steps per pad, drag to set or clear several steps at once.
+
+class StepGrid : public BView {
+public:
+	StepGrid(AudioEngine::Pattern* pattern)
+		:
+		BView("steps", B_WILL_DRAW),
+		fPattern(pattern),
+		fPainting(false),
+		fPaintValue(0)
+	{
+		fCellSize = ceilf(be_plain_font->Size() * 1.6f);
+		fLabelWidth = ceilf(be_plain_font->StringWidth("88") + fCellSize / 2);
+		SetViewUIColor(B_PANEL_BACKGROUND_COLOR);
+	}
+
+	virtual BSize MinSize()
+	{
+		return BSize(fLabelWidth + kStepCount * fCellSize, kPadCount * fCellSize);
+	}
+
+	virtual BSize MaxSize()
+	{
+		return MinSize();
+	}
+
+	virtual void Draw(BRect updateRect)
+	{
+		rgb_color background = ui_color(B_CONTROL_BACKGROUND_COLOR);
+		rgb_color beat = tint_color(background, B_DARKEN_1_TINT);
+		rgb_color border = ui_color(B_CONTROL_BORDER_COLOR);
+		rgb_color mark = ui_color(B_CONTROL_HIGHLIGHT_COLOR);
+
+		font_height height;
+		GetFontHeight(&height);
+
+		for (int32 pad = 0; pad < kPadCount; pad++) {
+			BString label;
+			label << pad + 1;
+			SetHighUIColor(B_PANEL_TEXT_COLOR);
+			DrawString(label, BPoint(0, (pad + 1) * fCellSize - height.descent - 2));
+
+			for (int32 step = 0; step < kStepCount; step++) {
+				BRect cell = _CellFrame(pad, step);
+				if (!cell.Intersects(updateRect))
+					continue;
+
+				// every other beat is shaded, to find your way in the bar
+				SetHighColor((step / 4) % 2 == 0 ? background : beat);
+				FillRect(cell);
+				if (fPattern->steps[pad][step] > 0) {
+					SetHighColor(mark);
+					FillRect(cell.InsetByCopy(3, 3));
+				}
+				SetHighColor(border);
+				StrokeRect(cell);
+			}
+		}
+	}
+
+	virtual void MouseDown(BPoint where)
+	{
+		int32 pad;
+		int32 step;
+		if (!_CellAt(where, pad, step))
+			return;
+
+		fPainting = true;
+		fPaintValue = fPattern->steps[pad][step] > 0 ? 0 : kStepVelocity;
+		SetMouseEventMask(B_POINTER_EVENTS, B_LOCK_WINDOW_FOCUS);
+		_SetStep(pad, step);
+	}
+
+	virtual void MouseMoved(BPoint where, uint32 transit, const BMessage* dragMessage)
+	{
+		int32 pad;
+		int32 step;
+		if (fPainting && _CellAt(where, pad, step))
+			_SetStep(pad, step);
+	}
+
+	virtual void MouseUp(BPoint where)
+	{
+		fPainting = false;
+	}
+
+private:
+	BRect _CellFrame(int32 pad, int32 step) const
+	{
+		BRect cell(0, 0, fCellSize - 1, fCellSize - 1);
+		cell.OffsetTo(fLabelWidth + step * fCellSize, pad * fCellSize);
+		return cell;
+	}
+
+	bool _CellAt(BPoint where, int32& pad, int32& step) const
+	{
+		if (where.x < fLabelWidth || where.y < 0)
+			return false;
+
+		pad = (int32)(where.y / fCellSize);
+		step = (int32)((where.x - fLabelWidth) / fCellSize);
+		return pad < kPadCount && step < kStepCount;
+	}
+
+	void _SetStep(int32 pad, int32 step)
+	{
+		if (fPattern->steps[pad][step] == fPaintValue)
+			return;
+
+		fPattern->steps[pad][step] = fPaintValue;
+		Invalidate(_CellFrame(pad, step));
+		Window()->PostMessage(SEQUENCER_STEP);
+	}
+
+	AudioEngine::Pattern*	fPattern;
+	float					fCellSize;
+	float					fLabelWidth;
+	bool					fPainting;
+	uint8					fPaintValue;
+};
+
+
+// #pragma mark -
+
+
+SequencerWindow::SequencerWindow(BMessenger target, AudioEngine* engine,
+	const BMessage* settings)
+	:
+	BWindow(BRect(240, 320, 640, 520), B_TRANSLATE("Samedi: Sequencer"), B_TITLED_WINDOW,
+		B_NOT_ZOOMABLE | B_NOT_RESIZABLE | B_ASYNCHRONOUS_CONTROLS
+			| B_AUTO_UPDATE_SIZE_LIMITS),
+	fTarget(target),
+	fEngine(engine)
+{
+	const void* steps;
+	ssize_t size;
+	if (settings->FindData("sequencer steps", B_RAW_TYPE, &steps, &size) == B_OK
+		&& size == sizeof(fPattern.steps))
+		memcpy(fPattern.steps, steps, size);
+	fPattern.tempo = settings->GetFloat("sequencer tempo", fPattern.tempo);
+	fPattern.swing = settings->GetFloat("sequencer swing", fPattern.swing);
+	fPattern.syncToClock = settings->GetBool("sequencer sync", false);
+
+	fGrid = new StepGrid(&fPattern);
+
+	fTempoSlider = new BSlider("tempo", "", new BMessage(SEQUENCER_TEMPO), kMinTempo,
+		kMaxTempo, B_HORIZONTAL);
+	fTempoSlider->SetModificationMessage(new BMessage(SEQUENCER_TEMPO));
+	fTempoSlider->SetValue((int32)fPattern.tempo);
+
+	fSwingSlider = new BSlider("swing", "", new BMessage(SEQUENCER_SWING), 50, 75,
+		B_HORIZONTAL);
+	fSwingSlider->SetModificationMessage(new BMessage(SEQUENCER_SWING));
+	fSwingSlider->SetValue((int32)(fPattern.swing * 100 + 0.5f));
+
+	fSyncBox = new BCheckBox("sync", B_TRANSLATE("Sync to MIDI clock"),
+		new BMessage(SEQUENCER_SYNC));
+	fSyncBox->SetValue(fPattern.syncToClock ? B_CONTROL_ON : B_CONTROL_OFF);
+
+	fPlayButton = new BButton("play", B_TRANSLATE("Play"), new BMessage(SEQUENCER_PLAY));
+	fPlayButton->SetBehavior(BButton::B_TOGGLE_BEHAVIOR);
+
+	BButton* renderButton = new BButton("render",
+		B_TRANSLATE("Render to file" B_UTF8_ELLIPSIS), new BMessage(RENDER_PATTERN));
+	renderButton->SetTarget(fTarget);
+
+	BLayoutBuilder::Group<>(this, B_VERTICAL)
+		.SetInsets(B_USE_WINDOW_SPACING)
+		.Add(fGrid)
+		.Add(fTempoSlider)
+		.Add(fSwingSlider)
+		.AddGroup(B_HORIZONTAL)
+			.Add(fSyncBox)
+			.AddGlue()
+			.Add(renderButton)
+			.Add(fPlayButton)
+		.End()
+	.End();
+
+	BRect frame;
+	if (settings->FindRect("sequencer frame", &frame) == B_OK
+		&& frame.Intersects(BScreen(this).Frame()))
+		MoveTo(frame.LeftTop());
+
+	_UpdateLabels();
+	_SendPattern();
+}
+
+
+bool
+SequencerWindow::QuitRequested()
+{
+	// the main window quits this one when it goes
+	if (!fTarget.IsValid())
+		return true;
+
+	Hide();
+	return false;
+}
+
+
+void
+SequencerWindow::MessageReceived(BMessage* msg)
+{
+	switch (msg->what) {
+		case SEQUENCER_STEP:
+		{
+			_SendPattern();
+			break;
+		}
+		case SEQUENCER_TEMPO:
+		{
+			fPattern.tempo = fTempoSlider->Value();
+			_UpdateLabels();
+			_SendPattern();
+			break;
+		}
+		case SEQUENCER_SWING:
+		{
+			fPattern.swing = fSwingSlider->Value() / 100.0f;
+			_UpdateLabels();
+			_SendPattern();
+			break;
+		}
+		case SEQUENCER_SYNC:
+		{
+			fPattern.syncToClock = fSyncBox->Value() == B_CONTROL_ON;
+			fTempoSlider->SetEnabled(!fPattern.syncToClock);
+			_SendPattern();
+			break;
+		}
+		case SEQUENCER_RESEND:
+		{
+			// to an engine that has nothing yet
+			_SendPattern();
+			if (fPlayButton->Value() == B_CONTROL_ON)
+				fEngine->StartSequencer();
+			break;
+		}
+		case SEQUENCER_PLAY:
+		{
+			if (fPlayButton->Value() == B_CONTROL_ON)
+				fEngine->StartSequencer();
+			else
+				fEngine->StopSequencer();
+			break;
+		}
+		default:
+		{
+			BWindow::MessageReceived(msg);
+			break;
+		}
+	}
+}
+
+
+void
+SequencerWindow::SaveSettings(BMessage* settings)
+{
+	settings->AddData("sequencer steps", B_RAW_TYPE, fPattern.steps,
+		sizeof(fPattern.steps));
+	settings->AddFloat("sequencer tempo", fPattern.tempo);
+	settings->AddFloat("sequencer swing", fPattern.swing);
+	settings->AddBool("sequencer sync", fPattern.syncToClock);
+	settings->AddRect("sequencer frame", Frame());
+}
+
+
+// #pragma mark -
+
+
+void
+SequencerWindow::_SendPattern()
+{
+	fEngine->SetPattern(new AudioEngine::Pattern(fPattern));
+}
+
+
+void
+SequencerWindow::_UpdateLabels()
+{
+	BString label(B_TRANSLATE("Tempo: %tempo% BPM"));
+	BString number;
+	number << (int32)fPattern.tempo;
+	label.ReplaceFirst("%tempo%", number);
+	fTempoSlider->SetLabel(label);
+
+	label = B_TRANSLATE("Swing: %swing%%");
+	number.SetToFormat("%d", (int)(fPattern.swing * 100 + 0.5f));
+	label.ReplaceFirst("%swing%", number);
+	fSwingSlider->SetLabel(label);
+
+	fTempoSlider->SetEnabled(!fPattern.syncToClock);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SEQUENCER_WINDOW_H
+#define SEQUENCER_WINDOW_H
+
+#include "AudioEngine.h"
+
+#include <Button.h>
+#include <CheckBox.h>
+#include <Messenger.h>
+#include <Slider.h>
+#include <Window.h>
+
+class StepGrid;
+
+
+// Edits the step pattern. Every change is handed to the engine as a new
+// pattern, the sequencer itself runs on the audio thread. Closing the
+// window only hides it.
+
+class SequencerWindow : public BWindow {
+public:
+					SequencerWindow(BMessenger target, AudioEngine* engine,
+						const BMessage* settings);
+
+	virtual bool	QuitRequested();
+	virtual void	MessageReceived(BMessage* msg);
+
+	const AudioEngine::Pattern&	Pattern() const { return fPattern; };
+	void			SaveSettings(BMessage* settings);
+
+private:
+	void			_SendPattern();
+	void			_UpdateLabels();
+
+	BMessenger		fTarget;
+	AudioEngine*	fEngine;
+	AudioEngine::Pattern	fPattern;
+
+	StepGrid*		fGrid;
+	BSlider*		fTempoSlider;
+	BSlider*		fSwingSlider;
+	BCheckBox*		fSyncBox;
+	BButton*		fPlayButton;
+};
+
+
+#endif // SEQUENCER_WINDOW_H
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "AudioEngine.h"
+#include "Constants.h"
+#include "Setlist.h"
+
+#include <Message.h>
+
+#include <set>
+
+
+Setlist::Setlist(BMessenger target, AudioEngine* engine, SampleCache* cache,
+	SampleLibrary* library)
+	:
+	fTarget(target),
+	fEngine(engine),
+	fCache(cache),
+	fLibrary(library),
+	fCurrent(-1),
+	fResident(false),
+	fPreloadThread(-1)
+{
+}
+
+
+Setlist::~Setlist()
+{
+	if (fPreloadThread >= 0) {
+		status_t result;
+		wait_for_thread(fPreloadThread, &result);
+	}
+}
+
+
+void
+Setlist::SetPaths(const BStringList& paths)
+{
+	fPaths = paths;
+	fCurrent = -1;
+	fResidentEnsembles.clear();
+	_PreloadNext();
+}
+
+
+void
+Setlist::Add(const char* path)
+{
+	fPaths.Add(path);
+	_PreloadNext();
+}
+
+
+void
+Setlist::MakeEmpty()
+{
+	fPaths.MakeEmpty();
+	fCurrent = -1;
+	fResidentEnsembles.clear();
+	fPreloaded.Unset();
+}
+
+
+void
+Setlist::SetCurrentIndex(int32 index)
+{
+	fCurrent = index;
+	_PreloadNext();
+}
+
+
+void
+Setlist::SetResident(bool resident)
+{
+	if (resident == fResident)
+		return;
+
+	fResident = resident;
+	fResidentEnsembles.clear();
+	fPreloaded.Unset();
+	_PreloadNext();
+}
+
+
+Ensemble*
+Setlist::ResidentAt(int32 index) const
+{
+	if (index < 0 || index >= (int32)fResidentEnsembles.size())
+		return NULL;
+
+	Ensemble* ensemble = fResidentEnsembles[index].Get();
+	if (ensemble == NULL || ensemble->InitCheck() != B_OK)
+		return NULL;
+
+	return ensemble;
+}
+
+
+void
+Setlist::GetResidentMemory(int32& count, size_t& size, size_t& shared) const
+{
+	// samples shared between ensembles are only in memory once
+	std::set<Sample*> samples;
+	size_t total = 0;
+	count = 0;
+	size = 0;
+
+	for (int32 i = 0; i < (int32)fResidentEnsembles.size(); i++) {
+		Ensemble* ensemble = ResidentAt(i);
+		if (ensemble == NULL)
+			continue;
+
+		count++;
+		for (int32 pad = 0; pad < kPadCount; pad++) {
+			Sample* sample = ensemble->SampleAt(pad);
+			if (sample == NULL || sample->InitCheck() != B_OK)
+				continue;
+
+			total += sample->Size();
+			if (samples.insert(sample).second)
+				size += sample->Size();
+		}
+	}
+	shared = total - size;
+}
+
+
+Ensemble*
+Setlist::TakePreloaded(int32 index)
+{
+	if (fPreloaded.Get() == NULL || index < 0 || index >= CountEntries()
+		|| fPaths.StringAt(index) != fPreloadedPath)
+		return NULL;
+
+	return fPreloaded.Detach();
+}
+
+
+int32
+Setlist::PreloadFinished(BMessage* message)
+{
+	Ensemble* ensemble;
+	if (message->FindPointer("ensemble", (void**)&ensemble) != B_OK)
+		return -1;
+
+	BReference<Ensemble> reference(ensemble, true);
+	int32 index = message->GetInt32("index", -1);
+	BString path = message->GetString("path", "");
+
+	status_t result;
+	wait_for_thread(fPreloadThread, &result);
+	fPreloadThread = -1;
+
+	// the setlist may have changed in the meantime
+	bool valid = index >= 0 && index < CountEntries() && fPaths.StringAt(index) == path;
+	int32 resident = -1;
+	if (valid && fResident && index < (int32)fResidentEnsembles.size()) {
+		fResidentEnsembles[index] = reference;
+		if (ensemble->InitCheck() == B_OK)
+			resident = index;
+	} else if (valid) {
+		fPreloaded = reference;
+		fPreloadedPath = path;
+	}
+
+	_PreloadNext();
+	return resident;
+}
+
+
+// #pragma mark -
+
+
+int32
+Setlist::_NextToLoad() const
+{
+	int32 next = fCurrent + 1;
+	int32 count = CountEntries();
+
+	if (fResident) {
+		// the next one first, then the rest in order
+		if (next < (int32)fResidentEnsembles.size()
+			&& fResidentEnsembles[next].Get() == NULL)
+			return next;
+		for (int32 i = 0; i < (int32)fResidentEnsembles.size(); i++) {
+			if (fResidentEnsembles[i].Get() == NULL)
+				return i;
+		}
+		if (next < (int32)fResidentEnsembles.size())
+			return -1;
+	}
+
+	if (next >= count)
+		return -1;
+	if (fPreloaded.Get() != NULL && fPaths.StringAt(next) == fPreloadedPath)
+		return -1;
+
+	return next;
+}
+
+
+void
+Setlist::_PreloadNext()
+{
+	// a running preload picks up the right entry when it's done
+	if (fPreloadThread >= 0)
+		return;
+
+	if (fResident) {
+		int32 size = CountEntries() < kMaxResidentKits ? CountEntries() : kMaxResidentKits;
+		fResidentEnsembles.resize(size);
+	}
+
+	int32 index = _NextToLoad();
+	if (index < 0)
+		return;
+
+	// don't hold on to a stale ensemble while loading the next one
+	fPreloaded.Unset();
+
+	BString path = fPaths.StringAt(index);
+	entry_ref ref;
+	if (get_ref_for_path(path.String(), &ref) != B_OK) {
+		// a resident entry that isn't there stays unloaded, so it isn't
+		// picked again and the ones after it still load
+		if (fResident) {
+			fResidentEnsembles[index].SetTo(new Ensemble(ref), true);
+			_PreloadNext();
+		}
+		return;
+	}
+
+	PreloadJob* job = new PreloadJob;
+	job->setlist = this;
+	job->ensemble = new Ensemble(ref);
+	job->index = index;
+	job->path = path;
+
+	fPreloadThread = spawn_thread(_PreloadThread, "samedi preloader", B_LOW_PRIORITY,
+		job);
+	if (fPreloadThread < 0) {
+		job->ensemble->ReleaseReference();
+		delete job;
+		return;
+	}
+	resume_thread(fPreloadThread);
+}
+
+
+/*static*/ status_t
+Setlist::_PreloadThread(void* data)
+{
+	PreloadJob* job = (PreloadJob*)data;
+	Setlist* setlist = job->setlist;
+	Ensemble* ensemble = job->ensemble;
+
+	ensemble->Load(setlist->fEngine, setlist->fCache, setlist->fLibrary);
+
+	// the message takes over the reference
+	BMessage message(SETLIST_PRELOADED);
+	message.AddPointer("ensemble", ensemble);
+	message.AddInt32("index", job->index);
+	message.AddString("path", job->path);
+	if (setlist->fTarget.SendMessage(&message) != B_OK)
+		ensemble->ReleaseReference();
+
+	delete job;
+	return B_OK;
+}
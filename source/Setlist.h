@@ -0,0 +1,90 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef SETLIST_H
+#define SETLIST_H
+
+#include "Ensemble.h"
+
+#include <Messenger.h>
+#include <OS.h>
+#include <String.h>
+#include <StringList.h>
+
+#include <vector>
+
+class AudioEngine;
+class SampleCache;
+class SampleLibrary;
+
+
+// An ordered list of ensembles, e.g. one per song of a gig. While one
+// ensemble plays, the next one is loaded on a background thread, so
+// switching to it is instant. The finished ensemble is sent to the target
+// as SETLIST_PRELOADED and has to be passed to PreloadFinished().
+//
+// A resident setlist loads all its ensembles and keeps them in memory, so
+// they can be handed to the engine and selected by MIDI program changes.
+
+class Setlist {
+public:
+					Setlist(BMessenger target, AudioEngine* engine,
+						SampleCache* cache, SampleLibrary* library);
+					~Setlist();
+
+	void			SetPaths(const BStringList& paths);
+	const BStringList&	Paths() const { return fPaths; };
+	int32			CountEntries() const { return fPaths.CountStrings(); };
+	BString			EntryAt(int32 index) const { return fPaths.StringAt(index); };
+	int32			IndexOf(const char* path) const { return fPaths.IndexOf(path); };
+
+	void			Add(const char* path);
+	void			MakeEmpty();
+
+	int32			CurrentIndex() const { return fCurrent; };
+	void			SetCurrentIndex(int32 index);
+
+	void			SetResident(bool resident);
+	bool			IsResident() const { return fResident; };
+	Ensemble*		ResidentAt(int32 index) const;
+	void			GetResidentMemory(int32& count, size_t& size,
+						size_t& shared) const;
+
+	Ensemble*		TakePreloaded(int32 index);
+	int32			PreloadFinished(BMessage* message);
+
+private:
+	struct PreloadJob {
+		Setlist*	setlist;
+		Ensemble*	ensemble;
+		int32		index;
+		BString		path;
+	};
+
+	int32			_NextToLoad() const;
+	void			_PreloadNext();
+	static status_t	_PreloadThread(void* data);
+
+	BMessenger		fTarget;
+	AudioEngine*	fEngine;
+	SampleCache*	fCache;
+	SampleLibrary*	fLibrary;
+
+	BStringList		fPaths;
+	int32			fCurrent;
+
+	bool			fResident;
+	std::vector<BReference<Ensemble> > fResidentEnsembles;
+
+	BReference<Ensemble> fPreloaded;
+	BString			fPreloadedPath;
+	thread_id		fPreloadThread;
+};
+
+
+#endif // SETLIST_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "VoiceLanes.h"
+
+#include <string.h>
+
+
+// GCC's generic vectors, an SSE register on x86, NEON on ARM, and plain
+// floats where there are no vector registers
+typedef float LaneVector __attribute__((vector_size(kLaneWidth * sizeof(float))));
+
+
+static inline LaneVector
+load_lanes(const float* lanes)
+{
+	LaneVector vector;
+	memcpy(&vector, lanes, sizeof(vector));
+	return vector;
+}
+
+
+static inline void
+store_lanes(float* lanes, LaneVector vector)
+{
+	memcpy(lanes, &vector, sizeof(vector));
+}
+
+
+void
+process_lanes(VoiceLanes& lanes, int32_t frameCount, int32_t laneCount)
+{
+	// One vector of lanes at a time, through all frames, so its filter and
+	// envelope state stays in registers. Left to itself, the compiler
+	// vectorized the loops over all lanes only partly, and they were slower
+	// than processing the voices one by one.
+	for (int32_t first = 0; first < laneCount; first += kLaneWidth) {
+		LaneVector b0 = load_lanes(lanes.b0 + first);
+		LaneVector b1 = load_lanes(lanes.b1 + first);
+		LaneVector b2 = load_lanes(lanes.b2 + first);
+		LaneVector a1 = load_lanes(lanes.a1 + first);
+		LaneVector a2 = load_lanes(lanes.a2 + first);
+		LaneVector envelope = load_lanes(lanes.envelope + first);
+		LaneVector multiply = load_lanes(lanes.multiply + first);
+		LaneVector add = load_lanes(lanes.add + first);
+		LaneVector full = envelope * 0.0f + 1.0f;
+
+		LaneVector z1[kEngineChannels];
+		LaneVector z2[kEngineChannels];
+		for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+			z1[channel] = load_lanes(lanes.z1[channel] + first);
+			z2[channel] = load_lanes(lanes.z2[channel] + first);
+		}
+
+		for (int32_t frame = 0; frame < frameCount; frame++) {
+			envelope = envelope * multiply + add;
+			envelope = envelope < full ? envelope : full;
+			for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+				float* input = lanes.input[channel][frame] + first;
+				LaneVector x = load_lanes(input);
+				LaneVector y = b0 * x + z1[channel];
+				z1[channel] = b1 * x - a1 * y + z2[channel];
+				z2[channel] = b2 * x - a2 * y;
+				store_lanes(input, y * envelope);
+			}
+		}
+
+		store_lanes(lanes.envelope + first, envelope);
+		for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+			store_lanes(lanes.z1[channel] + first, z1[channel]);
+			store_lanes(lanes.z2[channel] + first, z2[channel]);
+		}
+	}
+}
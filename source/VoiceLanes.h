@@ -0,0 +1,45 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef VOICE_LANES_H
+#define VOICE_LANES_H
+
+#include "Constants.h"
+
+#include <stdint.h>
+
+
+// The voices with a filter or an envelope, one lane per voice: each step of
+// the filter and the envelope is one vector operation on kLaneWidth voices,
+// with no branches and no dependencies between them.
+//
+// Portable (no Haiku API), so it can be benchmarked on other systems.
+
+static const int kMaxLanes = 64;		// one for each voice of the engine
+static const int kLaneFrames = 32;		// processed at a time
+static const int kLaneWidth = 4;		// voices in one SSE or NEON register
+
+struct VoiceLanes {
+	alignas(32) float	input[kEngineChannels][kLaneFrames][kMaxLanes];
+	alignas(32) float	b0[kMaxLanes];
+	alignas(32) float	b1[kMaxLanes];
+	alignas(32) float	b2[kMaxLanes];
+	alignas(32) float	a1[kMaxLanes];
+	alignas(32) float	a2[kMaxLanes];
+	alignas(32) float	z1[kEngineChannels][kMaxLanes];
+	alignas(32) float	z2[kEngineChannels][kMaxLanes];
+	alignas(32) float	envelope[kMaxLanes];
+	alignas(32) float	multiply[kMaxLanes];
+	alignas(32) float	add[kMaxLanes];
+};
+
+// the input is replaced by the output, laneCount is a multiple of kLaneWidth
+void	process_lanes(VoiceLanes& lanes, int32_t frameCount, int32_t laneCount);
+
+
+#endif // VOICE_LANES_H
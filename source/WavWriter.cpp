@@ -0,0 +1,145 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "WavWriter.h"
+
+#include <string.h>
+
+
+static const size_t kHeaderSize = 58;
+static const uint16_t kFormatFloat = 3;		// WAVE_FORMAT_IEEE_FLOAT
+static const size_t kWriteBufferFrames = 1024;
+
+
+static inline void
+put16(uint8_t* p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+
+static inline void
+put32(uint8_t* p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+
+WavWriter::WavWriter()
+	:
+	fFile(NULL),
+	fChannels(0),
+	fFrameCount(0),
+	fFailed(false)
+{
+}
+
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+
+bool
+WavWriter::Open(const char* path, uint16_t channels, uint32_t frameRate)
+{
+	Close();
+
+	fFile = fopen(path, "wb");
+	if (fFile == NULL)
+		return false;
+
+	fChannels = channels;
+	fFrameCount = 0;
+	fFailed = false;
+
+	// RIFF header, "fmt " with the extension size as float formats need it,
+	// and "fact"; the sizes are patched in by Close()
+	uint8_t header[kHeaderSize];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "RIFF", 4);
+	memcpy(header + 8, "WAVE", 4);
+	memcpy(header + 12, "fmt ", 4);
+	put32(header + 16, 18);
+	put16(header + 20, kFormatFloat);
+	put16(header + 22, channels);
+	put32(header + 24, frameRate);
+	put32(header + 28, frameRate * channels * sizeof(float));
+	put16(header + 32, channels * sizeof(float));
+	put16(header + 34, 32);
+	put16(header + 36, 0);
+	memcpy(header + 38, "fact", 4);
+	put32(header + 42, 4);
+	memcpy(header + 50, "data", 4);
+
+	if (fwrite(header, 1, sizeof(header), fFile) != sizeof(header)) {
+		fclose(fFile);
+		fFile = NULL;
+		return false;
+	}
+	return true;
+}
+
+
+bool
+WavWriter::Write(const float* frames, size_t frameCount)
+{
+	if (fFile == NULL || fFailed)
+		return false;
+
+	uint8_t buffer[kWriteBufferFrames * 4 * sizeof(float)];
+	size_t framesPerBuffer = sizeof(buffer) / (fChannels * sizeof(float));
+	while (frameCount > 0) {
+		size_t count = frameCount < framesPerBuffer ? frameCount : framesPerBuffer;
+		size_t samples = count * fChannels;
+		for (size_t i = 0; i < samples; i++) {
+			uint32_t bits;
+			memcpy(&bits, frames + i, sizeof(bits));
+			put32(buffer + i * sizeof(float), bits);
+		}
+		if (fwrite(buffer, sizeof(float), samples, fFile) != samples) {
+			fFailed = true;
+			return false;
+		}
+
+		frames += samples;
+		frameCount -= count;
+		fFrameCount += count;
+	}
+	return true;
+}
+
+
+bool
+WavWriter::Close()
+{
+	if (fFile == NULL)
+		return false;
+
+	uint64_t dataSize = fFrameCount * fChannels * sizeof(float);
+	bool ok = !fFailed && dataSize + kHeaderSize - 8 <= UINT32_MAX;
+	if (ok) {
+		uint8_t size[4];
+		put32(size, dataSize + kHeaderSize - 8);
+		ok = fseek(fFile, 4, SEEK_SET) == 0 && fwrite(size, 1, 4, fFile) == 4;
+		put32(size, fFrameCount);
+		ok = ok && fseek(fFile, 46, SEEK_SET) == 0 && fwrite(size, 1, 4, fFile) == 4;
+		put32(size, dataSize);
+		ok = ok && fseek(fFile, 54, SEEK_SET) == 0 && fwrite(size, 1, 4, fFile) == 4;
+	}
+
+	ok = fclose(fFile) == 0 && ok;
+	fFile = NULL;
+	return ok;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// Writes interleaved float frames to a 32 bit float WAV file, e.g. what the
+// engine rendered offline. The sizes in the header are filled in by Close().
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+class WavWriter {
+public:
+					WavWriter();
+					~WavWriter();
+
+	bool			Open(const char* path, uint16_t channels, uint32_t frameRate);
+	bool			Write(const float* frames, size_t frameCount);
+	bool			Close();
+
+	uint64_t		FrameCount() const { return fFrameCount; }
+
+private:
+	FILE*			fFile;
+	uint16_t		fChannels;
+	uint64_t		fFrameCount;
+	bool			fFailed;
+};
+
+
+#endif // WAV_WRITER_H
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "WaveformPeaks.h"
+
+#include <math.h>
+
+
+static const int64_t kBlockFrames = 64;	// of the lowest level
+static const float kScale = 127.0f;
+
+
+static inline int8_t
+quantize(float value, bool up)
+{
+	// rounded outwards, so a peak is never drawn smaller than it is
+	float scaled = up ? ceilf(value * kScale) : floorf(value * kScale);
+	if (scaled > kScale)
+		return (int8_t)kScale;
+	if (scaled < -kScale)
+		return (int8_t)-kScale;
+	return (int8_t)scaled;
+}
+
+
+WaveformPeaks::WaveformPeaks()
+	:
+	fData(NULL),
+	fFrameCount(0),
+	fChannels(0)
+{
+}
+
+
+void
+WaveformPeaks::Build(const float* data, int64_t frameCount, int32_t channels)
+{
+	MakeEmpty();
+	if (data == NULL || frameCount <= 0 || channels <= 0)
+		return;
+
+	fData = data;
+	fFrameCount = frameCount;
+	fChannels = channels;
+
+	// the lowest level from the frames, each one above from the one below
+	std::vector<Peak> level((frameCount + kBlockFrames - 1) / kBlockFrames);
+	for (size_t block = 0; block < level.size(); block++) {
+		int64_t start = block * kBlockFrames;
+		int64_t end = start + kBlockFrames < frameCount ? start + kBlockFrames : frameCount;
+		float minimum = data[start * channels];
+		float maximum = minimum;
+		for (int64_t i = start * channels; i < end * channels; i++) {
+			minimum = data[i] < minimum ? data[i] : minimum;
+			maximum = data[i] > maximum ? data[i] : maximum;
+		}
+		level[block].minimum = quantize(minimum, false);
+		level[block].maximum = quantize(maximum, true);
+	}
+	fLevels.push_back(level);
+
+	while (fLevels.back().size() > 1) {
+		const std::vector<Peak>& below = fLevels.back();
+		std::vector<Peak> above((below.size() + 1) / 2);
+		for (size_t i = 0; i < above.size(); i++) {
+			Peak peak = below[i * 2];
+			if (i * 2 + 1 < below.size()) {
+				const Peak& next = below[i * 2 + 1];
+				peak.minimum = next.minimum < peak.minimum ? next.minimum : peak.minimum;
+				peak.maximum = next.maximum > peak.maximum ? next.maximum : peak.maximum;
+			}
+			above[i] = peak;
+		}
+		fLevels.push_back(above);
+	}
+}
+
+
+void
+WaveformPeaks::MakeEmpty()
+{
+	fLevels.clear();
+	fData = NULL;
+	fFrameCount = 0;
+	fChannels = 0;
+}
+
+
+size_t
+WaveformPeaks::Size() const
+{
+	size_t size = 0;
+	for (size_t i = 0; i < fLevels.size(); i++)
+		size += fLevels[i].size() * sizeof(Peak);
+	return size;
+}
+
+
+void
+WaveformPeaks::GetRange(int64_t start, int64_t end, float& minimum, float& maximum) const
+{
+	minimum = 0.0f;
+	maximum = 0.0f;
+	if (start < 0)
+		start = 0;
+	if (end > fFrameCount)
+		end = fFrameCount;
+	if (start >= end)
+		return;
+
+	// short ranges straight from the frames, that's at most a few blocks
+	if (end - start < kBlockFrames * 2 && fData != NULL) {
+		minimum = maximum = fData[start * fChannels];
+		for (int64_t i = start * fChannels; i < end * fChannels; i++) {
+			minimum = fData[i] < minimum ? fData[i] : minimum;
+			maximum = fData[i] > maximum ? fData[i] : maximum;
+		}
+		return;
+	}
+
+	// the coarsest level with at least two blocks in the range
+	size_t level = 0;
+	int64_t blockFrames = kBlockFrames;
+	while (level + 1 < fLevels.size() && blockFrames * 4 <= end - start) {
+		level++;
+		blockFrames *= 2;
+	}
+
+	const std::vector<Peak>& peaks = fLevels[level];
+	int8_t low = peaks[start / blockFrames].minimum;
+	int8_t high = peaks[start / blockFrames].maximum;
+	for (int64_t block = start / blockFrames + 1; block <= (end - 1) / blockFrames; block++) {
+		low = peaks[block].minimum < low ? peaks[block].minimum : low;
+		high = peaks[block].maximum > high ? peaks[block].maximum : high;
+	}
+	minimum = low / kScale;
+	maximum = high / kScale;
+}
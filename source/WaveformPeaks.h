@@ -0,0 +1,54 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef WAVEFORM_PEAKS_H
+#define WAVEFORM_PEAKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+// The minimum and maximum of a sample over blocks of frames, each level
+// of blocks twice as long as the one below. Any range of frames is then
+// covered by a few blocks of the right level, so drawing a waveform costs
+// the same for a short hit and a long loop.
+//
+// Portable (no Haiku API), so it can be used and tested on other systems.
+
+class WaveformPeaks {
+public:
+					WaveformPeaks();
+
+	void			Build(const float* data, int64_t frameCount, int32_t channels);
+	void			MakeEmpty();
+	// once the frames are gone, short ranges come from the finest blocks
+	void			DropFrames() { fData = NULL; }
+
+	int64_t			FrameCount() const { return fFrameCount; }
+	size_t			Size() const;
+
+	// over all channels, in -1..1
+	void			GetRange(int64_t start, int64_t end, float& minimum,
+						float& maximum) const;
+
+private:
+	struct Peak {
+		int8_t		minimum;
+		int8_t		maximum;
+	};
+
+	std::vector<std::vector<Peak> > fLevels;
+	const float*	fData;
+	int64_t			fFrameCount;
+	int32_t			fChannels;
+};
+
+
+#endif // WAVEFORM_PEAKS_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+#include "WaveformView.h"
+
+#include <ControlLook.h>
+
+#include <math.h>
+
+
+WaveformView::WaveformView(const char* name)
+	:
+	BView(name, B_WILL_DRAW | B_FRAME_EVENTS),
+	fPlayhead(-1.0f),
+	fTrimStart(0),
+	fTrimEnd(0)
+{
+	SetViewColor(B_TRANSPARENT_COLOR);
+
+	float height = be_control_look->DefaultLabelSpacing();
+	SetExplicitMinSize(BSize(height * 12, B_SIZE_UNSET));
+	SetExplicitMaxSize(BSize(height * 12, B_SIZE_UNLIMITED));
+}
+
+
+void
+WaveformView::Draw(BRect updateRect)
+{
+	BRect bounds = Bounds();
+	rgb_color base = ui_color(B_PANEL_BACKGROUND_COLOR);
+	SetHighColor(tint_color(base, B_DARKEN_1_TINT));
+	FillRect(updateRect & bounds);
+
+	// only the columns that need it
+	float middle = (bounds.top + bounds.bottom) / 2;
+	float scale = (bounds.Height() - 2) / 2;
+	int32 first = (int32)floorf(updateRect.left - bounds.left);
+	int32 last = (int32)ceilf(updateRect.right - bounds.left);
+	if (first < 0)
+		first = 0;
+	if (last >= (int32)fMinimums.size())
+		last = (int32)fMinimums.size() - 1;
+
+	rgb_color color = tint_color(ui_color(B_CONTROL_HIGHLIGHT_COLOR), B_DARKEN_1_TINT);
+	rgb_color trimmedColor = tint_color(base, B_DARKEN_2_TINT);
+	int32 width = (int32)fMinimums.size();
+	int64 frameCount = fSample.Get() != NULL ? fSample->FrameCount() : 0;
+	BeginLineArray(last - first + 1 > 0 ? last - first + 1 : 0);
+	for (int32 x = first; x <= last; x++) {
+		BPoint top(bounds.left + x, roundf(middle - fMaximums[x] * scale));
+		BPoint bottom(bounds.left + x, roundf(middle - fMinimums[x] * scale));
+		int64 frame = frameCount * x / width;
+		bool trimmed = fTrimEnd > 0 && (frame < fTrimStart || frame >= fTrimEnd);
+		AddLine(top, bottom, trimmed ? trimmedColor : color);
+	}
+	EndLineArray();
+
+	if (fPlayhead >= 0.0f) {
+		float x = _PlayheadX(fPlayhead);
+		if (x >= updateRect.left && x <= updateRect.right) {
+			SetHighColor(ui_color(B_CONTROL_MARK_COLOR));
+			StrokeLine(BPoint(x, bounds.top), BPoint(x, bounds.bottom));
+		}
+	}
+}
+
+
+void
+WaveformView::FrameResized(float width, float height)
+{
+	_UpdateColumns();
+	Invalidate();
+}
+
+
+void
+WaveformView::SetSample(Sample* sample)
+{
+	if (sample == fSample.Get())
+		return;
+
+	fSample.SetTo(sample);
+	fPlayhead = -1.0f;
+	_UpdateColumns();
+	Invalidate();
+}
+
+
+void
+WaveformView::SetPlayhead(float position)
+{
+	float oldX = _PlayheadX(fPlayhead);
+	float newX = _PlayheadX(position);
+	if (roundf(oldX) == roundf(newX) && (fPlayhead < 0.0f) == (position < 0.0f))
+		return;
+
+	float oldPlayhead = fPlayhead;
+	fPlayhead = position;
+
+	BRect bounds = Bounds();
+	if (oldPlayhead >= 0.0f)
+		Invalidate(BRect(oldX - 1, bounds.top, oldX + 1, bounds.bottom));
+	if (position >= 0.0f)
+		Invalidate(BRect(newX - 1, bounds.top, newX + 1, bounds.bottom));
+}
+
+
+void
+WaveformView::SetTrim(int64 start, int64 end)
+{
+	if (start == fTrimStart && end == fTrimEnd)
+		return;
+
+	fTrimStart = start;
+	fTrimEnd = end;
+	Invalidate();
+}
+
+
+// #pragma mark -
+
+
+void
+WaveformView::_UpdateColumns()
+{
+	// one range of frames per pixel column, each just a few peak lookups
+	int32 width = (int32)Bounds().Width() + 1;
+	fMinimums.assign(width, 0.0f);
+	fMaximums.assign(width, 0.0f);
+
+	Sample* sample = fSample.Get();
+	if (sample == NULL || sample->InitCheck() != B_OK)
+		return;
+
+	const WaveformPeaks& peaks = sample->Peaks();
+	int64 frameCount = peaks.FrameCount();
+	for (int32 x = 0; x < width; x++) {
+		int64 start = frameCount * x / width;
+		int64 end = frameCount * (x + 1) / width;
+		if (end <= start)
+			end = start + 1;
+		peaks.GetRange(start, end, fMinimums[x], fMaximums[x]);
+	}
+}
+
+
+float
+WaveformView::_PlayheadX(float position) const
+{
+	BRect bounds = Bounds();
+	return bounds.left + roundf(position * bounds.Width());
+}
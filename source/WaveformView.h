@@ -0,0 +1,49 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef WAVEFORM_VIEW_H
+#define WAVEFORM_VIEW_H
+
+#include "Sample.h"
+
+#include <View.h>
+
+#include <vector>
+
+
+// A thumbnail of a sample's waveform with a playhead. The columns are taken
+// from the sample's peaks whenever the sample or the width changes; moving
+// the playhead only redraws the two columns it leaves and enters. The frames
+// trimmed off are drawn faded.
+
+class WaveformView : public BView {
+public:
+					WaveformView(const char* name);
+
+	virtual void	Draw(BRect updateRect);
+	virtual void	FrameResized(float width, float height);
+
+	void			SetSample(Sample* sample);
+	void			SetPlayhead(float position);
+	// an end of 0 for none
+	void			SetTrim(int64 start, int64 end);
+
+private:
+	void			_UpdateColumns();
+	float			_PlayheadX(float position) const;
+
+	BReference<Sample>	fSample;
+	std::vector<float>	fMinimums;
+	std::vector<float>	fMaximums;
+	float			fPlayhead;
+	int64			fTrimStart;
+	int64			fTrimEnd;
+};
+
+
+#endif // WAVEFORM_VIEW_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// How fast the AudioDecoder turns a file in memory into the stereo float
+// the engine plays: a minute of 44.1 kHz audio in each layout it reads,
+// decoded a few times, the fastest one counted. Megabytes are of the file,
+// the frames as many times real time.
+
+#include "AudioDecoder.h"
+#include "AudioFiles.h"
+#include "Check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+static const int64_t kFrames = 44100 * 60;
+static const uint32_t kRate = 44100;
+static const int32_t kRounds = 5;
+
+static volatile float sSink;
+
+
+static void
+bench(const char* name, const FileData& file)
+{
+	double best = 0;
+	int64_t frameCount = 0;
+	for (int32_t round = 0; round < kRounds; round++) {
+		AudioDecoder decoder;
+		double start = check_now();
+		AudioDecoder::Result result = decoder.Decode(file.data(), file.size());
+		double elapsed = check_now() - start;
+		CHECK_EQUAL(result, AudioDecoder::kOK);
+
+		frameCount = decoder.FrameCount();
+		float* frames = decoder.DetachFrames();
+		if (frames != NULL)
+			sSink = frames[frameCount * 2 - 1];
+		free(frames);
+		if (round == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	CHECK_EQUAL(frameCount, kFrames);
+	printf("  %-24s %6.1f MB in %6.1f ms: %7.1f MB/s, %6.0fx real time\n", name,
+		file.size() / 1e6, best / 1000, file.size() / best,
+		kFrames / (best / 1e6) / kRate);
+}
+
+
+int
+main()
+{
+	printf("AudioDecoderBenchmark, %lld frames each, best of %d\n",
+		(long long)kFrames, kRounds);
+
+	std::vector<double> mono = make_signal(kFrames, 1, 1);
+	std::vector<double> stereo = make_signal(kFrames, 2, 2);
+
+	bench("WAV 16 bit stereo", make_wav(stereo, { 2, 2, false }, kRate, false));
+	bench("WAV 16 bit mono", make_wav(mono, { 1, 2, false }, kRate, false));
+	bench("WAV 24 bit stereo", make_wav(stereo, { 2, 3, false }, kRate, false));
+	bench("WAV float stereo", make_wav(stereo, { 2, 4, true }, kRate, false));
+	bench("AIFF 16 bit stereo", make_aiff(stereo, { 2, 2, false }, kRate, NULL));
+	bench("AIFF 24 bit stereo", make_aiff(stereo, { 2, 3, false }, kRate, NULL));
+
+	bench("FLAC 16 bit fixed", make_flac(stereo,
+		{ 2, 16, 4096, kFlacFixed, kFlacLeftSide }, kRate));
+	bench("FLAC 16 bit LPC", make_flac(stereo,
+		{ 2, 16, 4096, kFlacLpc, kFlacMidSide }, kRate));
+	bench("FLAC 24 bit LPC", make_flac(stereo,
+		{ 2, 24, 4096, kFlacLpc, kFlacMidSide }, kRate));
+	bench("FLAC 16 bit verbatim", make_flac(stereo,
+		{ 2, 16, 4096, kFlacVerbatim, kFlacIndependent }, kRate));
+
+	return sCheckFailures;
+}
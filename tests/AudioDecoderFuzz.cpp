@@ -0,0 +1,225 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// Feeds the AudioDecoder damaged files; built with the address and undefined
+// behaviour sanitizers by "make fuzz". The seeds are valid WAV, AIFF and
+// FLAC files of every layout the decoder reads, each checked to decode right
+// first. Then every truncation of them is decoded, and the given number of
+// random mutations: flipped bits, bytes and sizes set to the values parsers
+// trip over, ranges inserted, removed or repeated. The FLAC frames of a
+// mutated file get their checksums fixed half of the time, so the damage
+// reaches the subframe decoder instead of stopping at the CRC. Fuzz.h has
+// how a crash is kept and replayed.
+
+#include "AudioDecoder.h"
+#include "AudioFiles.h"
+#include "Check.h"
+
+#include <stdlib.h>
+
+
+struct Seed {
+	const char*		name;
+	FileData		file;
+	std::vector<FlacFrameSpan>	spans;
+	// interleaved stereo, as decoded
+	std::vector<float>	expected;
+	double			tolerance;
+	uint32_t		rate;
+};
+
+static const int64_t kSeedFrames = 700;
+static const uint32_t kRate = 44100;
+static const int32_t kDefaultRuns = 100000;
+
+static volatile float sSink;
+
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	AudioDecoder decoder;
+	AudioDecoder::Result result = decoder.Decode(data, size);
+	AudioDecoder::Fingerprint(data, size);
+
+	if (result == AudioDecoder::kOK) {
+		if (decoder.FrameCount() <= 0 || !(decoder.FrameRate() > 0.0))
+			abort();
+
+		// every frame is read, so the sanitizer sees a short buffer
+		float* frames = decoder.DetachFrames();
+		float sum = 0;
+		for (int64_t i = 0; i < decoder.FrameCount() * 2; i++)
+			sum += frames[i];
+		sSink = sum;
+		free(frames);
+	} else if (decoder.FrameCount() != 0)
+		abort();
+	return 0;
+}
+
+
+#ifndef LIBFUZZER
+
+
+#include "Fuzz.h"
+
+
+static std::vector<float>
+expected_stereo(const std::vector<double>& signal, int32_t channels, int32_t bits,
+	bool isFloat)
+{
+	std::vector<float> expected;
+	int64_t frameCount = signal.size() / channels;
+	for (int64_t frame = 0; frame < frameCount; frame++) {
+		for (int32_t channel = 0; channel < 2; channel++) {
+			double value = signal[frame * channels + (channels > 1 ? channel : 0)];
+			if (!isFloat)
+				value = quantize(value, bits) / (double)((int64_t)1 << (bits - 1));
+			expected.push_back((float)value);
+		}
+	}
+	return expected;
+}
+
+
+static void
+add_pcm_seed(std::vector<Seed>& seeds, const char* name, const PcmLayout& layout,
+	const char* container)
+{
+	std::vector<double> signal = make_signal(kSeedFrames, layout.channels, seeds.size());
+	Seed seed;
+	seed.name = name;
+	if (strcmp(container, "wav") == 0)
+		seed.file = make_wav(signal, layout, kRate, false);
+	else if (strcmp(container, "wavex") == 0)
+		seed.file = make_wav(signal, layout, kRate, true);
+	else if (strcmp(container, "aiff") == 0)
+		seed.file = make_aiff(signal, layout, kRate, NULL);
+	else
+		seed.file = make_aiff(signal, layout, kRate, container);
+	seed.expected = expected_stereo(signal, layout.channels, layout.bytes * 8,
+		layout.isFloat);
+	seed.tolerance = layout.isFloat ? 1e-6 : 1e-6 + 1.0 / (1 << (layout.bytes * 8 - 1));
+	seed.rate = kRate;
+	seeds.push_back(seed);
+}
+
+
+static void
+add_flac_seed(std::vector<Seed>& seeds, const char* name, const FlacLayout& layout)
+{
+	std::vector<double> signal = make_signal(kSeedFrames, layout.channels, seeds.size());
+	if (layout.subframe == kFlacConstant) {
+		for (size_t i = 0; i < signal.size(); i++)
+			signal[i] = i % layout.channels == 0 ? 0.25 : -0.5;
+	}
+
+	Seed seed;
+	seed.name = name;
+	seed.file = make_flac(signal, layout, kRate, &seed.spans);
+	seed.expected = expected_stereo(signal, layout.channels, layout.bits, false);
+	seed.tolerance = 1e-6;
+	seed.rate = kRate;
+	seeds.push_back(seed);
+}
+
+
+static std::vector<Seed>
+make_seeds()
+{
+	std::vector<Seed> seeds;
+	add_pcm_seed(seeds, "WAV 8 bit mono", { 1, 1, false }, "wav");
+	add_pcm_seed(seeds, "WAV 16 bit stereo", { 2, 2, false }, "wav");
+	add_pcm_seed(seeds, "WAV 24 bit 3 channels", { 3, 3, false }, "wav");
+	add_pcm_seed(seeds, "WAV 32 bit", { 2, 4, false }, "wav");
+	add_pcm_seed(seeds, "WAV float", { 2, 4, true }, "wav");
+	add_pcm_seed(seeds, "WAV double, extensible", { 1, 8, true }, "wavex");
+	add_pcm_seed(seeds, "WAV 24 bit, extensible", { 6, 3, false }, "wavex");
+	add_pcm_seed(seeds, "AIFF 16 bit", { 2, 2, false }, "aiff");
+	add_pcm_seed(seeds, "AIFF 24 bit mono", { 1, 3, false }, "aiff");
+	add_pcm_seed(seeds, "AIFC sowt", { 2, 2, false }, "sowt");
+	add_pcm_seed(seeds, "AIFC fl32", { 2, 4, true }, "fl32");
+	add_pcm_seed(seeds, "AIFC fl64", { 1, 8, true }, "fl64");
+
+	add_flac_seed(seeds, "FLAC constant", { 2, 16, 256, kFlacConstant, kFlacIndependent });
+	add_flac_seed(seeds, "FLAC verbatim 8 bit", { 1, 8, 192, kFlacVerbatim, kFlacIndependent });
+	add_flac_seed(seeds, "FLAC fixed left/side", { 2, 16, 256, kFlacFixed, kFlacLeftSide });
+	add_flac_seed(seeds, "FLAC fixed side/right", { 2, 16, 300, kFlacFixed, kFlacSideRight });
+	add_flac_seed(seeds, "FLAC LPC mid/side", { 2, 24, 256, kFlacLpc, kFlacMidSide });
+	add_flac_seed(seeds, "FLAC LPC 12 bit", { 4, 12, 128, kFlacLpc, kFlacIndependent });
+	return seeds;
+}
+
+
+static bool
+check_seed(const Seed& seed)
+{
+	AudioDecoder decoder;
+	if (decoder.Decode(seed.file.data(), seed.file.size()) != AudioDecoder::kOK) {
+		fprintf(stderr, "  %s: doesn't decode\n", seed.name);
+		return false;
+	}
+
+	int64_t frameCount = decoder.FrameCount();
+	float* frames = decoder.DetachFrames();
+	bool matches = frameCount * 2 == (int64_t)seed.expected.size()
+		&& decoder.FrameRate() == seed.rate;
+	for (int64_t i = 0; matches && i < frameCount * 2; i++)
+		matches = fabs(frames[i] - seed.expected[i]) <= seed.tolerance;
+	free(frames);
+	if (!matches)
+		fprintf(stderr, "  %s: decodes to something else\n", seed.name);
+	return matches;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+		return fuzz_replay(argv[2]);
+
+	fuzz_start(argc > 1 ? argv[1] : NULL);
+	int32_t runs = argc > 2 ? atoi(argv[2]) : kDefaultRuns;
+
+	std::vector<Seed> seeds = make_seeds();
+	for (const Seed& seed : seeds)
+		CHECK(check_seed(seed));
+
+	double start = check_now();
+
+	// every truncation
+	for (const Seed& seed : seeds) {
+		for (size_t size = 0; size < seed.file.size(); size++) {
+			FileData input(seed.file.begin(), seed.file.begin() + size);
+			fuzz_run(input);
+		}
+	}
+
+	srand(27);
+	for (int32_t iteration = 0; iteration < runs; iteration++) {
+		const Seed& seed = seeds[rand() % seeds.size()];
+		FileData input = seed.file;
+		bool inPlace = true;
+		int32_t mutations = 1 + rand() % 8;
+		for (int32_t i = 0; i < mutations; i++)
+			mutate(input, inPlace);
+		if (inPlace && !seed.spans.empty() && rand() % 2 == 0)
+			fix_flac_checksums(input, seed.spans);
+		fuzz_run(input);
+	}
+
+	printf("  %zu seeds, %lld decodes in %.1f s\n", seeds.size(), (long long)sFuzzRuns,
+		(check_now() - start) / 1e6);
+	return check_result("AudioDecoderFuzz");
+}
+
+
+#endif // LIBFUZZER
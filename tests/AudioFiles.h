@@ -0,0 +1,507 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef AUDIO_FILES_H
+#define AUDIO_FILES_H
+
+// Writes the WAV, AIFF and FLAC files the AudioDecoder reads, for its fuzzer
+// and benchmark. The FLAC encoder only knows what the decoder has to: all
+// subframe types, the stereo decorrelations and Rice coded residuals, with a
+// fixed partition order and no search for the best of them.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+
+typedef std::vector<uint8_t> FileData;
+
+
+// interleaved samples between -1 and 1
+static inline std::vector<double>
+make_signal(int64_t frameCount, int32_t channels, uint32_t seed)
+{
+	std::vector<double> signal(frameCount * channels);
+	srand(seed);
+	for (int64_t frame = 0; frame < frameCount; frame++) {
+		for (int32_t channel = 0; channel < channels; channel++) {
+			// a tone per channel with some noise, like a recorded drum
+			double tone = 0.6 * sin(frame * (0.01 + channel * 0.003));
+			double noise = (rand() % 2001 - 1000) / 10000.0;
+			signal[frame * channels + channel] = tone + noise;
+		}
+	}
+	return signal;
+}
+
+
+static inline int32_t
+quantize(double value, int32_t bits)
+{
+	double scale = (double)((int64_t)1 << (bits - 1));
+	int64_t sample = (int64_t)floor(value * scale);
+	int64_t maximum = ((int64_t)1 << (bits - 1)) - 1;
+	return (int32_t)(sample > maximum ? maximum : sample < -maximum - 1 ? -maximum - 1
+		: sample);
+}
+
+
+static inline void
+put_bytes(FileData& file, uint64_t value, int32_t count, bool bigEndian)
+{
+	for (int32_t i = 0; i < count; i++) {
+		int32_t shift = bigEndian ? (count - 1 - i) * 8 : i * 8;
+		file.push_back((uint8_t)(value >> shift));
+	}
+}
+
+
+static inline void
+put_tag(FileData& file, const char* tag)
+{
+	file.insert(file.end(), tag, tag + 4);
+}
+
+
+// #pragma mark - WAV and AIFF
+
+
+struct PcmLayout {
+	int32_t		channels;
+	int32_t		bytes;
+	bool		isFloat;
+};
+
+
+static inline void
+put_pcm(FileData& file, const std::vector<double>& signal, const PcmLayout& layout,
+	bool bigEndian)
+{
+	for (double value : signal) {
+		if (layout.isFloat && layout.bytes == 4) {
+			float sample = (float)value;
+			uint32_t bits;
+			memcpy(&bits, &sample, sizeof(bits));
+			put_bytes(file, bits, 4, bigEndian);
+		} else if (layout.isFloat) {
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			put_bytes(file, bits, 8, bigEndian);
+		} else if (layout.bytes == 1) {
+			// unsigned in a WAV
+			file.push_back((uint8_t)(quantize(value, 8) + 128));
+		} else
+			put_bytes(file, (uint32_t)quantize(value, layout.bytes * 8), layout.bytes, bigEndian);
+	}
+}
+
+
+static inline FileData
+make_wav(const std::vector<double>& signal, const PcmLayout& layout, uint32_t rate,
+	bool extensible)
+{
+	FileData file;
+	put_tag(file, "RIFF");
+	put_bytes(file, 0, 4, false);
+	put_tag(file, "WAVE");
+
+	// a chunk the decoder has to skip
+	put_tag(file, "LIST");
+	put_bytes(file, 5, 4, false);
+	file.insert(file.end(), { 'I', 'N', 'F', 'O', '!', 0 });
+
+	uint32_t tag = layout.isFloat ? 3 : 1;
+	put_tag(file, "fmt ");
+	put_bytes(file, extensible ? 40 : 16, 4, false);
+	put_bytes(file, extensible ? 0xfffe : tag, 2, false);
+	put_bytes(file, layout.channels, 2, false);
+	put_bytes(file, rate, 4, false);
+	put_bytes(file, rate * layout.channels * layout.bytes, 4, false);
+	put_bytes(file, layout.channels * layout.bytes, 2, false);
+	put_bytes(file, layout.bytes * 8, 2, false);
+	if (extensible) {
+		put_bytes(file, 22, 2, false);
+		put_bytes(file, layout.bytes * 8, 2, false);
+		put_bytes(file, 0, 4, false);
+		// the GUID starts with the format tag
+		put_bytes(file, tag, 2, false);
+		file.insert(file.end(), { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+			0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 });
+	}
+
+	size_t dataSize = signal.size() * layout.bytes;
+	put_tag(file, "data");
+	put_bytes(file, dataSize, 4, false);
+	put_pcm(file, signal, layout, false);
+	if ((dataSize & 1) != 0)
+		file.push_back(0);
+
+	uint32_t riffSize = file.size() - 8;
+	memcpy(&file[4], &riffSize, 4);
+	return file;
+}
+
+
+static inline void
+put_extended(FileData& file, uint32_t rate)
+{
+	// the 80 bit float of the frame rate
+	int32_t top = 31;
+	while (top > 0 && (rate & (1u << top)) == 0)
+		top--;
+	put_bytes(file, rate == 0 ? 0 : 16383 + top, 2, true);
+	put_bytes(file, rate == 0 ? 0 : (uint64_t)rate << (63 - top), 8, true);
+}
+
+
+// compression is NULL for an AIFF, or the type of an AIFC
+static inline FileData
+make_aiff(const std::vector<double>& signal, const PcmLayout& layout, uint32_t rate,
+	const char* compression)
+{
+	FileData file;
+	put_tag(file, "FORM");
+	put_bytes(file, 0, 4, true);
+	put_tag(file, compression != NULL ? "AIFC" : "AIFF");
+
+	// the sound data may come before the format
+	int64_t frameCount = signal.size() / layout.channels;
+	bool littleEndian = compression != NULL && strcmp(compression, "sowt") == 0;
+	put_tag(file, "SSND");
+	put_bytes(file, 8 + signal.size() * layout.bytes, 4, true);
+	put_bytes(file, 0, 8, true);
+	put_pcm(file, signal, layout, !littleEndian);
+	if (((signal.size() * layout.bytes) & 1) != 0)
+		file.push_back(0);
+
+	put_tag(file, "COMM");
+	put_bytes(file, compression != NULL ? 24 : 18, 4, true);
+	put_bytes(file, layout.channels, 2, true);
+	put_bytes(file, frameCount, 4, true);
+	put_bytes(file, layout.bytes * 8, 2, true);
+	put_extended(file, rate);
+	if (compression != NULL) {
+		put_tag(file, compression);
+		put_bytes(file, 0, 2, true);
+	}
+
+	uint32_t formSize = file.size() - 8;
+	for (int32_t i = 0; i < 4; i++)
+		file[4 + i] = (uint8_t)(formSize >> ((3 - i) * 8));
+	return file;
+}
+
+
+// #pragma mark - FLAC
+
+
+class BitWriter {
+public:
+	BitWriter(FileData& file)
+		:
+		fFile(file),
+		fCache(0),
+		fBits(0)
+	{
+	}
+
+	void Write(uint64_t value, int32_t count)
+	{
+		for (int32_t bit = count - 1; bit >= 0; bit--) {
+			fCache = fCache << 1 | ((value >> bit) & 1);
+			if (++fBits == 8) {
+				fFile.push_back(fCache);
+				fCache = 0;
+				fBits = 0;
+			}
+		}
+	}
+
+	void WriteUnary(uint32_t zeros)
+	{
+		for (uint32_t i = 0; i < zeros; i++)
+			Write(0, 1);
+		Write(1, 1);
+	}
+
+	void AlignToByte()
+	{
+		if (fBits > 0)
+			Write(0, 8 - fBits);
+	}
+
+private:
+	FileData&	fFile;
+	uint8_t		fCache;
+	int32_t		fBits;
+};
+
+
+static inline uint8_t
+flac_crc8(const uint8_t* data, size_t size)
+{
+	uint8_t crc = 0;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int32_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) != 0 ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+
+static inline uint16_t
+flac_crc16(const uint8_t* data, size_t size)
+{
+	uint16_t crc = 0;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int32_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) != 0 ? (crc << 1) ^ 0x8005 : crc << 1;
+	}
+	return crc;
+}
+
+
+enum FlacSubframe {
+	kFlacConstant,	// for a signal that is
+	kFlacVerbatim,
+	kFlacFixed,		// of order 2
+	kFlacLpc		// of order 2, the same predictor quantized
+};
+
+enum FlacStereo {
+	kFlacIndependent = 0,
+	kFlacLeftSide = 8,
+	kFlacSideRight = 9,
+	kFlacMidSide = 10
+};
+
+struct FlacLayout {
+	int32_t			channels;
+	int32_t			bits;
+	int32_t			blockSize;
+	FlacSubframe	subframe;
+	FlacStereo		stereo;
+};
+
+// where a frame is in the file, so a fuzzer can fix its checksums
+struct FlacFrameSpan {
+	size_t		offset;
+	size_t		headerSize;
+	size_t		size;		// with the CRC-16
+};
+
+static const int32_t kFlacLpcShift = 10;
+
+
+static inline void
+put_rice_residual(BitWriter& writer, const int32_t* residual, int32_t count)
+{
+	// one partition, a parameter from the mean, escaped if it won't do
+	uint64_t sum = 0;
+	for (int32_t i = 0; i < count; i++)
+		sum += (uint32_t)(residual[i] < 0 ? -(int64_t)residual[i] : residual[i]);
+	uint32_t mean = count > 0 ? (uint32_t)(sum / count) : 0;
+	int32_t parameter = 0;
+	while (parameter < 30 && (1u << parameter) < mean)
+		parameter++;
+
+	writer.Write(1, 2);		// 5 bit parameters
+	writer.Write(0, 4);		// partition order
+	if (parameter > 20) {
+		writer.Write(31, 5);
+		writer.Write(31, 5);
+		for (int32_t i = 0; i < count; i++)
+			writer.Write((uint32_t)residual[i], 31);
+		return;
+	}
+	writer.Write(parameter, 5);
+	for (int32_t i = 0; i < count; i++) {
+		uint32_t folded = residual[i] < 0 ? ((uint32_t)~residual[i] << 1) | 1
+			: (uint32_t)residual[i] << 1;
+		writer.WriteUnary(folded >> parameter);
+		writer.Write(folded & ((1u << parameter) - 1), parameter);
+	}
+}
+
+
+static inline void
+put_subframe(BitWriter& writer, const int32_t* samples, int32_t count, int32_t bits,
+	FlacSubframe type)
+{
+	writer.Write(0, 1);
+	std::vector<int32_t> residual;
+	switch (type) {
+		case kFlacConstant:
+			writer.Write(0, 6);
+			writer.Write(0, 1);
+			writer.Write((uint32_t)samples[0], bits);
+			return;
+		case kFlacVerbatim:
+			writer.Write(1, 6);
+			writer.Write(0, 1);
+			for (int32_t i = 0; i < count; i++)
+				writer.Write((uint32_t)samples[i], bits);
+			return;
+		case kFlacFixed:
+		case kFlacLpc:
+		{
+			int32_t order = count < 2 ? count : 2;
+			if (type == kFlacFixed)
+				writer.Write(8 + order, 6);
+			else
+				writer.Write(32 + order - 1, 6);
+			writer.Write(0, 1);
+			for (int32_t i = 0; i < order; i++)
+				writer.Write((uint32_t)samples[i], bits);
+			if (type == kFlacLpc) {
+				writer.Write(12, 4);		// 13 bit coefficients
+				writer.Write(kFlacLpcShift, 5);
+				writer.Write((order > 1 ? 2 : 1) << kFlacLpcShift, 13);
+				if (order > 1)
+					writer.Write((uint32_t)-(1 << kFlacLpcShift), 13);
+			}
+			for (int32_t i = order; i < count; i++) {
+				int64_t prediction = order == 1 ? samples[i - 1]
+					: 2 * (int64_t)samples[i - 1] - samples[i - 2];
+				residual.push_back((int32_t)(samples[i] - prediction));
+			}
+			put_rice_residual(writer, residual.data(), residual.size());
+			return;
+		}
+	}
+}
+
+
+static inline void
+put_frame_number(BitWriter& writer, uint32_t number)
+{
+	// UTF-8 style
+	if (number < 0x80) {
+		writer.Write(number, 8);
+		return;
+	}
+	int32_t following = 1;
+	while (following < 6 && number >= (1u << (6 - following + 6 * following)))
+		following++;
+	writer.Write(((1u << (following + 1)) - 1) << 1, following + 2);
+	writer.Write(number >> (6 * following), 6 - following);
+	for (int32_t i = following - 1; i >= 0; i--)
+		writer.Write(0x80 | ((number >> (6 * i)) & 0x3f), 8);
+}
+
+
+static inline FileData
+make_flac(const std::vector<double>& signal, const FlacLayout& layout, uint32_t rate,
+	std::vector<FlacFrameSpan>* _spans = NULL)
+{
+	int64_t frameCount = signal.size() / layout.channels;
+	std::vector<int32_t> channels[8];
+	for (int32_t channel = 0; channel < layout.channels; channel++) {
+		for (int64_t frame = 0; frame < frameCount; frame++) {
+			channels[channel].push_back(
+				quantize(signal[frame * layout.channels + channel], layout.bits));
+		}
+	}
+
+	FileData file;
+	put_tag(file, "fLaC");
+	file.push_back(0x80);		// the last block, STREAMINFO
+	put_bytes(file, 34, 3, true);
+	{
+		BitWriter writer(file);
+		writer.Write(layout.blockSize, 16);
+		writer.Write(layout.blockSize, 16);
+		writer.Write(0, 24);
+		writer.Write(0, 24);
+		writer.Write(rate, 20);
+		writer.Write(layout.channels - 1, 3);
+		writer.Write(layout.bits - 1, 5);
+		writer.Write(frameCount, 36);
+		for (int32_t i = 0; i < 16; i++)
+			writer.Write(0, 8);
+	}
+
+	uint32_t number = 0;
+	for (int64_t start = 0; start < frameCount; start += layout.blockSize, number++) {
+		int32_t count = frameCount - start < layout.blockSize
+			? frameCount - start : layout.blockSize;
+		FlacFrameSpan span;
+		span.offset = file.size();
+
+		bool stereo = layout.channels == 2 && layout.stereo != kFlacIndependent;
+		BitWriter writer(file);
+		writer.Write(0x3ffe, 14);
+		writer.Write(0, 2);
+		writer.Write(7, 4);		// the block size follows
+		writer.Write(0, 4);		// the rate of the stream info
+		writer.Write(stereo ? layout.stereo : layout.channels - 1, 4);
+		writer.Write(0, 3);		// the bits of the stream info
+		writer.Write(0, 1);
+		put_frame_number(writer, number);
+		writer.Write(count - 1, 16);
+		file.push_back(flac_crc8(&file[span.offset], file.size() - span.offset));
+		span.headerSize = file.size() - span.offset;
+
+		std::vector<int32_t> subframes[8];
+		for (int32_t channel = 0; channel < layout.channels; channel++) {
+			subframes[channel].assign(channels[channel].begin() + start,
+				channels[channel].begin() + start + count);
+		}
+		int32_t sideChannel = -1;
+		if (stereo) {
+			std::vector<int32_t> left = subframes[0], right = subframes[1];
+			for (int32_t i = 0; i < count; i++) {
+				int32_t side = left[i] - right[i];
+				if (layout.stereo == kFlacLeftSide)
+					subframes[1][i] = side;
+				else if (layout.stereo == kFlacSideRight)
+					subframes[0][i] = side;
+				else {
+					subframes[0][i] = (left[i] + right[i]) >> 1;
+					subframes[1][i] = side;
+				}
+			}
+			sideChannel = layout.stereo == kFlacSideRight ? 0 : 1;
+		}
+
+		for (int32_t channel = 0; channel < layout.channels; channel++) {
+			put_subframe(writer, subframes[channel].data(), count,
+				layout.bits + (channel == sideChannel ? 1 : 0), layout.subframe);
+		}
+		writer.AlignToByte();
+		put_bytes(file, flac_crc16(&file[span.offset], file.size() - span.offset), 2, true);
+		span.size = file.size() - span.offset;
+		if (_spans != NULL)
+			_spans->push_back(span);
+	}
+	return file;
+}
+
+
+// after they were changed in place
+static inline void
+fix_flac_checksums(FileData& file, const std::vector<FlacFrameSpan>& spans)
+{
+	for (const FlacFrameSpan& span : spans) {
+		if (span.offset + span.size > file.size())
+			break;
+		uint8_t* frame = &file[span.offset];
+		frame[span.headerSize - 1] = flac_crc8(frame, span.headerSize - 1);
+		uint16_t crc = flac_crc16(frame, span.size - 2);
+		frame[span.size - 2] = crc >> 8;
+		frame[span.size - 1] = crc & 0xff;
+	}
+}
+
+
+#endif // AUDIO_FILES_H
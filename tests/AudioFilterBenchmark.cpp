@@ -0,0 +1,262 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// How many entries a second the sample panel's filter decides, over a
+// folder of 20,000: audio and other files, folders and links of them, each
+// file with its type in a BEOS:TYPE attribute where the file system has
+// them. The filter Samedi had before asked the file system for every entry,
+// as a BEntry that traverses links, a BNode and BNodeInfo for the type and a
+// BVolume; here that's a stat(), an open() and read of the attribute and a
+// statvfs(). AudioFilterCache decides from the stat and type the panel has
+// anyway, once when the panel opens and again when it refreshes. Listing
+// the folder is the panel's work, the same for both, and isn't counted.
+
+#include "AudioFilterCache.h"
+#include "Check.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+
+static const int32_t kEntries = 20000;
+static const char* kTypeAttribute = "user.BEOS:TYPE";
+
+
+struct PanelEntry {
+	std::string	path;
+	struct stat	st;
+	std::string	type;
+};
+
+
+static std::string
+entry_path(const std::string& root, int32_t index)
+{
+	// one in twenty a folder, two links, seven other files, the rest audio
+	const char* kNames[] = { "folder", "link to audio", "link to folder", "notes",
+		"notes", "cover", "cover", "session", "session", "readme" };
+	int32_t kind = index % 20;
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s %05d%s", root.c_str(),
+		kind < 10 ? kNames[kind] : "hit", index,
+		kind == 0 || kind == 2 ? "" : kind == 1 ? ".lnk" : kind < 10 ? ".txt" : ".wav");
+	return path;
+}
+
+
+static bool
+write_entries(const std::string& root, bool& _typed)
+{
+	if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST)
+		return false;
+
+	_typed = true;
+	for (int32_t i = 0; i < kEntries; i++) {
+		std::string path = entry_path(root, i);
+		int32_t kind = i % 20;
+		if (kind == 0) {
+			if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+				return false;
+			continue;
+		}
+		if (kind == 1 || kind == 2) {
+			// to the audio file or folder of the next twenty
+			int32_t target = (i / 20 + 1) % (kEntries / 20) * 20 + (kind == 1 ? 10 : 0);
+			std::string targetPath = entry_path(root, target);
+			unlink(path.c_str());
+			if (symlink(targetPath.c_str() + root.size() + 1, path.c_str()) != 0)
+				return false;
+			continue;
+		}
+
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		const char* type = kind < 10 ? "text/plain" : "audio/x-wav";
+		if (_typed && fsetxattr(fd, kTypeAttribute, type, strlen(type) + 1, 0) != 0)
+			_typed = false;
+		close(fd);
+	}
+	return true;
+}
+
+
+static std::string
+read_type(const char* path)
+{
+	char type[256];
+	ssize_t length = getxattr(path, kTypeAttribute, type, sizeof(type) - 1);
+	if (length <= 0)
+		return "";
+	type[length] = '\0';
+	return type;
+}
+
+
+static bool
+old_filter(const PanelEntry& entry)
+{
+	// BEntry(ref, true) and IsDirectory()
+	struct stat st;
+	if (stat(entry.path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+		return true;
+
+	// BNode of the traversed entry, BNodeInfo::GetType()
+	char type[256] = "";
+	int fd = open(entry.path.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		ssize_t length = fgetxattr(fd, kTypeAttribute, type, sizeof(type) - 1);
+		type[length > 0 ? length : 0] = '\0';
+		close(fd);
+	}
+	if (strncmp("audio/", type, 6) == 0)
+		return true;
+
+	// BVolume::KnowsMime()
+	struct statvfs volume;
+	statvfs(entry.path.c_str(), &volume);
+	return false;
+}
+
+
+static bool
+resolve_link(const void* ref, bool& _isDirectory, std::string& _type, dev_t& _device,
+	void* cookie)
+{
+	const PanelEntry* entry = (const PanelEntry*)ref;
+	struct stat st;
+	if (stat(entry->path.c_str(), &st) != 0)
+		return false;
+
+	_isDirectory = S_ISDIR(st.st_mode);
+	_device = st.st_dev;
+	_type = read_type(entry->path.c_str());
+	return true;
+}
+
+
+static bool
+knows_mime(dev_t device, void* cookie)
+{
+	// as on Haiku, the file system is asked once; every volume here has types
+	struct statvfs volume;
+	statvfs((const char*)cookie, &volume);
+	return true;
+}
+
+
+static double
+filter_all(const std::vector<PanelEntry>& entries, AudioFilterCache* cache,
+	std::vector<bool>& _accepted)
+{
+	_accepted.assign(entries.size(), false);
+	double start = check_now();
+	for (size_t i = 0; i < entries.size(); i++) {
+		const PanelEntry& entry = entries[i];
+		if (cache == NULL) {
+			_accepted[i] = old_filter(entry);
+			continue;
+		}
+		FilterEntry filterEntry = { entry.st.st_mode, entry.st.st_dev, entry.st.st_ino,
+			entry.st.st_mtime, entry.type.c_str(), &entry };
+		_accepted[i] = cache->Accepts(filterEntry);
+	}
+	return check_now() - start;
+}
+
+
+static void
+remove_entries(const std::string& root)
+{
+	for (int32_t i = 0; i < kEntries; i++) {
+		std::string path = entry_path(root, i);
+		if (i % 20 == 0)
+			rmdir(path.c_str());
+		else
+			unlink(path.c_str());
+	}
+	rmdir(root.c_str());
+}
+
+
+int
+main(int argc, char** argv)
+{
+	std::string root = std::string(argc > 1 ? argv[1] : ".") + "/panel";
+	printf("AudioFilterBenchmark, %d entries\n", kEntries);
+
+	bool typed;
+	if (!write_entries(root, typed)) {
+		fprintf(stderr, "cannot write the entries to %s: %s\n", root.c_str(),
+			strerror(errno));
+		remove_entries(root);
+		return 1;
+	}
+	if (!typed)
+		printf("  (no attributes on this file system, the types are empty)\n");
+
+	// what the panel lists and hands over
+	std::vector<PanelEntry> entries;
+	DIR* dir = opendir(root.c_str());
+	while (struct dirent* entry = dir != NULL ? readdir(dir) : NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		PanelEntry panelEntry;
+		panelEntry.path = root + "/" + entry->d_name;
+		lstat(panelEntry.path.c_str(), &panelEntry.st);
+		panelEntry.type = read_type(panelEntry.path.c_str());
+		entries.push_back(panelEntry);
+	}
+	if (dir != NULL)
+		closedir(dir);
+	CHECK_EQUAL(entries.size(), kEntries);
+
+	std::vector<bool> before;
+	double beforeTime = filter_all(entries, NULL, before);
+
+	AudioFilterCache cache(resolve_link, knows_mime, (void*)root.c_str());
+	std::vector<bool> opened;
+	double openTime = filter_all(entries, &cache, opened);
+	int64_t lookups = cache.CountLookups();
+
+	std::vector<bool> refreshed;
+	double refreshTime = filter_all(entries, &cache, refreshed);
+
+	// the same entries shown, every link looked up once, then none
+	int32_t shown = 0;
+	for (size_t i = 0; i < entries.size(); i++)
+		shown += before[i];
+	CHECK(opened == before);
+	CHECK(refreshed == before);
+	if (typed)
+		CHECK_EQUAL(shown, kEntries * 13 / 20);
+	CHECK_EQUAL(lookups, kEntries / 10 + (typed ? 1 : 0));
+	CHECK_EQUAL(cache.CountLookups(), lookups);
+
+	printf("  %d shown, %lld looked up by the cache\n", shown, (long long)lookups);
+	printf("  before             %8.1f ms: %12.0f entries/s\n", beforeTime / 1000,
+		entries.size() / (beforeTime / 1e6));
+	printf("  cache, opened      %8.1f ms: %12.0f entries/s\n", openTime / 1000,
+		entries.size() / (openTime / 1e6));
+	printf("  cache, refreshed   %8.1f ms: %12.0f entries/s\n", refreshTime / 1000,
+		entries.size() / (refreshTime / 1e6));
+
+	remove_entries(root);
+	return sCheckFailures;
+}
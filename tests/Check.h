@@ -0,0 +1,64 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef CHECK_H
+#define CHECK_H
+
+// The few checks the tests need. A failed one is printed, the test goes on
+// and its exit status is the number of failures.
+
+#include <stdio.h>
+#include <time.h>
+
+
+static int sCheckFailures = 0;
+
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+				#condition); \
+			sCheckFailures++; \
+		} \
+	} while (false)
+
+#define CHECK_EQUAL(value, expected) \
+	do { \
+		long long _value = (long long)(value); \
+		long long _expected = (long long)(expected); \
+		if (_value != _expected) { \
+			fprintf(stderr, "%s:%d: check failed: %s is %lld, not %lld\n", \
+				__FILE__, __LINE__, #value, _value, _expected); \
+			sCheckFailures++; \
+		} \
+	} while (false)
+
+
+static inline int
+check_result(const char* name)
+{
+	if (sCheckFailures == 0)
+		printf("%s: passed\n", name);
+	else
+		printf("%s: %d check(s) failed\n", name, sCheckFailures);
+	return sCheckFailures;
+}
+
+
+// in microseconds, monotonic
+static inline double
+check_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+
+#endif // CHECK_H
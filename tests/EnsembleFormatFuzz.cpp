@@ -0,0 +1,268 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// Feeds parse_ensemble() damaged ensembles; built with the address and
+// undefined behaviour sanitizers by "make fuzz". The seeds are a plain
+// ensemble and bundles of one and two channels, each checked to read back
+// as written. Then every truncation of them is parsed, and the given number
+// of random mutations, half of them with a layer's PCM offset or frame count
+// set to a value around the file's size or far beyond it.
+//
+// What parses has to be safe to use the way Ensemble does: every path inside
+// the string table, and a bundle's PCM inside the file, aligned for floats
+// and clear of the records and the strings. Its frames are all read, so the
+// address sanitizer sees any that aren't there.
+
+#include "Check.h"
+#include "EnsembleFormat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static const size_t kLayerRecordStart = 40;	// as written, after the header
+static const int32_t kDefaultRuns = 100000;
+
+static volatile float sSink;
+
+
+static uint64_t
+get_le(const uint8_t* data, int32_t bytes)
+{
+	uint64_t value = 0;
+	for (int32_t i = 0; i < bytes; i++)
+		value |= (uint64_t)data[i] << (i * 8);
+	return value;
+}
+
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	EnsembleData ensemble;
+	if (parse_ensemble(data, size, ensemble) != kEnsembleOK)
+		return 0;
+
+	// the header was checked, it's all there
+	uint64_t headerSize = get_le(data + 6, 2);
+	uint64_t layersEnd = headerSize + get_le(data + 8, 2) * get_le(data + 10, 2)
+		+ get_le(data + 12, 4) * get_le(data + 16, 2);
+	uint64_t stringOffset = get_le(data + 20, 4);
+	uint64_t stringSize = get_le(data + 24, 4);
+	if (layersEnd > stringOffset || stringOffset + stringSize > size)
+		abort();
+
+	uint64_t frameSize = pcm_frame_size(ensemble);
+	float sum = 0;
+	for (const EnsemblePad& pad : ensemble.pads) {
+		for (const EnsembleLayer& layer : pad.layers) {
+			if (layer.path.size() > stringSize)
+				abort();
+			if (!ensemble.IsBundle() || layer.pcmFrames == 0)
+				continue;
+
+			if (frameSize == 0 || layer.pcmOffset % sizeof(float) != 0
+				|| layer.pcmOffset < layersEnd || layer.pcmOffset > size
+				|| layer.pcmFrames > (size - layer.pcmOffset) / frameSize)
+				abort();
+			uint64_t pcmEnd = layer.pcmOffset + layer.pcmFrames * frameSize;
+			if (layer.pcmOffset < stringOffset + stringSize && pcmEnd > stringOffset)
+				abort();
+
+			// as the engine plays it
+			const float* frames = (const float*)(data + layer.pcmOffset);
+			for (uint64_t i = 0; i < layer.pcmFrames * ensemble.pcmChannels; i++)
+				sum += frames[i];
+		}
+	}
+	sSink = sum;
+	return 0;
+}
+
+
+#ifndef LIBFUZZER
+
+
+#include "Fuzz.h"
+
+
+struct Seed {
+	const char*		name;
+	EnsembleData	ensemble;
+	FileData		file;
+};
+
+
+static EnsembleData
+make_ensemble(int32_t padCount)
+{
+	EnsembleData ensemble;
+	ensemble.pads.resize(padCount);
+	for (int32_t i = 0; i < padCount; i++) {
+		EnsemblePad& pad = ensemble.pads[i];
+		pad.note = 36 + i;
+		pad.gain = 1.0f - i * 0.1f;
+		pad.cutoff = 1000.0f;
+
+		// every other pad empty, one with two layers
+		int32_t layers = i % 2 == 1 ? 0 : i == 2 ? 2 : 1;
+		for (int32_t j = 0; j < layers; j++) {
+			EnsembleLayer layer;
+			layer.path = std::string("/boot/home/samples/pad ") + (char)('1' + i)
+				+ (j == 0 ? ".wav" : " loud.flac");
+			layer.velocityLow = j * 64;
+			layer.velocityHigh = j * 64 + 63;
+			layer.identity.inode = 100 + i;
+			layer.pcmFrames = 3 + i * 5 + j;
+			pad.layers.push_back(layer);
+		}
+	}
+	return ensemble;
+}
+
+
+static void
+add_seed(std::vector<Seed>& seeds, const char* name, int32_t padCount,
+	uint16_t channels, size_t pageSize)
+{
+	Seed seed;
+	seed.name = name;
+	seed.ensemble = make_ensemble(padCount);
+	uint64_t size = 0;
+	if (channels > 0)
+		size = layout_bundle(seed.ensemble, 44100, channels, pageSize);
+	else {
+		for (EnsemblePad& pad : seed.ensemble.pads) {
+			for (EnsembleLayer& layer : pad.layers)
+				layer.pcmFrames = 0;
+		}
+	}
+
+	write_ensemble(seed.ensemble, seed.file);
+	if (size > seed.file.size()) {
+		// a ramp, so every frame is different
+		seed.file.resize(size);
+		for (EnsemblePad& pad : seed.ensemble.pads) {
+			for (EnsembleLayer& layer : pad.layers) {
+				for (uint64_t i = 0; i < layer.pcmFrames * channels; i++) {
+					float value = i / 100.0f;
+					memcpy(&seed.file[layer.pcmOffset + i * sizeof(float)], &value,
+						sizeof(float));
+				}
+			}
+		}
+	}
+	seeds.push_back(seed);
+}
+
+
+static bool
+check_seed(const Seed& seed)
+{
+	EnsembleData read;
+	if (parse_ensemble(seed.file.data(), seed.file.size(), read) != kEnsembleOK) {
+		fprintf(stderr, "  %s: doesn't parse\n", seed.name);
+		return false;
+	}
+
+	bool matches = read.pads.size() == seed.ensemble.pads.size()
+		&& read.IsBundle() == seed.ensemble.IsBundle();
+	for (size_t i = 0; matches && i < read.pads.size(); i++) {
+		const std::vector<EnsembleLayer>& layers = read.pads[i].layers;
+		const std::vector<EnsembleLayer>& written = seed.ensemble.pads[i].layers;
+		matches = layers.size() == written.size();
+		for (size_t j = 0; matches && j < layers.size(); j++) {
+			matches = layers[j].path == written[j].path
+				&& layers[j].pcmOffset == written[j].pcmOffset
+				&& layers[j].pcmFrames == written[j].pcmFrames;
+		}
+	}
+	if (!matches)
+		fprintf(stderr, "  %s: reads as something else\n", seed.name);
+	return matches;
+}
+
+
+static void
+mutate_pcm(FileData& file, const Seed& seed)
+{
+	// the layer records follow the header and the pad records as written
+	uint32_t layerCount = 0;
+	for (const EnsemblePad& pad : seed.ensemble.pads)
+		layerCount += pad.layers.size();
+	if (layerCount == 0 || file.size() < kLayerRecordStart + 36)
+		return;
+
+	size_t padRecordSize = file[10] | (file[11] << 8);
+	size_t layerRecordSize = file[16] | (file[17] << 8);
+	size_t record = kLayerRecordStart + seed.ensemble.pads.size() * padRecordSize
+		+ (rand() % layerCount) * layerRecordSize;
+	size_t field = record + (rand() % 2 == 0 ? 56 : 64);
+	if (field + 8 > file.size())
+		return;
+
+	uint64_t size = file.size();
+	uint64_t stringOffset = get_le(&file[20], 4);
+	const uint64_t kValues[] = { 0, 1, 2, 3, 4, size - 4, size - 1, size, size + 4,
+		stringOffset, stringOffset + 4, (uint64_t)1 << 32, (uint64_t)1 << 40,
+		(uint64_t)1 << 62, ~(uint64_t)0 - 3, ~(uint64_t)0 };
+	uint64_t value = kValues[rand() % (sizeof(kValues) / sizeof(kValues[0]))];
+	if (rand() % 4 == 0)
+		value += rand() % 9 - 4;
+	for (int32_t i = 0; i < 8; i++)
+		file[field + i] = value >> (i * 8);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+		return fuzz_replay(argv[2]);
+
+	fuzz_start(argc > 1 ? argv[1] : NULL);
+	int32_t runs = argc > 2 ? atoi(argv[2]) : kDefaultRuns;
+
+	std::vector<Seed> seeds;
+	add_seed(seeds, "plain", 8, 0, 0);
+	add_seed(seeds, "bundle, stereo", 8, 2, 16);
+	add_seed(seeds, "bundle, mono", 3, 1, 4);
+	for (const Seed& seed : seeds)
+		CHECK(check_seed(seed));
+
+	double start = check_now();
+
+	// every truncation
+	for (const Seed& seed : seeds) {
+		for (size_t size = 0; size < seed.file.size(); size++) {
+			FileData input(seed.file.begin(), seed.file.begin() + size);
+			fuzz_run(input);
+		}
+	}
+
+	srand(28);
+	for (int32_t iteration = 0; iteration < runs; iteration++) {
+		const Seed& seed = seeds[rand() % seeds.size()];
+		FileData input = seed.file;
+		bool inPlace = true;
+		if (rand() % 2 == 0)
+			mutate_pcm(input, seed);
+		int32_t mutations = rand() % 4;
+		for (int32_t i = 0; i < mutations; i++)
+			mutate(input, inPlace);
+		fuzz_run(input);
+	}
+
+	printf("  %zu seeds, %lld parses in %.1f s\n", seeds.size(), (long long)sFuzzRuns,
+		(check_now() - start) / 1e6);
+	return check_result("EnsembleFormatFuzz");
+}
+
+
+#endif // LIBFUZZER
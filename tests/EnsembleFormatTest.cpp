@@ -0,0 +1,471 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// The binary ensemble format: what is written is read back, the records of
+// older and newer versions are read as far as they go, and a damaged file is
+// refused instead of read past its end.
+
+#include "Check.h"
+#include "EnsembleFormat.h"
+
+#include <string.h>
+
+
+static const size_t kHeaderSize = 40;
+static const size_t kPadRecordSize = 44;
+static const size_t kLayerRecordSize = 104;
+
+
+static uint16_t
+get16(const std::vector<uint8_t>& file, size_t offset)
+{
+	return file[offset] | (file[offset + 1] << 8);
+}
+
+
+static uint32_t
+get32(const std::vector<uint8_t>& file, size_t offset)
+{
+	return get16(file, offset) | ((uint32_t)get16(file, offset + 2) << 16);
+}
+
+
+static void
+put16(std::vector<uint8_t>& file, size_t offset, uint16_t value)
+{
+	file[offset] = value;
+	file[offset + 1] = value >> 8;
+}
+
+
+static void
+put32(std::vector<uint8_t>& file, size_t offset, uint32_t value)
+{
+	put16(file, offset, value);
+	put16(file, offset + 2, value >> 16);
+}
+
+
+static void
+put64(std::vector<uint8_t>& file, size_t offset, uint64_t value)
+{
+	put32(file, offset, value);
+	put32(file, offset + 4, value >> 32);
+}
+
+
+static EnsembleData
+make_ensemble()
+{
+	// every field set to something that isn't its default
+	EnsembleData ensemble;
+	ensemble.pads.resize(3);
+	for (size_t i = 0; i < ensemble.pads.size(); i++) {
+		EnsemblePad& pad = ensemble.pads[i];
+		pad.note = 36 + i;
+		pad.modes = kPadMuted | kPadGate | kPadTrimmed;
+		pad.chokeGroup = 2;
+		pad.gainController = 7;
+		pad.gain = 0.5f + i;
+		pad.filterType = 2;
+		pad.bus = 3;
+		pad.cutoff = 440.0f;
+		pad.resonance = 2.5f;
+		pad.attack = 0.01f;
+		pad.decay = 0.2f;
+		pad.release = 0.3f;
+	}
+
+	// the second pad stays empty, the third has two layers
+	const char* paths[] = { "/boot/home/kick.wav", "snare ä.flac", "snare 2.aiff" };
+	size_t pads[] = { 0, 2, 2 };
+	for (size_t i = 0; i < 3; i++) {
+		EnsembleLayer layer;
+		layer.path = paths[i];
+		layer.velocityLow = 10 * i;
+		layer.velocityHigh = 100 + i;
+		layer.flags = kLayerMeasured;
+		layer.identity.device = 3;
+		layer.identity.inode = 1000 + i;
+		layer.identity.size = 44100 * (i + 1);
+		layer.identity.modificationTime = -1 - (int64_t)i;
+		layer.identity.contentHash = 0x0123456789abcdefULL + i;
+		layer.trimStart = 17 + i;
+		layer.trimEnd = 4000 + i;
+		layer.peak = 0.9f;
+		layer.loudness = -14.5f - i;
+		layer.fingerprint = 0xfedcba9876543210ULL - i;
+		ensemble.pads[pads[i]].layers.push_back(layer);
+	}
+	return ensemble;
+}
+
+
+static std::vector<uint8_t>
+resize_records(const std::vector<uint8_t>& file, size_t padSize, size_t layerSize)
+{
+	// as an older version wrote it, or a newer one with fields appended
+	uint16_t padCount = get16(file, 8);
+	uint32_t layerCount = get32(file, 12);
+	uint32_t stringOffset = get32(file, 20);
+	uint32_t stringSize = get32(file, 24);
+
+	std::vector<uint8_t> resized(file.begin(), file.begin() + kHeaderSize);
+	for (size_t i = 0; i < padCount; i++) {
+		size_t record = kHeaderSize + i * kPadRecordSize;
+		for (size_t j = 0; j < padSize; j++)
+			resized.push_back(j < kPadRecordSize ? file[record + j] : 0xa5);
+	}
+	size_t layers = kHeaderSize + padCount * kPadRecordSize;
+	for (size_t i = 0; i < layerCount; i++) {
+		size_t record = layers + i * kLayerRecordSize;
+		for (size_t j = 0; j < layerSize; j++)
+			resized.push_back(j < kLayerRecordSize ? file[record + j] : 0x5a);
+	}
+
+	put16(resized, 10, padSize);
+	put16(resized, 16, layerSize);
+	put32(resized, 20, resized.size());
+	resized.insert(resized.end(), file.begin() + stringOffset,
+		file.begin() + stringOffset + stringSize);
+	return resized;
+}
+
+
+static void
+check_same_pad(const EnsemblePad& pad, const EnsemblePad& expected,
+	bool withPadFields)
+{
+	EnsemblePad defaults;
+	CHECK_EQUAL(pad.note, expected.note);
+	CHECK_EQUAL(pad.modes, expected.modes);
+	CHECK_EQUAL(pad.chokeGroup, expected.chokeGroup);
+	CHECK_EQUAL(pad.gainController, expected.gainController);
+	CHECK(pad.gain == expected.gain);
+
+	const EnsemblePad& appended = withPadFields ? expected : defaults;
+	CHECK_EQUAL(pad.filterType, appended.filterType);
+	CHECK_EQUAL(pad.bus, appended.bus);
+	CHECK(pad.cutoff == appended.cutoff);
+	CHECK(pad.resonance == appended.resonance);
+	CHECK(pad.attack == appended.attack);
+	CHECK(pad.decay == appended.decay);
+	CHECK(pad.release == appended.release);
+}
+
+
+static void
+check_same_layer(const EnsembleLayer& layer, const EnsembleLayer& expected,
+	size_t layerSize)
+{
+	EnsembleLayer defaults;
+	CHECK(layer.path == expected.path);
+	CHECK_EQUAL(layer.velocityLow, expected.velocityLow);
+	CHECK_EQUAL(layer.velocityHigh, expected.velocityHigh);
+	CHECK(same_file_version(layer.identity, expected.identity));
+	CHECK_EQUAL(layer.identity.device, expected.identity.device);
+	CHECK_EQUAL(layer.identity.inode, expected.identity.inode);
+
+	// the appended fields are there as far as the records go
+	const EnsembleLayer& trim = layerSize >= 88 ? expected : defaults;
+	CHECK_EQUAL(layer.trimStart, trim.trimStart);
+	CHECK_EQUAL(layer.trimEnd, trim.trimEnd);
+
+	const EnsembleLayer& measured = layerSize >= 96 ? expected : defaults;
+	CHECK(layer.peak == measured.peak);
+	CHECK(layer.loudness == measured.loudness);
+	CHECK_EQUAL(layer.flags & kLayerMeasured, measured.flags & kLayerMeasured);
+
+	const EnsembleLayer& fingerprinted = layerSize >= 104 ? expected : defaults;
+	CHECK_EQUAL(layer.fingerprint, fingerprinted.fingerprint);
+}
+
+
+static void
+check_same_ensemble(const EnsembleData& ensemble, const EnsembleData& expected,
+	size_t padSize, size_t layerSize)
+{
+	CHECK_EQUAL(ensemble.flags, expected.flags);
+	CHECK_EQUAL(ensemble.pads.size(), expected.pads.size());
+	if (ensemble.pads.size() != expected.pads.size())
+		return;
+
+	for (size_t i = 0; i < expected.pads.size(); i++) {
+		const EnsemblePad& pad = ensemble.pads[i];
+		check_same_pad(pad, expected.pads[i], padSize >= kPadRecordSize);
+		CHECK_EQUAL(pad.layers.size(), expected.pads[i].layers.size());
+		if (pad.layers.size() != expected.pads[i].layers.size())
+			continue;
+		for (size_t j = 0; j < pad.layers.size(); j++)
+			check_same_layer(pad.layers[j], expected.pads[i].layers[j], layerSize);
+	}
+}
+
+
+// #pragma mark -
+
+
+static void
+test_round_trip()
+{
+	EnsembleData written = make_ensemble();
+	std::vector<uint8_t> file;
+	write_ensemble(written, file);
+	CHECK(is_binary_ensemble(file.data(), file.size()));
+
+	EnsembleData read;
+	CHECK_EQUAL(parse_ensemble(file.data(), file.size(), read), kEnsembleOK);
+	check_same_ensemble(read, written, kPadRecordSize, kLayerRecordSize);
+
+	// and written again, it's the same file
+	std::vector<uint8_t> again;
+	write_ensemble(read, again);
+	CHECK(again == file);
+
+	EnsembleData empty;
+	write_ensemble(EnsembleData(), file);
+	CHECK_EQUAL(parse_ensemble(file.data(), file.size(), empty), kEnsembleOK);
+	CHECK_EQUAL(empty.pads.size(), 0);
+}
+
+
+static void
+test_record_versions()
+{
+	EnsembleData written = make_ensemble();
+	std::vector<uint8_t> file;
+	write_ensemble(written, file);
+
+	// 1.0 wrote 16 byte pads and 56 byte layers, the layers grew by the
+	// bundle's PCM, the trim, the measurement and the fingerprint since
+	const size_t padSizes[] = { 16, 16, 44, 44, 44, 44 };
+	const size_t layerSizes[] = { 56, 72, 72, 88, 96, 104 };
+	for (size_t i = 0; i < sizeof(padSizes) / sizeof(padSizes[0]); i++) {
+		std::vector<uint8_t> older = resize_records(file, padSizes[i], layerSizes[i]);
+		EnsembleData read;
+		CHECK_EQUAL(parse_ensemble(older.data(), older.size(), read), kEnsembleOK);
+		check_same_ensemble(read, written, padSizes[i], layerSizes[i]);
+	}
+
+	// a later version's fields are skipped
+	std::vector<uint8_t> newer = resize_records(file, 60, 140);
+	EnsembleData read;
+	CHECK_EQUAL(parse_ensemble(newer.data(), newer.size(), read), kEnsembleOK);
+	check_same_ensemble(read, written, kPadRecordSize, kLayerRecordSize);
+
+	// a later header as well
+	std::vector<uint8_t> longHeader(file.begin(), file.begin() + kHeaderSize);
+	longHeader.insert(longHeader.end(), 24, 0xee);
+	longHeader.insert(longHeader.end(), file.begin() + kHeaderSize, file.end());
+	put16(longHeader, 6, kHeaderSize + 24);
+	put32(longHeader, 20, get32(file, 20) + 24);
+	CHECK_EQUAL(parse_ensemble(longHeader.data(), longHeader.size(), read),
+		kEnsembleOK);
+	check_same_ensemble(read, written, kPadRecordSize, kLayerRecordSize);
+
+	// but not a newer major version
+	std::vector<uint8_t> tooNew = file;
+	put16(tooNew, 4, kEnsembleVersion + 1);
+	CHECK_EQUAL(parse_ensemble(tooNew.data(), tooNew.size(), read), kEnsembleTooNew);
+}
+
+
+static void
+test_damaged()
+{
+	std::vector<uint8_t> file;
+	write_ensemble(make_ensemble(), file);
+	EnsembleData read;
+
+	// the string table ends the file, no cut of it is complete
+	for (size_t size = 0; size < file.size(); size++) {
+		ensemble_result expected = size < 4 ? kEnsembleNotBinary : kEnsembleCorrupt;
+		CHECK_EQUAL(parse_ensemble(file.data(), size, read), expected);
+	}
+
+	// records too small for what every version has
+	std::vector<uint8_t> damaged = file;
+	put16(damaged, 10, 15);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put16(damaged, 16, 55);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put16(damaged, 6, kHeaderSize - 1);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// counts and offsets past the end
+	damaged = file;
+	put16(damaged, 8, 0xffff);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put32(damaged, 12, 0xffffffff);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put32(damaged, 24, 0xffffffff);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// a pad's layers outside the layer records
+	size_t thirdPad = kHeaderSize + 2 * kPadRecordSize;
+	damaged = file;
+	put32(damaged, thirdPad + 8, 2);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// a path outside the string table
+	size_t firstLayer = kHeaderSize + 3 * kPadRecordSize;
+	damaged = file;
+	put32(damaged, firstLayer + 8, 10000);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put32(damaged, firstLayer + 4, 0xfffffff0);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// a bundle needs room for its PCM
+	damaged = file;
+	put16(damaged, 18, kEnsembleBundle);
+	damaged = resize_records(damaged, kPadRecordSize, 56);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+}
+
+
+static void
+test_bundle()
+{
+	EnsembleData written = make_ensemble();
+	written.pads[0].layers[0].pcmFrames = 100;
+	written.pads[2].layers[0].pcmFrames = 1;
+	written.pads[2].layers[1].pcmFrames = 0;
+	uint64_t size = layout_bundle(written, 48000, 2, 4096);
+	CHECK(written.IsBundle());
+	CHECK_EQUAL(pcm_frame_size(written), 8);
+
+	// every layer's PCM on its own page
+	const EnsembleLayer& first = written.pads[0].layers[0];
+	const EnsembleLayer& second = written.pads[2].layers[0];
+	CHECK_EQUAL(first.pcmOffset % 4096, 0);
+	CHECK_EQUAL(second.pcmOffset, first.pcmOffset + 4096);
+	CHECK_EQUAL(written.pads[2].layers[1].pcmOffset, 0);
+	CHECK_EQUAL(size, second.pcmOffset + 8);
+
+	std::vector<uint8_t> file;
+	write_ensemble(written, file);
+	file.resize(size);
+
+	EnsembleData read;
+	CHECK_EQUAL(parse_ensemble(file.data(), file.size(), read), kEnsembleOK);
+	CHECK_EQUAL(read.pcmFrameRate, 48000);
+	CHECK_EQUAL(read.pcmChannels, 2);
+	CHECK_EQUAL(read.pcmFormat, kPCMFloat32);
+	CHECK_EQUAL(read.pads[0].layers[0].pcmOffset, first.pcmOffset);
+	CHECK_EQUAL(read.pads[2].layers[0].pcmFrames, 1);
+
+	// a frame short
+	CHECK_EQUAL(parse_ensemble(file.data(), file.size() - 1, read), kEnsembleCorrupt);
+
+	// an unknown PCM format can't be checked against the file
+	std::vector<uint8_t> damaged = file;
+	put16(damaged, 34, 99);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// PCM past the end, where the room left would wrap around
+	size_t firstLayer = kHeaderSize + 3 * kPadRecordSize;
+	size_t secondLayer = firstLayer + kLayerRecordSize;
+	damaged = file;
+	put64(damaged, secondLayer + 56, (uint64_t)1 << 40);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put64(damaged, secondLayer + 56, file.size() + 4);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+	damaged = file;
+	put64(damaged, secondLayer + 56, 0xfffffffffffffffcULL);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleCorrupt);
+
+	// not aligned for the floats
+	for (uint64_t shift = 1; shift < sizeof(float); shift++) {
+		damaged = file;
+		put64(damaged, firstLayer + 56, first.pcmOffset + shift);
+		CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read),
+			kEnsembleCorrupt);
+	}
+	damaged = file;
+	put64(damaged, firstLayer + 56, first.pcmOffset + sizeof(float));
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleOK);
+
+	// over the strings, at their start, inside and reaching into them
+	uint32_t stringOffset = get32(file, 20);
+	uint32_t stringSize = get32(file, 24);
+	const uint64_t overStrings[] = { stringOffset, stringOffset + 4,
+		(stringOffset + stringSize - 1) & ~3 };
+	for (size_t i = 0; i < sizeof(overStrings) / sizeof(overStrings[0]); i++) {
+		damaged = file;
+		put64(damaged, secondLayer + 56, overStrings[i]);
+		CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read),
+			kEnsembleCorrupt);
+	}
+	damaged = file;
+	put64(damaged, secondLayer + 56, (stringOffset + stringSize + 3) & ~3);
+	CHECK_EQUAL(parse_ensemble(damaged.data(), damaged.size(), read), kEnsembleOK);
+}
+
+
+static void
+test_legacy()
+{
+	// how a flattened BMessage of Samedi 1.0 starts, in host order
+	const uint8_t message[] = { '1', 'F', 'M', 'H', 0x40, 0x00, 0x00, 0x00 };
+	EnsembleData read;
+	CHECK(!is_binary_ensemble(message, sizeof(message)));
+	CHECK_EQUAL(parse_ensemble(message, sizeof(message), read), kEnsembleNotBinary);
+	CHECK_EQUAL(parse_ensemble(message, 0, read), kEnsembleNotBinary);
+
+	LegacyEnsemble legacy;
+	legacy.notes.push_back(40);
+	legacy.notes.push_back(50);
+	legacy.samples.push_back("/boot/home/kick.wav");
+	legacy.samples.push_back("");
+	legacy.samples.push_back("/boot/home/snare.wav");
+	convert_legacy_ensemble(legacy, 8, 60, read);
+
+	// the notes without a pad of their own count on
+	const uint8_t notes[] = { 40, 50, 51, 52, 53, 54, 55, 56 };
+	CHECK_EQUAL(read.pads.size(), 8);
+	for (size_t i = 0; i < read.pads.size(); i++) {
+		CHECK_EQUAL(read.pads[i].note, notes[i]);
+		CHECK_EQUAL(read.pads[i].layers.size(), i == 0 || i == 2 ? 1 : 0);
+	}
+	CHECK(read.pads[0].layers[0].path == "/boot/home/kick.wav");
+	CHECK(read.pads[2].layers[0].path == "/boot/home/snare.wav");
+	CHECK(!read.IsBundle());
+
+	// an empty message is the default notes
+	convert_legacy_ensemble(LegacyEnsemble(), 8, 60, read);
+	for (size_t i = 0; i < read.pads.size(); i++)
+		CHECK_EQUAL(read.pads[i].note, 60 + i);
+
+	// converted, it's written as the binary format
+	std::vector<uint8_t> file;
+	convert_legacy_ensemble(legacy, 8, 60, read);
+	write_ensemble(read, file);
+	EnsembleData again;
+	CHECK_EQUAL(parse_ensemble(file.data(), file.size(), again), kEnsembleOK);
+	CHECK_EQUAL(again.pads[1].note, 50);
+	CHECK(again.pads[2].layers[0].path == "/boot/home/snare.wav");
+}
+
+
+int
+main()
+{
+	test_round_trip();
+	test_record_versions();
+	test_damaged();
+	test_bundle();
+	test_legacy();
+	return check_result("EnsembleFormatTest");
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// How long loading an ensemble takes, which is how long the window stayed
+// empty when an ensemble was given on the command line, before it was
+// loaded in the background. Each layer's sample is mapped and decoded,
+// fingerprinted and hashed, and its peaks, onset, decay and loudness found,
+// as a Sample does it, once with the files out of the page cache and once
+// cached. What else the start waits for, the app_server drawing the window
+// and the MIDI server answering the roster, only exists on Haiku: run
+// "make startup-times" there.
+
+#include "AudioDecoder.h"
+#include "AudioFiles.h"
+#include "Check.h"
+#include "EnsembleFormat.h"
+#include "FileIdentity.h"
+#include "SampleAnalysis.h"
+#include "WaveformPeaks.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+
+// as in Constants.h and Sample.cpp
+static const float kEngineFrameRate = 44100.0f;
+static const int32_t kEngineChannels = 2;
+static const float kOnsetThreshold = -48.0f;
+static const float kDecayThreshold = -60.0f;
+
+static volatile float sSink;
+
+
+struct Kit {
+	const char*	name;
+	int32_t		pads;
+	int32_t		layers;
+	double		seconds;
+};
+
+static const Kit kKits[] = {
+	{ "16 one-shots", 16, 1, 1.0 },
+	{ "64 pads, 2 layers", 64, 2, 1.0 },
+	{ "128 loops", 128, 1, 4.0 }
+};
+
+
+struct LoadTimes {
+	double		read;		// parsing the ensemble, mapping the files
+	double		decode;		// with the fingerprint
+	double		hash;
+	double		analyze;	// peaks, onset and decay
+	double		loudness;	// only if the ensemble didn't store it
+};
+
+
+static std::string
+sample_path(const std::string& root, int32_t pad, int32_t layer)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/pad %03d-%d.wav", root.c_str(), pad, layer);
+	return path;
+}
+
+
+static bool
+write_kit(const std::string& root, const Kit& kit, std::vector<uint8_t>& ensembleFile)
+{
+	if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST)
+		return false;
+
+	EnsembleData ensemble;
+	ensemble.pads.resize(kit.pads);
+	int64_t frameCount = (int64_t)(kit.seconds * kEngineFrameRate);
+	for (int32_t pad = 0; pad < kit.pads; pad++) {
+		ensemble.pads[pad].note = 36 + pad % 92;
+		for (int32_t layer = 0; layer < kit.layers; layer++) {
+			std::vector<double> signal = make_signal(frameCount, 2,
+				pad * kit.layers + layer + 1);
+			// a hit that fades out, with silence after it
+			for (int64_t frame = 0; frame < frameCount; frame++) {
+				double envelope = frame < frameCount * 3 / 4
+					? exp(-frame * 6.0 / frameCount) : 0.0;
+				signal[frame * 2] *= envelope;
+				signal[frame * 2 + 1] *= envelope;
+			}
+			FileData data = make_wav(signal, { 2, 2, false }, (uint32_t)kEngineFrameRate,
+				false);
+
+			std::string path = sample_path(root, pad, layer);
+			int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				return false;
+			bool written = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+			close(fd);
+			if (!written)
+				return false;
+
+			EnsembleLayer ensembleLayer;
+			ensembleLayer.path = path;
+			ensembleLayer.velocityLow = layer * 128 / kit.layers;
+			ensembleLayer.velocityHigh = (layer + 1) * 128 / kit.layers - 1;
+			ensemble.pads[pad].layers.push_back(ensembleLayer);
+		}
+	}
+	write_ensemble(ensemble, ensembleFile);
+	return true;
+}
+
+
+static void
+evict(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+
+static bool
+load_sample(const char* path, LoadTimes& times)
+{
+	double start = check_now();
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	fstat(fd, &st);
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	double mapped = check_now();
+	AudioDecoder decoder;
+	AudioDecoder::Result result = decoder.Decode((const uint8_t*)data, st.st_size);
+	AudioDecoder::Fingerprint((const uint8_t*)data, st.st_size);
+	munmap(data, st.st_size);
+	if (result != AudioDecoder::kOK)
+		return false;
+
+	// page aligned, as the engine locks it
+	int64_t frameCount = decoder.FrameCount();
+	float* frames = decoder.DetachFrames();
+	size_t size = frameCount * kEngineChannels * sizeof(float);
+	float* samples;
+	if (posix_memalign((void**)&samples, 4096, size) != 0) {
+		free(frames);
+		return false;
+	}
+	memcpy(samples, frames, size);
+	free(frames);
+
+	double decoded = check_now();
+	FileIdentity identity;
+	get_file_identity(path, identity);
+
+	double hashed = check_now();
+	WaveformPeaks peaks;
+	peaks.Build(samples, frameCount, kEngineChannels);
+	float peak = find_peak(samples, frameCount, kEngineChannels);
+	int64_t onset = find_onset(samples, frameCount, kEngineChannels,
+		peak * powf(10.0f, kOnsetThreshold / 20.0f));
+	int64_t end = find_decay_end(samples, frameCount, kEngineChannels,
+		peak * powf(10.0f, kDecayThreshold / 20.0f));
+
+	double analyzed = check_now();
+	LoudnessMeter meter(kEngineChannels, kEngineFrameRate);
+	meter.Process(samples, frameCount);
+	sSink = meter.Loudness() + onset + end;
+	free(samples);
+
+	double measured = check_now();
+	times.read += mapped - start;
+	times.decode += decoded - mapped;
+	times.hash += hashed - decoded;
+	times.analyze += analyzed - hashed;
+	times.loudness += measured - analyzed;
+	return true;
+}
+
+
+static bool
+load_ensemble(const std::vector<uint8_t>& file, LoadTimes& times)
+{
+	memset(&times, 0, sizeof(times));
+	double start = check_now();
+	EnsembleData ensemble;
+	if (parse_ensemble(file.data(), file.size(), ensemble) != kEnsembleOK)
+		return false;
+	times.read += check_now() - start;
+
+	for (size_t pad = 0; pad < ensemble.pads.size(); pad++) {
+		const std::vector<EnsembleLayer>& layers = ensemble.pads[pad].layers;
+		for (size_t layer = 0; layer < layers.size(); layer++) {
+			if (!load_sample(layers[layer].path.c_str(), times))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+static void
+print_times(const char* name, const LoadTimes& times)
+{
+	double total = times.read + times.decode + times.hash + times.analyze;
+	printf("    %-8s %7.1f ms: read %5.1f, decode %5.1f, hash %5.1f, "
+		"analyze %5.1f; loudness %6.1f more\n", name, total / 1000,
+		times.read / 1000, times.decode / 1000, times.hash / 1000,
+		times.analyze / 1000, times.loudness / 1000);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	printf("EnsembleLoadBenchmark, 16 bit stereo WAV samples\n");
+
+	for (size_t i = 0; i < sizeof(kKits) / sizeof(kKits[0]); i++) {
+		const Kit& kit = kKits[i];
+		std::string root = directory + "/ensemble";
+		std::vector<uint8_t> ensemble;
+		if (!write_kit(root, kit, ensemble)) {
+			fprintf(stderr, "cannot write the samples to %s: %s\n", root.c_str(),
+				strerror(errno));
+			sCheckFailures++;
+			break;
+		}
+
+		for (int32_t pad = 0; pad < kit.pads; pad++) {
+			for (int32_t layer = 0; layer < kit.layers; layer++)
+				evict(sample_path(root, pad, layer));
+		}
+		LoadTimes cold, cached;
+		CHECK(load_ensemble(ensemble, cold));
+		CHECK(load_ensemble(ensemble, cached));
+
+		printf("  %s of %.0f s\n", kit.name, kit.seconds);
+		print_times("uncached", cold);
+		print_times("cached", cached);
+
+		for (int32_t pad = 0; pad < kit.pads; pad++) {
+			for (int32_t layer = 0; layer < kit.layers; layer++)
+				unlink(sample_path(root, pad, layer).c_str());
+		}
+		rmdir(root.c_str());
+	}
+	return sCheckFailures;
+}
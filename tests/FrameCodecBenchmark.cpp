@@ -0,0 +1,170 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// What the packed sample memory saves and what a voice pays for it: each
+// signal is quantized to 16 bit and compressed in blocks as a sample is
+// past its head, then every block is unpacked the way a voice does it. The
+// size is compared to float and 16 bit, the unpacking to reading 16 bit
+// frames, and every unpacked block is checked to be exactly the 16 bit one.
+
+#include "Check.h"
+#include "FrameCodec.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+
+// as in Constants.h
+static const int32_t kPackedBlockFrames = 1024;
+
+static const int64_t kFrames = 44100 * 20;
+static const int32_t kRounds = 5;
+
+static volatile float sSink;
+
+
+typedef float (*SignalFunction)(int64_t frame, int32_t channel);
+
+
+static float
+drum_hits(int64_t frame, int32_t channel)
+{
+	// a kick every half second: a falling tone, a click of noise, decaying
+	int64_t position = frame % 22050;
+	double time = position / 44100.0;
+	double envelope = exp(-time * 12);
+	double tone = sin(2 * M_PI * (50 + 120 * exp(-time * 30)) * time);
+	double click = position < 400 ? (rand() % 2001 - 1000) / 1000.0 * 0.3 : 0;
+	return (float)((tone * 0.8 + click) * envelope * (channel == 0 ? 1.0 : 0.9));
+}
+
+
+static float
+pad_tone(int64_t frame, int32_t channel)
+{
+	// sustained, with a little noise as in a recording
+	double time = frame / 44100.0;
+	double tone = 0.3 * sin(2 * M_PI * 220 * time) + 0.2 * sin(2 * M_PI * 330.5 * time);
+	return (float)(tone + (rand() % 2001 - 1000) / 1000.0 * 0.002 * (channel + 1));
+}
+
+
+static float
+loud_noise(int64_t frame, int32_t channel)
+{
+	// nothing to predict, the worst case
+	return (rand() % 65536 - 32768) / 32768.0f;
+}
+
+
+static float
+silence(int64_t frame, int32_t channel)
+{
+	return 0.0f;
+}
+
+
+static void
+bench(const char* name, SignalFunction signal)
+{
+	srand(43);
+	std::vector<float> source(kFrames * 2);
+	for (int64_t frame = 0; frame < kFrames; frame++) {
+		for (int32_t channel = 0; channel < 2; channel++)
+			source[frame * 2 + channel] = signal(frame, channel);
+	}
+	std::vector<int16_t> quantized(kFrames * 2);
+	quantize_frames(source.data(), kFrames, quantized.data());
+
+	// compressed as the sample does it, a block at a time
+	std::vector<uint8_t> packed;
+	std::vector<size_t> offsets;
+	double start = check_now();
+	for (int64_t frame = 0; frame < kFrames; frame += kPackedBlockFrames) {
+		int32_t count = kFrames - frame < kPackedBlockFrames
+			? kFrames - frame : kPackedBlockFrames;
+		offsets.push_back(packed.size());
+		compress_block(&quantized[frame * 2], count, packed);
+	}
+	offsets.push_back(packed.size());
+	double compressTime = check_now() - start;
+
+	// the unpacked blocks match the 16 bit frames exactly
+	std::vector<float> expected(kFrames * 2);
+	unquantize_frames(quantized.data(), kFrames, expected.data());
+	std::vector<float> block((kPackedBlockFrames + 1) * 2);
+	int64_t mismatches = 0;
+	for (size_t i = 0; i + 1 < offsets.size(); i++) {
+		int64_t frame = i * kPackedBlockFrames;
+		int32_t count = kFrames - frame < kPackedBlockFrames
+			? kFrames - frame : kPackedBlockFrames;
+		CHECK(expand_block(&packed[offsets[i]], offsets[i + 1] - offsets[i], count,
+			block.data()));
+		if (memcmp(block.data(), &expected[frame * 2], count * 2 * sizeof(float)) != 0)
+			mismatches++;
+	}
+	CHECK_EQUAL(mismatches, 0);
+
+	double expandTime = 0;
+	double readTime = 0;
+	float sum = 0;
+	for (int32_t round = 0; round < kRounds; round++) {
+		double roundStart = check_now();
+		for (size_t i = 0; i + 1 < offsets.size(); i++) {
+			int64_t frame = i * kPackedBlockFrames;
+			int32_t count = kFrames - frame < kPackedBlockFrames
+				? kFrames - frame : kPackedBlockFrames;
+			expand_block(&packed[offsets[i]], offsets[i + 1] - offsets[i], count,
+				block.data());
+			sum += block[0];
+		}
+		double expanded = check_now();
+
+		// what the 16 bit memory costs instead
+		for (int64_t frame = 0; frame < kFrames; frame += kPackedBlockFrames) {
+			int32_t count = kFrames - frame < kPackedBlockFrames
+				? kFrames - frame : kPackedBlockFrames;
+			unquantize_frames(&quantized[frame * 2], count, block.data());
+			sum += block[0];
+		}
+		double read = check_now();
+
+		if (round == 0 || expanded - roundStart < expandTime)
+			expandTime = expanded - roundStart;
+		if (round == 0 || read - expanded < readTime)
+			readTime = read - expanded;
+	}
+	sSink = sum;
+
+	double blocks = offsets.size() - 1;
+	double floatSize = kFrames * 2 * sizeof(float);
+	double shortSize = kFrames * 2 * sizeof(int16_t);
+	printf("  %-10s %5.1f%% of float, %5.1f%% of 16 bit; packed at %5.1f M frames/s\n",
+		name, packed.size() * 100 / floatSize, packed.size() * 100 / shortSize,
+		kFrames / compressTime);
+	printf("  %-10s unpacked at %5.1f M frames/s, %5.2f µs a block "
+		"(16 bit: %4.2f µs)\n", "", kFrames / expandTime, expandTime / blocks,
+		readTime / blocks);
+}
+
+
+int
+main()
+{
+	printf("FrameCodecBenchmark, %lld stereo frames, %d frame blocks, best of %d\n",
+		(long long)kFrames, kPackedBlockFrames, kRounds);
+	bench("drum hits", drum_hits);
+	bench("pad tone", pad_tone);
+	bench("noise", loud_noise);
+	bench("silence", silence);
+	return sCheckFailures;
+}
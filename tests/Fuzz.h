@@ -0,0 +1,188 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef FUZZ_H
+#define FUZZ_H
+
+// What the fuzzers share: the mutations of a valid file, and keeping the
+// input that made a sanitizer stop. It's written to crash-<run> in the
+// directory given, to be replayed with
+//	<fuzzer> --replay <file>
+// The fuzzer itself only has to define LLVMFuzzerTestOneInput(), the entry
+// point libFuzzer expects, so clang can also build it with
+// -fsanitize=fuzzer,address,undefined -DLIBFUZZER, without this header.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+
+typedef std::vector<uint8_t> FileData;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static const FileData* sFuzzInput;
+static int64_t sFuzzRuns;
+static const char* sFuzzDirectory = ".";
+
+
+static inline void
+fuzz_run(const FileData& input)
+{
+	sFuzzInput = &input;
+	LLVMFuzzerTestOneInput(input.data(), input.size());
+	sFuzzInput = NULL;
+	sFuzzRuns++;
+}
+
+
+static inline uint32_t
+interesting_value()
+{
+	static const uint32_t kValues[] = { 0, 1, 2, 7, 8, 0x7f, 0x80, 0xff, 0x100,
+		0x7fff, 0x8000, 0xffff, 0x10000, 0x7fffffff, 0x80000000, 0xfffffffe,
+		0xffffffff };
+	return kValues[rand() % (sizeof(kValues) / sizeof(kValues[0]))];
+}
+
+
+// flipped bits, bytes and sizes set to the values parsers trip over, ranges
+// inserted, removed or repeated; _inPlace is cleared if the size changed
+static inline void
+mutate(FileData& file, bool& _inPlace)
+{
+	size_t size = file.size();
+	if (size == 0) {
+		file.push_back(rand());
+		_inPlace = false;
+		return;
+	}
+
+	size_t offset = rand() % size;
+	switch (rand() % 8) {
+		case 0:
+		case 1:
+			file[offset] ^= 1 << (rand() % 8);
+			break;
+		case 2:
+			file[offset] = rand();
+			break;
+		case 3:
+		{
+			// a size or count field, either byte order
+			uint32_t value = interesting_value();
+			bool bigEndian = rand() % 2 == 0;
+			for (size_t i = 0; i < 4 && offset + i < size; i++)
+				file[offset + i] = value >> (bigEndian ? (3 - i) * 8 : i * 8);
+			break;
+		}
+		case 4:
+			file.resize(offset);
+			_inPlace = false;
+			break;
+		case 5:
+		{
+			size_t length = 1 + rand() % 64;
+			file.erase(file.begin() + offset,
+				file.begin() + std::min(size, offset + length));
+			_inPlace = false;
+			break;
+		}
+		case 6:
+		{
+			size_t length = 1 + rand() % 16;
+			for (size_t i = 0; i < length; i++)
+				file.insert(file.begin() + offset, rand());
+			_inPlace = false;
+			break;
+		}
+		case 7:
+		{
+			// a chunk or record twice
+			size_t from = rand() % size;
+			size_t length = std::min(size - from, (size_t)(1 + rand() % 512));
+			FileData copy(file.begin() + from, file.begin() + from + length);
+			file.insert(file.begin() + offset, copy.begin(), copy.end());
+			_inPlace = false;
+			break;
+		}
+	}
+}
+
+
+// a sanitizer error aborts, instead of just ending the process
+extern "C" const char*
+__asan_default_options()
+{
+	return "abort_on_error=1";
+}
+
+
+extern "C" const char*
+__ubsan_default_options()
+{
+	return "abort_on_error=1:print_stacktrace=1";
+}
+
+
+static void
+fuzz_save_crash(int signal)
+{
+	if (sFuzzInput != NULL) {
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/crash-%lld", sFuzzDirectory,
+			(long long)sFuzzRuns);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd >= 0) {
+			if (write(fd, sFuzzInput->data(), sFuzzInput->size()) >= 0)
+				fprintf(stderr, "the input is in %s\n", path);
+			close(fd);
+		}
+	}
+	::signal(signal, SIG_DFL);
+	raise(signal);
+}
+
+
+static inline void
+fuzz_start(const char* directory)
+{
+	if (directory != NULL)
+		sFuzzDirectory = directory;
+	signal(SIGABRT, fuzz_save_crash);
+}
+
+
+static inline int
+fuzz_replay(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+	FileData input;
+	uint8_t buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		input.insert(input.end(), buffer, buffer + read);
+	fclose(file);
+
+	fuzz_run(input);
+	printf("%s: no sanitizer error\n", path);
+	return 0;
+}
+
+
+#endif // FUZZ_H
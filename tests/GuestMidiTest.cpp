@@ -0,0 +1,386 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// Two Samedis playing through a third one's engine. Each guest is a process
+// of its own with its own channel filters; it filters the same MIDI stream,
+// sends what it took to the host with its guest id and hits some pads. The
+// host reads each guest's port on a thread, like EngineHost, and queues the
+// events for that guest's engine. A datagram socket stands in for the port.
+// At the end the host goes away and the guests have to notice it on their
+// next send, which is when they start playing on their own.
+
+#include "Check.h"
+#include "GuestMidi.h"
+#include "LockFreeQueue.h"
+#include "MidiFilter.h"
+
+#include <MidiDefs.h>
+#include <SupportDefs.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+
+// as in the engine
+struct MidiEvent {
+	bigtime_t	time;
+	uint8		status;
+	uint8		data1;
+	uint8		data2;
+};
+
+static const size_t kMidiQueueSize = 1024;
+static const int32 kPadCount = 8;
+
+static const int32 kEvents = 20000;
+static const int32 kPadEvery = 50;
+static const int32 kGuests = 2;
+static const bigtime_t kWaitTimeout = 10000000;
+
+
+struct GuestSetup {
+	int32	id;
+	uint16	firstSourceChannels;
+	uint16	secondSourceChannels;
+	bool	wantsClock;
+};
+
+static const GuestSetup kSetups[kGuests] = {
+	// channel 1 of the first source, 1 to 8 of the second, no clock
+	{ 1001, 0x0001, 0x00ff, false },
+	// channel 10 of the first source, all of the second, synced to the clock
+	{ 1002, 0x0200, kAllMidiChannels, true }
+};
+
+
+static void
+script_event(int32 n, int32& producer, MidiEvent& event)
+{
+	// three sources, the third isn't filtered by either guest
+	producer = 1 + n % 3;
+	event.time = n;
+	event.data1 = 36 + n % 48;
+	event.data2 = 1 + n % 127;
+	if (n % 7 == 0)
+		event.status = B_TIMING_CLOCK;
+	else if (n % 11 == 0)
+		event.status = B_ACTIVE_SENSING;
+	else if (n % 5 == 0)
+		event.status = B_CONTROL_CHANGE | (n % 16);
+	else
+		event.status = (n % 2 == 0 ? B_NOTE_ON : B_NOTE_OFF) | (n % 16);
+}
+
+
+static void
+setup_filter(const GuestSetup& setup, MidiFilter& filter)
+{
+	filter.SetChannelFilter(1, setup.firstSourceChannels);
+	filter.SetChannelFilter(2, setup.secondSourceChannels);
+}
+
+
+// What the guest's engine should get, in the order it was sent
+static std::vector<MidiEvent>
+expected_events(const GuestSetup& setup)
+{
+	MidiFilter filter;
+	setup_filter(setup, filter);
+
+	std::vector<MidiEvent> events;
+	for (int32 n = 0; n < kEvents; n++) {
+		int32 producer;
+		MidiEvent event;
+		script_event(n, producer, event);
+		if (filter.Accepts(producer, event.status, setup.wantsClock))
+			events.push_back(event);
+		if (n % kPadEvery == 0)
+			events.push_back({ n, kGuestPadDown, (uint8)(n % kPadCount), 100 });
+	}
+	return events;
+}
+
+
+static bool
+send_event(int port, int32 guest, const MidiEvent& midi)
+{
+	GuestMidiEvent event = { guest, midi.time, midi.status, midi.data1,
+		midi.data2 };
+	uint8_t buffer[kGuestMidiEventSize];
+	encode_guest_midi_event(event, buffer);
+	return send(port, buffer, sizeof(buffer), 0) == (ssize_t)sizeof(buffer);
+}
+
+
+// #pragma mark - guest
+
+
+static int
+run_guest(const GuestSetup& setup, int port, int hostAlive)
+{
+	MidiFilter filter;
+	setup_filter(setup, filter);
+
+	int failures = 0;
+	for (int32 n = 0; n < kEvents; n++) {
+		int32 producer;
+		MidiEvent event;
+		script_event(n, producer, event);
+		if (filter.Accepts(producer, event.status, setup.wantsClock)
+			&& !send_event(port, setup.id, event)) {
+			fprintf(stderr, "guest %d: send failed: %s\n", setup.id,
+				strerror(errno));
+			failures++;
+		}
+		if (n % kPadEvery == 0) {
+			MidiEvent pad = { n, kGuestPadDown, (uint8)(n % kPadCount), 100 };
+			if (!send_event(port, setup.id, pad))
+				failures++;
+		}
+	}
+
+	// what the host must not hand to this guest's engine: an event of
+	// another guest, one cut short, hits of pads the engine doesn't have
+	// and a status that is neither MIDI nor a pad
+	MidiEvent stray = { kEvents, B_NOTE_ON, 60, 100 };
+	send_event(port, setup.id + 1000, stray);
+	uint8_t cut[kGuestMidiEventSize - 4] = {};
+	send(port, cut, sizeof(cut), 0);
+	MidiEvent badPads[] = {
+		{ kEvents, kGuestPadDown, kPadCount, 100 },
+		{ kEvents, kGuestPadUp, 255, 0 },
+		{ kEvents, 0x7f, 0, 0 }
+	};
+	for (size_t i = 0; i < sizeof(badPads) / sizeof(badPads[0]); i++)
+		send_event(port, setup.id, badPads[i]);
+
+	// until the host quits
+	char byte;
+	while (read(hostAlive, &byte, 1) > 0)
+		;
+
+	// the next event finds it gone and the guest plays it on its own
+	LockFreeQueue<MidiEvent> local(kMidiQueueSize);
+	MidiEvent last = { kEvents + 1, B_NOTE_ON, 38, 90 };
+	if (send_event(port, setup.id, last)) {
+		fprintf(stderr, "guest %d: sending to a host that quit worked\n",
+			setup.id);
+		failures++;
+	} else if (errno != ECONNREFUSED && errno != ENOTCONN && errno != EPIPE) {
+		fprintf(stderr, "guest %d: unexpected error for a host that quit: %s\n",
+			setup.id, strerror(errno));
+		failures++;
+	} else
+		local.Push(last);
+
+	MidiEvent played;
+	if (!local.Pop(played) || played.time != last.time)
+		failures++;
+
+	close(port);
+	return failures;
+}
+
+
+// #pragma mark - host
+
+
+static void
+read_guest(int port, int32 guest, LockFreeQueue<MidiEvent>* queue,
+	int32* dropped)
+{
+	uint8_t buffer[64];
+	while (true) {
+		ssize_t size = recv(port, buffer, sizeof(buffer), 0);
+		if (size <= 0)
+			break;
+
+		GuestMidiEvent event;
+		if (!decode_guest_midi_event(buffer, size, kPadCount, event)
+			|| event.guest != guest) {
+			(*dropped)++;
+			continue;
+		}
+
+		MidiEvent midi = { event.time, event.status, event.data1, event.data2 };
+		while (!queue->Push(midi))
+			std::this_thread::yield();
+	}
+}
+
+
+static void
+test_two_guests()
+{
+	int ports[kGuests][2];
+	int alive[kGuests][2];
+	pid_t guests[kGuests];
+	for (int32 i = 0; i < kGuests; i++) {
+		if (socketpair(AF_UNIX, SOCK_DGRAM, 0, ports[i]) != 0
+			|| pipe(alive[i]) != 0) {
+			fprintf(stderr, "cannot create the ports: %s\n", strerror(errno));
+			sCheckFailures++;
+			return;
+		}
+	}
+
+	for (int32 i = 0; i < kGuests; i++) {
+		guests[i] = fork();
+		if (guests[i] == 0) {
+			for (int32 j = 0; j < kGuests; j++) {
+				close(ports[j][0]);
+				close(alive[j][1]);
+				if (j != i) {
+					close(ports[j][1]);
+					close(alive[j][0]);
+				}
+			}
+			_exit(run_guest(kSetups[i], ports[i][1], alive[i][0]));
+		}
+		CHECK(guests[i] > 0);
+	}
+	for (int32 i = 0; i < kGuests; i++) {
+		close(ports[i][1]);
+		close(alive[i][0]);
+	}
+
+	std::vector<LockFreeQueue<MidiEvent>*> queues;
+	std::vector<std::thread> readers;
+	int32 dropped[kGuests] = {};
+	for (int32 i = 0; i < kGuests; i++) {
+		queues.push_back(new LockFreeQueue<MidiEvent>(kMidiQueueSize));
+		readers.emplace_back(read_guest, ports[i][0], kSetups[i].id, queues[i],
+			&dropped[i]);
+	}
+
+	// the audio thread, taking what is queued for each guest
+	std::vector<MidiEvent> expected[kGuests];
+	std::vector<MidiEvent> played[kGuests];
+	size_t total = 0;
+	for (int32 i = 0; i < kGuests; i++) {
+		expected[i] = expected_events(kSetups[i]);
+		total += expected[i].size();
+	}
+
+	double start = check_now();
+	size_t count = 0;
+	while (count < total && check_now() - start < kWaitTimeout) {
+		bool idle = true;
+		for (int32 i = 0; i < kGuests; i++) {
+			MidiEvent event;
+			while (queues[i]->Pop(event)) {
+				played[i].push_back(event);
+				count++;
+				idle = false;
+			}
+		}
+		if (idle)
+			std::this_thread::yield();
+	}
+	double elapsed = check_now() - start;
+
+	for (int32 i = 0; i < kGuests; i++) {
+		CHECK_EQUAL(played[i].size(), expected[i].size());
+		size_t mismatches = 0;
+		for (size_t j = 0; j < played[i].size() && j < expected[i].size(); j++) {
+			const MidiEvent& a = played[i][j];
+			const MidiEvent& b = expected[i][j];
+			if (a.time != b.time || a.status != b.status || a.data1 != b.data1
+				|| a.data2 != b.data2)
+				mismatches++;
+		}
+		CHECK_EQUAL(mismatches, 0);
+		printf("  guest %d: %zu of %d events taken\n", kSetups[i].id,
+			played[i].size(), kEvents);
+	}
+	printf("  %zu events in %.1f ms\n", count, elapsed / 1000);
+
+	// the host quits, the reader threads end with their ports
+	for (int32 i = 0; i < kGuests; i++) {
+		shutdown(ports[i][0], SHUT_RDWR);
+		close(ports[i][0]);
+	}
+	for (std::thread& reader : readers)
+		reader.join();
+	for (int32 i = 0; i < kGuests; i++) {
+		// the stray event, the cut one and the bad pads, nothing else
+		MidiEvent event;
+		while (queues[i]->Pop(event))
+			played[i].push_back(event);
+		CHECK_EQUAL(played[i].size(), expected[i].size());
+		CHECK_EQUAL(dropped[i], 5);
+		delete queues[i];
+		close(alive[i][1]);
+	}
+
+	for (int32 i = 0; i < kGuests; i++) {
+		int status = 0;
+		CHECK(waitpid(guests[i], &status, 0) == guests[i]);
+		CHECK(WIFEXITED(status));
+		CHECK_EQUAL(WEXITSTATUS(status), 0);
+	}
+}
+
+
+static void
+test_wire_format()
+{
+	GuestMidiEvent event = { -7, 0x123456789abcLL, B_PITCH_BEND | 3, 0x7f, 0 };
+	uint8_t buffer[kGuestMidiEventSize];
+	encode_guest_midi_event(event, buffer);
+
+	// little endian, whatever the machine
+	CHECK_EQUAL(buffer[0], 0xf9);
+	CHECK_EQUAL(buffer[4], 0xbc);
+	CHECK_EQUAL(buffer[12], B_PITCH_BEND | 3);
+
+	GuestMidiEvent decoded = {};
+	CHECK(decode_guest_midi_event(buffer, sizeof(buffer), kPadCount, decoded));
+	CHECK_EQUAL(decoded.guest, -7);
+	CHECK_EQUAL(decoded.time, 0x123456789abcLL);
+	CHECK_EQUAL(decoded.status, B_PITCH_BEND | 3);
+	CHECK_EQUAL(decoded.data1, 0x7f);
+	CHECK_EQUAL(decoded.data2, 0);
+
+	CHECK(!decode_guest_midi_event(buffer, sizeof(buffer) - 1, kPadCount, decoded));
+	CHECK(!decode_guest_midi_event(buffer, sizeof(buffer) + 1, kPadCount, decoded));
+	CHECK(!decode_guest_midi_event(NULL, sizeof(buffer), kPadCount, decoded));
+
+	// pads only in range, they index the host engine's pads
+	for (int32 pad = 0; pad < 256; pad++) {
+		event.status = pad % 2 == 0 ? kGuestPadDown : kGuestPadUp;
+		event.data1 = pad;
+		encode_guest_midi_event(event, buffer);
+		CHECK_EQUAL(decode_guest_midi_event(buffer, sizeof(buffer), kPadCount, decoded),
+			pad < kPadCount);
+	}
+	event.status = 0x03;
+	event.data1 = 0;
+	encode_guest_midi_event(event, buffer);
+	CHECK(!decode_guest_midi_event(buffer, sizeof(buffer), kPadCount, decoded));
+}
+
+
+int
+main()
+{
+	// a guest writing to a host that quit mustn't end the test
+	signal(SIGPIPE, SIG_IGN);
+
+	test_wire_format();
+	test_two_guests();
+	return check_result("GuestMidiTest");
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// What the sample library costs for a large collection: tens of thousands
+// of small WAV files in a hundred folders, indexed as the library's scan
+// does it, first with the files out of the page cache, then again with
+// nothing changed, which should only cost listing them. Then what an
+// ensemble's relink, a search, saving and loading the index and noticing
+// removed files take.
+
+#include "AudioFiles.h"
+#include "Check.h"
+#include "FileIdentity.h"
+#include "LibraryIndex.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+
+static const int32_t kFolders = 100;
+static const int32_t kFilesPerFolder = 300;
+static const int64_t kFileFrames = 1000;
+static const int32_t kLookups = 10000;
+
+
+static std::string
+file_path(const std::string& root, int32_t folder, int32_t file)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/kit %03d/snare %05d.wav", root.c_str(), folder,
+		file);
+	return path;
+}
+
+
+static bool
+write_files(const std::string& root, std::vector<uint64_t>& hashes)
+{
+	if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST)
+		return false;
+
+	for (int32_t folder = 0; folder < kFolders; folder++) {
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/kit %03d", root.c_str(), folder);
+		if (mkdir(path, 0755) != 0 && errno != EEXIST)
+			return false;
+
+		for (int32_t file = 0; file < kFilesPerFolder; file++) {
+			// each one different, srand() takes 0 as 1
+			FileData data = make_wav(make_signal(kFileFrames, 2,
+				folder * kFilesPerFolder + file + 1), { 2, 2, false }, 44100, false);
+			hashes.push_back(hash_content(data.data(), data.size()));
+
+			int fd = open(file_path(root, folder, file).c_str(),
+				O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				return false;
+			bool written = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+			close(fd);
+			if (!written)
+				return false;
+		}
+	}
+	return true;
+}
+
+
+static void
+evict(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+
+// as SampleLibrary::_ScanDirectory() and _AddFile() do it, returns the
+// files that were hashed
+static int32_t
+scan(LibraryIndex& index, const std::string& root, int32_t& _files)
+{
+	int32_t hashed = 0;
+	_files = 0;
+	std::vector<std::string> directories(1, root);
+	while (!directories.empty()) {
+		std::string directory = directories.back();
+		directories.pop_back();
+
+		DIR* dir = opendir(directory.c_str());
+		if (dir == NULL)
+			continue;
+		while (struct dirent* entry = readdir(dir)) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+			std::string path = directory + "/" + entry->d_name;
+			if (entry->d_type == DT_DIR) {
+				directories.push_back(path);
+				continue;
+			}
+			if (!is_sample_file_name(entry->d_name))
+				continue;
+
+			_files++;
+			if (index.Update(path.c_str()))
+				hashed++;
+		}
+		closedir(dir);
+	}
+	return hashed;
+}
+
+
+static void
+remove_files(const std::string& root)
+{
+	for (int32_t folder = 0; folder < kFolders; folder++) {
+		for (int32_t file = 0; file < kFilesPerFolder; file++)
+			unlink(file_path(root, folder, file).c_str());
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/kit %03d", root.c_str(), folder);
+		rmdir(path);
+	}
+	rmdir(root.c_str());
+}
+
+
+int
+main(int argc, char** argv)
+{
+	std::string root = std::string(argc > 1 ? argv[1] : ".") + "/library";
+	int32_t fileCount = kFolders * kFilesPerFolder;
+	printf("LibraryIndexBenchmark, %d files in %d folders\n", fileCount, kFolders);
+
+	std::vector<uint64_t> hashes;
+	if (!write_files(root, hashes)) {
+		fprintf(stderr, "cannot write the files to %s: %s\n", root.c_str(),
+			strerror(errno));
+		remove_files(root);
+		return 1;
+	}
+	struct stat st;
+	stat(file_path(root, 0, 0).c_str(), &st);
+	double megabytes = (double)st.st_size * fileCount / 1e6;
+
+	for (int32_t folder = 0; folder < kFolders; folder++) {
+		for (int32_t file = 0; file < kFilesPerFolder; file++)
+			evict(file_path(root, folder, file));
+	}
+
+	LibraryIndex index;
+	int32_t files;
+	double start = check_now();
+	int32_t hashed = scan(index, root, files);
+	double coldTime = check_now() - start;
+	CHECK_EQUAL(files, fileCount);
+	CHECK_EQUAL(hashed, fileCount);
+	CHECK_EQUAL(index.CountEntries(), fileCount);
+	printf("  first scan, not cached  %7.0f ms: %6.0f files/s, %6.1f MB/s\n",
+		coldTime / 1000, files / (coldTime / 1e6), megabytes / (coldTime / 1e6));
+
+	LibraryIndex warmIndex;
+	start = check_now();
+	scan(warmIndex, root, files);
+	double warmTime = check_now() - start;
+	printf("  first scan, cached      %7.0f ms: %6.0f files/s, %6.1f MB/s\n",
+		warmTime / 1000, files / (warmTime / 1e6), megabytes / (warmTime / 1e6));
+
+	start = check_now();
+	hashed = scan(index, root, files);
+	double rescanTime = check_now() - start;
+	CHECK_EQUAL(hashed, 0);
+	printf("  scan again, unchanged   %7.0f ms: %6.0f files/s\n",
+		rescanTime / 1000, files / (rescanTime / 1e6));
+
+	// the relink of an ensemble's samples, each stats the file found
+	start = check_now();
+	int32_t found = 0;
+	for (int32_t i = 0; i < kLookups; i++) {
+		std::string path;
+		int32_t which = (int32_t)(((int64_t)i * 7919) % fileCount);
+		if (index.FindByHash(hashes[which], path)
+			&& path == file_path(root, which / kFilesPerFolder, which % kFilesPerFolder))
+			found++;
+	}
+	double lookupTime = check_now() - start;
+	CHECK_EQUAL(found, kLookups);
+	printf("  find by hash            %7.2f µs each\n", lookupTime / kLookups);
+
+	std::vector<std::string> paths;
+	start = check_now();
+	index.Search("snare 0012", 100, paths);
+	double searchTime = check_now() - start;
+	CHECK_EQUAL(paths.size(), 100);
+	start = check_now();
+	index.Search("kick", 100, paths);
+	double missTime = check_now() - start;
+	CHECK_EQUAL(paths.size(), 0);
+	printf("  search                  %7.2f ms for 100 found, %.2f ms for none\n",
+		searchTime / 1000, missTime / 1000);
+
+	std::vector<uint8_t> flattened;
+	start = check_now();
+	index.Flatten(flattened);
+	double flattenTime = check_now() - start;
+	LibraryIndex loaded;
+	start = check_now();
+	CHECK(loaded.Unflatten(flattened.data(), flattened.size()));
+	double unflattenTime = check_now() - start;
+	CHECK_EQUAL(loaded.CountEntries(), fileCount);
+	printf("  save, load              %7.2f ms, %.2f ms for %.1f MB\n",
+		flattenTime / 1000, unflattenTime / 1000, flattened.size() / 1e6);
+
+	// a folder removed is noticed by what's missing below it
+	for (int32_t file = 0; file < kFilesPerFolder; file++)
+		unlink(file_path(root, 0, file).c_str());
+	start = check_now();
+	int32_t removed = index.RemoveMissing((root + "/kit 000").c_str());
+	double missingTime = check_now() - start;
+	CHECK_EQUAL(removed, kFilesPerFolder);
+	start = check_now();
+	removed = index.RemoveMissing(root.c_str());
+	double allTime = check_now() - start;
+	CHECK_EQUAL(removed, 0);
+	printf("  files gone              %7.2f ms for a folder, %.1f ms for all\n",
+		missingTime / 1000, allTime / 1000);
+
+	remove_files(root);
+	return sCheckFailures;
+}
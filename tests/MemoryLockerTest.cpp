@@ -0,0 +1,215 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// How long the first buffer of a hit takes to mix from a sample that was
+// paged out, compared to one pinned by the MemoryLocker. The sample is a
+// mapped file, like a sample the engine plays from its mapped PCM, and the
+// page cache is dropped for it before every hit.
+
+#include "Check.h"
+#include "MemoryLocker.h"
+
+#include <OS.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+
+static const size_t kSampleSize = 4 * 1024 * 1024;
+static const int32 kBufferFrames = 256;
+static const int32 kChannels = 2;
+static const int32 kHits = 20;
+
+
+static size_t
+resident_pages(const void* address, size_t size, size_t* _total)
+{
+	size_t pages = (size + B_PAGE_SIZE - 1) / B_PAGE_SIZE;
+	std::vector<unsigned char> vector(pages);
+	*_total = pages;
+	if (mincore((void*)address, size, vector.data()) != 0)
+		return 0;
+
+	size_t resident = 0;
+	for (size_t i = 0; i < pages; i++)
+		resident += vector[i] & 1;
+	return resident;
+}
+
+
+static void
+evict(int fd, void* address, size_t size)
+{
+	// the mapping is dropped as well, a page still mapped stays cached
+	madvise(address, size, MADV_DONTNEED);
+	posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED);
+}
+
+
+static double
+mix_first_buffer(const float* sample)
+{
+	// what a voice does with the first buffer of a hit
+	static float mix[kBufferFrames * kChannels];
+	double start = check_now();
+	for (int32 i = 0; i < kBufferFrames * kChannels; i++)
+		mix[i] += sample[i] * 0.5f;
+	return check_now() - start;
+}
+
+
+static double
+mix_whole_sample(const float* sample)
+{
+	// the worst buffer while the hit plays through
+	static float mix[kBufferFrames * kChannels];
+	size_t frames = kSampleSize / (kChannels * sizeof(float));
+	double worst = 0;
+	for (size_t frame = 0; frame + kBufferFrames <= frames; frame += kBufferFrames) {
+		const float* buffer = sample + frame * kChannels;
+		double start = check_now();
+		for (int32 i = 0; i < kBufferFrames * kChannels; i++)
+			mix[i] += buffer[i] * 0.5f;
+		worst = std::max(worst, check_now() - start);
+	}
+	return worst;
+}
+
+
+static void
+print_times(const char* name, std::vector<double>& times)
+{
+	std::sort(times.begin(), times.end());
+	printf("  %-22s median %8.1f µs, worst %8.1f µs\n", name,
+		times[times.size() / 2], times.back());
+}
+
+
+static void
+test_limit()
+{
+	std::vector<char> memory(3 * B_PAGE_SIZE);
+
+	MemoryLocker locker(2 * B_PAGE_SIZE);
+	CHECK_EQUAL(locker.Lock(NULL, B_PAGE_SIZE), B_BAD_VALUE);
+	CHECK_EQUAL(locker.Lock(memory.data(), 0), B_BAD_VALUE);
+
+	// over the limit nothing is counted
+	CHECK_EQUAL(locker.Lock(memory.data(), memory.size()), B_NO_MEMORY);
+	CHECK_EQUAL(locker.LockedSize(), 0);
+
+	CHECK_EQUAL(locker.Lock(memory.data(), B_PAGE_SIZE), B_OK);
+	CHECK_EQUAL(locker.Lock(memory.data() + B_PAGE_SIZE, B_PAGE_SIZE), B_OK);
+	CHECK_EQUAL(locker.LockedSize(), 2 * B_PAGE_SIZE);
+	CHECK_EQUAL(locker.Lock(memory.data() + 2 * B_PAGE_SIZE, 1), B_NO_MEMORY);
+	CHECK_EQUAL(locker.LockedSize(), 2 * B_PAGE_SIZE);
+
+	locker.Unlock(memory.data(), B_PAGE_SIZE);
+	CHECK_EQUAL(locker.LockedSize(), B_PAGE_SIZE);
+	// a raised limit takes more
+	locker.SetLimit(3 * B_PAGE_SIZE);
+	CHECK_EQUAL(locker.Lock(memory.data() + 2 * B_PAGE_SIZE, 1), B_OK);
+	locker.Unlock(memory.data() + 2 * B_PAGE_SIZE, 1);
+	locker.Unlock(memory.data() + B_PAGE_SIZE, B_PAGE_SIZE);
+	CHECK_EQUAL(locker.LockedSize(), 0);
+}
+
+
+static void
+test_latency(const char* directory)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/MemoryLockerTest-XXXXXX", directory);
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "cannot create %s: %s\n", path, strerror(errno));
+		sCheckFailures++;
+		return;
+	}
+	unlink(path);
+
+	std::vector<float> noise(kSampleSize / sizeof(float));
+	for (size_t i = 0; i < noise.size(); i++)
+		noise[i] = (rand() % 2001 - 1000) / 1000.0f;
+	CHECK(write(fd, noise.data(), kSampleSize) == (ssize_t)kSampleSize);
+	fsync(fd);
+
+	float* sample = (float*)mmap(NULL, kSampleSize, PROT_READ, MAP_SHARED, fd, 0);
+	CHECK(sample != MAP_FAILED);
+	if (sample == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+
+	std::vector<double> coldFirst, coldWorst, pinnedFirst, pinnedWorst;
+	size_t total, coldResident = 0, pinnedResident = 0;
+
+	for (int32 hit = 0; hit < kHits; hit++) {
+		evict(fd, sample, kSampleSize);
+		coldResident += resident_pages(sample, kSampleSize, &total);
+		coldFirst.push_back(mix_first_buffer(sample));
+		evict(fd, sample, kSampleSize);
+		coldWorst.push_back(mix_whole_sample(sample));
+	}
+
+	MemoryLocker locker(2 * kSampleSize);
+	status_t status = locker.Lock(sample, kSampleSize);
+	if (status != B_OK) {
+		printf("  the sample could not be locked (%s), raise ulimit -l above %zu KiB\n",
+			strerror(status), kSampleSize / 1024);
+	}
+	CHECK_EQUAL(status, B_OK);
+	CHECK_EQUAL(locker.LockedSize(), status == B_OK ? kSampleSize : 0);
+
+	for (int32 hit = 0; hit < kHits; hit++) {
+		// the page cache can't drop what is locked
+		evict(fd, sample, kSampleSize);
+		pinnedResident += resident_pages(sample, kSampleSize, &total);
+		pinnedFirst.push_back(mix_first_buffer(sample));
+		evict(fd, sample, kSampleSize);
+		pinnedWorst.push_back(mix_whole_sample(sample));
+	}
+
+	locker.Unlock(sample, kSampleSize);
+	CHECK_EQUAL(locker.LockedSize(), 0);
+
+	printf("  %zu KiB sample, %d frame buffers, %d hits each\n",
+		kSampleSize / 1024, kBufferFrames, kHits);
+	printf("  resident before a hit: cold %zu of %zu pages, pinned %zu of %zu\n",
+		coldResident / kHits, total, pinnedResident / kHits, total);
+	print_times("cold first buffer", coldFirst);
+	print_times("pinned first buffer", pinnedFirst);
+	print_times("cold worst buffer", coldWorst);
+	print_times("pinned worst buffer", pinnedWorst);
+
+	if (status == B_OK)
+		CHECK_EQUAL(pinnedResident / kHits, total);
+
+	munmap(sample, kSampleSize);
+	close(fd);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	// on a disk, a tmpfs keeps the pages in memory anyway
+	const char* directory = argc > 1 ? argv[1] : ".";
+
+	test_limit();
+	test_latency(directory);
+	return check_result("MemoryLockerTest");
+}
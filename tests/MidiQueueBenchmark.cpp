@@ -0,0 +1,128 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// What a MIDI event costs on its way to the audio thread: the push by the
+// MIDI thread and the pop by the audio thread, alone and with two sources
+// pushing while the audio thread drains the queue.
+
+#include "Check.h"
+#include "LockFreeQueue.h"
+
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <thread>
+
+
+// as in the engine
+struct MidiEvent {
+	bigtime_t	time;
+	uint8		status;
+	uint8		data1;
+	uint8		data2;
+};
+
+static const size_t kMidiQueueSize = 1024;
+static const int32 kMidiBatchSize = 256;
+static const int32 kRounds = 20000;
+static const int32 kSourceEvents = 2000000;
+
+// so the popped events aren't optimized away
+static volatile uint64 sSink;
+
+
+static void
+bench_single_thread()
+{
+	LockFreeQueue<MidiEvent> queue(kMidiQueueSize);
+	MidiEvent event = { 0, 0x90, 36, 100 };
+
+	double pushTime = 0;
+	double popTime = 0;
+	uint64 sum = 0;
+	for (int32 round = 0; round < kRounds; round++) {
+		double start = check_now();
+		for (int32 i = 0; i < kMidiBatchSize; i++) {
+			event.time = i;
+			queue.Push(event);
+		}
+		double pushed = check_now();
+		while (queue.Pop(event))
+			sum += event.data1;
+		popTime += check_now() - pushed;
+		pushTime += pushed - start;
+	}
+
+	double events = (double)kRounds * kMidiBatchSize;
+	printf("  one thread:  push %5.1f ns, pop %5.1f ns per event\n",
+		pushTime * 1000 / events, popTime * 1000 / events);
+	sSink = sum;
+}
+
+
+static void
+bench_two_sources()
+{
+	// two MIDI sources push, the audio thread takes what is there per buffer
+	LockFreeQueue<MidiEvent> queue(kMidiQueueSize);
+	std::atomic<int32> running(2);
+	std::atomic<uint64> retries(0);
+
+	auto source = [&](uint8 channel) {
+		MidiEvent event = { 0, (uint8)(0x90 | channel), 36, 100 };
+		uint64 full = 0;
+		for (int32 i = 0; i < kSourceEvents; i++) {
+			event.time = i;
+			while (!queue.Push(event)) {
+				full++;
+				std::this_thread::yield();
+			}
+		}
+		retries += full;
+		running--;
+	};
+
+	double start = check_now();
+	std::thread first(source, 0);
+	std::thread second(source, 1);
+
+	uint64 popped = 0;
+	MidiEvent event;
+	while (true) {
+		bool done = running.load() == 0;
+		int32 count = 0;
+		while (count < kMidiBatchSize && queue.Pop(event))
+			count++;
+		popped += count;
+		if (count == 0) {
+			if (done)
+				break;
+			std::this_thread::yield();
+		}
+	}
+	first.join();
+	second.join();
+	double elapsed = check_now() - start;
+
+	CHECK_EQUAL(popped, 2 * (uint64)kSourceEvents);
+	printf("  two sources: %.1f million events/s, %.1f ns per event, "
+		"%llu pushes retried on a full queue\n", popped / elapsed,
+		elapsed * 1000 / popped, (unsigned long long)retries.load());
+}
+
+
+int
+main()
+{
+	printf("MidiQueueBenchmark, %zu event queue, batches of %d\n",
+		kMidiQueueSize, kMidiBatchSize);
+	bench_single_thread();
+	bench_two_sources();
+	return sCheckFailures;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// When the SampleWatcher decodes an edited sample. It's played as the
+// watcher does: every change asks for a check at the time it's given back,
+// and the checks come in the order of their time, each taking what settled.
+
+#include "Check.h"
+#include "ReloadSchedule.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+static const bigtime_t kSettleTime = 500000;
+
+
+struct Change {
+	bigtime_t	time;
+	std::string	path;
+};
+
+struct Reload {
+	bigtime_t	time;
+	std::string	path;
+};
+
+
+static std::vector<Reload>
+play(ReloadSchedule& schedule, const std::vector<Change>& changes)
+{
+	std::vector<Reload> reloads;
+	std::vector<bigtime_t> checks;
+	size_t next = 0;
+	while (next < changes.size() || !checks.empty()) {
+		// a change and a check at the same time: the change comes first
+		std::sort(checks.begin(), checks.end());
+		if (next < changes.size()
+			&& (checks.empty() || changes[next].time <= checks.front())) {
+			checks.push_back(schedule.Changed(changes[next].path,
+				changes[next].time));
+			next++;
+			continue;
+		}
+
+		bigtime_t now = checks.front();
+		checks.erase(checks.begin());
+		std::vector<std::string> settled;
+		schedule.TakeSettled(now, settled);
+		for (size_t i = 0; i < settled.size(); i++) {
+			Reload reload = { now, settled[i] };
+			reloads.push_back(reload);
+		}
+	}
+	return reloads;
+}
+
+
+static void
+test_burst()
+{
+	// saved every 100 ms for two seconds, then left alone
+	ReloadSchedule schedule(kSettleTime);
+	std::vector<Change> changes;
+	for (bigtime_t time = 0; time <= 2000000; time += 100000) {
+		Change change = { time, "/boot/home/kick.wav" };
+		changes.push_back(change);
+	}
+
+	std::vector<Reload> reloads = play(schedule, changes);
+	CHECK_EQUAL(reloads.size(), 1);
+	if (reloads.size() == 1) {
+		CHECK_EQUAL(reloads[0].time, 2000000 + kSettleTime);
+		CHECK(reloads[0].path == "/boot/home/kick.wav");
+	}
+	CHECK_EQUAL(schedule.CountPending(), 0);
+}
+
+
+static void
+test_written_in_goes()
+{
+	// the size and the modification time come as separate changes
+	ReloadSchedule schedule(kSettleTime);
+	std::vector<Change> changes;
+	for (int32 i = 0; i < 4; i++) {
+		Change change = { 1000 + i, "/boot/home/snare.wav" };
+		changes.push_back(change);
+	}
+	CHECK_EQUAL(play(schedule, changes).size(), 1);
+
+	// within the settle time it's put off, up to the very time it's due
+	Change late[] = {
+		{ 0, "/boot/home/snare.wav" },
+		{ kSettleTime - 1, "/boot/home/snare.wav" },
+		{ 3 * kSettleTime, "/boot/home/snare.wav" },
+		{ 4 * kSettleTime, "/boot/home/snare.wav" },
+		{ 6 * kSettleTime + 1, "/boot/home/snare.wav" } };
+	std::vector<Reload> reloads = play(schedule,
+		std::vector<Change>(late, late + 5));
+	CHECK_EQUAL(reloads.size(), 3);
+	if (reloads.size() == 3) {
+		CHECK_EQUAL(reloads[0].time, 2 * kSettleTime - 1);
+		CHECK_EQUAL(reloads[1].time, 5 * kSettleTime);
+		CHECK_EQUAL(reloads[2].time, 7 * kSettleTime + 1);
+	}
+}
+
+
+static void
+test_files_apart()
+{
+	// two files edited at once settle each on its own
+	ReloadSchedule schedule(kSettleTime);
+	std::vector<Change> changes;
+	for (int32 i = 0; i < 10; i++) {
+		Change kick = { i * 100000, "/boot/home/kick.wav" };
+		changes.push_back(kick);
+		if (i < 3) {
+			Change hat = { i * 100000 + 50000, "/boot/home/hat.wav" };
+			changes.push_back(hat);
+		}
+	}
+
+	std::vector<Reload> reloads = play(schedule, changes);
+	CHECK_EQUAL(reloads.size(), 2);
+	if (reloads.size() == 2) {
+		CHECK(reloads[0].path == "/boot/home/hat.wav");
+		CHECK_EQUAL(reloads[0].time, 250000 + kSettleTime);
+		CHECK(reloads[1].path == "/boot/home/kick.wav");
+		CHECK_EQUAL(reloads[1].time, 900000 + kSettleTime);
+	}
+}
+
+
+static void
+test_early_check()
+{
+	// a check before the time given back finds nothing
+	ReloadSchedule schedule(kSettleTime);
+	bigtime_t settled = schedule.Changed("/boot/home/tom.wav", 1000);
+	CHECK_EQUAL(settled, 1000 + kSettleTime);
+
+	std::vector<std::string> paths;
+	schedule.TakeSettled(settled - 1, paths);
+	CHECK(paths.empty());
+	CHECK_EQUAL(schedule.CountPending(), 1);
+	schedule.TakeSettled(settled, paths);
+	CHECK_EQUAL(paths.size(), 1);
+	schedule.TakeSettled(settled + kSettleTime, paths);
+	CHECK(paths.empty());
+}
+
+
+static void
+test_keep_only()
+{
+	// a sample taken off its pad isn't decoded anymore
+	ReloadSchedule schedule(kSettleTime);
+	schedule.Changed("/boot/home/kick.wav", 0);
+	schedule.Changed("/boot/home/snare.wav", 0);
+	schedule.Changed("/boot/home/hat.wav", 0);
+
+	std::vector<std::string> onPads;
+	onPads.push_back("/boot/home/snare.wav");
+	onPads.push_back("/boot/home/ride.wav");
+	schedule.KeepOnly(onPads);
+	CHECK_EQUAL(schedule.CountPending(), 1);
+
+	std::vector<std::string> paths;
+	schedule.TakeSettled(kSettleTime, paths);
+	CHECK_EQUAL(paths.size(), 1);
+	if (paths.size() == 1)
+		CHECK(paths[0] == "/boot/home/snare.wav");
+}
+
+
+int
+main()
+{
+	test_burst();
+	test_written_in_goes();
+	test_files_apart();
+	test_early_check();
+	test_keep_only();
+	return check_result("ReloadScheduleTest");
+}
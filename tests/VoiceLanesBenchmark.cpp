@@ -0,0 +1,149 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+
+// The filter and envelope of the processed voices, run over all voices in
+// lanes, against the same math run voice by voice. Both have to give the
+// same output.
+
+#include "Check.h"
+#include "VoiceLanes.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const int32_t kBlocks = 20000;
+
+
+struct Voice {
+	float			b0, b1, b2, a1, a2;
+	float			z1[kEngineChannels];
+	float			z2[kEngineChannels];
+	float			envelope;
+	float			multiply;
+	float			add;
+};
+
+
+static void
+setup(VoiceLanes& lanes, Voice* voices, int32_t count)
+{
+	memset(&lanes, 0, sizeof(lanes));
+	for (int32_t i = 0; i < count; i++) {
+		// a low-pass somewhere between 200 Hz and 5 kHz, in its decay
+		double w0 = 2.0 * M_PI * (200.0 + 4800.0 * i / count) / kEngineFrameRate;
+		double alpha = sin(w0) / (2.0 * 2.0);
+		double a0 = 1.0 + alpha;
+		Voice& voice = voices[i];
+		voice.b0 = voice.b2 = (1.0 - cos(w0)) / 2.0 / a0;
+		voice.b1 = (1.0 - cos(w0)) / a0;
+		voice.a1 = -2.0 * cos(w0) / a0;
+		voice.a2 = (1.0 - alpha) / a0;
+		voice.envelope = 1.0f;
+		voice.multiply = 0.9999f;
+		voice.add = 0.0f;
+		memset(voice.z1, 0, sizeof(voice.z1));
+		memset(voice.z2, 0, sizeof(voice.z2));
+
+		lanes.b0[i] = voice.b0;
+		lanes.b1[i] = voice.b1;
+		lanes.b2[i] = voice.b2;
+		lanes.a1[i] = voice.a1;
+		lanes.a2[i] = voice.a2;
+		lanes.envelope[i] = voice.envelope;
+		lanes.multiply[i] = voice.multiply;
+		lanes.add[i] = voice.add;
+	}
+}
+
+
+static void
+process_voice(Voice& voice, float* frames, int32_t frameCount)
+{
+	// how each voice would be processed on its own, frames interleaved
+	for (int32_t frame = 0; frame < frameCount; frame++) {
+		float envelope = voice.envelope * voice.multiply + voice.add;
+		voice.envelope = envelope < 1.0f ? envelope : 1.0f;
+		for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+			float x = frames[frame * kEngineChannels + channel];
+			float y = voice.b0 * x + voice.z1[channel];
+			voice.z1[channel] = voice.b1 * x - voice.a1 * y + voice.z2[channel];
+			voice.z2[channel] = voice.b2 * x - voice.a2 * y;
+			frames[frame * kEngineChannels + channel] = y * voice.envelope;
+		}
+	}
+}
+
+
+static void
+bench(int32_t voiceCount)
+{
+	static VoiceLanes lanes;
+	static Voice voices[kMaxLanes];
+	static float frames[kMaxLanes][kLaneFrames * kEngineChannels];
+	static float noise[kLaneFrames * kEngineChannels];
+	for (int32_t i = 0; i < kLaneFrames * kEngineChannels; i++)
+		noise[i] = (rand() % 2001 - 1000) / 1000.0f;
+
+	setup(lanes, voices, voiceCount);
+	int32_t laneCount = (voiceCount + kLaneWidth - 1) / kLaneWidth * kLaneWidth;
+
+	double laneTime = 0;
+	double voiceTime = 0;
+	float largestError = 0;
+	for (int32_t block = 0; block < kBlocks; block++) {
+		// the input is gathered in both cases, only the processing is timed
+		for (int32_t i = 0; i < voiceCount; i++) {
+			memcpy(frames[i], noise, sizeof(noise));
+			for (int32_t frame = 0; frame < kLaneFrames; frame++) {
+				for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+					lanes.input[channel][frame][i]
+						= noise[frame * kEngineChannels + channel];
+				}
+			}
+		}
+
+		double start = check_now();
+		process_lanes(lanes, kLaneFrames, laneCount);
+		double lanesDone = check_now();
+		for (int32_t i = 0; i < voiceCount; i++)
+			process_voice(voices[i], frames[i], kLaneFrames);
+		voiceTime += check_now() - lanesDone;
+		laneTime += lanesDone - start;
+
+		for (int32_t i = 0; i < voiceCount; i++) {
+			for (int32_t frame = 0; frame < kLaneFrames; frame++) {
+				for (int32_t channel = 0; channel < kEngineChannels; channel++) {
+					float error = fabsf(lanes.input[channel][frame][i]
+						- frames[i][frame * kEngineChannels + channel]);
+					largestError = error > largestError ? error : largestError;
+				}
+			}
+		}
+	}
+
+	CHECK(largestError < 1e-5f);
+	double voiceFrames = (double)kBlocks * kLaneFrames * voiceCount;
+	printf("  %2d voices: lanes %5.2f ns, voice by voice %5.2f ns per voice frame, "
+		"%.1fx\n", voiceCount, laneTime * 1000 / voiceFrames,
+		voiceTime * 1000 / voiceFrames, voiceTime / laneTime);
+}
+
+
+int
+main()
+{
+	printf("VoiceLanesBenchmark, %d frame blocks, lanes of %d\n", kLaneFrames,
+		kLaneWidth);
+	const int32_t counts[] = { 1, 8, 16, 32, 64 };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+		bench(counts[i]);
+	return sCheckFailures;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef TESTS_MIDI_DEFS_H
+#define TESTS_MIDI_DEFS_H
+
+// Just enough of Haiku's MidiDefs.h to build the portable sources on other
+// systems.
+
+enum midi_message {
+	B_NOTE_OFF = 0x80,
+	B_NOTE_ON = 0x90,
+	B_KEY_PRESSURE = 0xa0,
+	B_CONTROL_CHANGE = 0xb0,
+	B_PROGRAM_CHANGE = 0xc0,
+	B_CHANNEL_PRESSURE = 0xd0,
+	B_PITCH_BEND = 0xe0,
+	B_SYS_EX_START = 0xf0,
+	B_TIMING_CLOCK = 0xf8,
+	B_START = 0xfa,
+	B_CONTINUE = 0xfb,
+	B_STOP = 0xfc,
+	B_ACTIVE_SENSING = 0xfe,
+	B_SYSTEM_RESET = 0xff
+};
+
+
+#endif // TESTS_MIDI_DEFS_H
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef TESTS_OS_H
+#define TESTS_OS_H
+
+// Just enough of Haiku's OS.h to build the portable sources on other
+// systems.
+
+#include <SupportDefs.h>
+
+#include <time.h>
+
+#define B_PAGE_SIZE 4096
+
+
+static inline bigtime_t
+system_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+#endif // TESTS_OS_H
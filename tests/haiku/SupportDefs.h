@@ -0,0 +1,39 @@
+/*
+ * Copyright 2023. All rights reserved.
+ * Distributed under the terms of the MIT license.
+ *
+ * Author:
+ *	Humdinger, humdingerb@gmail.com
+ *
+ */
+#ifndef TESTS_SUPPORT_DEFS_H
+#define TESTS_SUPPORT_DEFS_H
+
+// Just enough of Haiku's SupportDefs.h to build the portable sources on
+// other systems.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int8_t		int8;
+typedef uint8_t		uint8;
+typedef int16_t		int16;
+typedef uint16_t	uint16;
+typedef int32_t		int32;
+typedef uint32_t	uint32;
+typedef int64_t		int64;
+typedef uint64_t	uint64;
+typedef int32		status_t;
+typedef int64		bigtime_t;
+
+enum {
+	B_OK = 0,
+	B_ERROR = -1,
+	B_NO_MEMORY = (int32)0x80000000,
+	B_BAD_VALUE = B_NO_MEMORY + 5,
+	B_TIMED_OUT = B_NO_MEMORY + 9,
+	B_WOULD_BLOCK = B_NO_MEMORY + 11
+};
+
+
+#endif // TESTS_SUPPORT_DEFS_H